@@ -19,7 +19,6 @@
 
 #include "config.h"
 #include "wine/port.h"
-#include "wine/list.h"
 
 #define NONAMELESSUNION
 #include "d3d11_private.h"
@@ -74,7 +73,7 @@ enum deferred_cmd
 
 struct deferred_call
 {
-    struct list entry;
+    UINT size;  /* size of the call and its data, the next call follows */
     enum deferred_cmd cmd;
     union
     {
@@ -83,6 +82,7 @@ struct deferred_call
             UINT start_slot;
             UINT num_buffers;
             ID3D11Buffer **buffers;
+            struct wined3d_buffer **wined3d_buffers;
             UINT *strides;
             UINT *offsets;
         } vbuffer_info;
@@ -93,12 +93,15 @@ struct deferred_call
         struct
         {
             ID3D11Buffer *buffer;
+            struct wined3d_buffer *wined3d_buffer;
             DXGI_FORMAT format;
+            enum wined3d_format_id wined3d_format;
             UINT offset;
         } index_buffer_info;
         struct
         {
             ID3D11InputLayout *layout;
+            struct wined3d_vertex_declaration *wined3d_decl;
         } input_layout_info;
         struct
         {
@@ -144,11 +147,13 @@ struct deferred_call
         struct
         {
             ID3D11PixelShader *shader;
+            struct wined3d_shader *wined3d_shader;
             /* FIXME: add class instances */
         } ps_info;
         struct
         {
             ID3D11VertexShader *shader;
+            struct wined3d_shader *wined3d_shader;
             /* FIXME: add class instances */
         } vs_info;
         struct
@@ -156,18 +161,21 @@ struct deferred_call
             UINT start_slot;
             UINT num_views;
             ID3D11ShaderResourceView **views;
+            struct wined3d_shader_resource_view **wined3d_views;
         } res_info;
         struct
         {
             UINT start_slot;
             UINT num_samplers;
             ID3D11SamplerState **samplers;
+            struct wined3d_sampler **wined3d_samplers;
         } samplers_info;
         struct
         {
             UINT start_slot;
             UINT num_buffers;
             ID3D11Buffer **buffers;
+            struct wined3d_buffer **wined3d_buffers;
         } constant_buffers_info;
         struct
         {
@@ -203,6 +211,7 @@ struct deferred_call
             UINT map_flags;
             void *buffer;
             UINT size;
+            struct deferred_call *previous;  /* previous DEFERRED_MAP call */
         } map_info;
         struct
         {
@@ -225,6 +234,36 @@ struct deferred_call
     };
 };
 
+/* Deferred calls are recorded back to back into chunks of memory, so that
+ * recording doesn't go to the heap for every call and replaying them walks
+ * contiguous memory. Chunks of the default size are recycled through a
+ * process-wide pool once the calls have been freed. Each object used by the
+ * recorded calls is referenced only once, the first time it is used. */
+#define DEFERRED_CHUNK_SIZE     0x10000
+#define DEFERRED_CHUNK_POOL_MAX 64
+#define DEFERRED_CALL_ALIGN     16
+
+struct deferred_chunk
+{
+    SLIST_ENTRY entry;
+    struct deferred_chunk *next;
+    SIZE_T size;
+    SIZE_T used;
+};
+
+struct deferred_calls
+{
+    struct deferred_chunk *head;
+    struct deferred_chunk *tail;
+    struct deferred_call *last_map;
+
+    IUnknown **objects;
+    SIZE_T objects_size;
+    SIZE_T object_count;
+};
+
+static SLIST_HEADER deferred_chunk_pool;
+
 /* ID3D11CommandList - command list */
 struct d3d11_command_list
 {
@@ -232,7 +271,7 @@ struct d3d11_command_list
     ID3D11Device *device;
     LONG refcount;
 
-    struct list commands;
+    struct deferred_calls commands;
 
     struct wined3d_private_store private_store;
 };
@@ -244,20 +283,174 @@ struct d3d11_deferred_context
     ID3D11Device *device;
     LONG refcount;
 
-    struct list commands;
+    struct deferred_calls commands;
 
     struct wined3d_private_store private_store;
 };
 
-static struct deferred_call *add_deferred_call(struct d3d11_deferred_context *context, size_t extra_size)
+#define DEFERRED_CHUNK_HEADER_SIZE \
+        ((sizeof(struct deferred_chunk) + DEFERRED_CALL_ALIGN - 1) & ~(DEFERRED_CALL_ALIGN - 1))
+
+static inline BYTE *deferred_chunk_data(const struct deferred_chunk *chunk)
+{
+    return (BYTE *)chunk + DEFERRED_CHUNK_HEADER_SIZE;
+}
+
+static struct deferred_chunk *deferred_chunk_create(SIZE_T size)
+{
+    struct deferred_chunk *chunk;
+
+    if (size <= DEFERRED_CHUNK_SIZE)
+    {
+        size = DEFERRED_CHUNK_SIZE;
+        chunk = (struct deferred_chunk *)InterlockedPopEntrySList(&deferred_chunk_pool);
+    }
+    else
+    {
+        chunk = NULL;
+    }
+
+    if (!chunk && !(chunk = HeapAlloc(GetProcessHeap(), 0, DEFERRED_CHUNK_HEADER_SIZE + size)))
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+static void deferred_chunk_destroy(struct deferred_chunk *chunk)
+{
+    if (chunk->size == DEFERRED_CHUNK_SIZE
+            && QueryDepthSList(&deferred_chunk_pool) < DEFERRED_CHUNK_POOL_MAX)
+        InterlockedPushEntrySList(&deferred_chunk_pool, &chunk->entry);
+    else
+        HeapFree(GetProcessHeap(), 0, chunk);
+}
+
+static inline SIZE_T deferred_object_hash(const IUnknown *object, SIZE_T mask)
+{
+    return ((ULONG_PTR)object >> 4) * 0x9e3779b1 & mask;
+}
+
+/* Makes sure "count" objects can be added without failing. */
+static BOOL deferred_calls_reserve_objects(struct deferred_calls *calls, SIZE_T count)
+{
+    SIZE_T i, j, size;
+    IUnknown **objects;
+
+    if ((calls->object_count + count) * 2 <= calls->objects_size)
+        return TRUE;
+
+    size = max(calls->objects_size, 64);
+    while ((calls->object_count + count) * 2 > size)
+        size *= 2;
+    if (!(objects = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*objects))))
+        return FALSE;
+
+    for (i = 0; i < calls->objects_size; ++i)
+    {
+        if (!calls->objects[i])
+            continue;
+        for (j = deferred_object_hash(calls->objects[i], size - 1); objects[j]; j = (j + 1) & (size - 1));
+        objects[j] = calls->objects[i];
+    }
+
+    HeapFree(GetProcessHeap(), 0, calls->objects);
+    calls->objects = objects;
+    calls->objects_size = size;
+    return TRUE;
+}
+
+/* Keeps a reference to an object used by the recorded calls, unless there
+ * is one already. Space must have been reserved first. */
+static void deferred_calls_add_object(struct deferred_calls *calls, void *object)
+{
+    SIZE_T i, mask = calls->objects_size - 1;
+
+    if (!object)
+        return;
+
+    for (i = deferred_object_hash(object, mask); calls->objects[i]; i = (i + 1) & mask)
+    {
+        if (calls->objects[i] == object)
+            return;
+    }
+
+    IUnknown_AddRef((IUnknown *)object);
+    calls->objects[i] = object;
+    ++calls->object_count;
+}
+
+static void free_deferred_calls(struct deferred_calls *calls)
 {
+    struct deferred_chunk *chunk, *next;
+    SIZE_T i;
+
+    for (i = 0; i < calls->objects_size; ++i)
+    {
+        if (calls->objects[i])
+            IUnknown_Release(calls->objects[i]);
+    }
+    HeapFree(GetProcessHeap(), 0, calls->objects);
+
+    for (chunk = calls->head; chunk; chunk = next)
+    {
+        next = chunk->next;
+        deferred_chunk_destroy(chunk);
+    }
+
+    memset(calls, 0, sizeof(*calls));
+}
+
+static const struct deferred_call *first_deferred_call(const struct deferred_calls *calls,
+        const struct deferred_chunk **chunk)
+{
+    if (!(*chunk = calls->head))
+        return NULL;
+    return (const struct deferred_call *)deferred_chunk_data(*chunk);
+}
+
+static const struct deferred_call *next_deferred_call(const struct deferred_call *call,
+        const struct deferred_chunk **chunk)
+{
+    const BYTE *next = (const BYTE *)call + call->size;
+
+    if (next < deferred_chunk_data(*chunk) + (*chunk)->used)
+        return (const struct deferred_call *)next;
+    if (!(*chunk = (*chunk)->next))
+        return NULL;
+    return (const struct deferred_call *)deferred_chunk_data(*chunk);
+}
+
+/* Adds a call with "extra_size" bytes of data, using up to "object_count" objects. */
+static struct deferred_call *add_deferred_call(struct d3d11_deferred_context *context,
+        size_t extra_size, unsigned int object_count)
+{
+    struct deferred_calls *calls = &context->commands;
+    struct deferred_chunk *chunk = calls->tail;
     struct deferred_call *call;
+    SIZE_T size;
 
-    if (!(call = HeapAlloc(GetProcessHeap(), 0, sizeof(*call) + extra_size)))
+    if (!deferred_calls_reserve_objects(calls, object_count))
         return NULL;
 
+    size = (sizeof(*call) + extra_size + DEFERRED_CALL_ALIGN - 1) & ~(DEFERRED_CALL_ALIGN - 1);
+    if (!chunk || chunk->size - chunk->used < size)
+    {
+        if (!(chunk = deferred_chunk_create(size)))
+            return NULL;
+        if (calls->tail)
+            calls->tail->next = chunk;
+        else
+            calls->head = chunk;
+        calls->tail = chunk;
+    }
+
+    call = (struct deferred_call *)(deferred_chunk_data(chunk) + chunk->used);
+    chunk->used += size;
+    call->size = size;
     call->cmd = 0xdeadbeef;
-    list_add_tail(&context->commands, &call->entry);
     return call;
 }
 
@@ -268,17 +461,22 @@ static void add_deferred_set_shader_resources(struct d3d11_deferred_context *con
     struct deferred_call *call;
     int i;
 
-    if (!(call = add_deferred_call(context, sizeof(*views) * view_count)))
+    if (!(call = add_deferred_call(context,
+            view_count * (sizeof(*views) + sizeof(*call->res_info.wined3d_views)), view_count)))
         return;
 
     call->cmd = cmd;
     call->res_info.start_slot = start_slot;
     call->res_info.num_views = view_count;
     call->res_info.views = (void *)(call + 1);
+    call->res_info.wined3d_views = (void *)&call->res_info.views[view_count];
     for (i = 0; i < view_count; i++)
     {
-        if (views[i]) ID3D11ShaderResourceView_AddRef(views[i]);
+        struct d3d_shader_resource_view *view = unsafe_impl_from_ID3D11ShaderResourceView(views[i]);
+
+        deferred_calls_add_object(&context->commands, views[i]);
         call->res_info.views[i] = views[i];
+        call->res_info.wined3d_views[i] = view ? view->wined3d_view : NULL;
     }
 }
 
@@ -289,17 +487,22 @@ static void add_deferred_set_samplers(struct d3d11_deferred_context *context, en
     struct deferred_call *call;
     int i;
 
-    if (!(call = add_deferred_call(context, sizeof(*samplers) * sampler_count)))
+    if (!(call = add_deferred_call(context,
+            sampler_count * (sizeof(*samplers) + sizeof(*call->samplers_info.wined3d_samplers)), sampler_count)))
         return;
 
     call->cmd = cmd;
     call->samplers_info.start_slot = start_slot;
     call->samplers_info.num_samplers = sampler_count;
     call->samplers_info.samplers = (void *)(call + 1);
+    call->samplers_info.wined3d_samplers = (void *)&call->samplers_info.samplers[sampler_count];
     for (i = 0; i < sampler_count; i++)
     {
-        if (samplers[i]) ID3D11SamplerState_AddRef(samplers[i]);
+        struct d3d_sampler_state *sampler = unsafe_impl_from_ID3D11SamplerState(samplers[i]);
+
+        deferred_calls_add_object(&context->commands, samplers[i]);
         call->samplers_info.samplers[i] = samplers[i];
+        call->samplers_info.wined3d_samplers[i] = sampler ? sampler->wined3d_sampler : NULL;
     }
 }
 
@@ -311,231 +514,62 @@ static void add_deferred_set_constant_buffers(struct d3d11_deferred_context *con
     struct deferred_call *call;
     int i;
 
-    if (!(call = add_deferred_call(context, sizeof(*buffers) * buffer_count)))
+    if (!(call = add_deferred_call(context,
+            buffer_count * (sizeof(*buffers) + sizeof(*call->constant_buffers_info.wined3d_buffers)), buffer_count)))
         return;
 
     call->cmd = cmd;
     call->constant_buffers_info.start_slot = start_slot;
     call->constant_buffers_info.num_buffers = buffer_count;
     call->constant_buffers_info.buffers = (void *)(call + 1);
+    call->constant_buffers_info.wined3d_buffers = (void *)&call->constant_buffers_info.buffers[buffer_count];
     for (i = 0; i < buffer_count; i++)
     {
-        if (buffers[i]) ID3D11Buffer_AddRef(buffers[i]);
-        call->constant_buffers_info.buffers[i] = buffers[i];
-    }
-}
-
-static void free_deferred_calls(struct list *commands)
-{
-    struct deferred_call *call, *call2;
-    int i;
-
-    LIST_FOR_EACH_ENTRY_SAFE(call, call2, commands, struct deferred_call, entry)
-    {
-        switch (call->cmd)
-        {
-            case DEFERRED_IASETVERTEXBUFFERS:
-            {
-                for (i = 0; i < call->vbuffer_info.num_buffers; i++)
-                {
-                    if (call->vbuffer_info.buffers[i])
-                        ID3D11Buffer_Release(call->vbuffer_info.buffers[i]);
-                }
-                break;
-            }
-            case DEFERRED_IASETPRIMITIVETOPOLOGY:
-            {
-                break; /* nothing to do */
-            }
-            case DEFERRED_IASETINDEXBUFFER:
-            {
-                if (call->index_buffer_info.buffer)
-                    ID3D11Buffer_Release(call->index_buffer_info.buffer);
-                break;
-            }
-            case DEFERRED_IASETINPUTLAYOUT:
-            {
-                if (call->input_layout_info.layout)
-                    ID3D11InputLayout_Release(call->input_layout_info.layout);
-                break;
-            }
-            case DEFERRED_RSSETSTATE:
-            {
-                if (call->rstate_info.state)
-                    ID3D11RasterizerState_Release(call->rstate_info.state);
-                break;
-            }
-            case DEFERRED_RSSETVIEWPORTS:
-            {
-                break; /* nothing to do */
-            }
-            case DEFERRED_OMSETDEPTHSTENCILSTATE:
-            {
-                if (call->stencil_state_info.state)
-                    ID3D11DepthStencilState_Release(call->stencil_state_info.state);
-                break;
-            }
-            case DEFERRED_OMSETBLENDSTATE:
-            {
-                if (call->blend_state_info.state)
-                    ID3D11BlendState_Release(call->blend_state_info.state);
-                break;
-            }
-            case DEFERRED_OMSETRENDERTARGETS:
-            {
-                for (i = 0; i < call->render_target_info.num_views; i++)
-                {
-                    if (call->render_target_info.render_targets[i])
-                        ID3D11RenderTargetView_Release(call->render_target_info.render_targets[i]);
-                }
-                if (call->render_target_info.depth_stencil)
-                    ID3D11DepthStencilView_Release(call->render_target_info.depth_stencil);
-                break;
-            }
-            case DEFERRED_CSSETSHADER:
-            {
-                if (call->cs_info.shader)
-                    ID3D11ComputeShader_Release(call->cs_info.shader);
-                break;
-            }
-            case DEFERRED_DSSETSHADER:
-            {
-                if (call->ds_info.shader)
-                    ID3D11DomainShader_Release(call->ds_info.shader);
-                break;
-            }
-            case DEFERRED_HSSETSHADER:
-            {
-                if (call->hs_info.shader)
-                    ID3D11HullShader_Release(call->hs_info.shader);
-                break;
-            }
-            case DEFERRED_PSSETSHADER:
-            {
-                if (call->ps_info.shader)
-                    ID3D11PixelShader_Release(call->ps_info.shader);
-                break;
-            }
-            case DEFERRED_VSSETSHADER:
-            {
-                if (call->vs_info.shader)
-                    ID3D11VertexShader_Release(call->vs_info.shader);
-                break;
-            }
-            case DEFERRED_DSSETSHADERRESOURCES:
-            case DEFERRED_PSSETSHADERRESOURCES:
-            {
-                for (i = 0; i < call->res_info.num_views; i++)
-                {
-                    if (call->res_info.views[i])
-                        ID3D11ShaderResourceView_Release(call->res_info.views[i]);
-                }
-                break;
-            }
-            case DEFERRED_DSSETSAMPLERS:
-            case DEFERRED_PSSETSAMPLERS:
-            {
-                for (i = 0; i < call->samplers_info.num_samplers; i++)
-                {
-                    if (call->samplers_info.samplers[i])
-                        ID3D11SamplerState_Release(call->samplers_info.samplers[i]);
-                }
-                break;
-            }
-            case DEFERRED_CSSETCONSTANTBUFFERS:
-            case DEFERRED_DSSETCONSTANTBUFFERS:
-            case DEFERRED_HSSETCONSTANTBUFFERS:
-            case DEFERRED_PSSETCONSTANTBUFFERS:
-            case DEFERRED_VSSETCONSTANTBUFFERS:
-            {
-                for (i = 0; i < call->constant_buffers_info.num_buffers; i++)
-                {
-                    if (call->constant_buffers_info.buffers[i])
-                        ID3D11Buffer_Release(call->constant_buffers_info.buffers[i]);
-                }
-                break;
-            }
-            case DEFERRED_CSSETUNORDEREDACCESSVIEWS:
-            {
-                for (i = 0; i < call->unordered_view.num_views; i++)
-                {
-                    if (call->unordered_view.views[i])
-                        ID3D11UnorderedAccessView_Release(call->unordered_view.views[i]);
-                }
-                break;
-            }
-            case DEFERRED_DRAW:
-            case DEFERRED_DRAWINDEXED:
-            case DEFERRED_DRAWINDEXEDINSTANCED:
-            {
-                break; /* nothing to do */
-            }
-            case DEFERRED_MAP:
-            {
-                ID3D11Resource_Release(call->map_info.resource);
-                break;
-            }
-            case DEFERRED_DISPATCH:
-            {
-                break; /* nothing to do */
-            }
-            case DEFERRED_CLEARSTATE:
-            {
-                break; /* nothing to do */
-            }
-            case DEFERRED_CLEARRENDERTARGETVIEW:
-            {
-                if (call->clear_rtv_info.rtv)
-                    ID3D11RenderTargetView_Release(call->clear_rtv_info.rtv);
-                break;
-            }
-            case DEFERRED_CLEARDEPTHSTENCILVIEW:
-            {
-                if (call->clear_depth_info.view)
-                    ID3D11DepthStencilView_Release(call->clear_depth_info.view);
-                break;
-            }
-            default:
-            {
-                FIXME("Unimplemented command type %u\n", call->cmd);
-                break;
-            }
-        }
+        struct d3d_buffer *buffer = unsafe_impl_from_ID3D11Buffer(buffers[i]);
 
-        list_remove(&call->entry);
-        HeapFree(GetProcessHeap(), 0, call);
+        deferred_calls_add_object(&context->commands, buffers[i]);
+        call->constant_buffers_info.buffers[i] = buffers[i];
+        call->constant_buffers_info.wined3d_buffers[i] = buffer ? buffer->wined3d_buffer : NULL;
     }
 }
 
-static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *commands)
+/* Replays recorded calls on the immediate context. The wined3d objects were
+ * looked up at record time, so the common state changes and draws go to
+ * wined3d directly. The caller holds the wined3d mutex. */
+static void exec_deferred_calls(ID3D11DeviceContext *iface, struct wined3d_device *wined3d_device,
+        const struct deferred_calls *commands)
 {
-    struct deferred_call *call;
+    const struct deferred_chunk *chunk;
+    const struct deferred_call *call;
+    unsigned int i;
 
-    LIST_FOR_EACH_ENTRY(call, commands, struct deferred_call, entry)
+    for (call = first_deferred_call(commands, &chunk); call; call = next_deferred_call(call, &chunk))
     {
         switch (call->cmd)
         {
             case DEFERRED_IASETVERTEXBUFFERS:
             {
-                ID3D11DeviceContext_IASetVertexBuffers(iface, call->vbuffer_info.start_slot,
-                        call->vbuffer_info.num_buffers, call->vbuffer_info.buffers,
-                        call->vbuffer_info.strides, call->vbuffer_info.offsets);
+                for (i = 0; i < call->vbuffer_info.num_buffers; ++i)
+                    wined3d_device_set_stream_source(wined3d_device, call->vbuffer_info.start_slot + i,
+                            call->vbuffer_info.wined3d_buffers[i], call->vbuffer_info.offsets[i],
+                            call->vbuffer_info.strides[i]);
                 break;
             }
             case DEFERRED_IASETPRIMITIVETOPOLOGY:
             {
-                ID3D11DeviceContext_IASetPrimitiveTopology(iface, call->topology_info.topology);
+                wined3d_device_set_primitive_type(wined3d_device,
+                        (enum wined3d_primitive_type)call->topology_info.topology);
                 break;
             }
             case DEFERRED_IASETINDEXBUFFER:
             {
-                ID3D11DeviceContext_IASetIndexBuffer(iface, call->index_buffer_info.buffer,
-                        call->index_buffer_info.format, call->index_buffer_info.offset);
+                wined3d_device_set_index_buffer(wined3d_device, call->index_buffer_info.wined3d_buffer,
+                        call->index_buffer_info.wined3d_format, call->index_buffer_info.offset);
                 break;
             }
             case DEFERRED_IASETINPUTLAYOUT:
             {
-                ID3D11DeviceContext_IASetInputLayout(iface, call->input_layout_info.layout);
+                wined3d_device_set_vertex_declaration(wined3d_device, call->input_layout_info.wined3d_decl);
                 break;
             }
             case DEFERRED_RSSETSTATE:
@@ -584,12 +618,12 @@ static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *command
             }
             case DEFERRED_PSSETSHADER:
             {
-                ID3D11DeviceContext_PSSetShader(iface, call->ps_info.shader, NULL, 0);
+                wined3d_device_set_pixel_shader(wined3d_device, call->ps_info.wined3d_shader);
                 break;
             }
             case DEFERRED_VSSETSHADER:
             {
-                ID3D11DeviceContext_VSSetShader(iface, call->vs_info.shader, NULL, 0);
+                wined3d_device_set_vertex_shader(wined3d_device, call->vs_info.wined3d_shader);
                 break;
             }
             case DEFERRED_DSSETSHADERRESOURCES:
@@ -600,8 +634,9 @@ static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *command
             }
             case DEFERRED_PSSETSHADERRESOURCES:
             {
-                ID3D11DeviceContext_PSSetShaderResources(iface, call->res_info.start_slot,
-                        call->res_info.num_views, call->res_info.views);
+                for (i = 0; i < call->res_info.num_views; ++i)
+                    wined3d_device_set_ps_resource_view(wined3d_device, call->res_info.start_slot + i,
+                            call->res_info.wined3d_views[i]);
                 break;
             }
             case DEFERRED_DSSETSAMPLERS:
@@ -612,8 +647,9 @@ static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *command
             }
             case DEFERRED_PSSETSAMPLERS:
             {
-                ID3D11DeviceContext_PSSetSamplers(iface, call->samplers_info.start_slot,
-                        call->samplers_info.num_samplers, call->samplers_info.samplers);
+                for (i = 0; i < call->samplers_info.num_samplers; ++i)
+                    wined3d_device_set_ps_sampler(wined3d_device, call->samplers_info.start_slot + i,
+                            call->samplers_info.wined3d_samplers[i]);
                 break;
             }
             case DEFERRED_CSSETCONSTANTBUFFERS:
@@ -636,14 +672,16 @@ static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *command
             }
             case DEFERRED_PSSETCONSTANTBUFFERS:
             {
-                ID3D11DeviceContext_PSSetConstantBuffers(iface, call->constant_buffers_info.start_slot,
-                        call->constant_buffers_info.num_buffers, call->constant_buffers_info.buffers);
+                for (i = 0; i < call->constant_buffers_info.num_buffers; ++i)
+                    wined3d_device_set_ps_cb(wined3d_device, call->constant_buffers_info.start_slot + i,
+                            call->constant_buffers_info.wined3d_buffers[i]);
                 break;
             }
             case DEFERRED_VSSETCONSTANTBUFFERS:
             {
-                ID3D11DeviceContext_VSSetConstantBuffers(iface, call->constant_buffers_info.start_slot,
-                        call->constant_buffers_info.num_buffers, call->constant_buffers_info.buffers);
+                for (i = 0; i < call->constant_buffers_info.num_buffers; ++i)
+                    wined3d_device_set_vs_cb(wined3d_device, call->constant_buffers_info.start_slot + i,
+                            call->constant_buffers_info.wined3d_buffers[i]);
                 break;
             }
             case DEFERRED_CSSETUNORDEREDACCESSVIEWS:
@@ -654,20 +692,22 @@ static void exec_deferred_calls(ID3D11DeviceContext *iface, struct list *command
             }
             case DEFERRED_DRAW:
             {
-                ID3D11DeviceContext_Draw(iface, call->draw_info.count, call->draw_info.start);
+                wined3d_device_draw_primitive(wined3d_device, call->draw_info.start, call->draw_info.count);
                 break;
             }
             case DEFERRED_DRAWINDEXED:
             {
-                ID3D11DeviceContext_DrawIndexed(iface, call->draw_indexed_info.count,
-                        call->draw_indexed_info.start_index, call->draw_indexed_info.base_vertex);
+                wined3d_device_set_base_vertex_index(wined3d_device, call->draw_indexed_info.base_vertex);
+                wined3d_device_draw_indexed_primitive(wined3d_device, call->draw_indexed_info.start_index,
+                        call->draw_indexed_info.count);
                 break;
             }
             case DEFERRED_DRAWINDEXEDINSTANCED:
             {
-                ID3D11DeviceContext_DrawIndexedInstanced(iface, call->draw_indexed_inst_info.count_per_instance,
-                        call->draw_indexed_inst_info.instance_count, call->draw_indexed_inst_info.start_index,
-                        call->draw_indexed_inst_info.base_vertex, call->draw_indexed_inst_info.start_instance);
+                wined3d_device_set_base_vertex_index(wined3d_device, call->draw_indexed_inst_info.base_vertex);
+                wined3d_device_draw_indexed_primitive_instanced(wined3d_device,
+                        call->draw_indexed_inst_info.start_index, call->draw_indexed_inst_info.count_per_instance,
+                        call->draw_indexed_inst_info.start_instance, call->draw_indexed_inst_info.instance_count);
                 break;
             }
             case DEFERRED_MAP:
@@ -1959,6 +1999,7 @@ static void STDMETHODCALLTYPE d3d11_immediate_context_ResolveSubresource(ID3D11D
 static void STDMETHODCALLTYPE d3d11_immediate_context_ExecuteCommandList(ID3D11DeviceContext *iface,
         ID3D11CommandList *command_list, BOOL restore_state)
 {
+    struct d3d_device *device = device_from_immediate_ID3D11DeviceContext(iface);
     struct d3d11_command_list *cmdlist = unsafe_impl_from_ID3D11CommandList(command_list);
 
     TRACE("iface %p, command_list %p, restore_state %#x.\n", iface, command_list, restore_state);
@@ -1970,7 +2011,7 @@ static void STDMETHODCALLTYPE d3d11_immediate_context_ExecuteCommandList(ID3D11D
         FIXME("restoring state not supported!\n");
 
     wined3d_mutex_lock();
-    exec_deferred_calls(iface, &cmdlist->commands);
+    exec_deferred_calls(iface, device->wined3d_device, &cmdlist->commands);
     ID3D11DeviceContext_ClearState(iface);
     wined3d_mutex_unlock();
 }
@@ -3073,17 +3114,19 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_PSSetShader(ID3D11DeviceCon
         ID3D11PixelShader *shader, ID3D11ClassInstance *const *class_instances, UINT class_instance_count)
 {
     struct d3d11_deferred_context *context = impl_from_deferred_ID3D11DeviceContext(iface);
+    struct d3d_pixel_shader *ps = unsafe_impl_from_ID3D11PixelShader(shader);
     struct deferred_call *call;
 
     TRACE("iface %p, shader %p, class_instances %p, class_instance_count %u.\n",
             iface, shader, class_instances, class_instance_count);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_PSSETSHADER;
-    if (shader) ID3D11PixelShader_AddRef(shader);
+    deferred_calls_add_object(&context->commands, shader);
     call->ps_info.shader = shader;
+    call->ps_info.wined3d_shader = ps ? ps->wined3d_shader : NULL;
 }
 
 static void STDMETHODCALLTYPE d3d11_deferred_context_PSSetSamplers(ID3D11DeviceContext *iface,
@@ -3101,17 +3144,19 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_VSSetShader(ID3D11DeviceCon
         ID3D11VertexShader *shader, ID3D11ClassInstance *const *class_instances, UINT class_instance_count)
 {
     struct d3d11_deferred_context *context = impl_from_deferred_ID3D11DeviceContext(iface);
+    struct d3d_vertex_shader *vs = unsafe_impl_from_ID3D11VertexShader(shader);
     struct deferred_call *call;
 
     TRACE("iface %p, shader %p, class_instances %p, class_instance_count %u.\n",
             iface, shader, class_instances, class_instance_count);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_VSSETSHADER;
-    if (shader) ID3D11VertexShader_AddRef(shader);
+    deferred_calls_add_object(&context->commands, shader);
     call->vs_info.shader = shader;
+    call->vs_info.wined3d_shader = vs ? vs->wined3d_shader : NULL;
 }
 
 static void STDMETHODCALLTYPE d3d11_deferred_context_DrawIndexed(ID3D11DeviceContext *iface,
@@ -3123,7 +3168,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_DrawIndexed(ID3D11DeviceCon
     TRACE("iface %p, index_count %u, start_index_location %u, base_vertex_location %d.\n",
             iface, index_count, start_index_location, base_vertex_location);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_DRAWINDEXED;
@@ -3141,7 +3186,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_Draw(ID3D11DeviceContext *i
     TRACE("iface %p, vertex_count %u, start_vertex_location %u.\n",
             iface, vertex_count, start_vertex_location);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_DRAW;
@@ -3166,9 +3211,8 @@ static HRESULT STDMETHODCALLTYPE d3d11_deferred_context_Map(ID3D11DeviceContext
 
     if (map_type != D3D11_MAP_WRITE_DISCARD)
     {
-        LIST_FOR_EACH_ENTRY_REV(call, &context->commands, struct deferred_call, entry)
+        for (call = context->commands.last_map; call; call = call->map_info.previous)
         {
-            if (call->cmd != DEFERRED_MAP) continue;
             if (call->map_info.resource != resource) continue;
             if (call->map_info.subresource_idx != subresource_idx) continue;
             previous = call;
@@ -3191,17 +3235,19 @@ static HRESULT STDMETHODCALLTYPE d3d11_deferred_context_Map(ID3D11DeviceContext
     if (FAILED(hr))
         return hr;
 
-    if (!(call = add_deferred_call(context, map_info.size)))
+    if (!(call = add_deferred_call(context, map_info.size, 1)))
         return E_OUTOFMEMORY;
 
     call->cmd = DEFERRED_MAP;
-    ID3D11Resource_AddRef(resource);
+    deferred_calls_add_object(&context->commands, resource);
     call->map_info.resource = resource;
     call->map_info.subresource_idx = subresource_idx;
     call->map_info.map_type = map_type;
     call->map_info.map_flags = map_flags;
     call->map_info.buffer = (void *)(call + 1);
     call->map_info.size = map_info.size;
+    call->map_info.previous = context->commands.last_map;
+    context->commands.last_map = call;
 
     if (previous)
         memcpy(call->map_info.buffer, previous->map_info.buffer, map_info.size);
@@ -3234,16 +3280,18 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_IASetInputLayout(ID3D11Devi
         ID3D11InputLayout *input_layout)
 {
     struct d3d11_deferred_context *context = impl_from_deferred_ID3D11DeviceContext(iface);
+    struct d3d_input_layout *layout = unsafe_impl_from_ID3D11InputLayout(input_layout);
     struct deferred_call *call;
 
     TRACE("iface %p, input_layout %p.\n", iface, input_layout);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_IASETINPUTLAYOUT;
-    if (input_layout) ID3D11InputLayout_AddRef(input_layout);
+    deferred_calls_add_object(&context->commands, input_layout);
     call->input_layout_info.layout = input_layout;
+    call->input_layout_info.wined3d_decl = layout ? layout->wined3d_decl : NULL;
 }
 
 static void STDMETHODCALLTYPE d3d11_deferred_context_IASetVertexBuffers(ID3D11DeviceContext *iface,
@@ -3256,7 +3304,8 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_IASetVertexBuffers(ID3D11De
     TRACE("iface %p, start_slot %u, buffer_count %u, buffers %p, strides %p, offsets %p.\n",
             iface, start_slot, buffer_count, buffers, strides, offsets);
 
-    if (!(call = add_deferred_call(context, buffer_count * (sizeof(*buffers) + sizeof(UINT) + sizeof(UINT)))))
+    if (!(call = add_deferred_call(context, buffer_count * (sizeof(*buffers)
+            + sizeof(*call->vbuffer_info.wined3d_buffers) + sizeof(UINT) + sizeof(UINT)), buffer_count)))
         return;
 
     call->cmd = DEFERRED_IASETVERTEXBUFFERS;
@@ -3264,12 +3313,16 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_IASetVertexBuffers(ID3D11De
     call->vbuffer_info.num_buffers = buffer_count;
 
     call->vbuffer_info.buffers = (void *)(call + 1);
-    call->vbuffer_info.strides = (void *)&call->vbuffer_info.buffers[buffer_count];
+    call->vbuffer_info.wined3d_buffers = (void *)&call->vbuffer_info.buffers[buffer_count];
+    call->vbuffer_info.strides = (void *)&call->vbuffer_info.wined3d_buffers[buffer_count];
     call->vbuffer_info.offsets = (void *)&call->vbuffer_info.strides[buffer_count];
     for (i = 0; i < buffer_count; i++)
     {
-        if (buffers[i]) ID3D11Buffer_AddRef(buffers[i]);
+        struct d3d_buffer *buffer = unsafe_impl_from_ID3D11Buffer(buffers[i]);
+
+        deferred_calls_add_object(&context->commands, buffers[i]);
         call->vbuffer_info.buffers[i] = buffers[i];
+        call->vbuffer_info.wined3d_buffers[i] = buffer ? buffer->wined3d_buffer : NULL;
         call->vbuffer_info.strides[i] = strides[i];
         call->vbuffer_info.offsets[i] = offsets[i];
     }
@@ -3279,18 +3332,21 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_IASetIndexBuffer(ID3D11Devi
         ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset)
 {
     struct d3d11_deferred_context *context = impl_from_deferred_ID3D11DeviceContext(iface);
+    struct d3d_buffer *buffer_impl = unsafe_impl_from_ID3D11Buffer(buffer);
     struct deferred_call *call;
 
     TRACE("iface %p, buffer %p, format %s, offset %u.\n",
             iface, buffer, debug_dxgi_format(format), offset);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_IASETINDEXBUFFER;
-    if (buffer) ID3D11Buffer_AddRef(buffer);
+    deferred_calls_add_object(&context->commands, buffer);
     call->index_buffer_info.buffer = buffer;
+    call->index_buffer_info.wined3d_buffer = buffer_impl ? buffer_impl->wined3d_buffer : NULL;
     call->index_buffer_info.format = format;
+    call->index_buffer_info.wined3d_format = wined3dformat_from_dxgi_format(format);
     call->index_buffer_info.offset = offset;
 }
 
@@ -3306,7 +3362,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_DrawIndexedInstanced(ID3D11
             iface, instance_index_count, instance_count, start_index_location,
             base_vertex_location, start_instance_location);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_DRAWINDEXEDINSTANCED;
@@ -3348,7 +3404,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_IASetPrimitiveTopology(ID3D
 
     TRACE("iface %p, topology %u.\n", iface, topology);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_IASETPRIMITIVETOPOLOGY;
@@ -3419,7 +3475,8 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_OMSetRenderTargets(ID3D11De
     TRACE("iface %p, render_target_view_count %u, render_target_views %p, depth_stencil_view %p.\n",
             iface, render_target_view_count, render_target_views, depth_stencil_view);
 
-    if (!(call = add_deferred_call(context, sizeof(*render_target_views) * render_target_view_count)))
+    if (!(call = add_deferred_call(context, sizeof(*render_target_views) * render_target_view_count,
+            render_target_view_count + 1)))
         return;
 
     call->cmd = DEFERRED_OMSETRENDERTARGETS;
@@ -3427,12 +3484,10 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_OMSetRenderTargets(ID3D11De
     call->render_target_info.render_targets = (void *)(call + 1);
     for (i = 0; i < render_target_view_count; i++)
     {
-        if (render_target_views[i])
-            ID3D11RenderTargetView_AddRef(render_target_views[i]);
+        deferred_calls_add_object(&context->commands, render_target_views[i]);
         call->render_target_info.render_targets[i] = render_target_views[i];
     }
-    if (depth_stencil_view)
-        ID3D11DepthStencilView_AddRef(depth_stencil_view);
+    deferred_calls_add_object(&context->commands, depth_stencil_view);
     call->render_target_info.depth_stencil = depth_stencil_view;
 }
 
@@ -3464,11 +3519,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_OMSetBlendState(ID3D11Devic
     if (!blend_factor)
         blend_factor = default_blend_factor;
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_OMSETBLENDSTATE;
-    if (blend_state) ID3D11BlendState_AddRef(blend_state);
+    deferred_calls_add_object(&context->commands, blend_state);
     call->blend_state_info.state = blend_state;
     for (i = 0; i < 4; i++)
         call->blend_state_info.factor[i] = blend_factor[i];
@@ -3484,11 +3539,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_OMSetDepthStencilState(ID3D
     TRACE("iface %p, depth_stencil_state %p, stencil_ref %u.\n",
             iface, depth_stencil_state, stencil_ref);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_OMSETDEPTHSTENCILSTATE;
-    if (depth_stencil_state) ID3D11DepthStencilState_AddRef(depth_stencil_state);
+    deferred_calls_add_object(&context->commands, depth_stencil_state);
     call->stencil_state_info.state = depth_stencil_state;
     call->stencil_state_info.stencil_ref = stencil_ref;
 }
@@ -3525,7 +3580,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_Dispatch(ID3D11DeviceContex
     TRACE("iface %p, thread_group_count_x %u, thread_group_count_y %u, thread_group_count_z %u.\n",
             iface, thread_group_count_x, thread_group_count_y, thread_group_count_z);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_DISPATCH;
@@ -3548,11 +3603,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_RSSetState(ID3D11DeviceCont
 
     TRACE("iface %p, rasterizer_state %p.\n", iface, rasterizer_state);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_RSSETSTATE;
-    if (rasterizer_state) ID3D11RasterizerState_AddRef(rasterizer_state);
+    deferred_calls_add_object(&context->commands, rasterizer_state);
     call->rstate_info.state = rasterizer_state;
 }
 
@@ -3564,7 +3619,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_RSSetViewports(ID3D11Device
 
     TRACE("iface %p, viewport_count %u, viewports %p.\n", iface, viewport_count, viewports);
 
-    if (!(call = add_deferred_call(context, sizeof(D3D11_VIEWPORT) * viewport_count)))
+    if (!(call = add_deferred_call(context, sizeof(D3D11_VIEWPORT) * viewport_count, 0)))
         return;
 
     call->cmd = DEFERRED_RSSETVIEWPORTS;
@@ -3620,11 +3675,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_ClearRenderTargetView(ID3D1
     TRACE("iface %p, render_target_view %p, color_rgba %s.\n",
             iface, render_target_view, debug_float4(color_rgba));
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_CLEARRENDERTARGETVIEW;
-    if (render_target_view) ID3D11RenderTargetView_AddRef(render_target_view);
+    deferred_calls_add_object(&context->commands, render_target_view);
     call->clear_rtv_info.rtv = render_target_view;
     for (i = 0; i < 4; i++)
         call->clear_rtv_info.color[i] = color_rgba[i];
@@ -3653,11 +3708,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_ClearDepthStencilView(ID3D1
     TRACE("iface %p, depth_stencil_view %p, flags %#x, depth %.8e, stencil %u.\n",
             iface, depth_stencil_view, flags, depth, stencil);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_CLEARDEPTHSTENCILVIEW;
-    if (depth_stencil_view) ID3D11DepthStencilView_AddRef(depth_stencil_view);
+    deferred_calls_add_object(&context->commands, depth_stencil_view);
     call->clear_depth_info.view = depth_stencil_view;
     call->clear_depth_info.flags = flags;
     call->clear_depth_info.depth = depth;
@@ -3717,11 +3772,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_HSSetShader(ID3D11DeviceCon
     TRACE("iface %p, shader %p, class_instances %p, class_instance_count %u.\n",
             iface, shader, class_instances, class_instance_count);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_HSSETSHADER;
-    if (shader) ID3D11HullShader_AddRef(shader);
+    deferred_calls_add_object(&context->commands, shader);
     call->hs_info.shader = shader;
 }
 
@@ -3763,11 +3818,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_DSSetShader(ID3D11DeviceCon
     TRACE("iface %p, shader %p, class_instances %p, class_instance_count %u.\n",
             iface, shader, class_instances, class_instance_count);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_DSSETSHADER;
-    if (shader) ID3D11DomainShader_AddRef(shader);
+    deferred_calls_add_object(&context->commands, shader);
     call->ds_info.shader = shader;
 }
 
@@ -3810,7 +3865,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_CSSetUnorderedAccessViews(I
     TRACE("iface %p, start_slot %u, view_count %u, views %p, initial_counts %p.\n",
             iface, start_slot, view_count, views, initial_counts);
 
-    if (!(call = add_deferred_call(context, view_count * (sizeof(*views) + sizeof(UINT)))))
+    if (!(call = add_deferred_call(context, view_count * (sizeof(*views) + sizeof(UINT)), view_count)))
         return;
 
     call->cmd = DEFERRED_CSSETUNORDEREDACCESSVIEWS;
@@ -3820,7 +3875,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_CSSetUnorderedAccessViews(I
     call->unordered_view.initial_counts = (void *)&call->unordered_view.views[view_count];
     for (i = 0; i < view_count; i++)
     {
-        if (views[i]) ID3D11UnorderedAccessView_AddRef(views[i]);
+        deferred_calls_add_object(&context->commands, views[i]);
         call->unordered_view.views[i] = views[i];
         call->unordered_view.initial_counts[i] = initial_counts[i];
     }
@@ -3835,11 +3890,11 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_CSSetShader(ID3D11DeviceCon
     TRACE("iface %p, shader %p, class_instances %p, class_instance_count %u.\n",
             iface, shader, class_instances, class_instance_count);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 1)))
         return;
 
     call->cmd = DEFERRED_CSSETSHADER;
-    if (shader) ID3D11ComputeShader_AddRef(shader);
+    deferred_calls_add_object(&context->commands, shader);
     call->cs_info.shader = shader;
 }
 
@@ -4129,7 +4184,7 @@ static void STDMETHODCALLTYPE d3d11_deferred_context_ClearState(ID3D11DeviceCont
 
     TRACE("iface %p.\n", iface);
 
-    if (!(call = add_deferred_call(context, 0)))
+    if (!(call = add_deferred_call(context, 0, 0)))
         return;
 
     call->cmd = DEFERRED_CLEARSTATE;
@@ -4172,8 +4227,8 @@ static HRESULT STDMETHODCALLTYPE d3d11_deferred_context_FinishCommandList(ID3D11
     object->device = context->device;
     object->refcount = 1;
 
-    list_init(&object->commands);
-    list_move_tail(&object->commands, &context->commands);
+    object->commands = context->commands;
+    memset(&context->commands, 0, sizeof(context->commands));
 
     ID3D11Device_AddRef(context->device);
     wined3d_private_store_init(&object->private_store);
@@ -4949,8 +5004,6 @@ static HRESULT STDMETHODCALLTYPE d3d11_device_CreateDeferredContext(ID3D11Device
     object->device = iface;
     object->refcount = 1;
 
-    list_init(&object->commands);
-
     ID3D11Device_AddRef(iface);
     wined3d_private_store_init(&object->private_store);
 
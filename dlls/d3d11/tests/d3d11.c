@@ -13367,6 +13367,111 @@ static void test_render_target_device_mismatch(void)
     release_test_context(&test_context);
 }
 
+static void test_deferred_context_performance(void)
+{
+    static const unsigned int call_count = 10000;
+    static const D3D11_VIEWPORT vp = {0.0f, 0.0f, 640.0f, 480.0f, 0.0f, 1.0f};
+    struct d3d11_test_context test_context;
+    ID3D11DeviceContext *deferred_context, *context;
+    double record_time, execute_time, replay_time;
+    LARGE_INTEGER frequency, start, end;
+    ID3D11CommandList *command_list;
+    ULONG refcount, expected_refcount;
+    ID3D11Device *device;
+    ID3D11Buffer *cb;
+    unsigned int i;
+    HRESULT hr;
+
+    if (!init_test_context(&test_context, NULL))
+        return;
+
+    device = test_context.device;
+    context = test_context.immediate_context;
+
+    hr = ID3D11Device_CreateDeferredContext(device, 0, &deferred_context);
+    if (FAILED(hr))
+    {
+        skip("Failed to create deferred context, hr %#x.\n", hr);
+        release_test_context(&test_context);
+        return;
+    }
+
+    cb = create_buffer(device, D3D11_BIND_CONSTANT_BUFFER, 4 * sizeof(float), NULL);
+    expected_refcount = get_refcount((IUnknown *)cb);
+
+    QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < call_count / 4; ++i)
+    {
+        ID3D11DeviceContext_IASetPrimitiveTopology(deferred_context, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+        ID3D11DeviceContext_PSSetConstantBuffers(deferred_context, 0, 1, &cb);
+        ID3D11DeviceContext_OMSetRenderTargets(deferred_context, 1, &test_context.backbuffer_rtv, NULL);
+        ID3D11DeviceContext_RSSetViewports(deferred_context, 1, &vp);
+    }
+    hr = ID3D11DeviceContext_FinishCommandList(deferred_context, FALSE, &command_list);
+    QueryPerformanceCounter(&end);
+    ok(SUCCEEDED(hr), "Failed to create command list, hr %#x.\n", hr);
+    record_time = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+
+    /* Command lists can be executed more than once. */
+    QueryPerformanceCounter(&start);
+    ID3D11DeviceContext_ExecuteCommandList(context, command_list, FALSE);
+    QueryPerformanceCounter(&end);
+    execute_time = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+
+    QueryPerformanceCounter(&start);
+    ID3D11DeviceContext_ExecuteCommandList(context, command_list, FALSE);
+    QueryPerformanceCounter(&end);
+    replay_time = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+
+    trace("%u deferred calls: record %.2f ms, execute %.2f ms, execute again %.2f ms.\n",
+            call_count, record_time, execute_time, replay_time);
+
+    ID3D11CommandList_Release(command_list);
+    refcount = get_refcount((IUnknown *)cb);
+    ok(refcount == expected_refcount, "Got unexpected refcount %u, expected %u.\n", refcount, expected_refcount);
+
+    /* The context records into recycled memory after FinishCommandList(). */
+    for (i = 0; i < call_count / 4; ++i)
+        ID3D11DeviceContext_PSSetConstantBuffers(deferred_context, 0, 1, &cb);
+    hr = ID3D11DeviceContext_FinishCommandList(deferred_context, FALSE, &command_list);
+    ok(SUCCEEDED(hr), "Failed to create command list, hr %#x.\n", hr);
+    ID3D11DeviceContext_ExecuteCommandList(context, command_list, FALSE);
+    ID3D11CommandList_Release(command_list);
+
+    ID3D11Buffer_Release(cb);
+    ID3D11DeviceContext_Release(deferred_context);
+    release_test_context(&test_context);
+}
+
+static void test_shader_cache(void)
+{
+    static const struct vec4 colors[] =
+    {
+        {0.0f, 1.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f, 1.0f},
+        {0.0f, 0.0f, 1.0f, 1.0f},
+    };
+    static const DWORD expected_colors[] = {0xff00ff00, 0xff0000ff, 0xffff0000};
+
+    struct d3d11_test_context test_context;
+    unsigned int i;
+
+    /* Programs linked by one device may be reused by the next ones, their
+     * constants have to keep working. */
+    for (i = 0; i < sizeof(colors) / sizeof(*colors); ++i)
+    {
+        if (!init_test_context(&test_context, NULL))
+            return;
+
+        draw_color_quad(&test_context, &colors[i]);
+        check_texture_color(test_context.backbuffer, expected_colors[i], 1);
+
+        release_test_context(&test_context);
+    }
+}
+
 START_TEST(d3d11)
 {
     test_create_device();
@@ -13438,4 +13543,6 @@ START_TEST(d3d11)
     test_primitive_restart();
     test_sm5_bufinfo_instruction();
     test_render_target_device_mismatch();
+    test_deferred_context_performance();
+    test_shader_cache();
 }
@@ -235,9 +235,9 @@ static ULONG DirectSoundDevice_Release(DirectSoundDevice * device)
         if(device->volume)
             IAudioStreamVolume_Release(device->volume);
 
-        HeapFree(GetProcessHeap(), 0, device->dsp_buffer);
-        HeapFree(GetProcessHeap(), 0, device->tmp_buffer);
-        HeapFree(GetProcessHeap(), 0, device->cp_buffer);
+        HeapFree(GetProcessHeap(), 0, device->scratch.dsp_buffer);
+        HeapFree(GetProcessHeap(), 0, device->scratch.tmp_buffer);
+        HeapFree(GetProcessHeap(), 0, device->scratch.cp_buffer);
         HeapFree(GetProcessHeap(), 0, device->buffer);
         RtlDeleteResource(&device->buffer_list_lock);
         device->mixlock.DebugInfo->Spare[0] = 0;
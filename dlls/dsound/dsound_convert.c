@@ -37,8 +37,15 @@
 #include "config.h"
 
 #include <stdarg.h>
+#include <string.h>
 #include <math.h>
 
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(WORDS_BIGENDIAN) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_MIXER_SIMD
+#include <immintrin.h>
+#endif
+
 #include "windef.h"
 #include "winbase.h"
 #include "mmsystem.h"
@@ -102,6 +109,48 @@ static float getieee32(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD chann
 
 const bitsgetfunc getbpp[5] = {get8, get16, get24, get32, getieee32};
 
+/* The conv* functions convert a contiguous run of interleaved samples at
+ * once, producing exactly the same values as the get* functions above. */
+
+static void conv8(const void *src, float *dst, unsigned samples)
+{
+    const BYTE *buf = src;
+    while (samples--)
+        *(dst++) = (*(buf++) - 0x80) / (float)0x80;
+}
+
+static void conv16(const void *src, float *dst, unsigned samples)
+{
+    const SHORT *sbuf = src;
+    while (samples--)
+        *(dst++) = (SHORT)le16(*(sbuf++)) / (float)0x8000;
+}
+
+static void conv24(const void *src, float *dst, unsigned samples)
+{
+    const BYTE *buf = src;
+    while (samples--)
+    {
+        LONG sample = (buf[0] << 8) | (buf[1] << 16) | (buf[2] << 24);
+        *(dst++) = sample / (float)0x80000000U;
+        buf += 3;
+    }
+}
+
+static void conv32(const void *src, float *dst, unsigned samples)
+{
+    const LONG *sbuf = src;
+    while (samples--)
+        *(dst++) = (LONG)le32(*(sbuf++)) / (float)0x80000000U;
+}
+
+static void convieee32(const void *src, float *dst, unsigned samples)
+{
+    memcpy(dst, src, samples * sizeof(float));
+}
+
+bitsconvfunc convbpp[5] = {conv8, conv16, conv24, conv32, convieee32};
+
 float get_mono(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel)
 {
     DWORD channels = dsb->pwfx->nChannels;
@@ -152,14 +201,14 @@ static inline LONG f_to_32(float value)
 
 void putieee32(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value)
 {
-    BYTE *buf = (BYTE *)dsb->device->tmp_buffer;
+    BYTE *buf = (BYTE *)dsb->scratch->tmp_buffer;
     float *fbuf = (float*)(buf + pos + sizeof(float) * channel);
     *fbuf = value;
 }
 
 void putieee32_sum(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value)
 {
-    BYTE *buf = (BYTE *)dsb->device->tmp_buffer;
+    BYTE *buf = (BYTE *)dsb->scratch->tmp_buffer;
     float *fbuf = (float*)(buf + pos + sizeof(float) * channel);
     *fbuf += value;
 }
@@ -279,7 +328,7 @@ void put_quad2stereo(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel
     }
 }
 
-void mixieee32(float *src, float *dst, unsigned samples)
+static void mixieee32_scalar(float *src, float *dst, unsigned samples)
 {
     TRACE("%p - %p %d\n", src, dst, samples);
     while (samples--)
@@ -336,9 +385,318 @@ static void norm32(float *src, INT *dst, unsigned len)
     }
 }
 
-const normfunc normfunctions[4] = {
+normfunc normfunctions[4] = {
     (normfunc)norm8,
     (normfunc)norm16,
     (normfunc)norm24,
     (normfunc)norm32,
 };
+
+static void mixvolume_scalar(float *buf, const float *vols, unsigned channels, unsigned frames)
+{
+    unsigned i, chan;
+
+    for (i = 0; i < frames; ++i)
+        for (chan = 0; chan < channels; ++chan)
+            buf[i * channels + chan] *= vols[chan];
+}
+
+struct mixer_kernels
+{
+    const char *name;
+    void (*conv8)(const void *src, float *dst, unsigned samples);
+    void (*conv16)(const void *src, float *dst, unsigned samples);
+    void (*mixieee32)(float *src, float *dst, unsigned samples);
+    void (*mixvolume)(float *buf, const float *vols, unsigned channels, unsigned frames);
+    void (*norm16)(float *src, SHORT *dst, unsigned len);
+};
+
+static const struct mixer_kernels scalar_kernels =
+{
+    "scalar", conv8, conv16, mixieee32_scalar, mixvolume_scalar, norm16
+};
+
+#ifdef HAVE_MIXER_SIMD
+
+#ifdef __i386__
+#define SIMD_ALIGN_STACK __attribute__((force_align_arg_pointer))
+#else
+#define SIMD_ALIGN_STACK
+#endif
+
+#define SSE2_FUNC __attribute__((target("sse2"))) SIMD_ALIGN_STACK
+#define AVX2_FUNC __attribute__((target("avx2"))) SIMD_ALIGN_STACK
+
+static SSE2_FUNC void conv8_sse2(const void *src, float *dst, unsigned samples)
+{
+    const BYTE *buf = src;
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128 scale = _mm_set1_ps(1.0f / 0x80);
+    unsigned i;
+
+    for (i = 0; i + 16 <= samples; i += 16)
+    {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(buf + i)), bias);
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), scale));
+    }
+    conv8(buf + i, dst + i, samples - i);
+}
+
+static SSE2_FUNC void conv16_sse2(const void *src, float *dst, unsigned samples)
+{
+    const SHORT *sbuf = src;
+    const __m128 scale = _mm_set1_ps(1.0f / 0x8000);
+    unsigned i;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(sbuf + i));
+
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale));
+    }
+    conv16(sbuf + i, dst + i, samples - i);
+}
+
+static SSE2_FUNC void mixieee32_sse2(float *src, float *dst, unsigned samples)
+{
+    unsigned i;
+
+    TRACE("%p - %p %d\n", src, dst, samples);
+    for (i = 0; i + 4 <= samples; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    for (; i < samples; i++)
+        dst[i] += src[i];
+}
+
+static SSE2_FUNC void mixvolume_sse2(float *buf, const float *vols, unsigned channels, unsigned frames)
+{
+    float pattern[DS_MAX_CHANNELS * 4];
+    unsigned i, j, block = channels * 4, samples = channels * frames;
+
+    /* four frames always fill a whole number of registers */
+    for (i = 0; i < block; i++)
+        pattern[i] = vols[i % channels];
+    for (i = 0; i + block <= samples; i += block)
+        for (j = 0; j < block; j += 4)
+            _mm_storeu_ps(buf + i + j, _mm_mul_ps(_mm_loadu_ps(buf + i + j), _mm_loadu_ps(pattern + j)));
+    for (j = 0; i < samples; i++, j++)
+        buf[i] *= pattern[j];
+}
+
+static SSE2_FUNC void norm16_sse2(float *src, SHORT *dst, unsigned len)
+{
+    const __m128 min = _mm_set1_ps(-1.f), max = _mm_set1_ps(1.f * 0x7FFF / 0x8000);
+    const __m128 scale = _mm_set1_ps(0x8000);
+    unsigned i;
+
+    TRACE("%p - %p %d\n", src, dst, len);
+    len /= 2;
+    /* clamping first gives the same results as f_to_16, and cvtps2dq rounds
+     * to nearest like lrintf in the default rounding mode */
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128 lo = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), min), max);
+        __m128 hi = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), min), max);
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, scale)),
+                                                               _mm_cvtps_epi32(_mm_mul_ps(hi, scale))));
+    }
+    for (; i < len; i++)
+        dst[i] = f_to_16(src[i]);
+}
+
+static AVX2_FUNC void conv8_avx2(const void *src, float *dst, unsigned samples)
+{
+    const BYTE *buf = src;
+    const __m256i bias = _mm256_set1_epi32(0x80);
+    const __m256 scale = _mm256_set1_ps(1.0f / 0x80);
+    unsigned i;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(buf + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(v, bias)), scale));
+    }
+    conv8(buf + i, dst + i, samples - i);
+}
+
+static AVX2_FUNC void conv16_avx2(const void *src, float *dst, unsigned samples)
+{
+    const SHORT *sbuf = src;
+    const __m256 scale = _mm256_set1_ps(1.0f / 0x8000);
+    unsigned i;
+
+    for (i = 0; i + 8 <= samples; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(sbuf + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    conv16(sbuf + i, dst + i, samples - i);
+}
+
+static AVX2_FUNC void mixieee32_avx2(float *src, float *dst, unsigned samples)
+{
+    unsigned i;
+
+    TRACE("%p - %p %d\n", src, dst, samples);
+    for (i = 0; i + 8 <= samples; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    for (; i < samples; i++)
+        dst[i] += src[i];
+}
+
+static AVX2_FUNC void mixvolume_avx2(float *buf, const float *vols, unsigned channels, unsigned frames)
+{
+    float pattern[DS_MAX_CHANNELS * 8];
+    unsigned i, j, block = channels * 8, samples = channels * frames;
+
+    for (i = 0; i < block; i++)
+        pattern[i] = vols[i % channels];
+    for (i = 0; i + block <= samples; i += block)
+        for (j = 0; j < block; j += 8)
+            _mm256_storeu_ps(buf + i + j, _mm256_mul_ps(_mm256_loadu_ps(buf + i + j), _mm256_loadu_ps(pattern + j)));
+    for (j = 0; i < samples; i++, j++)
+        buf[i] *= pattern[j];
+}
+
+static inline void do_cpuid(unsigned int ax, unsigned int cx, unsigned int *p)
+{
+#ifdef __i386__
+    __asm__("pushl %%ebx\n\t"
+            "cpuid\n\t"
+            "movl %%ebx, %%esi\n\t"
+            "popl %%ebx"
+            : "=a" (p[0]), "=S" (p[1]), "=c" (p[2]), "=d" (p[3])
+            : "0" (ax), "2" (cx));
+#else
+    __asm__("push %%rbx\n\t"
+            "cpuid\n\t"
+            "movq %%rbx, %%rsi\n\t"
+            "pop %%rbx"
+            : "=a" (p[0]), "=S" (p[1]), "=c" (p[2]), "=d" (p[3])
+            : "0" (ax), "2" (cx));
+#endif
+}
+
+static BOOL have_avx2(void)
+{
+    unsigned int regs[4], lo, hi;
+
+    do_cpuid(0, 0, regs);
+    if (regs[0] < 7) return FALSE;
+    /* the OS has to save the ymm registers too, see OSXSAVE and XCR0 */
+    do_cpuid(1, 0, regs);
+    if ((regs[2] & 0x18000000) != 0x18000000) return FALSE;
+    __asm__(".byte 0x0f,0x01,0xd0" /* xgetbv */ : "=a" (lo), "=d" (hi) : "c" (0));
+    if ((lo & 6) != 6) return FALSE;
+    do_cpuid(7, 0, regs);
+    return (regs[1] & (1 << 5)) != 0;
+}
+
+static const struct mixer_kernels sse2_kernels =
+{
+    "sse2", conv8_sse2, conv16_sse2, mixieee32_sse2, mixvolume_sse2, norm16_sse2
+};
+
+static const struct mixer_kernels avx2_kernels =
+{
+    "avx2", conv8_avx2, conv16_avx2, mixieee32_avx2, mixvolume_avx2, norm16_sse2
+};
+
+/* Compare a set of kernels with the C ones on pseudo-random data. They only
+ * do element-wise operations that round the same way, so the output must be
+ * bit-exact. */
+static BOOL check_mixer_kernels(const struct mixer_kernels *kernels)
+{
+    /* an odd length, so that the tails get checked too */
+    enum { count = 6 * 32 + 5 };
+    static const float vols[DS_MAX_CHANNELS] = {0.5f, 0.7071f, 1.0f, 0.0f, 0.25f, 0.9f};
+    SHORT words[count];
+    float src[count], ref[count], res[count];
+    SHORT ref16[count], res16[count];
+    DWORD seed = 12345;
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        words[i] = seed >> 16;
+    }
+    for (i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        /* beyond full scale, to check the clamping */
+        src[i] = ((seed >> 8) & 0xffff) / 21845.0f - 1.5f;
+    }
+
+    scalar_kernels.conv8(words, ref, count);
+    kernels->conv8(words, res, count);
+    if (memcmp(ref, res, sizeof(ref))) return FALSE;
+
+    scalar_kernels.conv16(words, ref, count);
+    kernels->conv16(words, res, count);
+    if (memcmp(ref, res, sizeof(ref))) return FALSE;
+
+    memcpy(ref, src, sizeof(src));
+    memcpy(res, src, sizeof(src));
+    scalar_kernels.mixieee32(src, ref, count);
+    kernels->mixieee32(src, res, count);
+    if (memcmp(ref, res, sizeof(ref))) return FALSE;
+
+    for (i = 1; i <= DS_MAX_CHANNELS; i++)
+    {
+        memcpy(ref, src, sizeof(src));
+        memcpy(res, src, sizeof(src));
+        scalar_kernels.mixvolume(ref, vols, i, count / i);
+        kernels->mixvolume(res, vols, i, count / i);
+        if (memcmp(ref, res, sizeof(ref))) return FALSE;
+    }
+
+    scalar_kernels.norm16(src, ref16, sizeof(ref16));
+    kernels->norm16(src, res16, sizeof(res16));
+    return !memcmp(ref16, res16, sizeof(ref16));
+}
+
+#endif  /* HAVE_MIXER_SIMD */
+
+void (*mixieee32)(float *src, float *dst, unsigned samples) = mixieee32_scalar;
+void (*mixvolume)(float *buf, const float *vols, unsigned channels, unsigned frames) = mixvolume_scalar;
+
+/* Select the fastest mixing kernels this CPU supports that give the same
+ * results as the C ones. This is done once before any mixing happens.
+ * Returns the name of the selected set. */
+const char *init_mixer_kernels(void)
+{
+    const struct mixer_kernels *kernels = NULL;
+
+#ifdef HAVE_MIXER_SIMD
+    if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+    {
+        if (have_avx2())
+        {
+            if (check_mixer_kernels(&avx2_kernels)) kernels = &avx2_kernels;
+            else ERR("avx2 mixing kernels don't match the C ones, not using them\n");
+        }
+        if (!kernels)
+        {
+            if (check_mixer_kernels(&sse2_kernels)) kernels = &sse2_kernels;
+            else ERR("sse2 mixing kernels don't match the C ones, not using them\n");
+        }
+    }
+#endif
+    if (!kernels) return scalar_kernels.name;
+
+    convbpp[0] = kernels->conv8;
+    convbpp[1] = kernels->conv16;
+    mixieee32 = kernels->mixieee32;
+    mixvolume = kernels->mixvolume;
+    normfunctions[1] = (normfunc)kernels->norm16;
+    return kernels->name;
+}
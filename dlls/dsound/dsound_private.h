@@ -51,9 +51,13 @@ typedef void (*bitsputfunc)(const IDirectSoundBufferImpl *, DWORD, DWORD, float)
 extern const bitsgetfunc getbpp[5] DECLSPEC_HIDDEN;
 void putieee32(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value) DECLSPEC_HIDDEN;
 void putieee32_sum(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value) DECLSPEC_HIDDEN;
-void mixieee32(float *src, float *dst, unsigned samples) DECLSPEC_HIDDEN;
+typedef void (*bitsconvfunc)(const void *, float *, unsigned);
+extern bitsconvfunc convbpp[5] DECLSPEC_HIDDEN;
+extern void (*mixieee32)(float *src, float *dst, unsigned samples) DECLSPEC_HIDDEN;
+extern void (*mixvolume)(float *buf, const float *vols, unsigned channels, unsigned frames) DECLSPEC_HIDDEN;
 typedef void (*normfunc)(const void *, void *, unsigned);
-extern const normfunc normfunctions[4] DECLSPEC_HIDDEN;
+extern normfunc normfunctions[4] DECLSPEC_HIDDEN;
+const char *init_mixer_kernels(void) DECLSPEC_HIDDEN;
 
 typedef struct _DSVOLUMEPAN
 {
@@ -62,6 +66,15 @@ typedef struct _DSVOLUMEPAN
     LONG	lPan;
 } DSVOLUMEPAN,*PDSVOLUMEPAN;
 
+/* scratch buffers used while mixing one secondary buffer, one set per mixing thread */
+struct mix_scratch
+{
+    float *tmp_buffer, *cp_buffer, *dsp_buffer;
+    DWORD tmp_buffer_len, cp_buffer_len, dsp_buffer_len;
+};
+
+struct mix_context;
+
 typedef struct DSFilter {
     GUID guid;
     IMediaObject* obj;
@@ -91,8 +104,8 @@ struct DirectSoundDevice
     int                         speaker_num[DS_MAX_CHANNELS];
     int                         num_speakers;
     int                         lfe_channel;
-    float *tmp_buffer, *cp_buffer, *dsp_buffer;
-    DWORD                       tmp_buffer_len, cp_buffer_len, dsp_buffer_len;
+    struct mix_scratch          scratch;
+    struct mix_context         *mixer;
 
     DSVOLUMEPAN                 volpan;
 
@@ -157,6 +170,7 @@ struct IDirectSoundBufferImpl
     float                       firgain;
     LONG64                      freqAdjustNum,freqAdjustDen;
     LONG64                      freqAccNum;
+    DWORD                       format_gen; /* incremented when the format or frequency changes */
     /* used for mixing */
     DWORD                       sec_mixpos;
 
@@ -171,6 +185,8 @@ struct IDirectSoundBufferImpl
     int                         mix_channels;
     bitsgetfunc get, get_aux;
     bitsputfunc put, put_aux;
+    bitsconvfunc                conv;
+    struct mix_scratch         *scratch;
     int                         num_filters;
     DSFilter*                   filters;
 
@@ -248,6 +264,7 @@ void DSOUND_CheckEvent(const IDirectSoundBufferImpl *dsb, DWORD playpos, int len
 void DSOUND_RecalcVolPan(PDSVOLUMEPAN volpan) DECLSPEC_HIDDEN;
 void DSOUND_AmpFactorToVolPan(PDSVOLUMEPAN volpan) DECLSPEC_HIDDEN;
 void DSOUND_RecalcFormat(IDirectSoundBufferImpl *dsb) DECLSPEC_HIDDEN;
+void DSOUND_InitMixer(void) DECLSPEC_HIDDEN;
 DWORD DSOUND_secpos_to_bufpos(const IDirectSoundBufferImpl *dsb, DWORD secpos, DWORD secmixpos, float *overshot) DECLSPEC_HIDDEN;
 
 DWORD CALLBACK DSOUND_mixthread(void *ptr) DECLSPEC_HIDDEN;
@@ -42,6 +42,7 @@
 #include "fir.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(dsound);
+WINE_DECLARE_DEBUG_CHANNEL(dsound_perf);
 
 void DSOUND_RecalcVolPan(PDSVOLUMEPAN volpan)
 {
@@ -132,8 +133,10 @@ void DSOUND_RecalcFormat(IDirectSoundBufferImpl *dsb)
 	dsb->writelead = (dsb->freq / 100) * dsb->pwfx->nBlockAlign;
 
 	dsb->freqAccNum = 0;
+	dsb->format_gen++;
 
 	dsb->get_aux = ieee ? getbpp[4] : getbpp[dsb->pwfx->wBitsPerSample/8 - 1];
+	dsb->conv = ieee ? convbpp[4] : convbpp[dsb->pwfx->wBitsPerSample/8 - 1];
 	dsb->put_aux = putieee32;
 
 	dsb->get = dsb->get_aux;
@@ -278,14 +281,125 @@ static inline float get_current_sample(const IDirectSoundBufferImpl *dsb,
     return dsb->get(dsb, mixpos % dsb->buflen, channel);
 }
 
-static UINT cp_fields_noresample(IDirectSoundBufferImpl *dsb, bitsputfunc put, UINT ostride, UINT count)
+static float getieee32_dsp(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel)
+{
+    const BYTE *buf = (BYTE *)dsb->scratch->dsp_buffer;
+    const float *fbuf = (const float*)(buf + pos + sizeof(float) * channel);
+    return *fbuf;
+}
+
+static void putieee32_dsp(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value)
+{
+    BYTE *buf = (BYTE *)dsb->scratch->dsp_buffer;
+    float *fbuf = (float*)(buf + pos + sizeof(float) * channel);
+    *fbuf = value;
+}
+
+static float *get_cp_buffer(struct mix_scratch *scratch, DWORD len)
+{
+    if (!scratch->cp_buffer) {
+        scratch->cp_buffer = HeapAlloc(GetProcessHeap(), 0, len);
+        scratch->cp_buffer_len = len;
+    } else if (len > scratch->cp_buffer_len) {
+        scratch->cp_buffer = HeapReAlloc(GetProcessHeap(), 0, scratch->cp_buffer, len);
+        scratch->cp_buffer_len = len;
+    }
+    return scratch->cp_buffer;
+}
+
+/**
+ * Returns the float buffer written by put, so that the common case of a
+ * straight copy can store samples directly, or NULL if put remaps channels.
+ */
+static float *get_put_buffer(const IDirectSoundBufferImpl *dsb, bitsputfunc put)
+{
+    if (put == putieee32)
+        return dsb->scratch->tmp_buffer;
+    if (put == putieee32_dsp)
+        return dsb->scratch->dsp_buffer;
+    return NULL;
+}
+
+/**
+ * Fetch count frames, starting at the current mix position, as float.
+ * With interleaved set, the frames are stored as they are in the buffer
+ * (the caller makes sure that mix_channels covers all input channels),
+ * otherwise each mixed channel gets its own row of row_len samples.
+ */
+static void fetch_frames(const IDirectSoundBufferImpl *dsb, float *dst, UINT row_len,
+                         UINT count, BOOL interleaved)
 {
     UINT istride = dsb->pwfx->nBlockAlign;
+    UINT ichannels = dsb->pwfx->nChannels;
+    UINT channels = dsb->mix_channels;
+    DWORD pos = dsb->sec_mixpos;
+    UINT done = 0, i, channel;
+    float stage[1024];
+
+    if (!dsb->conv || dsb->get != dsb->get_aux || ichannels > sizeof(stage) / sizeof(stage[0]) ||
+        istride != ichannels * (dsb->pwfx->wBitsPerSample / 8))
+    {
+        for (i = 0; i < count; i++)
+            for (channel = 0; channel < channels; channel++)
+                dst[interleaved ? i * channels + channel : channel * row_len + i] =
+                    get_current_sample(dsb, pos + i * istride, channel);
+        return;
+    }
+
+    while (done < count) {
+        UINT frames;
+
+        if (pos >= dsb->buflen) {
+            if (!(dsb->playflags & DSBPLAY_LOOPING)) {
+                if (interleaved)
+                    memset(dst + done * channels, 0, (count - done) * channels * sizeof(float));
+                else
+                    for (channel = 0; channel < channels; channel++)
+                        memset(dst + channel * row_len + done, 0, (count - done) * sizeof(float));
+                return;
+            }
+            pos %= dsb->buflen;
+        }
+
+        frames = min(count - done, (dsb->buflen - pos) / istride);
+        if (interleaved || ichannels == 1) {
+            dsb->conv(dsb->buffer->memory + pos, dst + done * ichannels, frames * ichannels);
+        } else {
+            frames = min(frames, (sizeof(stage) / sizeof(stage[0])) / ichannels);
+            dsb->conv(dsb->buffer->memory + pos, stage, frames * ichannels);
+            for (channel = 0; channel < channels; channel++) {
+                float *row = dst + channel * row_len + done;
+                for (i = 0; i < frames; i++)
+                    row[i] = stage[i * ichannels + channel];
+            }
+        }
+        pos += frames * istride;
+        done += frames;
+    }
+}
+
+static UINT cp_fields_noresample(IDirectSoundBufferImpl *dsb, bitsputfunc put, UINT ostride, UINT count)
+{
+    UINT channels = dsb->mix_channels;
+    float *out = get_put_buffer(dsb, put), *intermediate;
     DWORD channel, i;
+
+    if (out && channels == dsb->pwfx->nChannels && ostride == channels * sizeof(float)) {
+        fetch_frames(dsb, out, 0, count, TRUE);
+        return count;
+    }
+
+    intermediate = get_cp_buffer(dsb->scratch, count * channels * sizeof(float));
+    fetch_frames(dsb, intermediate, count, count, FALSE);
+
     for (i = 0; i < count; i++)
-        for (channel = 0; channel < dsb->mix_channels; channel++)
-            put(dsb, i * ostride, channel, get_current_sample(dsb,
-                dsb->sec_mixpos + i * istride, channel));
+        for (channel = 0; channel < channels; channel++) {
+            float value = intermediate[channel * count + i];
+            if (out)
+                out[i * ostride / sizeof(float) + channel] = value;
+            else
+                put(dsb, i * ostride, channel, value);
+        }
     return count;
 }
 
@@ -293,35 +407,36 @@ static UINT cp_fields_resample_lq(IDirectSoundBufferImpl *dsb, bitsputfunc put,
                                   UINT ostride, UINT count, LONG64 *freqAccNum)
 {
     UINT i, channel;
-    UINT istride = dsb->pwfx->nBlockAlign;
     UINT channels = dsb->mix_channels;
+    float *out = get_put_buffer(dsb, put), *intermediate;
 
     LONG64 freqAcc_start = *freqAccNum;
     LONG64 freqAcc_end = freqAcc_start + count * dsb->freqAdjustNum;
     UINT max_ipos = freqAcc_end / dsb->freqAdjustDen;
 
+    /* one more for the second interpolation point, and one more in case
+     * the float position below rounds up */
+    UINT required_input = max_ipos + 3;
+
+    intermediate = get_cp_buffer(dsb->scratch, required_input * channels * sizeof(float));
+    fetch_frames(dsb, intermediate, required_input, required_input, FALSE);
+
     for (i = 0; i < count; ++i) {
         float cur_freqAcc = (freqAcc_start + i * dsb->freqAdjustNum) / (float)dsb->freqAdjustDen;
         float cur_freqAcc2;
         UINT ipos = cur_freqAcc;
-        UINT idx = dsb->sec_mixpos + ipos * istride;
         cur_freqAcc -= (int)cur_freqAcc;
         cur_freqAcc2 = 1.0f - cur_freqAcc;
+
+        assert(ipos + 1 < required_input);
+
         for (channel = 0; channel < channels; channel++) {
-            /**
-             * Generally we cannot cache the result of get_current_sample().
-             * Consider the case of resampling from 192000 Hz to 44100 Hz -
-             * none of the values will get reused for the next value of i.
-             * OTOH, for resampling from 44100 Hz to 192000 Hz both values
-             * will likely be reused.
-             *
-             * So far, this possibility of saving calls to
-             * get_current_sample() is ignored.
-             */
-            float s1 = get_current_sample(dsb, idx, channel);
-            float s2 = get_current_sample(dsb, idx + istride, channel);
-            float result = s1 * cur_freqAcc2 + s2 * cur_freqAcc;
-            put(dsb, i * ostride, channel, result);
+            const float *cache = &intermediate[channel * required_input + ipos];
+            float result = cache[0] * cur_freqAcc2 + cache[1] * cur_freqAcc;
+            if (out)
+                out[i * ostride / sizeof(float) + channel] = result;
+            else
+                put(dsb, i * ostride, channel, result);
         }
     }
 
@@ -333,7 +448,6 @@ static UINT cp_fields_resample_hq(IDirectSoundBufferImpl *dsb, bitsputfunc put,
                                   UINT ostride, UINT count, LONG64 *freqAccNum)
 {
     UINT i, channel;
-    UINT istride = dsb->pwfx->nBlockAlign;
 
     LONG64 freqAcc_start = *freqAccNum;
     LONG64 freqAcc_end = freqAcc_start + count * dsb->freqAdjustNum;
@@ -343,33 +457,22 @@ static UINT cp_fields_resample_hq(IDirectSoundBufferImpl *dsb, bitsputfunc put,
 
     UINT fir_cachesize = (fir_len + dsbfirstep - 2) / dsbfirstep;
     UINT required_input = max_ipos + fir_cachesize;
-    float *intermediate, *fir_copy, *itmp;
+    float *intermediate, *fir_copy;
+    float *out = get_put_buffer(dsb, put);
 
     DWORD len = required_input * channels;
     len += fir_cachesize;
     len *= sizeof(float);
 
-    if (!dsb->device->cp_buffer) {
-        dsb->device->cp_buffer = HeapAlloc(GetProcessHeap(), 0, len);
-        dsb->device->cp_buffer_len = len;
-    } else if (len > dsb->device->cp_buffer_len) {
-        dsb->device->cp_buffer = HeapReAlloc(GetProcessHeap(), 0, dsb->device->cp_buffer, len);
-        dsb->device->cp_buffer_len = len;
-    }
-
-    fir_copy = dsb->device->cp_buffer;
+    fir_copy = get_cp_buffer(dsb->scratch, len);
     intermediate = fir_copy + fir_cachesize;
 
 
     /* Important: this buffer MUST be non-interleaved
-     * if you want -msse3 to have any effect.
+     * if you want the FIR dot product to be vectorized.
      * This is good for CPU cache effects, too.
      */
-    itmp = intermediate;
-    for (channel = 0; channel < channels; channel++)
-        for (i = 0; i < required_input; i++)
-            *(itmp++) = get_current_sample(dsb,
-                    dsb->sec_mixpos + i * istride, channel);
+    fetch_frames(dsb, intermediate, required_input, required_input, FALSE);
 
     for(i = 0; i < count; ++i) {
         UINT int_fir_steps = (freqAcc_start + i * dsb->freqAdjustNum) * dsbfirstep / dsb->freqAdjustDen;
@@ -389,12 +492,17 @@ static UINT cp_fields_resample_hq(IDirectSoundBufferImpl *dsb, bitsputfunc put,
         assert(ipos + fir_used <= required_input);
 
         for (channel = 0; channel < dsb->mix_channels; channel++) {
-            int j;
-            float sum = 0.0;
             float* cache = &intermediate[channel * required_input + ipos];
+            float sum = 0.0;
+            int j;
+
             for (j = 0; j < fir_used; j++)
                 sum += fir_copy[j] * cache[j];
-            put(dsb, i * ostride, channel, sum * dsb->firgain);
+            sum *= dsb->firgain;
+            if (out)
+                out[i * ostride / sizeof(float) + channel] = sum;
+            else
+                put(dsb, i * ostride, channel, sum);
         }
     }
 
@@ -444,20 +552,6 @@ static inline DWORD DSOUND_BufPtrDiff(DWORD buflen, DWORD ptr1, DWORD ptr2)
 	}
 }
 
-static float getieee32_dsp(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel)
-{
-    const BYTE *buf = (BYTE *)dsb->device->dsp_buffer;
-    const float *fbuf = (const float*)(buf + pos + sizeof(float) * channel);
-    return *fbuf;
-}
-
-static void putieee32_dsp(const IDirectSoundBufferImpl *dsb, DWORD pos, DWORD channel, float value)
-{
-    BYTE *buf = (BYTE *)dsb->device->dsp_buffer;
-    float *fbuf = (float*)(buf + pos + sizeof(float) * channel);
-    *fbuf = value;
-}
-
 /**
  * Mix at most the given amount of data into the allocated temporary buffer
  * of the given secondary buffer, starting from the dsb's first currently
@@ -483,28 +577,28 @@ static void DSOUND_MixToTemporary(IDirectSoundBufferImpl *dsb, DWORD frames)
     ostride = dsb->device->pwfx->nChannels * sizeof(float);
     size_bytes = frames * ostride;
 
-    if (dsb->device->tmp_buffer_len < size_bytes || !dsb->device->tmp_buffer) {
-		if (dsb->device->tmp_buffer)
-			dsb->device->tmp_buffer = HeapReAlloc(GetProcessHeap(), 0, dsb->device->tmp_buffer, size_bytes);
+    if (dsb->scratch->tmp_buffer_len < size_bytes || !dsb->scratch->tmp_buffer) {
+		if (dsb->scratch->tmp_buffer)
+			dsb->scratch->tmp_buffer = HeapReAlloc(GetProcessHeap(), 0, dsb->scratch->tmp_buffer, size_bytes);
 		else
-			dsb->device->tmp_buffer = HeapAlloc(GetProcessHeap(), 0, size_bytes);
-        dsb->device->tmp_buffer_len = size_bytes;
+			dsb->scratch->tmp_buffer = HeapAlloc(GetProcessHeap(), 0, size_bytes);
+        dsb->scratch->tmp_buffer_len = size_bytes;
 	}
 
     if(dsb->put_aux == putieee32_sum)
-        memset(dsb->device->tmp_buffer, 0, dsb->device->tmp_buffer_len);
+        memset(dsb->scratch->tmp_buffer, 0, dsb->scratch->tmp_buffer_len);
 
     if (using_filters) {
         put = putieee32_dsp;
         ostride = dsb->mix_channels * sizeof(float);
         size_bytes = frames * ostride;
 
-        if (dsb->device->dsp_buffer_len < size_bytes || !dsb->device->dsp_buffer) {
-            if (dsb->device->dsp_buffer)
-                dsb->device->dsp_buffer = HeapReAlloc(GetProcessHeap(), 0, dsb->device->dsp_buffer, size_bytes);
+        if (dsb->scratch->dsp_buffer_len < size_bytes || !dsb->scratch->dsp_buffer) {
+            if (dsb->scratch->dsp_buffer)
+                dsb->scratch->dsp_buffer = HeapReAlloc(GetProcessHeap(), 0, dsb->scratch->dsp_buffer, size_bytes);
             else
-                dsb->device->dsp_buffer = HeapAlloc(GetProcessHeap(), 0, size_bytes);
-            dsb->device->dsp_buffer_len = size_bytes;
+                dsb->scratch->dsp_buffer = HeapAlloc(GetProcessHeap(), 0, size_bytes);
+            dsb->scratch->dsp_buffer_len = size_bytes;
         }
     }
 
@@ -515,7 +609,7 @@ static void DSOUND_MixToTemporary(IDirectSoundBufferImpl *dsb, DWORD frames)
             for (i = 0; i < dsb->num_filters; i++) {
                 if (dsb->filters[i].inplace) {
                     hr = IMediaObjectInPlace_Process(dsb->filters[i].inplace, frames * sizeof(float) * dsb->mix_channels,
-                                                     (BYTE *)dsb->device->dsp_buffer, 0, DMO_INPLACE_NORMAL);
+                                                     (BYTE *)dsb->scratch->dsp_buffer, 0, DMO_INPLACE_NORMAL);
                     if (FAILED(hr))
                         WARN("IMediaObjectInPlace_Process failed for filter %u\n", i);
                 } else
@@ -524,7 +618,7 @@ static void DSOUND_MixToTemporary(IDirectSoundBufferImpl *dsb, DWORD frames)
         }
 
         if (dsb->device->eax.using_eax)
-            process_eax_buffer(dsb, dsb->device->dsp_buffer, frames * dsb->mix_channels);
+            process_eax_buffer(dsb, dsb->scratch->dsp_buffer, frames * dsb->mix_channels);
 
         istride = ostride;
         ostride = dsb->device->pwfx->nChannels * sizeof(float);
@@ -540,7 +634,7 @@ static void DSOUND_MixerVol(const IDirectSoundBufferImpl *dsb, INT frames)
 {
 	INT	i;
 	float vols[DS_MAX_CHANNELS];
-	UINT channels = dsb->device->pwfx->nChannels, chan;
+	UINT channels = dsb->device->pwfx->nChannels;
 
 	TRACE("(%p,%d)\n",dsb,frames);
 	TRACE("left = %x, right = %x\n", dsb->volpan.dwTotalAmpFactor[0],
@@ -560,11 +654,7 @@ static void DSOUND_MixerVol(const IDirectSoundBufferImpl *dsb, INT frames)
 	for (i = 0; i < channels; ++i)
 		vols[i] = dsb->volpan.dwTotalAmpFactor[i] / ((float)0xFFFF);
 
-	for(i = 0; i < frames; ++i){
-		for(chan = 0; chan < channels; ++chan){
-			dsb->device->tmp_buffer[i * channels + chan] *= vols[chan];
-		}
-	}
+	mixvolume(dsb->scratch->tmp_buffer, vols, channels, frames);
 }
 
 /**
@@ -584,7 +674,6 @@ static DWORD DSOUND_MixInBuffer(IDirectSoundBufferImpl *dsb, float *mix_buffer,
 {
 	INT len = fraglen;
 	float *ibuf;
-	DWORD oldpos;
 	UINT frames = fraglen / dsb->device->pwfx->nBlockAlign;
 
 	TRACE("sec_mixpos=%d/%d\n", dsb->sec_mixpos, dsb->buflen);
@@ -597,25 +686,25 @@ static DWORD DSOUND_MixInBuffer(IDirectSoundBufferImpl *dsb, float *mix_buffer,
 	}
 
 	/* Resample buffer to temporary buffer specifically allocated for this purpose, if needed */
-	oldpos = dsb->sec_mixpos;
 	DSOUND_MixToTemporary(dsb, frames);
-	ibuf = dsb->device->tmp_buffer;
+	ibuf = dsb->scratch->tmp_buffer;
 
 	/* Apply volume if needed */
 	DSOUND_MixerVol(dsb, frames);
 
 	mixieee32(ibuf, mix_buffer, frames * dsb->device->pwfx->nChannels);
 
-	/* check for notification positions */
-	if (dsb->dsbd.dwFlags & DSBCAPS_CTRLPOSITIONNOTIFY &&
-	    dsb->state != STATE_STARTING) {
-		INT ilen = DSOUND_BufPtrDiff(dsb->buflen, dsb->sec_mixpos, oldpos);
-		DSOUND_CheckEvent(dsb, oldpos, ilen);
-	}
-
 	return len;
 }
 
+/**
+ * Select the mixing kernels for this CPU.
+ */
+void DSOUND_InitMixer(void)
+{
+    TRACE("using %s mixing kernels\n", init_mixer_kernels());
+}
+
 /**
  * Mix some frames from the given secondary buffer "dsb" into the device
  * primary buffer.
@@ -626,11 +715,12 @@ static DWORD DSOUND_MixInBuffer(IDirectSoundBufferImpl *dsb, float *mix_buffer,
  * mixlen = the maximum number of bytes in the primary buffer to mix, from the
  *          current writepos.
  *
- * Returns: the number of bytes beyond the writepos that were mixed.
+ * Returns: the position in the secondary buffer that mixing started from.
  */
 static DWORD DSOUND_MixOne(IDirectSoundBufferImpl *dsb, float *mix_buffer, DWORD writepos, DWORD mixlen)
 {
 	DWORD primary_done = 0;
+	DWORD oldpos;
 
 	TRACE("(%p,%d,%d)\n",dsb,writepos,mixlen);
 	TRACE("writepos=%d, mixlen=%d\n", writepos, mixlen);
@@ -655,18 +745,314 @@ static DWORD DSOUND_MixOne(IDirectSoundBufferImpl *dsb, float *mix_buffer, DWORD
 	/* First try to mix to the end of the buffer if possible
 	 * Theoretically it would allow for better optimization
 	*/
+	oldpos = dsb->sec_mixpos;
 	primary_done += DSOUND_MixInBuffer(dsb, mix_buffer, writepos, mixlen);
 
 	TRACE("total mixed data=%d\n", primary_done);
 
-	/* Report back the total prebuffered amount for this buffer */
-	return primary_done;
+	return oldpos;
+}
+
+/**
+ * Signal the notifications for the secondary buffer range mixed since oldpos.
+ */
+static void DSOUND_CheckMixedEvents(const IDirectSoundBufferImpl *dsb, DWORD oldpos)
+{
+	if (dsb->dsbd.dwFlags & DSBCAPS_CTRLPOSITIONNOTIFY &&
+	    dsb->state != STATE_STARTING) {
+		INT ilen = DSOUND_BufPtrDiff(dsb->buflen, dsb->sec_mixpos, oldpos);
+		DSOUND_CheckEvent(dsb, oldpos, ilen);
+	}
+}
+
+#define DS_MAX_MIX_WORKERS 3
+/* fewer buffers are not worth waking up other threads for */
+#define DS_MIN_PARALLEL_BUFFERS 4
+#define DS_MIX_STATS_PERIODS 1000
+
+/* A secondary buffer mixed in the current period. The snapshot is a copy of
+ * the buffer taken under its lock; only the fields used for mixing are
+ * meaningful in it, and the mixing threads work on it without any lock. */
+struct mix_source
+{
+    IDirectSoundBufferImpl *dsb;
+    IDirectSoundBufferImpl snapshot;
+    DWORD mixpos;   /* dsb->sec_mixpos when the snapshot was taken */
+    DWORD startpos; /* position mixing started from, after lead-in */
+};
+
+struct mix_worker
+{
+    struct mix_context *ctx;
+    HANDLE thread, start_event;
+    UINT index;
+    struct mix_scratch scratch;
+    float *partial;
+    DWORD partial_len;
+};
+
+struct mix_context
+{
+    DirectSoundDevice *device;
+    struct mix_source *sources;
+    UINT nrofsources, sources_size;
+
+    /* worker threads, started when there is first enough to mix */
+    struct mix_worker workers[DS_MAX_MIX_WORKERS];
+    UINT nrofworkers;
+    BOOL workers_started;
+    HANDLE done_event;
+    LONG pending;
+    BOOL quit;
+
+    /* the current period, shared between the mixer thread and the workers */
+    UINT nrofthreads;
+    DWORD writepos, mixlen;
+
+    /* mixing time statistics */
+    LARGE_INTEGER freq;
+    UINT periods, overruns;
+    LONGLONG total_ticks, max_ticks;
+};
+
+static struct mix_context *create_mix_context(DirectSoundDevice *device)
+{
+    struct mix_context *ctx;
+
+    if (!(ctx = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ctx))))
+        return NULL;
+    ctx->device = device;
+    QueryPerformanceFrequency(&ctx->freq);
+    return ctx;
+}
+
+static void destroy_mix_context(struct mix_context *ctx)
+{
+    UINT i;
+
+    if (!ctx)
+        return;
+
+    ctx->quit = TRUE;
+    for (i = 0; i < ctx->nrofworkers; i++) {
+        struct mix_worker *worker = &ctx->workers[i];
+
+        SetEvent(worker->start_event);
+        WaitForSingleObject(worker->thread, INFINITE);
+        CloseHandle(worker->thread);
+        CloseHandle(worker->start_event);
+        HeapFree(GetProcessHeap(), 0, worker->scratch.tmp_buffer);
+        HeapFree(GetProcessHeap(), 0, worker->scratch.cp_buffer);
+        HeapFree(GetProcessHeap(), 0, worker->scratch.dsp_buffer);
+        HeapFree(GetProcessHeap(), 0, worker->partial);
+    }
+    if (ctx->done_event)
+        CloseHandle(ctx->done_event);
+    HeapFree(GetProcessHeap(), 0, ctx->sources);
+    HeapFree(GetProcessHeap(), 0, ctx);
+}
+
+static BOOL reserve_mix_sources(struct mix_context *ctx, UINT count)
+{
+    struct mix_source *sources;
+
+    if (count <= ctx->sources_size)
+        return TRUE;
+
+    if (ctx->sources)
+        sources = HeapReAlloc(GetProcessHeap(), 0, ctx->sources, count * sizeof(*sources));
+    else
+        sources = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*sources));
+    if (!sources)
+        return FALSE;
+
+    ctx->sources = sources;
+    ctx->sources_size = count;
+    return TRUE;
+}
+
+/**
+ * Mix every nrofthreads-th snapshot, starting at index, into mix_buffer.
+ */
+static void mix_sources(struct mix_context *ctx, UINT index, float *mix_buffer, struct mix_scratch *scratch)
+{
+    UINT i;
+
+    for (i = index; i < ctx->nrofsources; i += ctx->nrofthreads) {
+        struct mix_source *source = &ctx->sources[i];
+
+        source->snapshot.scratch = scratch;
+        source->startpos = DSOUND_MixOne(&source->snapshot, mix_buffer, ctx->writepos, ctx->mixlen);
+    }
+}
+
+static DWORD CALLBACK DSOUND_mixworker(void *p)
+{
+    struct mix_worker *worker = p;
+    struct mix_context *ctx = worker->ctx;
+    DWORD len;
+
+    TRACE("(%p)\n", worker);
+
+    for (;;) {
+        WaitForSingleObject(worker->start_event, INFINITE);
+        if (ctx->quit)
+            break;
+
+        /* the partial mix is in the float format of the mix buffer */
+        len = ctx->mixlen / ctx->device->pwfx->nBlockAlign * ctx->device->pwfx->nChannels * sizeof(float);
+        memset(worker->partial, 0, len);
+
+        mix_sources(ctx, worker->index, worker->partial, &worker->scratch);
+
+        if (!InterlockedDecrement(&ctx->pending))
+            SetEvent(ctx->done_event);
+    }
+
+    return 0;
+}
+
+/**
+ * Make sure the partial mix buffer of a worker holds len bytes.
+ */
+static BOOL reserve_partial_mix(struct mix_worker *worker, DWORD len)
+{
+    float *partial;
+
+    if (worker->partial_len >= len)
+        return TRUE;
+
+    if (!(partial = HeapAlloc(GetProcessHeap(), 0, len)))
+        return FALSE;
+    HeapFree(GetProcessHeap(), 0, worker->partial);
+    worker->partial = partial;
+    worker->partial_len = len;
+    return TRUE;
+}
+
+static void start_mix_workers(struct mix_context *ctx)
+{
+    int priority = GetThreadPriority(GetCurrentThread());
+    SYSTEM_INFO si;
+    UINT count;
+
+    ctx->workers_started = TRUE;
+
+    GetSystemInfo(&si);
+    count = min(si.dwNumberOfProcessors - 1, DS_MAX_MIX_WORKERS);
+    if (!count || !(ctx->done_event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+        return;
+
+    while (ctx->nrofworkers < count) {
+        struct mix_worker *worker = &ctx->workers[ctx->nrofworkers];
+
+        worker->ctx = ctx;
+        worker->index = ctx->nrofworkers + 1;
+        if (!(worker->start_event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+            break;
+        if (!(worker->thread = CreateThread(NULL, 0, DSOUND_mixworker, worker, 0, NULL))) {
+            CloseHandle(worker->start_event);
+            break;
+        }
+        SetThreadPriority(worker->thread, priority);
+        ctx->nrofworkers++;
+    }
+
+    TRACE("started %u mixing threads\n", ctx->nrofworkers);
+}
+
+/**
+ * Mix the snapshots of the current period into mix_buffer, sharing them
+ * out between the mixer thread and the workers. Each worker mixes into its
+ * own partial buffer, which are then added up in a fixed order.
+ */
+static void mix_snapshots(struct mix_context *ctx, float *mix_buffer)
+{
+    UINT i, samples = ctx->mixlen / ctx->device->pwfx->nBlockAlign * ctx->device->pwfx->nChannels;
+
+    ctx->nrofthreads = 1;
+    if (ctx->nrofsources >= DS_MIN_PARALLEL_BUFFERS) {
+        if (!ctx->workers_started)
+            start_mix_workers(ctx);
+        ctx->nrofthreads = min(ctx->nrofworkers + 1, ctx->nrofsources / 2);
+    }
+
+    /* workers without a buffer for their partial mix leave their share to the others */
+    for (i = 1; i < ctx->nrofthreads; i++) {
+        if (!reserve_partial_mix(&ctx->workers[i - 1], samples * sizeof(float))) {
+            WARN("out of memory, mixing on %u threads\n", i);
+            ctx->nrofthreads = i;
+            break;
+        }
+    }
+
+    ctx->pending = ctx->nrofthreads - 1;
+    for (i = 1; i < ctx->nrofthreads; i++)
+        SetEvent(ctx->workers[i - 1].start_event);
+
+    mix_sources(ctx, 0, mix_buffer, &ctx->device->scratch);
+
+    if (ctx->nrofthreads > 1) {
+        WaitForSingleObject(ctx->done_event, INFINITE);
+        for (i = 1; i < ctx->nrofthreads; i++)
+            mixieee32(ctx->workers[i - 1].partial, mix_buffer, samples);
+    }
+}
+
+/**
+ * Write the new mixing position of a snapshot back to its buffer, unless
+ * the application has moved the buffer or changed its frequency while it
+ * was being mixed. The resampler state of the snapshot doesn't apply to
+ * the new frequency, the next period mixes again from the old position.
+ */
+static void commit_mix_source(struct mix_source *source)
+{
+    IDirectSoundBufferImpl *dsb = source->dsb;
+
+    RtlAcquireResourceShared(&dsb->lock, TRUE);
+    if (dsb->sec_mixpos == source->mixpos && dsb->format_gen == source->snapshot.format_gen) {
+        dsb->sec_mixpos = source->snapshot.sec_mixpos;
+        dsb->freqAccNum = source->snapshot.freqAccNum;
+        dsb->leadin = source->snapshot.leadin;
+        if (source->snapshot.state == STATE_STOPPED)
+            dsb->state = STATE_STOPPED;
+        DSOUND_CheckMixedEvents(dsb, source->startpos);
+    }
+    RtlReleaseResource(&dsb->lock);
+}
+
+static void record_mix_time(struct mix_context *ctx, LONGLONG ticks, DWORD frames)
+{
+    /* the time it takes the device to play what has been mixed */
+    LONGLONG budget = frames * ctx->freq.QuadPart / ctx->device->pwfx->nSamplesPerSec;
+
+    ctx->periods++;
+    ctx->total_ticks += ticks;
+    if (ticks > ctx->max_ticks)
+        ctx->max_ticks = ticks;
+    if (ticks > budget)
+        ctx->overruns++;
+
+    if (ctx->periods < DS_MIX_STATS_PERIODS)
+        return;
+
+    TRACE_(dsound_perf)("%p: %u periods, %u buffers, %u threads: mix time average %.1f us, max %.1f us, %u overruns\n",
+            ctx->device, ctx->periods, ctx->device->nrofbuffers, ctx->nrofthreads,
+            ctx->total_ticks * 1000000.0 / ctx->periods / ctx->freq.QuadPart,
+            ctx->max_ticks * 1000000.0 / ctx->freq.QuadPart, ctx->overruns);
+    ctx->periods = ctx->overruns = 0;
+    ctx->total_ticks = ctx->max_ticks = 0;
 }
 
 /**
  * For a DirectSoundDevice, go through all the currently playing buffers and
  * mix them in to the device buffer.
  *
+ * Buffers are snapshotted under their lock, mixed without it, possibly on
+ * several threads, and their new positions written back afterwards.
+ * Buffers with DMO filters or EAX keep their DSP state in the buffer itself
+ * and are mixed in place instead.
+ *
  * writepos = the current safe-to-write position in the primary buffer
  * mixlen = the maximum amount to mix into the primary buffer
  *          (beyond the current writepos)
@@ -675,14 +1061,23 @@ static DWORD DSOUND_MixOne(IDirectSoundBufferImpl *dsb, float *mix_buffer, DWORD
  * Returns:  the length beyond the writepos that was mixed to.
  */
 
-static void DSOUND_MixToPrimary(const DirectSoundDevice *device, float *mix_buffer, DWORD writepos, DWORD mixlen, BOOL *all_stopped)
+static void DSOUND_MixToPrimary(DirectSoundDevice *device, float *mix_buffer, DWORD writepos, DWORD mixlen, BOOL *all_stopped)
 {
+	struct mix_context *ctx = device->mixer;
+	BOOL snapshots;
 	INT i;
 	IDirectSoundBufferImpl	*dsb;
 
 	/* unless we find a running buffer, all have stopped */
 	*all_stopped = TRUE;
 
+	snapshots = ctx && reserve_mix_sources(ctx, device->nrofbuffers);
+	if (ctx) {
+		ctx->nrofsources = 0;
+		ctx->writepos = writepos;
+		ctx->mixlen = mixlen;
+	}
+
 	TRACE("(%d,%d)\n", writepos, mixlen);
 	for (i = 0; i < device->nrofbuffers; i++) {
 		dsb = device->buffers[i];
@@ -702,14 +1097,32 @@ static void DSOUND_MixToPrimary(const DirectSoundDevice *device, float *mix_buff
 				if (dsb->state == STATE_STARTING)
 					dsb->state = STATE_PLAYING;
 
-				/* mix next buffer into the main buffer */
-				DSOUND_MixOne(dsb, mix_buffer, writepos, mixlen);
+				if (snapshots && !dsb->num_filters && !device->eax.using_eax) {
+					struct mix_source *source = &ctx->sources[ctx->nrofsources++];
+
+					source->dsb = dsb;
+					source->snapshot = *dsb;
+					source->mixpos = dsb->sec_mixpos;
+				} else {
+					/* mix next buffer into the main buffer */
+					DWORD oldpos;
+
+					dsb->scratch = &device->scratch;
+					oldpos = DSOUND_MixOne(dsb, mix_buffer, writepos, mixlen);
+					DSOUND_CheckMixedEvents(dsb, oldpos);
+				}
 
 				*all_stopped = FALSE;
 			}
 			RtlReleaseResource(&dsb->lock);
 		}
 	}
+
+	if (ctx && ctx->nrofsources) {
+		mix_snapshots(ctx, mix_buffer);
+		for (i = 0; i < ctx->nrofsources; i++)
+			commit_mix_source(&ctx->sources[i]);
+	}
 }
 
 /**
@@ -755,8 +1168,8 @@ static void DSOUND_WaveQueue(DirectSoundDevice *device, LPBYTE pos, DWORD bytes)
  * The mixing procedure goes:
  *
  * secondary->buffer (secondary format)
- *   =[Resample]=> device->tmp_buffer (float format)
- *   =[Volume]=> device->tmp_buffer (float format)
+ *   =[Resample]=> scratch->tmp_buffer (float format)
+ *   =[Volume]=> scratch->tmp_buffer (float format)
  *   =[Reformat]=> device->buffer (device format, skipped on float)
  */
 static void DSOUND_PerformMix(DirectSoundDevice *device)
@@ -795,6 +1208,7 @@ static void DSOUND_PerformMix(DirectSoundDevice *device)
 
 	if (device->priolevel != DSSCL_WRITEPRIMARY) {
 		BOOL all_stopped = FALSE;
+		LARGE_INTEGER start, end;
 		int nfiller;
 		void *buffer = NULL;
 
@@ -815,6 +1229,8 @@ static void DSOUND_PerformMix(DirectSoundDevice *device)
 
 		memset(buffer, nfiller, maxq);
 
+		QueryPerformanceCounter(&start);
+
 		if (!device->normfunction)
 			DSOUND_MixToPrimary(device, buffer, writepos, maxq, &all_stopped);
 		else {
@@ -826,6 +1242,10 @@ static void DSOUND_PerformMix(DirectSoundDevice *device)
 			device->normfunction(device->buffer, buffer, maxq);
 		}
 
+		QueryPerformanceCounter(&end);
+		if (device->mixer)
+			record_mix_time(device->mixer, end.QuadPart - start.QuadPart, maxq / block);
+
 		hr = IAudioRenderClient_ReleaseBuffer(device->render, maxq / block, 0);
 		if(FAILED(hr))
 			ERR("ReleaseBuffer failed: %08x\n", hr);
@@ -850,6 +1270,8 @@ DWORD CALLBACK DSOUND_mixthread(void *p)
 	DirectSoundDevice *dev = p;
 	TRACE("(%p)\n", dev);
 
+	dev->mixer = create_mix_context(dev);
+
 	while (dev->ref) {
 		DWORD ret;
 
@@ -869,6 +1291,10 @@ DWORD CALLBACK DSOUND_mixthread(void *p)
 		DSOUND_PerformMix(dev);
 		RtlReleaseResource(&(dev->buffer_list_lock));
 	}
+
+	destroy_mix_context(dev->mixer);
+	dev->mixer = NULL;
+
 	SetEvent(dev->thread_finished);
 	return 0;
 }
@@ -18,8 +18,16 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include "config.h"
+
 #include <assert.h>
 
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(WORDS_BIGENDIAN) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_PRIMITIVES_SIMD
+#include <immintrin.h>
+#endif
+
 #include "gdi_private.h"
 #include "dibdrv.h"
 
@@ -27,6 +35,27 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(dib);
 
+/* Row kernels behind the hottest 32 and 16 bpp primitives. The C versions
+ * are the reference; the SSE2 and AVX2 versions at the end of this file
+ * produce identical pixels and are selected by init_dib_primitives(). */
+struct row_funcs
+{
+    void                     (* rop_32)(DWORD *ptr, int len, DWORD and, DWORD xor);
+    void                     (* rop_16)(WORD *ptr, int len, WORD and, WORD xor);
+    void                 (* blend_argb)(DWORD *dst, const DWORD *src, int len);
+    void           (* blend_argb_alpha)(DWORD *dst, const DWORD *src, int len, DWORD alpha);
+    void  (* blend_argb_constant_alpha)(DWORD *dst, const DWORD *src, int len, DWORD alpha);
+    void    (* blend_argb_no_src_alpha)(DWORD *dst, const DWORD *src, int len, DWORD alpha);
+    void        (* convert_555_to_8888)(DWORD *dst, const WORD *src, int len);
+    void        (* convert_565_to_8888)(DWORD *dst, const WORD *src, int len, const dib_info *src_dib);
+    void         (* convert_32_to_8888)(DWORD *dst, const DWORD *src, int len, const dib_info *src_dib);
+    void        (* convert_8888_to_555)(WORD *dst, const DWORD *src, int len);
+    void         (* convert_8888_to_16)(WORD *dst, const DWORD *src, int len, const dib_info *dst_dib);
+};
+
+static const struct row_funcs scalar_row_funcs;
+static const struct row_funcs *row_funcs = &scalar_row_funcs;
+
 /* Bayer matrices for dithering */
 
 static const BYTE bayer_4x4[4][4] =
@@ -144,6 +173,16 @@ static inline void do_rop_8(BYTE *ptr, BYTE and, BYTE xor)
     *ptr = (*ptr & and) ^ xor;
 }
 
+static void rop_row_32(DWORD *ptr, int len, DWORD and, DWORD xor)
+{
+    while (len-- > 0) do_rop_32(ptr++, and, xor);
+}
+
+static void rop_row_16(WORD *ptr, int len, WORD and, WORD xor)
+{
+    while (len-- > 0) do_rop_16(ptr++, and, xor);
+}
+
 static inline void do_rop_mask_8(BYTE *ptr, BYTE and, BYTE xor, BYTE mask)
 {
     *ptr = (*ptr & (and | ~mask)) ^ (xor & mask);
@@ -263,8 +302,8 @@ static inline void memset_16( WORD *start, WORD val, DWORD size )
 
 static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    DWORD *ptr, *start;
-    int x, y, i;
+    DWORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -273,8 +312,7 @@ static void solid_rects_32(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_32(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_32(ptr++, and, xor);
+                row_funcs->rop_32( start, rc->right - rc->left, and, xor );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 4)
                 memset_32( start, xor, rc->right - rc->left );
@@ -414,8 +452,8 @@ static void solid_rects_24(const dib_info *dib, int num, const RECT *rc, DWORD a
 
 static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD and, DWORD xor)
 {
-    WORD *ptr, *start;
-    int x, y, i;
+    WORD *start;
+    int y, i;
 
     for(i = 0; i < num; i++, rc++)
     {
@@ -424,8 +462,7 @@ static void solid_rects_16(const dib_info *dib, int num, const RECT *rc, DWORD a
         start = get_pixel_ptr_16(dib, rc->left, rc->top);
         if (and)
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
-                for(x = rc->left, ptr = start; x < rc->right; x++)
-                    do_rop_16(ptr++, and, xor);
+                row_funcs->rop_16( start, rc->right - rc->left, and, xor );
         else
             for(y = rc->top; y < rc->bottom; y++, start += dib->stride / 2)
                 memset_16( start, xor, rc->right - rc->left );
@@ -2082,6 +2119,74 @@ static inline DWORD put_field(DWORD field, int shift, int len)
     return field;
 }
 
+static void convert_row_555_to_8888(DWORD *dst, const WORD *src, int len)
+{
+    DWORD src_val;
+
+    while (len-- > 0)
+    {
+        src_val = *src++;
+        *dst++ = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
+                 ((src_val << 6) & 0x00f800) | ((src_val << 1) & 0x000700) |
+                 ((src_val << 3) & 0x0000f8) | ((src_val >> 2) & 0x000007);
+    }
+}
+
+static void convert_row_565_to_8888(DWORD *dst, const WORD *src, int len, const dib_info *src_dib)
+{
+    DWORD src_val;
+
+    while (len-- > 0)
+    {
+        src_val = *src++;
+        *dst++ = (((src_val >> src_dib->red_shift)   << 19) & 0xf80000) |
+                 (((src_val >> src_dib->red_shift)   << 14) & 0x070000) |
+                 (((src_val >> src_dib->green_shift) << 10) & 0x00fc00) |
+                 (((src_val >> src_dib->green_shift) <<  4) & 0x000300) |
+                 (((src_val >> src_dib->blue_shift)  <<  3) & 0x0000f8) |
+                 (((src_val >> src_dib->blue_shift)  >>  2) & 0x000007);
+    }
+}
+
+static void convert_row_32_to_8888(DWORD *dst, const DWORD *src, int len, const dib_info *src_dib)
+{
+    DWORD src_val;
+
+    while (len-- > 0)
+    {
+        src_val = *src++;
+        *dst++ = (((src_val >> src_dib->red_shift)   & 0xff) << 16) |
+                 (((src_val >> src_dib->green_shift) & 0xff) <<  8) |
+                  ((src_val >> src_dib->blue_shift)  & 0xff);
+    }
+}
+
+static void convert_row_8888_to_555(WORD *dst, const DWORD *src, int len)
+{
+    DWORD src_val;
+
+    while (len-- > 0)
+    {
+        src_val = *src++;
+        *dst++ = ((src_val >> 9) & 0x7c00) |
+                 ((src_val >> 6) & 0x03e0) |
+                 ((src_val >> 3) & 0x001f);
+    }
+}
+
+static void convert_row_8888_to_16(WORD *dst, const DWORD *src, int len, const dib_info *dst_dib)
+{
+    DWORD src_val;
+
+    while (len-- > 0)
+    {
+        src_val = *src++;
+        *dst++ = put_field(src_val >> 16, dst_dib->red_shift,   dst_dib->red_len)   |
+                 put_field(src_val >>  8, dst_dib->green_shift, dst_dib->green_len) |
+                 put_field(src_val,       dst_dib->blue_shift,  dst_dib->blue_len);
+    }
+}
+
 static DWORD colorref_to_pixel_masks(const dib_info *dib, COLORREF colour)
 {
     DWORD r,g,b;
@@ -2233,16 +2338,8 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
-                {
-                    src_val = *src_pixel++;
-                    *dst_pixel++ = (((src_val >> src->red_shift)   & 0xff) << 16) |
-                                   (((src_val >> src->green_shift) & 0xff) <<  8) |
-                                    ((src_val >> src->blue_shift)  & 0xff);
-                }
-                if(pad_size) memset(dst_pixel, 0, pad_size);
+                row_funcs->convert_32_to_8888( dst_start, src_start, src_rect->right - src_rect->left, src );
+                if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
                 dst_start += dst->stride / 4;
                 src_start += src->stride / 4;
             }
@@ -2299,16 +2396,8 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
-                {
-                    src_val = *src_pixel++;
-                    *dst_pixel++ = ((src_val << 9) & 0xf80000) | ((src_val << 4) & 0x070000) |
-                                   ((src_val << 6) & 0x00f800) | ((src_val << 1) & 0x000700) |
-                                   ((src_val << 3) & 0x0000f8) | ((src_val >> 2) & 0x000007);
-                }
-                if(pad_size) memset(dst_pixel, 0, pad_size);
+                row_funcs->convert_555_to_8888( dst_start, src_start, src_rect->right - src_rect->left );
+                if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
                 dst_start += dst->stride / 4;
                 src_start += src->stride / 2;
             }
@@ -2338,19 +2427,8 @@ static void convert_to_8888(dib_info *dst, const dib_info *src, const RECT *src_
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
-                {
-                    src_val = *src_pixel++;
-                    *dst_pixel++ = (((src_val >> src->red_shift)   << 19) & 0xf80000) |
-                                   (((src_val >> src->red_shift)   << 14) & 0x070000) |
-                                   (((src_val >> src->green_shift) << 10) & 0x00fc00) |
-                                   (((src_val >> src->green_shift) <<  4) & 0x000300) |
-                                   (((src_val >> src->blue_shift)  <<  3) & 0x0000f8) |
-                                   (((src_val >> src->blue_shift)  >>  2) & 0x000007);
-                }
-                if(pad_size) memset(dst_pixel, 0, pad_size);
+                row_funcs->convert_565_to_8888( dst_start, src_start, src_rect->right - src_rect->left, src );
+                if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
                 dst_start += dst->stride / 4;
                 src_start += src->stride / 2;
             }
@@ -3000,16 +3078,8 @@ static void convert_to_555(dib_info *dst, const dib_info *src, const RECT *src_r
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
-                {
-                    src_val = *src_pixel++;
-                    *dst_pixel++ = ((src_val >> 9) & 0x7c00) |
-                                   ((src_val >> 6) & 0x03e0) |
-                                   ((src_val >> 3) & 0x001f);
-                }
-                if(pad_size) memset(dst_pixel, 0, pad_size);
+                row_funcs->convert_8888_to_555( dst_start, src_start, src_rect->right - src_rect->left );
+                if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
                 dst_start += dst->stride / 2;
                 src_start += src->stride / 4;
             }
@@ -3255,16 +3325,8 @@ static void convert_to_16(dib_info *dst, const dib_info *src, const RECT *src_re
         {
             for(y = src_rect->top; y < src_rect->bottom; y++)
             {
-                dst_pixel = dst_start;
-                src_pixel = src_start;
-                for(x = src_rect->left; x < src_rect->right; x++)
-                {
-                    src_val = *src_pixel++;
-                    *dst_pixel++ = put_field(src_val >> 16, dst->red_shift,   dst->red_len)   |
-                                   put_field(src_val >>  8, dst->green_shift, dst->green_len) |
-                                   put_field(src_val,       dst->blue_shift,  dst->blue_len);
-                }
-                if(pad_size) memset(dst_pixel, 0, pad_size);
+                row_funcs->convert_8888_to_16( dst_start, src_start, src_rect->right - src_rect->left, dst );
+                if(pad_size) memset(dst_start + (src_rect->right - src_rect->left), 0, pad_size);
                 dst_start += dst->stride / 2;
                 src_start += src->stride / 4;
             }
@@ -4672,6 +4734,38 @@ static inline DWORD blend_argb_alpha( DWORD dst, DWORD src, DWORD alpha )
             (alpha + ((BYTE)(dst >> 24) * (255 - alpha) + 127) / 255) << 24);
 }
 
+static void blend_row_argb( DWORD *dst, const DWORD *src, int len )
+{
+    int x;
+
+    for (x = 0; x < len; x++)
+        dst[x] = blend_argb( dst[x], src[x] );
+}
+
+static void blend_row_argb_alpha( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    int x;
+
+    for (x = 0; x < len; x++)
+        dst[x] = blend_argb_alpha( dst[x], src[x], alpha );
+}
+
+static void blend_row_argb_constant_alpha( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    int x;
+
+    for (x = 0; x < len; x++)
+        dst[x] = blend_argb_constant_alpha( dst[x], src[x], alpha );
+}
+
+static void blend_row_argb_no_src_alpha( DWORD *dst, const DWORD *src, int len, DWORD alpha )
+{
+    int x;
+
+    for (x = 0; x < len; x++)
+        dst[x] = blend_argb_no_src_alpha( dst[x], src[x], alpha );
+}
+
 static inline DWORD blend_rgb( BYTE dst_r, BYTE dst_g, BYTE dst_b, DWORD src, BLENDFUNCTION blend )
 {
     if (blend.AlphaFormat & AC_SRC_ALPHA)
@@ -4695,27 +4789,23 @@ static void blend_rect_8888(const dib_info *dst, const RECT *rc,
 {
     DWORD *src_ptr = get_pixel_ptr_32( src, origin->x, origin->y );
     DWORD *dst_ptr = get_pixel_ptr_32( dst, rc->left, rc->top );
-    int x, y;
+    int y, len = rc->right - rc->left;
 
     if (blend.AlphaFormat & AC_SRC_ALPHA)
     {
 	if (blend.SourceConstantAlpha == 255)
 	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
-		    dst_ptr[x] = blend_argb( dst_ptr[x], src_ptr[x] );
+		row_funcs->blend_argb( dst_ptr, src_ptr, len );
         else
 	    for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-		for (x = 0; x < rc->right - rc->left; x++)
-		    dst_ptr[x] = blend_argb_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+		row_funcs->blend_argb_alpha( dst_ptr, src_ptr, len, blend.SourceConstantAlpha );
     }
     else if (src->compression == BI_RGB)
 	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
-		dst_ptr[x] = blend_argb_constant_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+	    row_funcs->blend_argb_constant_alpha( dst_ptr, src_ptr, len, blend.SourceConstantAlpha );
     else
 	for (y = rc->top; y < rc->bottom; y++, dst_ptr += dst->stride / 4, src_ptr += src->stride / 4)
-	    for (x = 0; x < rc->right - rc->left; x++)
-		dst_ptr[x] = blend_argb_no_src_alpha( dst_ptr[x], src_ptr[x], blend.SourceConstantAlpha );
+	    row_funcs->blend_argb_no_src_alpha( dst_ptr, src_ptr, len, blend.SourceConstantAlpha );
 }
 
 static void blend_rect_32(const dib_info *dst, const RECT *rc,
@@ -7590,3 +7680,673 @@ const primitive_funcs funcs_null =
     stretch_row_null,
     shrink_row_null
 };
+
+static const struct row_funcs scalar_row_funcs =
+{
+    rop_row_32,
+    rop_row_16,
+    blend_row_argb,
+    blend_row_argb_alpha,
+    blend_row_argb_constant_alpha,
+    blend_row_argb_no_src_alpha,
+    convert_row_555_to_8888,
+    convert_row_565_to_8888,
+    convert_row_32_to_8888,
+    convert_row_8888_to_555,
+    convert_row_8888_to_16
+};
+
+#ifdef HAVE_PRIMITIVES_SIMD
+
+#ifdef __i386__
+#define SIMD_ALIGN_STACK __attribute__((force_align_arg_pointer))
+#else
+#define SIMD_ALIGN_STACK
+#endif
+
+#define SSE2_FUNC __attribute__((target("sse2"))) SIMD_ALIGN_STACK
+#define AVX2_FUNC __attribute__((target("avx2"))) SIMD_ALIGN_STACK
+#define SSE2_INLINE static inline __attribute__((target("sse2")))
+#define AVX2_INLINE static inline __attribute__((target("avx2")))
+
+/* put_field() as a mask and a pair of shift counts, one of which is zero */
+static inline void get_put_field_shifts(int shift, int len, DWORD *mask, int *left, int *right)
+{
+    shift -= 8 - len;
+    *mask = field_masks[len];
+    *left = shift > 0 ? shift : 0;
+    *right = shift < 0 ? -shift : 0;
+}
+
+/* (x + 127) / 255, exact for x <= 255 * 255 */
+SSE2_INLINE __m128i div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(127));
+    return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)0x8081)), 7);
+}
+
+/* Pack the 16-bit channel sums of four pixels. Sums above 255 only happen
+ * with a source that isn't premultiplied; the C code then lets bit 8 spill
+ * into the next channel up, so do the same. */
+SSE2_INLINE __m128i pack_sums_sse2(__m128i lo, __m128i hi)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+
+    lo = _mm_or_si128(_mm_and_si128(lo, mask), _mm_slli_epi64(_mm_srli_epi16(lo, 8), 16));
+    hi = _mm_or_si128(_mm_and_si128(hi, mask), _mm_slli_epi64(_mm_srli_epi16(hi, 8), 16));
+    return _mm_packus_epi16(lo, hi);
+}
+
+/* blend_argb() on two pixels unpacked to 16-bit channels */
+SSE2_INLINE __m128i blend_argb_sse2(__m128i dst, __m128i src)
+{
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xff), 0xff);
+
+    alpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    return _mm_add_epi16(src, div255_sse2(_mm_mullo_epi16(dst, alpha)));
+}
+
+/* blend_color() on two pixels unpacked to 16-bit channels */
+SSE2_INLINE __m128i blend_color_sse2(__m128i dst, __m128i src, __m128i alpha, __m128i inv_alpha)
+{
+    return div255_sse2(_mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, inv_alpha)));
+}
+
+static SSE2_FUNC void rop_row_32_sse2(DWORD *ptr, int len, DWORD and, DWORD xor)
+{
+    const __m128i and_vec = _mm_set1_epi32(and), xor_vec = _mm_set1_epi32(xor);
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(ptr + x));
+        _mm_storeu_si128((__m128i *)(ptr + x), _mm_xor_si128(_mm_and_si128(v, and_vec), xor_vec));
+    }
+    rop_row_32(ptr + x, len - x, and, xor);
+}
+
+static SSE2_FUNC void rop_row_16_sse2(WORD *ptr, int len, WORD and, WORD xor)
+{
+    const __m128i and_vec = _mm_set1_epi16(and), xor_vec = _mm_set1_epi16(xor);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(ptr + x));
+        _mm_storeu_si128((__m128i *)(ptr + x), _mm_xor_si128(_mm_and_si128(v, and_vec), xor_vec));
+    }
+    rop_row_16(ptr + x, len - x, and, xor);
+}
+
+static SSE2_FUNC void blend_row_argb_sse2(DWORD *dst, const DWORD *src, int len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_argb_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        __m128i hi = blend_argb_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i *)(dst + x), pack_sums_sse2(lo, hi));
+    }
+    blend_row_argb(dst + x, src + x, len - x);
+}
+
+static SSE2_FUNC void blend_row_argb_alpha_sse2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m128i zero = _mm_setzero_si128(), alpha_vec = _mm_set1_epi16(alpha);
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i s_lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), alpha_vec));
+        __m128i s_hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), alpha_vec));
+        __m128i lo = blend_argb_sse2(_mm_unpacklo_epi8(d, zero), s_lo);
+        __m128i hi = blend_argb_sse2(_mm_unpackhi_epi8(d, zero), s_hi);
+        _mm_storeu_si128((__m128i *)(dst + x), pack_sums_sse2(lo, hi));
+    }
+    blend_row_argb_alpha(dst + x, src + x, len - x, alpha);
+}
+
+static SSE2_FUNC void blend_row_argb_constant_alpha_sse2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_vec = _mm_set1_epi16(alpha), inv_alpha_vec = _mm_set1_epi16(255 - alpha);
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_color_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        __m128i hi = blend_color_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_argb_constant_alpha(dst + x, src + x, len - x, alpha);
+}
+
+static SSE2_FUNC void blend_row_argb_no_src_alpha_sse2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m128i zero = _mm_setzero_si128(), opaque = _mm_set1_epi32(0xff000000);
+    const __m128i alpha_vec = _mm_set1_epi16(alpha), inv_alpha_vec = _mm_set1_epi16(255 - alpha);
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i s = _mm_or_si128(_mm_loadu_si128((const __m128i *)(src + x)), opaque);
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_color_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        __m128i hi = blend_color_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_argb_no_src_alpha(dst + x, src + x, len - x, alpha);
+}
+
+SSE2_INLINE __m128i expand_555_sse2(__m128i v)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 9), _mm_set1_epi32(0xf80000)),
+                                                  _mm_and_si128(_mm_slli_epi32(v, 4), _mm_set1_epi32(0x070000))),
+                                     _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 6), _mm_set1_epi32(0x00f800)),
+                                                  _mm_and_si128(_mm_slli_epi32(v, 1), _mm_set1_epi32(0x000700)))),
+                        _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 3), _mm_set1_epi32(0x0000f8)),
+                                     _mm_and_si128(_mm_srli_epi32(v, 2), _mm_set1_epi32(0x000007))));
+}
+
+SSE2_INLINE __m128i expand_565_sse2(__m128i v, __m128i red_shift, __m128i green_shift, __m128i blue_shift)
+{
+    __m128i r = _mm_srl_epi32(v, red_shift), g = _mm_srl_epi32(v, green_shift), b = _mm_srl_epi32(v, blue_shift);
+
+    return _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_slli_epi32(r, 19), _mm_set1_epi32(0xf80000)),
+                                                  _mm_and_si128(_mm_slli_epi32(r, 14), _mm_set1_epi32(0x070000))),
+                                     _mm_or_si128(_mm_and_si128(_mm_slli_epi32(g, 10), _mm_set1_epi32(0x00fc00)),
+                                                  _mm_and_si128(_mm_slli_epi32(g, 4), _mm_set1_epi32(0x000300)))),
+                        _mm_or_si128(_mm_and_si128(_mm_slli_epi32(b, 3), _mm_set1_epi32(0x0000f8)),
+                                     _mm_and_si128(_mm_srli_epi32(b, 2), _mm_set1_epi32(0x000007))));
+}
+
+static SSE2_FUNC void convert_row_555_to_8888_sse2(DWORD *dst, const WORD *src, int len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        _mm_storeu_si128((__m128i *)(dst + x), expand_555_sse2(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128((__m128i *)(dst + x + 4), expand_555_sse2(_mm_unpackhi_epi16(v, zero)));
+    }
+    convert_row_555_to_8888(dst + x, src + x, len - x);
+}
+
+static SSE2_FUNC void convert_row_565_to_8888_sse2(DWORD *dst, const WORD *src, int len, const dib_info *src_dib)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i red_shift = _mm_cvtsi32_si128(src_dib->red_shift);
+    const __m128i green_shift = _mm_cvtsi32_si128(src_dib->green_shift);
+    const __m128i blue_shift = _mm_cvtsi32_si128(src_dib->blue_shift);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        _mm_storeu_si128((__m128i *)(dst + x),
+                         expand_565_sse2(_mm_unpacklo_epi16(v, zero), red_shift, green_shift, blue_shift));
+        _mm_storeu_si128((__m128i *)(dst + x + 4),
+                         expand_565_sse2(_mm_unpackhi_epi16(v, zero), red_shift, green_shift, blue_shift));
+    }
+    convert_row_565_to_8888(dst + x, src + x, len - x, src_dib);
+}
+
+static SSE2_FUNC void convert_row_32_to_8888_sse2(DWORD *dst, const DWORD *src, int len, const dib_info *src_dib)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i red_shift = _mm_cvtsi32_si128(src_dib->red_shift);
+    const __m128i green_shift = _mm_cvtsi32_si128(src_dib->green_shift);
+    const __m128i blue_shift = _mm_cvtsi32_si128(src_dib->blue_shift);
+    int x;
+
+    for (x = 0; x + 4 <= len; x += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i r = _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(v, red_shift), mask), 16);
+        __m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(v, green_shift), mask), 8);
+        __m128i b = _mm_and_si128(_mm_srl_epi32(v, blue_shift), mask);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(_mm_or_si128(r, g), b));
+    }
+    convert_row_32_to_8888(dst + x, src + x, len - x, src_dib);
+}
+
+SSE2_INLINE __m128i reduce_8888_to_555_sse2(__m128i v)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 9), _mm_set1_epi32(0x7c00)),
+                                     _mm_and_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0x03e0))),
+                        _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x001f)));
+}
+
+static SSE2_FUNC void convert_row_8888_to_555_sse2(WORD *dst, const DWORD *src, int len)
+{
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i lo = reduce_8888_to_555_sse2(_mm_loadu_si128((const __m128i *)(src + x)));
+        __m128i hi = reduce_8888_to_555_sse2(_mm_loadu_si128((const __m128i *)(src + x + 4)));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(lo, hi));
+    }
+    convert_row_8888_to_555(dst + x, src + x, len - x);
+}
+
+struct put_field_sse2
+{
+    __m128i mask, left, right;
+};
+
+SSE2_INLINE void init_put_field_sse2(struct put_field_sse2 *field, int shift, int len)
+{
+    DWORD mask;
+    int left, right;
+
+    get_put_field_shifts(shift, len, &mask, &left, &right);
+    field->mask = _mm_set1_epi32(mask);
+    field->left = _mm_cvtsi32_si128(left);
+    field->right = _mm_cvtsi32_si128(right);
+}
+
+SSE2_INLINE __m128i put_field_sse2(__m128i v, const struct put_field_sse2 *field)
+{
+    return _mm_sll_epi32(_mm_srl_epi32(_mm_and_si128(v, field->mask), field->right), field->left);
+}
+
+/* keep the low 16 bits of each dword, sign extended so that packs doesn't saturate */
+SSE2_INLINE __m128i low_words_sse2(__m128i v)
+{
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+SSE2_INLINE __m128i reduce_8888_to_16_sse2(__m128i v, const struct put_field_sse2 *fields)
+{
+    return low_words_sse2(_mm_or_si128(_mm_or_si128(put_field_sse2(_mm_srli_epi32(v, 16), &fields[0]),
+                                                    put_field_sse2(_mm_srli_epi32(v, 8), &fields[1])),
+                                       put_field_sse2(v, &fields[2])));
+}
+
+static SSE2_FUNC void convert_row_8888_to_16_sse2(WORD *dst, const DWORD *src, int len, const dib_info *dst_dib)
+{
+    struct put_field_sse2 fields[3];
+    int x;
+
+    init_put_field_sse2(&fields[0], dst_dib->red_shift, dst_dib->red_len);
+    init_put_field_sse2(&fields[1], dst_dib->green_shift, dst_dib->green_len);
+    init_put_field_sse2(&fields[2], dst_dib->blue_shift, dst_dib->blue_len);
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m128i lo = reduce_8888_to_16_sse2(_mm_loadu_si128((const __m128i *)(src + x)), fields);
+        __m128i hi = reduce_8888_to_16_sse2(_mm_loadu_si128((const __m128i *)(src + x + 4)), fields);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(lo, hi));
+    }
+    convert_row_8888_to_16(dst + x, src + x, len - x, dst_dib);
+}
+
+/* The AVX2 versions work on twice as many pixels; the unpack and pack
+ * instructions operate within each 128-bit lane, so pixels stay in order
+ * as long as both are done the same way. */
+
+AVX2_INLINE __m256i div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(127));
+    return _mm256_srli_epi16(_mm256_mulhi_epu16(x, _mm256_set1_epi16((short)0x8081)), 7);
+}
+
+AVX2_INLINE __m256i pack_sums_avx2(__m256i lo, __m256i hi)
+{
+    const __m256i mask = _mm256_set1_epi16(0xff);
+
+    lo = _mm256_or_si256(_mm256_and_si256(lo, mask), _mm256_slli_epi64(_mm256_srli_epi16(lo, 8), 16));
+    hi = _mm256_or_si256(_mm256_and_si256(hi, mask), _mm256_slli_epi64(_mm256_srli_epi16(hi, 8), 16));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+AVX2_INLINE __m256i blend_argb_avx2(__m256i dst, __m256i src)
+{
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xff), 0xff);
+
+    alpha = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    return _mm256_add_epi16(src, div255_avx2(_mm256_mullo_epi16(dst, alpha)));
+}
+
+AVX2_INLINE __m256i blend_color_avx2(__m256i dst, __m256i src, __m256i alpha, __m256i inv_alpha)
+{
+    return div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(src, alpha), _mm256_mullo_epi16(dst, inv_alpha)));
+}
+
+static AVX2_FUNC void rop_row_32_avx2(DWORD *ptr, int len, DWORD and, DWORD xor)
+{
+    const __m256i and_vec = _mm256_set1_epi32(and), xor_vec = _mm256_set1_epi32(xor);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(ptr + x));
+        _mm256_storeu_si256((__m256i *)(ptr + x), _mm256_xor_si256(_mm256_and_si256(v, and_vec), xor_vec));
+    }
+    rop_row_32(ptr + x, len - x, and, xor);
+}
+
+static AVX2_FUNC void rop_row_16_avx2(WORD *ptr, int len, WORD and, WORD xor)
+{
+    const __m256i and_vec = _mm256_set1_epi16(and), xor_vec = _mm256_set1_epi16(xor);
+    int x;
+
+    for (x = 0; x + 16 <= len; x += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(ptr + x));
+        _mm256_storeu_si256((__m256i *)(ptr + x), _mm256_xor_si256(_mm256_and_si256(v, and_vec), xor_vec));
+    }
+    rop_row_16(ptr + x, len - x, and, xor);
+}
+
+static AVX2_FUNC void blend_row_argb_avx2(DWORD *dst, const DWORD *src, int len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+        __m256i lo = blend_argb_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+        __m256i hi = blend_argb_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256((__m256i *)(dst + x), pack_sums_avx2(lo, hi));
+    }
+    blend_row_argb(dst + x, src + x, len - x);
+}
+
+static AVX2_FUNC void blend_row_argb_alpha_avx2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m256i zero = _mm256_setzero_si256(), alpha_vec = _mm256_set1_epi16(alpha);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+        __m256i s_lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), alpha_vec));
+        __m256i s_hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), alpha_vec));
+        __m256i lo = blend_argb_avx2(_mm256_unpacklo_epi8(d, zero), s_lo);
+        __m256i hi = blend_argb_avx2(_mm256_unpackhi_epi8(d, zero), s_hi);
+        _mm256_storeu_si256((__m256i *)(dst + x), pack_sums_avx2(lo, hi));
+    }
+    blend_row_argb_alpha(dst + x, src + x, len - x, alpha);
+}
+
+static AVX2_FUNC void blend_row_argb_constant_alpha_avx2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_vec = _mm256_set1_epi16(alpha), inv_alpha_vec = _mm256_set1_epi16(255 - alpha);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+        __m256i lo = blend_color_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        __m256i hi = blend_color_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    blend_row_argb_constant_alpha(dst + x, src + x, len - x, alpha);
+}
+
+static AVX2_FUNC void blend_row_argb_no_src_alpha_avx2(DWORD *dst, const DWORD *src, int len, DWORD alpha)
+{
+    const __m256i zero = _mm256_setzero_si256(), opaque = _mm256_set1_epi32(0xff000000);
+    const __m256i alpha_vec = _mm256_set1_epi16(alpha), inv_alpha_vec = _mm256_set1_epi16(255 - alpha);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i s = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(src + x)), opaque);
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+        __m256i lo = blend_color_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        __m256i hi = blend_color_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), alpha_vec, inv_alpha_vec);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    blend_row_argb_no_src_alpha(dst + x, src + x, len - x, alpha);
+}
+
+AVX2_INLINE __m256i expand_555_avx2(__m256i v)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(v, 9), _mm256_set1_epi32(0xf80000)),
+                                                           _mm256_and_si256(_mm256_slli_epi32(v, 4), _mm256_set1_epi32(0x070000))),
+                                           _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(v, 6), _mm256_set1_epi32(0x00f800)),
+                                                           _mm256_and_si256(_mm256_slli_epi32(v, 1), _mm256_set1_epi32(0x000700)))),
+                           _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(v, 3), _mm256_set1_epi32(0x0000f8)),
+                                           _mm256_and_si256(_mm256_srli_epi32(v, 2), _mm256_set1_epi32(0x000007))));
+}
+
+AVX2_INLINE __m256i expand_565_avx2(__m256i v, __m128i red_shift, __m128i green_shift, __m128i blue_shift)
+{
+    __m256i r = _mm256_srl_epi32(v, red_shift), g = _mm256_srl_epi32(v, green_shift), b = _mm256_srl_epi32(v, blue_shift);
+
+    return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(r, 19), _mm256_set1_epi32(0xf80000)),
+                                                           _mm256_and_si256(_mm256_slli_epi32(r, 14), _mm256_set1_epi32(0x070000))),
+                                           _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(g, 10), _mm256_set1_epi32(0x00fc00)),
+                                                           _mm256_and_si256(_mm256_slli_epi32(g, 4), _mm256_set1_epi32(0x000300)))),
+                           _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(b, 3), _mm256_set1_epi32(0x0000f8)),
+                                           _mm256_and_si256(_mm256_srli_epi32(b, 2), _mm256_set1_epi32(0x000007))));
+}
+
+static AVX2_FUNC void convert_row_555_to_8888_avx2(DWORD *dst, const WORD *src, int len)
+{
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + x)));
+        _mm256_storeu_si256((__m256i *)(dst + x), expand_555_avx2(v));
+    }
+    convert_row_555_to_8888(dst + x, src + x, len - x);
+}
+
+static AVX2_FUNC void convert_row_565_to_8888_avx2(DWORD *dst, const WORD *src, int len, const dib_info *src_dib)
+{
+    const __m128i red_shift = _mm_cvtsi32_si128(src_dib->red_shift);
+    const __m128i green_shift = _mm_cvtsi32_si128(src_dib->green_shift);
+    const __m128i blue_shift = _mm_cvtsi32_si128(src_dib->blue_shift);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + x)));
+        _mm256_storeu_si256((__m256i *)(dst + x), expand_565_avx2(v, red_shift, green_shift, blue_shift));
+    }
+    convert_row_565_to_8888(dst + x, src + x, len - x, src_dib);
+}
+
+static AVX2_FUNC void convert_row_32_to_8888_avx2(DWORD *dst, const DWORD *src, int len, const dib_info *src_dib)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m128i red_shift = _mm_cvtsi32_si128(src_dib->red_shift);
+    const __m128i green_shift = _mm_cvtsi32_si128(src_dib->green_shift);
+    const __m128i blue_shift = _mm_cvtsi32_si128(src_dib->blue_shift);
+    int x;
+
+    for (x = 0; x + 8 <= len; x += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i r = _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(v, red_shift), mask), 16);
+        __m256i g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(v, green_shift), mask), 8);
+        __m256i b = _mm256_and_si256(_mm256_srl_epi32(v, blue_shift), mask);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_or_si256(_mm256_or_si256(r, g), b));
+    }
+    convert_row_32_to_8888(dst + x, src + x, len - x, src_dib);
+}
+
+AVX2_INLINE __m256i reduce_8888_to_555_avx2(__m256i v)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(v, 9), _mm256_set1_epi32(0x7c00)),
+                                           _mm256_and_si256(_mm256_srli_epi32(v, 6), _mm256_set1_epi32(0x03e0))),
+                           _mm256_and_si256(_mm256_srli_epi32(v, 3), _mm256_set1_epi32(0x001f)));
+}
+
+static AVX2_FUNC void convert_row_8888_to_555_avx2(WORD *dst, const DWORD *src, int len)
+{
+    int x;
+
+    for (x = 0; x + 16 <= len; x += 16)
+    {
+        __m256i lo = reduce_8888_to_555_avx2(_mm256_loadu_si256((const __m256i *)(src + x)));
+        __m256i hi = reduce_8888_to_555_avx2(_mm256_loadu_si256((const __m256i *)(src + x + 8)));
+        /* packs interleaves the lanes of both halves, put them back in order */
+        _mm256_storeu_si256((__m256i *)(dst + x),
+                            _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    convert_row_8888_to_555(dst + x, src + x, len - x);
+}
+
+struct put_field_avx2
+{
+    __m256i mask;
+    __m128i left, right;
+};
+
+AVX2_INLINE void init_put_field_avx2(struct put_field_avx2 *field, int shift, int len)
+{
+    DWORD mask;
+    int left, right;
+
+    get_put_field_shifts(shift, len, &mask, &left, &right);
+    field->mask = _mm256_set1_epi32(mask);
+    field->left = _mm_cvtsi32_si128(left);
+    field->right = _mm_cvtsi32_si128(right);
+}
+
+AVX2_INLINE __m256i put_field_avx2(__m256i v, const struct put_field_avx2 *field)
+{
+    return _mm256_sll_epi32(_mm256_srl_epi32(_mm256_and_si256(v, field->mask), field->right), field->left);
+}
+
+AVX2_INLINE __m256i reduce_8888_to_16_avx2(__m256i v, const struct put_field_avx2 *fields)
+{
+    v = _mm256_or_si256(_mm256_or_si256(put_field_avx2(_mm256_srli_epi32(v, 16), &fields[0]),
+                                        put_field_avx2(_mm256_srli_epi32(v, 8), &fields[1])),
+                        put_field_avx2(v, &fields[2]));
+    return _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+}
+
+static AVX2_FUNC void convert_row_8888_to_16_avx2(WORD *dst, const DWORD *src, int len, const dib_info *dst_dib)
+{
+    struct put_field_avx2 fields[3];
+    int x;
+
+    init_put_field_avx2(&fields[0], dst_dib->red_shift, dst_dib->red_len);
+    init_put_field_avx2(&fields[1], dst_dib->green_shift, dst_dib->green_len);
+    init_put_field_avx2(&fields[2], dst_dib->blue_shift, dst_dib->blue_len);
+
+    for (x = 0; x + 16 <= len; x += 16)
+    {
+        __m256i lo = reduce_8888_to_16_avx2(_mm256_loadu_si256((const __m256i *)(src + x)), fields);
+        __m256i hi = reduce_8888_to_16_avx2(_mm256_loadu_si256((const __m256i *)(src + x + 8)), fields);
+        _mm256_storeu_si256((__m256i *)(dst + x),
+                            _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    convert_row_8888_to_16(dst + x, src + x, len - x, dst_dib);
+}
+
+static const struct row_funcs sse2_row_funcs =
+{
+    rop_row_32_sse2,
+    rop_row_16_sse2,
+    blend_row_argb_sse2,
+    blend_row_argb_alpha_sse2,
+    blend_row_argb_constant_alpha_sse2,
+    blend_row_argb_no_src_alpha_sse2,
+    convert_row_555_to_8888_sse2,
+    convert_row_565_to_8888_sse2,
+    convert_row_32_to_8888_sse2,
+    convert_row_8888_to_555_sse2,
+    convert_row_8888_to_16_sse2
+};
+
+static const struct row_funcs avx2_row_funcs =
+{
+    rop_row_32_avx2,
+    rop_row_16_avx2,
+    blend_row_argb_avx2,
+    blend_row_argb_alpha_avx2,
+    blend_row_argb_constant_alpha_avx2,
+    blend_row_argb_no_src_alpha_avx2,
+    convert_row_555_to_8888_avx2,
+    convert_row_565_to_8888_avx2,
+    convert_row_32_to_8888_avx2,
+    convert_row_8888_to_555_avx2,
+    convert_row_8888_to_16_avx2
+};
+
+static inline void do_cpuid(unsigned int ax, unsigned int cx, unsigned int *p)
+{
+#ifdef __i386__
+    __asm__("pushl %%ebx\n\t"
+            "cpuid\n\t"
+            "movl %%ebx, %%esi\n\t"
+            "popl %%ebx"
+            : "=a" (p[0]), "=S" (p[1]), "=c" (p[2]), "=d" (p[3])
+            : "0" (ax), "2" (cx));
+#else
+    __asm__("push %%rbx\n\t"
+            "cpuid\n\t"
+            "movq %%rbx, %%rsi\n\t"
+            "pop %%rbx"
+            : "=a" (p[0]), "=S" (p[1]), "=c" (p[2]), "=d" (p[3])
+            : "0" (ax), "2" (cx));
+#endif
+}
+
+static BOOL have_avx2(void)
+{
+    unsigned int regs[4], lo, hi;
+
+    do_cpuid(0, 0, regs);
+    if (regs[0] < 7) return FALSE;
+    /* the OS has to save the ymm registers too, see OSXSAVE and XCR0 */
+    do_cpuid(1, 0, regs);
+    if ((regs[2] & 0x18000000) != 0x18000000) return FALSE;
+    __asm__(".byte 0x0f,0x01,0xd0" /* xgetbv */ : "=a" (lo), "=d" (hi) : "c" (0));
+    if ((lo & 6) != 6) return FALSE;
+    do_cpuid(7, 0, regs);
+    return (regs[1] & (1 << 5)) != 0;
+}
+
+#endif  /* HAVE_PRIMITIVES_SIMD */
+
+/***********************************************************************
+ *           init_dib_primitives
+ *
+ * Select the fastest row kernels this CPU supports. This is done once at
+ * process attach, before anything can draw.
+ */
+void init_dib_primitives(void)
+{
+    const char *name = "scalar";
+
+#ifdef HAVE_PRIMITIVES_SIMD
+    if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+    {
+        if (have_avx2())
+        {
+            row_funcs = &avx2_row_funcs;
+            name = "avx2";
+        }
+        else
+        {
+            row_funcs = &sse2_row_funcs;
+            name = "sse2";
+        }
+    }
+#endif
+    TRACE( "using %s row kernels\n", name );
+}
@@ -109,6 +109,7 @@
 #include "resource.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(font);
+WINE_DECLARE_DEBUG_CHANNEL(glyphcache);
 
 static RTL_RUN_ONCE init_once = RTL_RUN_ONCE_INIT;
 static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **context);
@@ -434,6 +435,7 @@ struct tagGdiFont {
     DWORD cache_num;
     DWORD instance_id;
     struct font_fileinfo *fileinfo;
+    struct glyph_cache_font *glyph_font;
 };
 
 typedef struct {
@@ -566,24 +568,10 @@ typedef struct tagFontSubst {
     NameCs to;
 } FontSubst;
 
-/* Registry font cache key and value names */
+/* Registry font key; its volatile Cache subkey marks the current session */
 static const WCHAR wine_fonts_key[] = {'S','o','f','t','w','a','r','e','\\','W','i','n','e','\\',
                                        'F','o','n','t','s',0};
 static const WCHAR wine_fonts_cache_key[] = {'C','a','c','h','e',0};
-static const WCHAR english_name_value[] = {'E','n','g','l','i','s','h',' ','N','a','m','e',0};
-static const WCHAR face_index_value[] = {'I','n','d','e','x',0};
-static const WCHAR face_ntmflags_value[] = {'N','t','m','f','l','a','g','s',0};
-static const WCHAR face_version_value[] = {'V','e','r','s','i','o','n',0};
-static const WCHAR face_height_value[] = {'H','e','i','g','h','t',0};
-static const WCHAR face_width_value[] = {'W','i','d','t','h',0};
-static const WCHAR face_size_value[] = {'S','i','z','e',0};
-static const WCHAR face_x_ppem_value[] = {'X','p','p','e','m',0};
-static const WCHAR face_y_ppem_value[] = {'Y','p','p','e','m',0};
-static const WCHAR face_flags_value[] = {'F','l','a','g','s',0};
-static const WCHAR face_internal_leading_value[] = {'I','n','t','e','r','n','a','l',' ','L','e','a','d','i','n','g',0};
-static const WCHAR face_font_sig_value[] = {'F','o','n','t',' ','S','i','g','n','a','t','u','r','e',0};
-static const WCHAR face_file_name_value[] = {'F','i','l','e',' ','N','a','m','e','\0'};
-static const WCHAR face_full_name_value[] = {'F','u','l','l',' ','N','a','m','e','\0'};
 
 
 struct font_mapping
@@ -599,7 +587,6 @@ struct font_mapping
 static struct list mappings_list = LIST_INIT( mappings_list );
 
 static UINT default_aa_flags;
-static HKEY hkey_font_cache;
 static BOOL antialias_fakes = TRUE;
 
 static CRITICAL_SECTION freetype_cs;
@@ -1595,6 +1582,49 @@ static Family *create_family( WCHAR *name, WCHAR *english_name )
     return family;
 }
 
+/****************************************************************
+ * NB This function takes ownership of the names.
+ */
+static Family *get_family( WCHAR *name, WCHAR *english_name )
+{
+    Family *family = find_family_from_name( name );
+
+    if (!family)
+    {
+        family = create_family( name, english_name );
+        if (english_name)
+        {
+            FontSubst *subst = HeapAlloc( GetProcessHeap(), 0, sizeof(*subst) );
+            subst->from.name = strdupW( english_name );
+            subst->from.charset = -1;
+            subst->to.name = strdupW( name );
+            subst->to.charset = -1;
+            add_font_subst( &font_subst_list, subst, 0 );
+        }
+    }
+    else
+    {
+        HeapFree( GetProcessHeap(), 0, name );
+        HeapFree( GetProcessHeap(), 0, english_name );
+        family->refcount++;
+    }
+
+    return family;
+}
+
+static BOOL add_face_to_family( Face *face, Family *family )
+{
+    if (strlenW( family->FamilyName ) >= LF_FACESIZE)
+    {
+        WARN("Ignoring %s because name is too long\n", debugstr_w(family->FamilyName));
+        return FALSE;
+    }
+    if (!insert_face_in_family_list( face, family )) return FALSE;
+
+    TRACE("Added font %s %s\n", debugstr_w(family->FamilyName), debugstr_w(face->StyleName));
+    return TRUE;
+}
+
 static LONG reg_load_dword(HKEY hkey, const WCHAR *value, DWORD *data)
 {
     DWORD type, size = sizeof(DWORD);
@@ -1608,279 +1638,1189 @@ static LONG reg_load_dword(HKEY hkey, const WCHAR *value, DWORD *data)
     return ERROR_SUCCESS;
 }
 
-static inline LONG reg_load_ftlong(HKEY hkey, const WCHAR *value, FT_Long *data)
+static LONG create_font_cache_key(HKEY *hkey, DWORD *disposition)
+{
+    LONG ret;
+    HKEY hkey_wine_fonts;
+
+    /* We don't want to create the fonts key as volatile, so open this first */
+    ret = RegCreateKeyExW(HKEY_CURRENT_USER, wine_fonts_key, 0, NULL, 0,
+                          KEY_ALL_ACCESS, NULL, &hkey_wine_fonts, NULL);
+    if(ret != ERROR_SUCCESS)
+    {
+        WARN("Can't create %s\n", debugstr_w(wine_fonts_key));
+        return ret;
+    }
+
+    ret = RegCreateKeyExW(hkey_wine_fonts, wine_fonts_cache_key, 0, NULL, REG_OPTION_VOLATILE,
+                          KEY_ALL_ACCESS, NULL, hkey, disposition);
+    RegCloseKey(hkey_wine_fonts);
+    return ret;
+}
+
+/*
+ * Binary font index
+ *
+ * The font list built at startup is stored in fonts.cache in the config
+ * directory.  For every font file that was loaded with ADDFONT_ADD_TO_CACHE
+ * it records the modification time and size of the file and the faces
+ * AddFaceToList was called with, and for every scanned directory its
+ * modification time.  Other processes map the index read-only and replay
+ * it instead of opening each font with FreeType.  When a stamp no longer
+ * matches the font list is rebuilt, and files that didn't change are
+ * replayed from the previous index.  All fields have a fixed size so that
+ * 32 and 64-bit processes share the same file.
+ */
+
+#define FONT_CACHE_MAGIC     0x43544e46  /* "FNTC" */
+#define FONT_CACHE_VERSION   1
+#define FONT_CACHE_NO_STRING (~0u)
+
+struct font_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD size;           /* size of the whole file */
+    DWORD lcid;           /* locale used for the localized names */
+    DWORD aa_flags;       /* default_aa_flags */
+    DWORD ft_version;     /* FT_SimpleVersion */
+    DWORD file_count;
+    DWORD face_count;
+    DWORD dir_count;
+    DWORD strings_size;   /* in WCHARs */
+};
+
+struct font_cache_file
+{
+    ULONGLONG mtime;
+    ULONGLONG size;
+    DWORD     path;       /* offset of the unix path in the string table */
+    DWORD     flags;      /* flags AddFontToList was called with */
+    DWORD     first_face;
+    DWORD     face_count;
+    DWORD     ret;        /* value returned by AddFontToList */
+    DWORD     pad;
+};
+
+struct font_cache_face
+{
+    DWORD         family;
+    DWORD         english;
+    DWORD         style;
+    DWORD         full;
+    LONG          face_index;
+    DWORD         ntm_flags;
+    LONG          font_version;
+    DWORD         flags;
+    FONTSIGNATURE fs;
+    DWORD         scalable;
+    SHORT         height;
+    SHORT         width;
+    SHORT         internal_leading;
+    SHORT         pad;
+    LONG          size;
+    LONG          x_ppem;
+    LONG          y_ppem;
+};
+
+struct font_cache_dir
+{
+    ULONGLONG mtime;      /* zero if the directory doesn't exist */
+    DWORD     path;
+    DWORD     pad;
+};
+
+C_ASSERT( sizeof(struct font_cache_header) == 40 );
+C_ASSERT( sizeof(struct font_cache_file) == 40 );
+C_ASSERT( sizeof(struct font_cache_face) == 80 );
+C_ASSERT( sizeof(struct font_cache_dir) == 16 );
+
+/* a mapped index, or one being built */
+struct font_cache
+{
+    struct font_cache_file *files;
+    struct font_cache_face *faces;
+    struct font_cache_dir  *dirs;
+    WCHAR                  *strings;
+    DWORD                   file_count;
+    DWORD                   face_count;
+    DWORD                   dir_count;
+    DWORD                   strings_size;
+    DWORD                   max_files;    /* allocated sizes, unused when mapped */
+    DWORD                   max_faces;
+    DWORD                   max_dirs;
+    DWORD                   max_strings;
+    DWORD                   current;      /* file whose faces are being recorded */
+    BOOL                    failed;       /* an allocation failed, don't write it */
+    DWORD                  *hash;         /* file lookup table, indices + 1 */
+    DWORD                   hash_size;
+    void                   *data;         /* file mapping */
+    size_t                  data_size;
+};
+
+/* an AddFontResource file removed since the last flush */
+struct removed_font_file
+{
+    WCHAR *path;
+    DWORD  pending;   /* number of files in font_cache when it was removed */
+};
+
+#define FONT_CACHE_FLUSH_DELAY 1000  /* ms */
+
+static struct font_cache *font_cache;      /* records the files added with ADDFONT_ADD_TO_CACHE */
+static struct font_cache *prev_font_cache; /* index being rebuilt, for unchanged files */
+static BOOL font_cache_ready;
+static HANDLE font_cache_timer;            /* pending flush */
+static struct removed_font_file *removed_font_files;
+static DWORD removed_font_files_count, removed_font_files_size;
+
+static BOOL grow_cache_array( void **array, DWORD *size, DWORD needed, size_t elem_size )
+{
+    DWORD new_size = *size;
+    void *new_array;
+
+    if (needed <= *size) return TRUE;
+    while (new_size < needed) new_size = max( new_size * 2, 64 );
+    if (*array) new_array = HeapReAlloc( GetProcessHeap(), 0, *array, new_size * elem_size );
+    else new_array = HeapAlloc( GetProcessHeap(), 0, new_size * elem_size );
+    if (!new_array) return FALSE;
+    *array = new_array;
+    *size = new_size;
+    return TRUE;
+}
+
+static DWORD cache_add_string( struct font_cache *cache, const WCHAR *str )
 {
-    DWORD dw;
-    LONG ret = reg_load_dword(hkey, value, &dw);
-    *data = dw;
+    DWORD len, ret;
+
+    if (!str) return FONT_CACHE_NO_STRING;
+    len = strlenW( str ) + 1;
+    if (!grow_cache_array( (void **)&cache->strings, &cache->max_strings,
+                           cache->strings_size + len, sizeof(WCHAR) ))
+    {
+        cache->failed = TRUE;
+        return FONT_CACHE_NO_STRING;
+    }
+    ret = cache->strings_size;
+    memcpy( cache->strings + ret, str, len * sizeof(WCHAR) );
+    cache->strings_size += len;
     return ret;
 }
 
-static inline LONG reg_load_ftshort(HKEY hkey, const WCHAR *value, FT_Short *data)
+static inline const WCHAR *cache_string( const struct font_cache *cache, DWORD offset )
 {
-    DWORD dw;
-    LONG ret = reg_load_dword(hkey, value, &dw);
-    *data = dw;
+    return offset == FONT_CACHE_NO_STRING ? NULL : cache->strings + offset;
+}
+
+static WCHAR *cache_strdupW( const struct font_cache *cache, DWORD offset )
+{
+    const WCHAR *str = cache_string( cache, offset );
+    return str ? strdupW( str ) : NULL;
+}
+
+static inline BOOL cache_string_valid( const struct font_cache *cache, DWORD offset, BOOL optional )
+{
+    if (offset == FONT_CACHE_NO_STRING) return optional;
+    return offset < cache->strings_size;
+}
+
+static ULONGLONG get_mtime( const struct stat *st )
+{
+    ULONGLONG ret = (ULONGLONG)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
     return ret;
 }
 
-static inline LONG reg_save_dword(HKEY hkey, const WCHAR *value, DWORD data)
+static inline DWORD hash_cache_path( const WCHAR *path )
 {
-    return RegSetValueExW(hkey, value, 0, REG_DWORD, (BYTE*)&data, sizeof(DWORD));
+    DWORD hash = 0;
+    while (*path) hash = hash * 31 + *path++;
+    return hash;
 }
 
-static void load_face(HKEY hkey_face, WCHAR *face_name, Family *family, void *buffer, DWORD buffer_size)
+static char *get_font_cache_path(void)
 {
-    DWORD needed, strike_index = 0;
-    HKEY hkey_strike;
+    static const char cache_name[] = "/fonts.cache";
+    const char *dir = wine_get_config_dir();
+    char *path = HeapAlloc( GetProcessHeap(), 0, strlen(dir) + sizeof(cache_name) );
 
-    /* If we have a File Name key then this is a real font, not just the parent
-       key of a bunch of non-scalable strikes */
-    needed = buffer_size;
-    if (RegQueryValueExW(hkey_face, face_file_name_value, NULL, NULL, buffer, &needed) == ERROR_SUCCESS)
+    if (path)
     {
-        Face *face;
-        face = HeapAlloc(GetProcessHeap(), 0, sizeof(*face));
-        face->cached_enum_data = NULL;
-        face->family = NULL;
+        strcpy( path, dir );
+        strcat( path, cache_name );
+    }
+    return path;
+}
 
-        face->refcount = 1;
-        face->file = strdupW( buffer );
-        face->StyleName = strdupW(face_name);
+static struct font_cache *alloc_font_cache(void)
+{
+    struct font_cache *cache = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) );
 
-        needed = buffer_size;
-        if(RegQueryValueExW(hkey_face, face_full_name_value, NULL, NULL, buffer, &needed) == ERROR_SUCCESS)
-            face->FullName = strdupW( buffer );
-        else
-            face->FullName = NULL;
+    if (cache) cache->current = ~0u;
+    return cache;
+}
+
+static void free_font_cache( struct font_cache *cache )
+{
+    if (!cache) return;
+    if (cache->data) munmap( cache->data, cache->data_size );
+    else
+    {
+        HeapFree( GetProcessHeap(), 0, cache->files );
+        HeapFree( GetProcessHeap(), 0, cache->faces );
+        HeapFree( GetProcessHeap(), 0, cache->dirs );
+        HeapFree( GetProcessHeap(), 0, cache->strings );
+    }
+    HeapFree( GetProcessHeap(), 0, cache->hash );
+    HeapFree( GetProcessHeap(), 0, cache );
+}
 
-        reg_load_ftlong(hkey_face, face_index_value, &face->face_index);
-        reg_load_dword(hkey_face, face_ntmflags_value, &face->ntmFlags);
-        reg_load_ftlong(hkey_face, face_version_value, &face->font_version);
-        reg_load_dword(hkey_face, face_flags_value, &face->flags);
+/* map the index and check that it is consistent, so that replaying it can't go out of bounds */
+static struct font_cache *map_font_cache(void)
+{
+    const struct font_cache_header *header;
+    struct font_cache *cache;
+    struct stat st;
+    ULONGLONG size;
+    char *path;
+    void *data;
+    DWORD i;
+    int fd;
 
-        needed = sizeof(face->fs);
-        RegQueryValueExW(hkey_face, face_font_sig_value, NULL, NULL, (BYTE*)&face->fs, &needed);
+    if (!(path = get_font_cache_path())) return NULL;
+    fd = open( path, O_RDONLY );
+    HeapFree( GetProcessHeap(), 0, path );
+    if (fd == -1) return NULL;
 
-        if(reg_load_ftshort(hkey_face, face_height_value, &face->size.height) != ERROR_SUCCESS)
-        {
-            face->scalable = TRUE;
-            memset(&face->size, 0, sizeof(face->size));
-        }
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || st.st_size > 0x7fffffff)
+    {
+        close( fd );
+        return NULL;
+    }
+    data = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (data == MAP_FAILED) return NULL;
+
+    if (!(cache = alloc_font_cache()))
+    {
+        munmap( data, st.st_size );
+        return NULL;
+    }
+    cache->data = data;
+    cache->data_size = st.st_size;
+
+    header = data;
+    if (header->magic != FONT_CACHE_MAGIC || header->version != FONT_CACHE_VERSION ||
+        header->size != st.st_size || header->lcid != GetSystemDefaultLCID() ||
+        header->aa_flags != default_aa_flags || header->ft_version != FT_SimpleVersion)
+    {
+        TRACE( "font index is out of date\n" );
+        goto failed;
+    }
+
+    size = sizeof(*header) + (ULONGLONG)header->file_count * sizeof(struct font_cache_file) +
+           (ULONGLONG)header->face_count * sizeof(struct font_cache_face) +
+           (ULONGLONG)header->dir_count * sizeof(struct font_cache_dir) +
+           (ULONGLONG)header->strings_size * sizeof(WCHAR);
+    if (size != header->size) goto failed;
+
+    cache->files = (struct font_cache_file *)(header + 1);
+    cache->faces = (struct font_cache_face *)(cache->files + header->file_count);
+    cache->dirs = (struct font_cache_dir *)(cache->faces + header->face_count);
+    cache->strings = (WCHAR *)(cache->dirs + header->dir_count);
+    cache->file_count = header->file_count;
+    cache->face_count = header->face_count;
+    cache->dir_count = header->dir_count;
+    cache->strings_size = header->strings_size;
+
+    if (cache->strings_size && cache->strings[cache->strings_size - 1]) goto failed;
+    for (i = 0; i < cache->file_count; i++)
+    {
+        const struct font_cache_file *file = &cache->files[i];
+
+        if (!cache_string_valid( cache, file->path, FALSE ) || file->first_face > cache->face_count ||
+            file->face_count > cache->face_count - file->first_face)
+            goto failed;
+    }
+    for (i = 0; i < cache->face_count; i++)
+    {
+        const struct font_cache_face *face = &cache->faces[i];
+
+        if (!cache_string_valid( cache, face->family, FALSE ) || !cache_string_valid( cache, face->english, TRUE ) ||
+            !cache_string_valid( cache, face->style, FALSE ) || !cache_string_valid( cache, face->full, TRUE ))
+            goto failed;
+    }
+    for (i = 0; i < cache->dir_count; i++)
+        if (!cache_string_valid( cache, cache->dirs[i].path, FALSE )) goto failed;
+
+    return cache;
+
+failed:
+    WARN( "ignoring font index\n" );
+    free_font_cache( cache );
+    return NULL;
+}
+
+static BOOL font_cache_up_to_date( const struct font_cache *cache )
+{
+    struct stat st;
+    char *path;
+    BOOL ret;
+    DWORD i;
+
+    for (i = 0; i < cache->dir_count; i++)
+    {
+        path = strWtoA( CP_UNIXCP, cache_string( cache, cache->dirs[i].path ));
+        ret = (stat( path, &st ) ? 0 : get_mtime( &st )) == cache->dirs[i].mtime;
+        if (!ret) TRACE( "directory %s changed\n", debugstr_a(path) );
+        HeapFree( GetProcessHeap(), 0, path );
+        if (!ret) return FALSE;
+    }
+    for (i = 0; i < cache->file_count; i++)
+    {
+        path = strWtoA( CP_UNIXCP, cache_string( cache, cache->files[i].path ));
+        ret = !stat( path, &st ) && get_mtime( &st ) == cache->files[i].mtime &&
+              st.st_size == cache->files[i].size;
+        if (!ret) TRACE( "font file %s changed\n", debugstr_a(path) );
+        HeapFree( GetProcessHeap(), 0, path );
+        if (!ret) return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL write_all( int fd, const void *data, size_t size )
+{
+    const char *ptr = data;
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write( fd, ptr, size )) <= 0) return FALSE;
+        ptr += ret;
+        size -= ret;
+    }
+    return TRUE;
+}
+
+/* write to a temporary file and rename it, processes that mapped the old index keep it */
+static void write_font_cache( const struct font_cache *cache )
+{
+    struct font_cache_header header;
+    char *path, *tmp;
+    BOOL ret;
+    int fd;
+
+    if (cache->failed) return;
+    if (!(path = get_font_cache_path())) return;
+    if (!(tmp = HeapAlloc( GetProcessHeap(), 0, strlen(path) + sizeof(".XXXXXX") )))
+    {
+        HeapFree( GetProcessHeap(), 0, path );
+        return;
+    }
+    sprintf( tmp, "%s.XXXXXX", path );
+
+    header.magic = FONT_CACHE_MAGIC;
+    header.version = FONT_CACHE_VERSION;
+    header.lcid = GetSystemDefaultLCID();
+    header.aa_flags = default_aa_flags;
+    header.ft_version = FT_SimpleVersion;
+    header.file_count = cache->file_count;
+    header.face_count = cache->face_count;
+    header.dir_count = cache->dir_count;
+    header.strings_size = cache->strings_size;
+    header.size = sizeof(header) + cache->file_count * sizeof(*cache->files) +
+                  cache->face_count * sizeof(*cache->faces) + cache->dir_count * sizeof(*cache->dirs) +
+                  cache->strings_size * sizeof(WCHAR);
+
+    if ((fd = mkstemp( tmp )) != -1)
+    {
+        ret = write_all( fd, &header, sizeof(header) ) &&
+              write_all( fd, cache->files, cache->file_count * sizeof(*cache->files) ) &&
+              write_all( fd, cache->faces, cache->face_count * sizeof(*cache->faces) ) &&
+              write_all( fd, cache->dirs, cache->dir_count * sizeof(*cache->dirs) ) &&
+              write_all( fd, cache->strings, cache->strings_size * sizeof(WCHAR) );
+        close( fd );
+        if (ret && !rename( tmp, path ))
+            TRACE( "wrote %u files %u faces to %s\n", cache->file_count, cache->face_count, debugstr_a(path) );
         else
         {
-            face->scalable = FALSE;
-            reg_load_ftshort(hkey_face, face_width_value, &face->size.width);
-            reg_load_ftlong(hkey_face, face_size_value, &face->size.size);
-            reg_load_ftlong(hkey_face, face_x_ppem_value, &face->size.x_ppem);
-            reg_load_ftlong(hkey_face, face_y_ppem_value, &face->size.y_ppem);
-            reg_load_ftshort(hkey_face, face_internal_leading_value, &face->size.internal_leading);
-
-            TRACE("Adding bitmap size h %d w %d size %ld x_ppem %ld y_ppem %ld\n",
-                  face->size.height, face->size.width, face->size.size >> 6,
-                  face->size.x_ppem >> 6, face->size.y_ppem >> 6);
+            WARN( "failed to write %s\n", debugstr_a(path) );
+            unlink( tmp );
         }
+    }
+    else WARN( "can't create %s\n", debugstr_a(tmp) );
+
+    HeapFree( GetProcessHeap(), 0, tmp );
+    HeapFree( GetProcessHeap(), 0, path );
+}
 
-        TRACE("fsCsb = %08x %08x/%08x %08x %08x %08x\n",
-              face->fs.fsCsb[0], face->fs.fsCsb[1],
-              face->fs.fsUsb[0], face->fs.fsUsb[1],
-              face->fs.fsUsb[2], face->fs.fsUsb[3]);
+static void build_font_cache_hash( struct font_cache *cache )
+{
+    DWORD i, pos, size;
 
-        if (insert_face_in_family_list(face, family))
-            TRACE("Added font %s %s\n", debugstr_w(family->FamilyName), debugstr_w(face->StyleName));
+    for (size = 16; size < cache->file_count * 2; size *= 2) ;
+    if (!(cache->hash = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*cache->hash) ))) return;
+    cache->hash_size = size;
 
-        release_face( face );
+    for (i = 0; i < cache->file_count; i++)
+    {
+        pos = hash_cache_path( cache_string( cache, cache->files[i].path )) & (size - 1);
+        while (cache->hash[pos]) pos = (pos + 1) & (size - 1);
+        cache->hash[pos] = i + 1;
     }
+}
+
+static const struct font_cache_file *find_cache_file( const struct font_cache *cache, const WCHAR *path,
+                                                      DWORD flags, const struct stat *st )
+{
+    DWORD pos, index;
 
-    /* load bitmap strikes */
+    if (!cache->hash_size) return NULL;
 
-    needed = buffer_size;
-    while (!RegEnumKeyExW(hkey_face, strike_index++, buffer, &needed, NULL, NULL, NULL, NULL))
+    pos = hash_cache_path( path ) & (cache->hash_size - 1);
+    while ((index = cache->hash[pos]))
     {
-        if (!RegOpenKeyExW(hkey_face, buffer, 0, KEY_ALL_ACCESS, &hkey_strike))
-        {
-            load_face(hkey_strike, face_name, family, buffer, buffer_size);
-            RegCloseKey(hkey_strike);
-        }
-        needed = buffer_size;
+        const struct font_cache_file *file = &cache->files[index - 1];
+
+        if (file->flags == flags && file->mtime == get_mtime( st ) && file->size == st->st_size &&
+            !strcmpW( cache_string( cache, file->path ), path ))
+            return file;
+        pos = (pos + 1) & (cache->hash_size - 1);
+    }
+    return NULL;
+}
+
+static void cache_add_dir( struct font_cache *cache, const char *dirname )
+{
+    struct font_cache_dir *dir;
+    struct stat st;
+    WCHAR *path;
+
+    if (!grow_cache_array( (void **)&cache->dirs, &cache->max_dirs, cache->dir_count + 1, sizeof(*dir) ))
+    {
+        cache->failed = TRUE;
+        return;
     }
+    dir = &cache->dirs[cache->dir_count++];
+    dir->mtime = stat( dirname, &st ) ? 0 : get_mtime( &st );
+    path = towstr( CP_UNIXCP, dirname );
+    dir->path = cache_add_string( cache, path );
+    dir->pad = 0;
+    HeapFree( GetProcessHeap(), 0, path );
 }
 
-/* move vertical fonts after their horizontal counterpart */
-/* assumes that font_list is already sorted by family name */
-static void reorder_vertical_fonts(void)
+static void cache_begin_file( struct font_cache *cache, const WCHAR *path, DWORD flags, const struct stat *st )
 {
-    Family *family, *next, *vert_family;
-    struct list *ptr, *vptr;
-    struct list vertical_families = LIST_INIT( vertical_families );
+    struct font_cache_file *file;
 
-    LIST_FOR_EACH_ENTRY_SAFE( family, next, &font_list, Family, entry )
+    if (!grow_cache_array( (void **)&cache->files, &cache->max_files, cache->file_count + 1, sizeof(*file) ))
     {
-        if (family->FamilyName[0] != '@') continue;
-        list_remove( &family->entry );
-        list_add_tail( &vertical_families, &family->entry );
+        cache->failed = TRUE;
+        return;
     }
+    file = &cache->files[cache->file_count];
+    file->mtime = get_mtime( st );
+    file->size = st->st_size;
+    file->path = cache_add_string( cache, path );
+    file->flags = flags;
+    file->first_face = cache->face_count;
+    file->face_count = 0;
+    file->ret = 0;
+    file->pad = 0;
+    cache->current = cache->file_count++;
+}
+
+static void cache_end_file( struct font_cache *cache, INT ret )
+{
+    if (cache->current == ~0u) return;
+    cache->files[cache->current].ret = ret;
+    cache->current = ~0u;
+}
+
+static void cache_record_face( struct font_cache *cache, const Face *face,
+                               const WCHAR *family_name, const WCHAR *english_name )
+{
+    struct font_cache_face *rec;
 
-    ptr = list_head( &font_list );
-    vptr = list_head( &vertical_families );
-    while (ptr && vptr)
+    if (cache->current == ~0u) return;
+    if (!grow_cache_array( (void **)&cache->faces, &cache->max_faces, cache->face_count + 1, sizeof(*rec) ))
     {
-        family = LIST_ENTRY( ptr, Family, entry );
-        vert_family = LIST_ENTRY( vptr, Family, entry );
-        if (strcmpiW( family->FamilyName, vert_family->FamilyName + 1 ) > 0)
-        {
-            list_remove( vptr );
-            list_add_before( ptr, vptr );
-            vptr = list_head( &vertical_families );
-        }
-        else ptr = list_next( &font_list, ptr );
+        cache->failed = TRUE;
+        return;
+    }
+    rec = &cache->faces[cache->face_count++];
+    rec->family = cache_add_string( cache, family_name );
+    rec->english = cache_add_string( cache, english_name );
+    rec->style = cache_add_string( cache, face->StyleName );
+    rec->full = cache_add_string( cache, face->FullName );
+    rec->face_index = face->face_index;
+    rec->ntm_flags = face->ntmFlags;
+    rec->font_version = face->font_version;
+    rec->flags = face->flags;
+    rec->fs = face->fs;
+    rec->scalable = face->scalable;
+    rec->height = face->size.height;
+    rec->width = face->size.width;
+    rec->internal_leading = face->size.internal_leading;
+    rec->pad = 0;
+    rec->size = face->size.size;
+    rec->x_ppem = face->size.x_ppem;
+    rec->y_ppem = face->size.y_ppem;
+    cache->files[cache->current].face_count++;
+}
+
+static void copy_cache_file( struct font_cache *dst, const struct font_cache *src,
+                             const struct font_cache_file *file )
+{
+    struct font_cache_file *copy;
+    DWORD i;
+
+    if (!grow_cache_array( (void **)&dst->files, &dst->max_files, dst->file_count + 1, sizeof(*copy) ) ||
+        !grow_cache_array( (void **)&dst->faces, &dst->max_faces, dst->face_count + file->face_count,
+                           sizeof(*dst->faces) ))
+    {
+        dst->failed = TRUE;
+        return;
+    }
+    copy = &dst->files[dst->file_count++];
+    *copy = *file;
+    copy->path = cache_add_string( dst, cache_string( src, file->path ));
+    copy->first_face = dst->face_count;
+
+    for (i = 0; i < file->face_count; i++)
+    {
+        const struct font_cache_face *face = &src->faces[file->first_face + i];
+        struct font_cache_face *rec = &dst->faces[dst->face_count++];
+
+        *rec = *face;
+        rec->family = cache_add_string( dst, cache_string( src, face->family ));
+        rec->english = cache_add_string( dst, cache_string( src, face->english ));
+        rec->style = cache_add_string( dst, cache_string( src, face->style ));
+        rec->full = cache_add_string( dst, cache_string( src, face->full ));
     }
-    list_move_tail( &font_list, &vertical_families );
 }
 
-static void load_font_list_from_cache(HKEY hkey_font_cache)
+static void add_face_from_cache( const struct font_cache *cache, const struct font_cache_face *rec,
+                                 const WCHAR *file, const struct stat *st )
 {
-    DWORD size, family_index = 0;
+    Face *face = HeapAlloc( GetProcessHeap(), 0, sizeof(*face) );
     Family *family;
-    HKEY hkey_family;
-    WCHAR buffer[4096];
 
-    size = sizeof(buffer);
-    while (!RegEnumKeyExW(hkey_font_cache, family_index++, buffer, &size, NULL, NULL, NULL, NULL))
+    face->refcount = 1;
+    face->StyleName = cache_strdupW( cache, rec->style );
+    face->FullName = cache_strdupW( cache, rec->full );
+    face->file = strdupW( file );
+    face->dev = st->st_dev;
+    face->ino = st->st_ino;
+    face->font_data_ptr = NULL;
+    face->font_data_size = 0;
+    face->face_index = rec->face_index;
+    face->fs = rec->fs;
+    face->ntmFlags = rec->ntm_flags;
+    face->font_version = rec->font_version;
+    face->scalable = rec->scalable;
+    face->size.height = rec->height;
+    face->size.width = rec->width;
+    face->size.size = rec->size;
+    face->size.x_ppem = rec->x_ppem;
+    face->size.y_ppem = rec->y_ppem;
+    face->size.internal_leading = rec->internal_leading;
+    face->flags = rec->flags;
+    face->family = NULL;
+    face->cached_enum_data = NULL;
+
+    family = get_family( cache_strdupW( cache, rec->family ), cache_strdupW( cache, rec->english ));
+    add_face_to_family( face, family );
+    release_face( face );
+    release_family( family );
+}
+
+static void add_file_from_cache( const struct font_cache *cache, const struct font_cache_file *file,
+                                 const struct stat *st )
+{
+    const WCHAR *path = cache_string( cache, file->path );
+    DWORD i;
+
+    for (i = 0; i < file->face_count; i++)
+        add_face_from_cache( cache, &cache->faces[file->first_face + i], path, st );
+}
+
+static void load_font_list_from_cache( const struct font_cache *cache )
+{
+    struct stat st;
+    char *path;
+    DWORD i;
+
+    for (i = 0; i < cache->file_count; i++)
     {
-        WCHAR *english_family = NULL;
-        WCHAR *family_name = strdupW( buffer );
-        DWORD face_index = 0;
+        path = strWtoA( CP_UNIXCP, cache_string( cache, cache->files[i].path ));
+        if (!stat( path, &st )) add_file_from_cache( cache, &cache->files[i], &st );
+        HeapFree( GetProcessHeap(), 0, path );
+    }
+    TRACE( "loaded %u files %u faces from the font index\n", cache->file_count, cache->face_count );
+}
 
-        RegOpenKeyExW(hkey_font_cache, family_name, 0, KEY_ALL_ACCESS, &hkey_family);
-        TRACE("opened family key %s\n", debugstr_w(family_name));
-        size = sizeof(buffer);
-        if (!RegQueryValueExW(hkey_family, english_name_value, NULL, NULL, (BYTE *)buffer, &size))
-            english_family = strdupW( buffer );
+/*************************************************************
+ * add_font_from_cache
+ *
+ * Replay a file that didn't change since the previous index was written.
+ * Returns -1 if it has to be loaded with FreeType, in which case the faces
+ * that get added for it are recorded in the new index.
+ */
+static INT add_font_from_cache( const char *file, DWORD flags )
+{
+    const struct font_cache_file *cache_file = NULL;
+    struct stat st;
+    WCHAR *path;
+
+    if (stat( file, &st ) == -1) return -1;
+
+    path = towstr( CP_UNIXCP, file );
+    if (prev_font_cache) cache_file = find_cache_file( prev_font_cache, path, flags, &st );
+    if (cache_file)
+    {
+        TRACE( "%s unchanged, using the font index\n", debugstr_a(file) );
+        add_file_from_cache( prev_font_cache, cache_file, &st );
+        copy_cache_file( font_cache, prev_font_cache, cache_file );
+    }
+    else cache_begin_file( font_cache, path, flags, &st );
+    HeapFree( GetProcessHeap(), 0, path );
+
+    return cache_file ? cache_file->ret : -1;
+}
+
+static void remove_face_from_cache( Face *face )
+{
+    struct removed_font_file *removed;
+
+    /* only AddFontResource fonts can go away, and only once the list is complete */
+    if (!font_cache_ready || !font_cache || !face->file || !(face->flags & ADDFONT_ADD_RESOURCE)) return;
+
+    if (!grow_cache_array( (void **)&removed_font_files, &removed_font_files_size,
+                           removed_font_files_count + 1, sizeof(*removed_font_files) ))
+        return;
+    removed = &removed_font_files[removed_font_files_count];
+    if (!(removed->path = strdupW( face->file ))) return;
+    removed->pending = font_cache->file_count;
+    removed_font_files_count++;
+}
+
+/* index is the position of the file in font_cache, or ~0u for a file of the index on disk */
+static BOOL font_file_removed( const struct font_cache *cache, const struct font_cache_file *file, DWORD index )
+{
+    DWORD i;
+
+    if (!(file->flags & ADDFONT_ADD_RESOURCE)) return FALSE;
+    for (i = 0; i < removed_font_files_count; i++)
+    {
+        if (index != ~0u && index >= removed_font_files[i].pending) continue;
+        if (!strcmpW( removed_font_files[i].path, cache_string( cache, file->path ))) return TRUE;
+    }
+    return FALSE;
+}
+
+/* the same file can be added again by any process, keep a single record of it */
+static BOOL font_file_merged( const struct font_cache *merged, const struct font_cache *cache,
+                              const struct font_cache_file *file )
+{
+    DWORD i;
 
-        family = create_family(family_name, english_family);
+    if (!(file->flags & ADDFONT_ADD_RESOURCE)) return FALSE;
+    for (i = 0; i < merged->file_count; i++)
+    {
+        if (!(merged->files[i].flags & ADDFONT_ADD_RESOURCE)) continue;
+        if (merged->files[i].mtime == file->mtime &&
+            !strcmpW( cache_string( merged, merged->files[i].path ), cache_string( cache, file->path )))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static inline BOOL font_cache_pending(void)
+{
+    return font_cache && (font_cache->file_count || removed_font_files_count);
+}
+
+/*************************************************************
+ * flush_font_cache
+ *
+ * Merge the fonts added and removed with AddFontResource and
+ * RemoveFontResource into the index, so that new processes see them.
+ * When the process is exiting, other threads may have died holding
+ * freetype_cs, so the flush is skipped rather than waiting for it.
+ */
+static void flush_font_cache( BOOL process_exit )
+{
+    struct font_cache *disk, *merged;
+    HANDLE mutex;
+    BOOL pending;
+    DWORD i;
+
+    if (process_exit)
+    {
+        if (!TryEnterCriticalSection( &freetype_cs )) return;
+    }
+    else EnterCriticalSection( &freetype_cs );
+    pending = font_cache_pending();
+    LeaveCriticalSection( &freetype_cs );
+    if (!pending) return;
 
-        if(english_family)
+    if (!(mutex = CreateMutexW( NULL, FALSE, font_mutex_nameW ))) return;
+    WaitForSingleObject( mutex, INFINITE );
+    if (process_exit)
+    {
+        if (!TryEnterCriticalSection( &freetype_cs ))
         {
-            FontSubst *subst = HeapAlloc(GetProcessHeap(), 0, sizeof(*subst));
-            subst->from.name = strdupW(english_family);
-            subst->from.charset = -1;
-            subst->to.name = strdupW(family_name);
-            subst->to.charset = -1;
-            add_font_subst(&font_subst_list, subst, 0);
+            ReleaseMutex( mutex );
+            CloseHandle( mutex );
+            return;
         }
+    }
+    else EnterCriticalSection( &freetype_cs );
 
-        size = sizeof(buffer);
-        while (!RegEnumKeyExW(hkey_family, face_index++, buffer, &size, NULL, NULL, NULL, NULL))
+    if (font_cache_timer)
+    {
+        DeleteTimerQueueTimer( NULL, font_cache_timer, NULL );
+        font_cache_timer = NULL;
+    }
+
+    /* if there is no usable index, the next process rebuilds it anyway */
+    if (font_cache_pending() && (disk = map_font_cache()))
+    {
+        if ((merged = alloc_font_cache()))
         {
-            WCHAR *face_name = strdupW( buffer );
-            HKEY hkey_face;
+            if (grow_cache_array( (void **)&merged->dirs, &merged->max_dirs, disk->dir_count, sizeof(*merged->dirs) ))
+            {
+                for (i = 0; i < disk->dir_count; i++)
+                {
+                    merged->dirs[i] = disk->dirs[i];
+                    merged->dirs[i].path = cache_add_string( merged, cache_string( disk, disk->dirs[i].path ));
+                }
+                merged->dir_count = disk->dir_count;
+            }
+            else merged->failed = TRUE;
+
+            for (i = 0; i < disk->file_count; i++)
+            {
+                const struct font_cache_file *file = &disk->files[i];
 
-            if (!RegOpenKeyExW(hkey_family, face_name, 0, KEY_ALL_ACCESS, &hkey_face))
+                if (font_file_removed( disk, file, ~0u ) || font_file_merged( merged, disk, file ))
+                    continue;
+                copy_cache_file( merged, disk, file );
+            }
+            for (i = 0; i < font_cache->file_count; i++)
             {
-                load_face(hkey_face, face_name, family, buffer, sizeof(buffer));
-                RegCloseKey(hkey_face);
+                const struct font_cache_file *file = &font_cache->files[i];
+
+                if (font_file_removed( font_cache, file, i ) || font_file_merged( merged, font_cache, file ))
+                    continue;
+                copy_cache_file( merged, font_cache, file );
             }
-            HeapFree( GetProcessHeap(), 0, face_name );
-            size = sizeof(buffer);
+
+            write_font_cache( merged );
+            free_font_cache( merged );
         }
-        RegCloseKey(hkey_family);
-        release_family( family );
-        size = sizeof(buffer);
+        free_font_cache( disk );
     }
 
-    reorder_vertical_fonts();
+    free_font_cache( font_cache );
+    font_cache = alloc_font_cache();
+    for (i = 0; i < removed_font_files_count; i++) HeapFree( GetProcessHeap(), 0, removed_font_files[i].path );
+    removed_font_files_count = 0;
+
+    LeaveCriticalSection( &freetype_cs );
+    ReleaseMutex( mutex );
+    CloseHandle( mutex );
 }
 
-static LONG create_font_cache_key(HKEY *hkey, DWORD *disposition)
+static void CALLBACK font_cache_timer_proc( void *arg, BOOLEAN fired )
 {
-    LONG ret;
-    HKEY hkey_wine_fonts;
+    flush_font_cache( FALSE );
+}
 
-    /* We don't want to create the fonts key as volatile, so open this first */
-    ret = RegCreateKeyExW(HKEY_CURRENT_USER, wine_fonts_key, 0, NULL, 0,
-                          KEY_ALL_ACCESS, NULL, &hkey_wine_fonts, NULL);
-    if(ret != ERROR_SUCCESS)
+/* AddFontResource calls usually come in batches, the index is written once they are done */
+static void schedule_font_cache_flush(void)
+{
+    BOOL flush = FALSE;
+
+    EnterCriticalSection( &freetype_cs );
+    if (!font_cache_timer && font_cache_pending())
+        flush = !CreateTimerQueueTimer( &font_cache_timer, NULL, font_cache_timer_proc, NULL,
+                                        FONT_CACHE_FLUSH_DELAY, 0, WT_EXECUTEONLYONCE );
+    LeaveCriticalSection( &freetype_cs );
+    if (flush) flush_font_cache( FALSE );
+}
+
+/*
+ * Process-wide glyph cache
+ *
+ * GetGlyphOutline results are kept in a size-bounded LRU cache shared by
+ * all the fonts that render the same way.  The key is made of the font
+ * file, the face, the pixel size, the font transform and the other
+ * parameters used by get_glyph_outline, so entries outlive the GdiFont
+ * that created them and are shared by HFONTs that resolve to the same
+ * face.  The cache is split in stripes that each have their own lock and
+ * LRU list, and lookups don't need freetype_cs.
+ */
+
+#define GLYPH_CACHE_STRIPES      16
+#define GLYPH_CACHE_BUCKETS      64  /* per stripe */
+#define GLYPH_CACHE_FONT_BUCKETS 256
+#define GLYPH_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+struct glyph_font_key
+{
+    dev_t     dev;
+    ino_t     ino;
+    size_t    file_size;
+    FT_Long   face_index;
+    FT_UShort x_ppem;
+    FT_UShort y_ppem;
+    FT_Fixed  x_scale;
+    FT_Fixed  y_scale;
+    double    scale_y;
+    LONG      aveWidth;
+    LONG      ppem;
+    FMAT2     matrix;
+    INT       orientation;
+    int       charset;
+    int       codepage;
+    BOOL      fake_bold;
+    BOOL      fake_italic;
+    LONG      generation;    /* fonts added or removed since then change font linking */
+};
+
+struct glyph_cache_font
+{
+    struct list           entry;
+    unsigned int          refcount;
+    DWORD                 hash;
+    struct glyph_font_key key;
+    WCHAR                *name;  /* determines font linking and vertical writing */
+};
+
+struct glyph_cache_entry
+{
+    struct list              entry;      /* entry in the hash bucket */
+    struct list              lru_entry;
+    struct glyph_cache_font *font;
+    DWORD                    hash;
+    UINT                     glyph;
+    UINT                     format;
+    MAT2                     mat;
+    GLYPHMETRICS             gm;
+    DWORD                    ret;        /* value returned by get_glyph_outline */
+    BOOL                     has_data;   /* data holds the ret bytes it returned */
+    BYTE                     data[1];
+};
+
+struct glyph_cache_stripe
+{
+    CRITICAL_SECTION cs;
+    struct list      lru;
+    struct list      buckets[GLYPH_CACHE_BUCKETS];
+    SIZE_T           size;
+    SIZE_T           max_size;
+    DWORD            count;
+};
+
+static struct glyph_cache_stripe glyph_cache[GLYPH_CACHE_STRIPES];
+static DWORD glyph_cache_size = GLYPH_CACHE_DEFAULT_SIZE;
+static BOOL glyph_cache_enabled;
+static LONG glyph_cache_generation;
+static LONG glyph_cache_hits, glyph_cache_misses, glyph_cache_evictions;
+static struct list glyph_cache_fonts[GLYPH_CACHE_FONT_BUCKETS];
+
+static CRITICAL_SECTION glyph_cache_fonts_cs;
+static CRITICAL_SECTION_DEBUG glyph_cache_fonts_cs_debug =
+{
+    0, 0, &glyph_cache_fonts_cs,
+    { &glyph_cache_fonts_cs_debug.ProcessLocksList, &glyph_cache_fonts_cs_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": glyph_cache_fonts_cs") }
+};
+static CRITICAL_SECTION glyph_cache_fonts_cs = { &glyph_cache_fonts_cs_debug, -1, 0, 0, 0, 0 };
+
+static inline DWORD hash_glyph_data( DWORD hash, const void *data, size_t size )
+{
+    const BYTE *ptr = data;
+
+    while (size--) hash = (hash ^ *ptr++) * 0x01000193;
+    return hash;
+}
+
+static void init_glyph_cache(void)
+{
+    unsigned int i, j;
+
+    if (!glyph_cache_size) return;
+
+    for (i = 0; i < GLYPH_CACHE_STRIPES; i++)
     {
-        WARN("Can't create %s\n", debugstr_w(wine_fonts_key));
-        return ret;
+        struct glyph_cache_stripe *stripe = &glyph_cache[i];
+
+        InitializeCriticalSection( &stripe->cs );
+        stripe->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": glyph_cache");
+        list_init( &stripe->lru );
+        for (j = 0; j < GLYPH_CACHE_BUCKETS; j++) list_init( &stripe->buckets[j] );
+        stripe->max_size = glyph_cache_size / GLYPH_CACHE_STRIPES;
     }
+    for (i = 0; i < GLYPH_CACHE_FONT_BUCKETS; i++) list_init( &glyph_cache_fonts[i] );
+    glyph_cache_enabled = TRUE;
+    TRACE_(glyphcache)( "using %u KB\n", glyph_cache_size / 1024 );
+}
 
-    ret = RegCreateKeyExW(hkey_wine_fonts, wine_fonts_cache_key, 0, NULL, REG_OPTION_VOLATILE,
-                          KEY_ALL_ACCESS, NULL, hkey, disposition);
-    RegCloseKey(hkey_wine_fonts);
-    return ret;
+static void dump_glyph_cache_stats(void)
+{
+    LONG hits = glyph_cache_hits, misses = glyph_cache_misses;
+    SIZE_T size = 0;
+    DWORD count = 0;
+    unsigned int i;
+
+    /* no locking, these are only statistics */
+    for (i = 0; i < GLYPH_CACHE_STRIPES; i++)
+    {
+        size += glyph_cache[i].size;
+        count += glyph_cache[i].count;
+    }
+    TRACE_(glyphcache)( "%d hits %d misses (%d%% hit rate), %u glyphs using %u/%u KB, %d evictions\n",
+                        hits, misses, hits + misses ? MulDiv( hits, 100, hits + misses ) : 0,
+                        count, (DWORD)(size / 1024), glyph_cache_size / 1024, glyph_cache_evictions );
 }
 
-static void add_face_to_cache(Face *face)
+/* get the shared key of a font; memory fonts don't have a stable identity and aren't cached */
+static struct glyph_cache_font *get_glyph_cache_font( const GdiFont *font )
 {
-    HKEY hkey_family, hkey_face;
-    WCHAR *face_key_name;
+    struct glyph_cache_font *cache_font;
+    struct glyph_font_key key;
+    struct list *bucket;
+    DWORD hash;
 
-    RegCreateKeyExW(hkey_font_cache, face->family->FamilyName, 0,
-                    NULL, REG_OPTION_VOLATILE, KEY_ALL_ACCESS, NULL, &hkey_family, NULL);
-    if(face->family->EnglishName)
-        RegSetValueExW(hkey_family, english_name_value, 0, REG_SZ, (BYTE*)face->family->EnglishName,
-                       (strlenW(face->family->EnglishName) + 1) * sizeof(WCHAR));
+    if (!glyph_cache_enabled || !font->mapping) return NULL;
+
+    memset( &key, 0, sizeof(key) );
+    key.dev = font->mapping->dev;
+    key.ino = font->mapping->ino;
+    key.file_size = font->mapping->size;
+    key.face_index = font->ft_face->face_index;
+    key.x_ppem = font->ft_face->size->metrics.x_ppem;
+    key.y_ppem = font->ft_face->size->metrics.y_ppem;
+    key.x_scale = font->ft_face->size->metrics.x_scale;
+    key.y_scale = font->ft_face->size->metrics.y_scale;
+    key.scale_y = font->scale_y;
+    key.aveWidth = font->aveWidth;
+    key.ppem = font->ppem;
+    key.matrix = font->font_desc.matrix;
+    key.orientation = font->orientation;
+    key.charset = font->charset;
+    key.codepage = font->codepage;
+    key.fake_bold = font->fake_bold;
+    key.fake_italic = font->fake_italic;
+    key.generation = glyph_cache_generation;
+
+    hash = hash_glyph_data( 0x811c9dc5, &key, sizeof(key) );
+    hash = hash_glyph_data( hash, font->name, strlenW( font->name ) * sizeof(WCHAR) );
+    bucket = &glyph_cache_fonts[hash % GLYPH_CACHE_FONT_BUCKETS];
+
+    EnterCriticalSection( &glyph_cache_fonts_cs );
+    LIST_FOR_EACH_ENTRY( cache_font, bucket, struct glyph_cache_font, entry )
+    {
+        if (cache_font->hash == hash && !memcmp( &cache_font->key, &key, sizeof(key) ) &&
+            !strcmpW( cache_font->name, font->name ))
+        {
+            cache_font->refcount++;
+            goto done;
+        }
+    }
+    if ((cache_font = HeapAlloc( GetProcessHeap(), 0, sizeof(*cache_font) )))
+    {
+        cache_font->refcount = 1;
+        cache_font->hash = hash;
+        cache_font->key = key;
+        cache_font->name = strdupW( font->name );
+        list_add_head( bucket, &cache_font->entry );
+    }
+done:
+    LeaveCriticalSection( &glyph_cache_fonts_cs );
+    return cache_font;
+}
 
-    if(face->scalable)
-        face_key_name = face->StyleName;
-    else
+static void release_glyph_cache_font( struct glyph_cache_font *cache_font )
+{
+    if (!cache_font) return;
+
+    EnterCriticalSection( &glyph_cache_fonts_cs );
+    if (!--cache_font->refcount)
     {
-        static const WCHAR fmtW[] = {'%','s','\\','%','d',0};
-        face_key_name = HeapAlloc(GetProcessHeap(), 0, (strlenW(face->StyleName) + 10) * sizeof(WCHAR));
-        sprintfW(face_key_name, fmtW, face->StyleName, face->size.y_ppem);
+        list_remove( &cache_font->entry );
+        HeapFree( GetProcessHeap(), 0, cache_font->name );
+        HeapFree( GetProcessHeap(), 0, cache_font );
     }
-    RegCreateKeyExW(hkey_family, face_key_name, 0, NULL, REG_OPTION_VOLATILE, KEY_ALL_ACCESS, NULL,
-                    &hkey_face, NULL);
-    if(!face->scalable)
-        HeapFree(GetProcessHeap(), 0, face_key_name);
+    LeaveCriticalSection( &glyph_cache_fonts_cs );
+}
+
+static inline DWORD glyph_cache_hash( const struct glyph_cache_font *cache_font, UINT glyph, UINT format,
+                                      const MAT2 *mat )
+{
+    DWORD hash = cache_font->hash;
+
+    hash = hash_glyph_data( hash, &glyph, sizeof(glyph) );
+    hash = hash_glyph_data( hash, &format, sizeof(format) );
+    return hash_glyph_data( hash, mat, sizeof(*mat) );
+}
+
+static inline struct glyph_cache_stripe *get_glyph_cache_stripe( DWORD hash )
+{
+    return &glyph_cache[hash % GLYPH_CACHE_STRIPES];
+}
 
-    RegSetValueExW(hkey_face, face_file_name_value, 0, REG_SZ, (BYTE *)face->file,
-                   (strlenW(face->file) + 1) * sizeof(WCHAR));
-    if (face->FullName)
-        RegSetValueExW(hkey_face, face_full_name_value, 0, REG_SZ, (BYTE*)face->FullName,
-                       (strlenW(face->FullName) + 1) * sizeof(WCHAR));
+static inline struct list *get_glyph_cache_bucket( struct glyph_cache_stripe *stripe, DWORD hash )
+{
+    return &stripe->buckets[(hash / GLYPH_CACHE_STRIPES) % GLYPH_CACHE_BUCKETS];
+}
 
-    reg_save_dword(hkey_face, face_index_value, face->face_index);
-    reg_save_dword(hkey_face, face_ntmflags_value, face->ntmFlags);
-    reg_save_dword(hkey_face, face_version_value, face->font_version);
-    if (face->flags) reg_save_dword(hkey_face, face_flags_value, face->flags);
+static inline SIZE_T glyph_cache_entry_size( const struct glyph_cache_entry *entry )
+{
+    return FIELD_OFFSET( struct glyph_cache_entry, data[entry->has_data ? entry->ret : 0] );
+}
 
-    RegSetValueExW(hkey_face, face_font_sig_value, 0, REG_BINARY, (BYTE*)&face->fs, sizeof(face->fs));
+static struct glyph_cache_entry *find_glyph_cache_entry( struct glyph_cache_stripe *stripe, DWORD hash,
+                                                         const struct glyph_cache_font *cache_font,
+                                                         UINT glyph, UINT format, const MAT2 *mat )
+{
+    struct glyph_cache_entry *entry;
 
-    if(!face->scalable)
+    LIST_FOR_EACH_ENTRY( entry, get_glyph_cache_bucket( stripe, hash ), struct glyph_cache_entry, entry )
     {
-        reg_save_dword(hkey_face, face_height_value, face->size.height);
-        reg_save_dword(hkey_face, face_width_value, face->size.width);
-        reg_save_dword(hkey_face, face_size_value, face->size.size);
-        reg_save_dword(hkey_face, face_x_ppem_value, face->size.x_ppem);
-        reg_save_dword(hkey_face, face_y_ppem_value, face->size.y_ppem);
-        reg_save_dword(hkey_face, face_internal_leading_value, face->size.internal_leading);
+        if (entry->hash == hash && entry->font == cache_font && entry->glyph == glyph &&
+            entry->format == format && !memcmp( &entry->mat, mat, sizeof(*mat) ))
+            return entry;
     }
-    RegCloseKey(hkey_face);
-    RegCloseKey(hkey_family);
+    return NULL;
 }
 
-static void remove_face_from_cache( Face *face )
+static void remove_glyph_cache_entry( struct glyph_cache_stripe *stripe, struct glyph_cache_entry *entry )
 {
-    HKEY hkey_family;
+    list_remove( &entry->entry );
+    list_remove( &entry->lru_entry );
+    stripe->size -= glyph_cache_entry_size( entry );
+    stripe->count--;
+    release_glyph_cache_font( entry->font );
+    HeapFree( GetProcessHeap(), 0, entry );
+}
 
-    RegOpenKeyExW( hkey_font_cache, face->family->FamilyName, 0, KEY_ALL_ACCESS, &hkey_family );
+/*************************************************************
+ * lookup_glyph_cache
+ *
+ * Returns TRUE if the result of get_glyph_outline is known for these
+ * parameters, in which case it's stored in ret, lpgm and buf.
+ */
+static BOOL lookup_glyph_cache( const GdiFont *font, UINT glyph, UINT format, LPGLYPHMETRICS lpgm,
+                                DWORD buflen, LPVOID buf, const MAT2 *lpmat, DWORD *ret )
+{
+    struct glyph_cache_stripe *stripe;
+    struct glyph_cache_entry *entry;
+    BOOL want_data = buf && buflen && format != GGO_METRICS;
+    LONG hits, misses;
+    DWORD hash;
+
+    if (!font->glyph_font) return FALSE;
 
-    if (face->scalable)
+    hash = glyph_cache_hash( font->glyph_font, glyph, format, lpmat );
+    stripe = get_glyph_cache_stripe( hash );
+
+    EnterCriticalSection( &stripe->cs );
+    if ((entry = find_glyph_cache_entry( stripe, hash, font->glyph_font, glyph, format, lpmat )) &&
+        (entry->has_data || !want_data))
     {
-        RegDeleteKeyW( hkey_family, face->StyleName );
+        /* the metrics are known, return them even if the buffer is too small */
+        *lpgm = entry->gm;
+        if (want_data && entry->ret > buflen) *ret = GDI_ERROR;
+        else
+        {
+            if (want_data) memcpy( buf, entry->data, entry->ret );
+            *ret = entry->ret;
+        }
+        list_remove( &entry->lru_entry );
+        list_add_head( &stripe->lru, &entry->lru_entry );
+    }
+    else entry = NULL;
+    LeaveCriticalSection( &stripe->cs );
+
+    if (entry)
+    {
+        hits = InterlockedIncrement( &glyph_cache_hits );
+        misses = glyph_cache_misses;
     }
     else
     {
-        static const WCHAR fmtW[] = {'%','s','\\','%','d',0};
-        WCHAR *face_key_name = HeapAlloc(GetProcessHeap(), 0, (strlenW(face->StyleName) + 10) * sizeof(WCHAR));
-        sprintfW(face_key_name, fmtW, face->StyleName, face->size.y_ppem);
-        RegDeleteKeyW( hkey_family, face_key_name );
-        HeapFree(GetProcessHeap(), 0, face_key_name);
+        misses = InterlockedIncrement( &glyph_cache_misses );
+        hits = glyph_cache_hits;
     }
-    RegCloseKey(hkey_family);
+    if (!((hits + misses) % 4096) && TRACE_ON(glyphcache)) dump_glyph_cache_stats();
+    return entry != NULL;
+}
+
+static void add_to_glyph_cache( const GdiFont *font, UINT glyph, UINT format, const GLYPHMETRICS *gm,
+                                DWORD buflen, const void *buf, const MAT2 *lpmat, DWORD ret )
+{
+    struct glyph_cache_stripe *stripe;
+    struct glyph_cache_entry *entry, *old;
+    BOOL has_data = buf && buflen && format != GGO_METRICS;
+    DWORD hash;
+
+    if (!font->glyph_font) return;
+
+    hash = glyph_cache_hash( font->glyph_font, glyph, format, lpmat );
+    stripe = get_glyph_cache_stripe( hash );
+
+    /* don't let a single huge glyph flush the whole stripe */
+    if (has_data && ret > stripe->max_size / 8) return;
+    if (!(entry = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET( struct glyph_cache_entry,
+                                                                data[has_data ? ret : 0] ))))
+        return;
+
+    entry->hash = hash;
+    entry->glyph = glyph;
+    entry->format = format;
+    entry->mat = *lpmat;
+    entry->gm = *gm;
+    entry->ret = ret;
+    entry->has_data = has_data;
+    if (has_data) memcpy( entry->data, buf, ret );
+
+    EnterCriticalSection( &stripe->cs );
+    if ((old = find_glyph_cache_entry( stripe, hash, font->glyph_font, glyph, format, lpmat )))
+    {
+        if (old->has_data || !has_data)
+        {
+            LeaveCriticalSection( &stripe->cs );
+            HeapFree( GetProcessHeap(), 0, entry );
+            return;
+        }
+        remove_glyph_cache_entry( stripe, old );
+    }
+
+    EnterCriticalSection( &glyph_cache_fonts_cs );
+    entry->font = font->glyph_font;
+    entry->font->refcount++;
+    LeaveCriticalSection( &glyph_cache_fonts_cs );
+
+    list_add_head( get_glyph_cache_bucket( stripe, hash ), &entry->entry );
+    list_add_head( &stripe->lru, &entry->lru_entry );
+    stripe->size += glyph_cache_entry_size( entry );
+    stripe->count++;
+
+    while (stripe->size > stripe->max_size && list_tail( &stripe->lru ) != &entry->lru_entry)
+    {
+        old = LIST_ENTRY( list_tail( &stripe->lru ), struct glyph_cache_entry, lru_entry );
+        remove_glyph_cache_entry( stripe, old );
+        InterlockedIncrement( &glyph_cache_evictions );
+    }
+    LeaveCriticalSection( &stripe->cs );
 }
 
 static WCHAR *prepend_at(WCHAR *family)
@@ -1921,38 +2861,6 @@ static void get_family_names( FT_Face ft_face, WCHAR **name, WCHAR **english, BO
     }
 }
 
-static Family *get_family( FT_Face ft_face, BOOL vertical )
-{
-    Family *family;
-    WCHAR *name, *english_name;
-
-    get_family_names( ft_face, &name, &english_name, vertical );
-
-    family = find_family_from_name( name );
-
-    if (!family)
-    {
-        family = create_family( name, english_name );
-        if (english_name)
-        {
-            FontSubst *subst = HeapAlloc( GetProcessHeap(), 0, sizeof(*subst) );
-            subst->from.name = strdupW( english_name );
-            subst->from.charset = -1;
-            subst->to.name = strdupW( name );
-            subst->to.charset = -1;
-            add_font_subst( &font_subst_list, subst, 0 );
-        }
-    }
-    else
-    {
-        HeapFree( GetProcessHeap(), 0, name );
-        HeapFree( GetProcessHeap(), 0, english_name );
-        family->refcount++;
-    }
-
-    return family;
-}
-
 static inline FT_Fixed get_font_version( FT_Face ft_face )
 {
     FT_Fixed version = 0;
@@ -2141,25 +3049,15 @@ static void AddFaceToList(FT_Face ft_face, const char *file, void *font_data_ptr
 {
     Face *face;
     Family *family;
+    WCHAR *name, *english_name;
 
     face = create_face( ft_face, face_index, file, font_data_ptr, font_data_size, flags );
-    family = get_family( ft_face, flags & ADDFONT_VERTICAL_FONT );
-    if (strlenW(family->FamilyName) >= LF_FACESIZE)
-    {
-        WARN("Ignoring %s because name is too long\n", debugstr_w(family->FamilyName));
-        release_face( face );
-        release_family( family );
-        return;
-    }
-
-    if (insert_face_in_family_list( face, family ))
-    {
-        if (flags & ADDFONT_ADD_TO_CACHE)
-            add_face_to_cache( face );
+    get_family_names( ft_face, &name, &english_name, flags & ADDFONT_VERTICAL_FONT );
+    if ((flags & ADDFONT_ADD_TO_CACHE) && font_cache)
+        cache_record_face( font_cache, face, name, english_name );
 
-        TRACE("Added font %s %s\n", debugstr_w(family->FamilyName),
-              debugstr_w(face->StyleName));
-    }
+    family = get_family( name, english_name );
+    add_face_to_family( face, family );
     release_face( face );
     release_family( family );
 }
@@ -2270,18 +3168,29 @@ static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_
     }
 #endif /* HAVE_CARBON_CARBON_H */
 
+    if (file && (flags & ADDFONT_ADD_TO_CACHE) && font_cache)
+    {
+        if ((ret = add_font_from_cache( file, flags )) >= 0) return ret;
+        ret = 0;
+    }
+
     do {
         const DWORD FS_DBCS_MASK = FS_JISJAPAN|FS_CHINESESIMP|FS_WANSUNG|FS_CHINESETRAD|FS_JOHAB;
         FONTSIGNATURE fs;
 
         ft_face = new_ft_face( file, font_data_ptr, font_data_size, face_index, flags & ADDFONT_ALLOW_BITMAP );
-        if (!ft_face) return 0;
+        if (!ft_face)
+        {
+            ret = 0;
+            break;
+        }
 
         if(ft_face->family_name[0] == '.') /* Ignore fonts with names beginning with a dot */
         {
             TRACE("Ignoring %s since its family name begins with a dot\n", debugstr_a(file));
             pFT_Done_Face(ft_face);
-            return 0;
+            ret = 0;
+            break;
         }
 
         AddFaceToList(ft_face, file, font_data_ptr, font_data_size, face_index, flags);
@@ -2298,9 +3207,31 @@ static INT AddFontToList(const char *file, void *font_data_ptr, DWORD font_data_
 	num_faces = ft_face->num_faces;
 	pFT_Done_Face(ft_face);
     } while(num_faces > ++face_index);
+
+    if (font_cache) cache_end_file( font_cache, ret );
     return ret;
 }
 
+/* files added with AddFontResource by processes of the current session */
+static void add_font_resources_from_cache( const struct font_cache *cache )
+{
+    char *path;
+    DWORD i, j;
+
+    for (i = 0; i < cache->file_count; i++)
+    {
+        if (!(cache->files[i].flags & ADDFONT_ADD_RESOURCE)) continue;
+        for (j = 0; j < i; j++)
+            if ((cache->files[j].flags & ADDFONT_ADD_RESOURCE) &&
+                !strcmpW( cache_string( cache, cache->files[j].path ), cache_string( cache, cache->files[i].path )))
+                break;
+        if (j < i) continue;  /* already added, possibly with an older stamp */
+        path = strWtoA( CP_UNIXCP, cache_string( cache, cache->files[i].path ));
+        AddFontToList( path, NULL, 0, cache->files[i].flags );
+        HeapFree( GetProcessHeap(), 0, path );
+    }
+}
+
 static int remove_font_resource( const char *file, DWORD flags )
 {
     Family *family, *family_next;
@@ -2727,6 +3658,7 @@ static BOOL ReadFontDir(const char *dirname, BOOL external_fonts)
 
     TRACE("Loading fonts from %s\n", debugstr_a(dirname));
 
+    if (font_cache) cache_add_dir( font_cache, dirname );
     dir = opendir(dirname);
     if(!dir) {
         WARN("Can't open directory %s\n", debugstr_a(dirname));
@@ -3278,7 +4210,9 @@ INT WineEngAddFontResourceEx(LPCWSTR file, DWORD flags, PVOID pdv)
             }
         }
 
+        if (ret) InterlockedIncrement( &glyph_cache_generation );
         LeaveCriticalSection( &freetype_cs );
+        schedule_font_cache_flush();
     }
     return ret;
 }
@@ -3301,6 +4235,7 @@ HANDLE WineEngAddFontMemResourceEx(PVOID pbFont, DWORD cbFont, PVOID pdv, DWORD
 
         EnterCriticalSection( &freetype_cs );
         *pcFonts = AddFontToList(NULL, pFontCopy, cbFont, ADDFONT_ALLOW_BITMAP | ADDFONT_ADD_RESOURCE);
+        if (*pcFonts) InterlockedIncrement( &glyph_cache_generation );
         LeaveCriticalSection( &freetype_cs );
 
         if (*pcFonts == 0)
@@ -3359,7 +4294,9 @@ BOOL WineEngRemoveFontResourceEx(LPCWSTR file, DWORD flags, PVOID pdv)
             }
         }
 
+        if (ret) InterlockedIncrement( &glyph_cache_generation );
         LeaveCriticalSection( &freetype_cs );
+        schedule_font_cache_flush();
     }
     return ret;
 }
@@ -4354,8 +5291,10 @@ static void reorder_font_list(void)
 static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **context)
 {
     HKEY hkey;
-    DWORD disposition;
+    DWORD disposition = REG_CREATED_NEW_KEY;
     HANDLE font_mutex;
+    struct font_cache *cache;
+    BOOL rebuilt;
 
     if(!init_freetype()) return TRUE;
 
@@ -4368,6 +5307,7 @@ static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **c
         static const WCHAR antialias_fake_bold_or_italic[] = { 'A','n','t','i','a','l','i','a','s','F','a','k','e',
                                                                'B','o','l','d','O','r','I','t','a','l','i','c',0 };
         static const WCHAR true_options[] = { 'y','Y','t','T','1',0 };
+        static const WCHAR glyph_cache_sizeW[] = {'G','l','y','p','h','C','a','c','h','e','S','i','z','e',0};
         DWORD type, size;
         WCHAR buffer[20];
 
@@ -4377,8 +5317,12 @@ static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **c
         {
             antialias_fakes = (strchrW(true_options, buffer[0]) != NULL);
         }
+        /* in KB, 0 disables the glyph cache */
+        if (!reg_load_dword(hkey, glyph_cache_sizeW, &size))
+            glyph_cache_size = min( size, 1024 * 1024 ) * 1024;
         RegCloseKey(hkey);
     }
+    init_glyph_cache();
 
     if((font_mutex = CreateMutexW(NULL, FALSE, font_mutex_nameW)) == NULL)
     {
@@ -4387,12 +5331,30 @@ static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **c
     }
     WaitForSingleObject(font_mutex, INFINITE);
 
-    create_font_cache_key(&hkey_font_cache, &disposition);
+    if (!create_font_cache_key(&hkey, &disposition)) RegCloseKey(hkey);
 
-    if(disposition == REG_CREATED_NEW_KEY)
-        init_font_list();
+    /* a new session rescans everything, but unchanged files are still taken from the index */
+    cache = map_font_cache();
+    if (disposition != REG_CREATED_NEW_KEY && cache && font_cache_up_to_date(cache))
+    {
+        load_font_list_from_cache(cache);
+        rebuilt = FALSE;
+    }
     else
-        load_font_list_from_cache(hkey_font_cache);
+    {
+        if (cache) build_font_cache_hash(cache);
+        prev_font_cache = cache;
+        font_cache = alloc_font_cache();
+        init_font_list();
+        if (cache && disposition != REG_CREATED_NEW_KEY)
+            add_font_resources_from_cache(cache);
+        if (font_cache) write_font_cache(font_cache);
+        free_font_cache(font_cache);
+        prev_font_cache = NULL;
+        rebuilt = TRUE;
+    }
+    free_font_cache(cache);
+    font_cache = alloc_font_cache();
 
     reorder_font_list();
 
@@ -4401,15 +5363,26 @@ static DWORD WINAPI freetype_lazy_init(RTL_RUN_ONCE *once, void *param, void **c
     DumpSubstList();
     LoadReplaceList();
 
-    if(disposition == REG_CREATED_NEW_KEY)
+    if(rebuilt)
         update_reg_entries();
 
     init_system_links();
-    
+    font_cache_ready = TRUE;
+
     ReleaseMutex(font_mutex);
     return TRUE;
 }
 
+/*************************************************************
+ *    WineEngFlushFontCache
+ *
+ * Write the pending changes to the font index when the process exits.
+ */
+void WineEngFlushFontCache( BOOL process_exit )
+{
+    flush_font_cache( process_exit );
+}
+
 /*************************************************************
  *    WineEngInit
  *
@@ -4681,6 +5654,7 @@ static void free_font(GdiFont *font)
     }
 
     HeapFree(GetProcessHeap(), 0, font->fileinfo);
+    release_glyph_cache_font(font->glyph_font);
     free_font_handle(font->instance_id);
     if (font->ft_face) pFT_Done_Face(font->ft_face);
     if (font->mapping) unmap_font_file( font->mapping );
@@ -5784,6 +6758,7 @@ found_face:
         }
     }
     ret->aa_flags = HIWORD( face->flags );
+    ret->glyph_font = get_glyph_cache_font( ret );
 
     TRACE("caching: gdiFont=%p  hfont=%p\n", ret, hfont);
 
@@ -8000,7 +8975,7 @@ static DWORD freetype_GetGlyphOutline( PHYSDEV dev, UINT glyph, UINT format,
                                        LPGLYPHMETRICS lpgm, DWORD buflen, LPVOID buf, const MAT2 *lpmat )
 {
     struct freetype_physdev *physdev = get_freetype_dev( dev );
-    DWORD ret;
+    DWORD ret = GDI_ERROR;
     ABC abc;
 
     if (!physdev->font)
@@ -8010,8 +8985,12 @@ static DWORD freetype_GetGlyphOutline( PHYSDEV dev, UINT glyph, UINT format,
     }
 
     GDI_CheckNotLock();
+    if (lookup_glyph_cache( physdev->font, glyph, format, lpgm, buflen, buf, lpmat, &ret )) return ret;
+
     EnterCriticalSection( &freetype_cs );
     ret = get_glyph_outline( physdev->font, glyph, format, lpgm, &abc, buflen, buf, lpmat );
+    if (ret != GDI_ERROR)
+        add_to_glyph_cache( physdev->font, glyph, format, lpgm, buflen, buf, lpmat, ret );
     LeaveCriticalSection( &freetype_cs );
     return ret;
 }
@@ -8928,6 +9907,10 @@ BOOL WineEngInit(void)
     return FALSE;
 }
 
+void WineEngFlushFontCache( BOOL process_exit )
+{
+}
+
 INT WineEngAddFontResourceEx(LPCWSTR file, DWORD flags, PVOID pdv)
 {
     FIXME("(%s, %x, %p): stub\n", debugstr_w(file), flags, pdv);
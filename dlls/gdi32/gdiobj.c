@@ -651,10 +651,16 @@ BOOL WINAPI DllMain( HINSTANCE inst, DWORD reason, LPVOID reserved )
     const struct DefaultFontInfo* deffonts;
     int i;
 
+    if (reason == DLL_PROCESS_DETACH)
+    {
+        WineEngFlushFontCache( reserved != NULL );
+        return TRUE;
+    }
     if (reason != DLL_PROCESS_ATTACH) return TRUE;
 
     gdi32_module = inst;
     DisableThreadLibraryCalls( inst );
+    init_dib_primitives();
     WineEngInit();
 
     /* create stock objects */
@@ -3391,6 +3391,334 @@ static void test_simple_graphics(void)
     DeleteDC(mem_dc);
 }
 
+static DWORD row_seed;
+
+static DWORD row_rand(void)
+{
+    row_seed = row_seed * 1664525 + 1013904223;
+    return row_seed ^ (row_seed >> 15);
+}
+
+static BYTE blend_channel( BYTE dst, BYTE src, BYTE alpha )
+{
+    return (src * alpha + dst * (255 - alpha) + 127) / 255;
+}
+
+/* reference AlphaBlend of a single 8888 pixel, with a premultiplied source */
+static DWORD blend_pixel( DWORD dst, DWORD src, BLENDFUNCTION blend, BOOL bitfields )
+{
+    DWORD ret = 0;
+    int i;
+
+    if (blend.AlphaFormat & AC_SRC_ALPHA)
+    {
+        BYTE alpha = ((src >> 24) * blend.SourceConstantAlpha + 127) / 255;
+
+        for (i = 0; i < 32; i += 8)
+        {
+            BYTE s = (((src >> i) & 0xff) * blend.SourceConstantAlpha + 127) / 255;
+            ret |= (s + (((dst >> i) & 0xff) * (255 - alpha) + 127) / 255) << i;
+        }
+        return ret;
+    }
+    if (bitfields) src |= 0xff000000;
+    for (i = 0; i < 32; i += 8)
+        ret |= blend_channel( dst >> i, src >> i, blend.SourceConstantAlpha ) << i;
+    return ret;
+}
+
+static BOOL pixels_close( DWORD a, DWORD b )
+{
+    int i;
+
+    for (i = 0; i < 32; i += 8)
+        if (abs( (int)((a >> i) & 0xff) - (int)((b >> i) & 0xff) ) > 1) return FALSE;
+    return TRUE;
+}
+
+static DWORD expand_555( WORD val )
+{
+    return ((val << 9) & 0xf80000) | ((val << 4) & 0x070000) | ((val << 6) & 0x00f800) |
+           ((val << 1) & 0x000700) | ((val << 3) & 0x0000f8) | ((val >> 2) & 0x000007);
+}
+
+static DWORD expand_565( WORD val )
+{
+    return ((val << 8) & 0xf80000) | ((val << 3) & 0x070000) | ((val << 5) & 0x00fc00) |
+           ((val >> 1) & 0x000300) | ((val << 3) & 0x0000f8) | ((val >> 2) & 0x000007);
+}
+
+/* Run the row based 32 and 16-bpp primitives over every width up to a few
+ * vector lengths and at odd offsets, and compare each pixel against a plain
+ * computation, so that the vectorized paths and their tails are covered. */
+static void test_row_widths(void)
+{
+    static const struct { BYTE format, alpha; BOOL bitfields; } blends[] =
+    {
+        { AC_SRC_ALPHA, 0xff }, { AC_SRC_ALPHA, 0x80 }, { 0, 0x80 }, { 0, 0x33, TRUE }
+    };
+    char bmibuf[sizeof(BITMAPINFO) + 256 * sizeof(RGBQUAD)];
+    BITMAPINFO *bmi = (BITMAPINFO *)bmibuf;
+    HDC hdc = CreateCompatibleDC( 0 ), src_dc = CreateCompatibleDC( 0 );
+    DWORD *dst_bits, *src_bits, orig[80], buf[80];
+    WORD *bits16, orig16[80];
+    HBITMAP dst_bmp, src_bmp, bmp, orig_bm, orig_src_bm;
+    BLENDFUNCTION blend;
+    int width, x, i;
+
+    memset( bmibuf, 0, sizeof(bmibuf) );
+    bmi->bmiHeader.biSize = sizeof(bmi->bmiHeader);
+    bmi->bmiHeader.biWidth = 80;
+    bmi->bmiHeader.biHeight = -1;
+    bmi->bmiHeader.biPlanes = 1;
+    bmi->bmiHeader.biBitCount = 32;
+    bmi->bmiHeader.biCompression = BI_RGB;
+    dst_bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+    ok( dst_bmp != NULL, "failed to create bitmap\n" );
+    orig_bm = SelectObject( hdc, dst_bmp );
+
+    for (i = 0; i < sizeof(blends) / sizeof(blends[0]) && pGdiAlphaBlend; i++)
+    {
+        bmi->bmiHeader.biCompression = blends[i].bitfields ? BI_BITFIELDS : BI_RGB;
+        ((DWORD *)bmi->bmiColors)[0] = 0xff0000;
+        ((DWORD *)bmi->bmiColors)[1] = 0x00ff00;
+        ((DWORD *)bmi->bmiColors)[2] = 0x0000ff;
+        src_bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+        orig_src_bm = SelectObject( src_dc, src_bmp );
+
+        blend.BlendOp = AC_SRC_OVER;
+        blend.BlendFlags = 0;
+        blend.SourceConstantAlpha = blends[i].alpha;
+        blend.AlphaFormat = blends[i].format;
+
+        for (width = 1; width <= 67; width++)
+        {
+            for (x = 0; x < 80; x++)
+            {
+                DWORD val = row_rand();
+                BYTE alpha = val >> 24;
+
+                src_bits[x] = (alpha << 24) | RGB( (BYTE)val * alpha / 255, (BYTE)(val >> 8) * alpha / 255,
+                                                   (BYTE)(val >> 16) * alpha / 255 );
+                dst_bits[x] = orig[x] = row_rand();
+            }
+            pGdiAlphaBlend( hdc, 3, 0, width, 1, src_dc, 1, 0, width, 1, blend );
+            for (x = 0; x < 80; x++)
+            {
+                DWORD expect = orig[x];
+
+                if (x >= 3 && x < 3 + width) expect = blend_pixel( orig[x], src_bits[x - 2], blend, blends[i].bitfields );
+                ok( dst_bits[x] == expect || broken( pixels_close( dst_bits[x], expect )),
+                    "%d: width %d pixel %d: got %08x expected %08x\n", i, width, x, dst_bits[x], expect );
+                if (dst_bits[x] != expect) break;
+            }
+        }
+        SelectObject( src_dc, orig_src_bm );
+        DeleteObject( src_bmp );
+    }
+
+    for (width = 1; width <= 67; width++)
+    {
+        for (x = 0; x < 80; x++) dst_bits[x] = orig[x] = row_rand();
+        PatBlt( hdc, 3, 0, width, 1, DSTINVERT );
+        for (x = 0; x < 80; x++)
+        {
+            DWORD expect = (x >= 3 && x < 3 + width) ? ~orig[x] : orig[x];
+            ok( dst_bits[x] == expect, "width %d pixel %d: got %08x expected %08x\n", width, x, dst_bits[x], expect );
+            if (dst_bits[x] != expect) break;
+        }
+    }
+
+    /* 32-bpp bgr source */
+    bmi->bmiHeader.biCompression = BI_BITFIELDS;
+    ((DWORD *)bmi->bmiColors)[0] = 0x0000ff;
+    ((DWORD *)bmi->bmiColors)[1] = 0x00ff00;
+    ((DWORD *)bmi->bmiColors)[2] = 0xff0000;
+    bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    for (x = 0; x < 80; x++) src_bits[x] = row_rand();
+    bmi->bmiHeader.biCompression = BI_RGB;
+    GetDIBits( hdc, bmp, 0, 1, buf, bmi, DIB_RGB_COLORS );
+    for (x = 0; x < 80; x++)
+    {
+        DWORD expect = RGB( src_bits[x] >> 16, src_bits[x] >> 8, src_bits[x] );
+        ok( buf[x] == expect, "pixel %d: got %08x expected %08x\n", x, buf[x], expect );
+        if (buf[x] != expect) break;
+    }
+    DeleteObject( bmp );
+
+    SelectObject( hdc, orig_bm );
+    DeleteObject( dst_bmp );
+
+    for (width = 1; width <= 67; width++)
+    {
+        /* 555 and 565 to 8888 */
+        for (i = 0; i < 2; i++)
+        {
+            bmi->bmiHeader.biWidth = width;
+            bmi->bmiHeader.biBitCount = 16;
+            bmi->bmiHeader.biCompression = i ? BI_BITFIELDS : BI_RGB;
+            ((DWORD *)bmi->bmiColors)[0] = 0xf800;
+            ((DWORD *)bmi->bmiColors)[1] = 0x07e0;
+            ((DWORD *)bmi->bmiColors)[2] = 0x001f;
+            bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&bits16, NULL, 0 );
+            for (x = 0; x < width; x++) bits16[x] = row_rand() & (i ? 0xffff : 0x7fff);
+
+            bmi->bmiHeader.biBitCount = 32;
+            bmi->bmiHeader.biCompression = BI_RGB;
+            GetDIBits( hdc, bmp, 0, 1, buf, bmi, DIB_RGB_COLORS );
+            for (x = 0; x < width; x++)
+            {
+                DWORD expect = i ? expand_565( bits16[x] ) : expand_555( bits16[x] );
+                ok( buf[x] == expect || broken( pixels_close( buf[x], expect )),
+                    "%d: width %d pixel %d: got %08x expected %08x\n", i, width, x, buf[x], expect );
+                if (buf[x] != expect) break;
+            }
+
+            /* and the 16-bpp rops */
+            SelectObject( hdc, bmp );
+            memcpy( orig16, bits16, width * sizeof(WORD) );
+            PatBlt( hdc, 0, 0, width, 1, DSTINVERT );
+            for (x = 0; x < width; x++)
+            {
+                WORD expect = ~orig16[x] & (i ? 0xffff : 0x7fff);
+                ok( (bits16[x] & (i ? 0xffff : 0x7fff)) == expect,
+                    "%d: width %d pixel %d: got %04x expected %04x\n", i, width, x, bits16[x], expect );
+                if ((bits16[x] & (i ? 0xffff : 0x7fff)) != expect) break;
+            }
+            SelectObject( hdc, orig_bm );
+            DeleteObject( bmp );
+        }
+
+        /* 8888 to 555 and 565 */
+        bmi->bmiHeader.biBitCount = 32;
+        bmi->bmiHeader.biCompression = BI_RGB;
+        bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+        for (x = 0; x < width; x++) src_bits[x] = row_rand();
+        for (i = 0; i < 2; i++)
+        {
+            bmi->bmiHeader.biBitCount = 16;
+            bmi->bmiHeader.biCompression = i ? BI_BITFIELDS : BI_RGB;
+            ((DWORD *)bmi->bmiColors)[0] = 0xf800;
+            ((DWORD *)bmi->bmiColors)[1] = 0x07e0;
+            ((DWORD *)bmi->bmiColors)[2] = 0x001f;
+            GetDIBits( hdc, bmp, 0, 1, buf, bmi, DIB_RGB_COLORS );
+            for (x = 0; x < width; x++)
+            {
+                WORD expect = i ? ((src_bits[x] >> 8) & 0xf800) | ((src_bits[x] >> 5) & 0x07e0) | ((src_bits[x] >> 3) & 0x001f)
+                                : ((src_bits[x] >> 9) & 0x7c00) | ((src_bits[x] >> 6) & 0x03e0) | ((src_bits[x] >> 3) & 0x001f);
+                ok( ((WORD *)buf)[x] == expect, "%d: width %d pixel %d: got %04x expected %04x\n",
+                    i, width, x, ((WORD *)buf)[x], expect );
+                if (((WORD *)buf)[x] != expect) break;
+            }
+            bmi->bmiHeader.biBitCount = 32;
+            bmi->bmiHeader.biCompression = BI_RGB;
+        }
+        DeleteObject( bmp );
+    }
+
+    DeleteDC( src_dc );
+    DeleteDC( hdc );
+}
+
+/* time the row based primitives on large bitmaps, with an odd width so that
+ * the tails are included */
+static void test_row_performance(void)
+{
+    const int width = 1917, height = 512, loops = 8;
+    char bmibuf[sizeof(BITMAPINFO) + 256 * sizeof(RGBQUAD)];
+    BITMAPINFO *bmi = (BITMAPINFO *)bmibuf;
+    HDC hdc = CreateCompatibleDC( 0 ), src_dc = CreateCompatibleDC( 0 );
+    HBITMAP dst_bmp, src_bmp, bmp16, orig_bm, orig_src_bm;
+    DWORD *dst_bits, *src_bits, *copy, *buf, start, ticks[4];
+    WORD *bits16;
+    BLENDFUNCTION blend;
+    int x, i;
+
+    memset( bmibuf, 0, sizeof(bmibuf) );
+    bmi->bmiHeader.biSize = sizeof(bmi->bmiHeader);
+    bmi->bmiHeader.biWidth = width;
+    bmi->bmiHeader.biHeight = -height;
+    bmi->bmiHeader.biPlanes = 1;
+    bmi->bmiHeader.biBitCount = 32;
+    bmi->bmiHeader.biCompression = BI_RGB;
+    dst_bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&dst_bits, NULL, 0 );
+    src_bmp = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&src_bits, NULL, 0 );
+    copy = HeapAlloc( GetProcessHeap(), 0, width * height * sizeof(DWORD) );
+    buf = HeapAlloc( GetProcessHeap(), 0, width * height * sizeof(DWORD) );
+    ok( dst_bmp && src_bmp && copy && buf, "allocation failed\n" );
+    if (!dst_bmp || !src_bmp || !copy || !buf) goto done;
+    orig_bm = SelectObject( hdc, dst_bmp );
+    orig_src_bm = SelectObject( src_dc, src_bmp );
+
+    for (x = 0; x < width * height; x++)
+    {
+        DWORD val = row_rand();
+        BYTE alpha = val >> 24;
+
+        src_bits[x] = (alpha << 24) | RGB( (BYTE)val * alpha / 255, (BYTE)(val >> 8) * alpha / 255,
+                                           (BYTE)(val >> 16) * alpha / 255 );
+        dst_bits[x] = copy[x] = row_rand();
+    }
+
+    /* an even number of inversions gives the original pixels back */
+    start = GetTickCount();
+    for (i = 0; i < 2 * loops; i++) PatBlt( hdc, 0, 0, width, height, DSTINVERT );
+    ticks[0] = GetTickCount() - start;
+    ok( !memcmp( dst_bits, copy, width * height * sizeof(DWORD) ), "PatBlt changed the pixels\n" );
+
+    blend.BlendOp = AC_SRC_OVER;
+    blend.BlendFlags = 0;
+    blend.SourceConstantAlpha = 0x80;
+    blend.AlphaFormat = AC_SRC_ALPHA;
+    start = GetTickCount();
+    for (i = 0; i < loops && pGdiAlphaBlend; i++)
+        pGdiAlphaBlend( hdc, 0, 0, width, height, src_dc, 0, 0, width, height, blend );
+    ticks[1] = GetTickCount() - start;
+
+    SelectObject( hdc, orig_bm );
+
+    /* 8888 to 565 and back */
+    bmi->bmiHeader.biBitCount = 16;
+    bmi->bmiHeader.biCompression = BI_BITFIELDS;
+    ((DWORD *)bmi->bmiColors)[0] = 0xf800;
+    ((DWORD *)bmi->bmiColors)[1] = 0x07e0;
+    ((DWORD *)bmi->bmiColors)[2] = 0x001f;
+    start = GetTickCount();
+    for (i = 0; i < loops; i++) GetDIBits( hdc, dst_bmp, 0, height, buf, bmi, DIB_RGB_COLORS );
+    ticks[2] = GetTickCount() - start;
+    for (x = 0; x < width * height; x++)
+    {
+        WORD expect = ((dst_bits[x] >> 8) & 0xf800) | ((dst_bits[x] >> 5) & 0x07e0) | ((dst_bits[x] >> 3) & 0x001f);
+        if (((WORD *)buf)[x] != expect) break;
+    }
+    ok( x == width * height, "pixel %d: got %04x\n", x, x < width * height ? ((WORD *)buf)[x] : 0 );
+
+    bmp16 = CreateDIBSection( 0, bmi, DIB_RGB_COLORS, (void **)&bits16, NULL, 0 );
+    ok( bmp16 != NULL, "failed to create bitmap\n" );
+    memcpy( bits16, buf, width * height * sizeof(WORD) );
+    bmi->bmiHeader.biBitCount = 32;
+    bmi->bmiHeader.biCompression = BI_RGB;
+    start = GetTickCount();
+    for (i = 0; i < loops; i++) GetDIBits( hdc, bmp16, 0, height, buf, bmi, DIB_RGB_COLORS );
+    ticks[3] = GetTickCount() - start;
+    for (x = 0; x < width * height; x++)
+        if (buf[x] != expand_565( bits16[x] ) && !pixels_close( buf[x], expand_565( bits16[x] ))) break;
+    ok( x == width * height, "pixel %d: got %08x\n", x, x < width * height ? buf[x] : 0 );
+    DeleteObject( bmp16 );
+
+    trace( "%dx%d pixels, %d times: PatBlt %u ms, AlphaBlend %u ms, 8888 to 565 %u ms, 565 to 8888 %u ms\n",
+           width, height, loops, ticks[0] / 2, ticks[1], ticks[2], ticks[3] );
+
+    SelectObject( src_dc, orig_src_bm );
+done:
+    HeapFree( GetProcessHeap(), 0, copy );
+    HeapFree( GetProcessHeap(), 0, buf );
+    DeleteObject( dst_bmp );
+    DeleteObject( src_bmp );
+    DeleteDC( src_dc );
+    DeleteDC( hdc );
+}
+
 START_TEST(dib)
 {
     HMODULE mod = GetModuleHandleA("gdi32.dll");
@@ -3401,6 +3729,8 @@ START_TEST(dib)
     CryptAcquireContextW(&crypt_prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
 
     test_simple_graphics();
+    test_row_widths();
+    test_row_performance();
 
     CryptReleaseContext(crypt_prov, 0);
 }
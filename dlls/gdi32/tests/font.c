@@ -20,6 +20,8 @@
  */
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "windef.h"
@@ -5792,6 +5794,102 @@ static void test_CreateScalableFontResource(void)
     DeleteFileA(ttf_name);
 }
 
+static int count_wine_test_faces(void)
+{
+    struct enum_font_data efd;
+    LOGFONTA lf;
+    HDC hdc = GetDC(0);
+
+    memset(&lf, 0, sizeof(lf));
+    lf.lfCharSet = DEFAULT_CHARSET;
+    strcpy(lf.lfFaceName, "wine_test");
+    memset(&efd, 0, sizeof(efd));
+    EnumFontFamiliesExA(hdc, &lf, enum_font_data_proc, (LPARAM)&efd, 0);
+    ReleaseDC(0, hdc);
+    heap_free(efd.lf);
+    return efd.total;
+}
+
+static void font_resource_child(const char *cmd, const char *ttf_name, int count)
+{
+    int i, ret;
+
+    if (!strcmp(cmd, "add"))
+    {
+        for (i = 0; i < count; i++)
+        {
+            SetLastError(0xdeadbeef);
+            ret = pAddFontResourceExA(ttf_name, 0, 0);
+            ok(ret, "AddFontResourceEx() error %d\n", GetLastError());
+        }
+    }
+    else if (!strcmp(cmd, "check"))
+    {
+        ret = count_wine_test_faces();
+        ok(ret == count, "expected %d wine_test faces, got %d\n", count, ret);
+    }
+    else if (!strcmp(cmd, "remove"))
+    {
+        for (i = 0; i < count; i++)
+            if (!pRemoveFontResourceExA(ttf_name, 0, 0)) break;
+        ok(i > 0, "RemoveFontResourceEx() error %d\n", GetLastError());
+        ret = pRemoveFontResourceExA(ttf_name, 0, 0);
+        ok(!ret, "RemoveFontResourceEx() should fail\n");
+    }
+}
+
+static void run_font_resource_child(const char *cmd, const char *ttf_name, int count)
+{
+    char cmdline[2 * MAX_PATH + 64], **argv;
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    BOOL ret;
+
+    winetest_get_mainargs(&argv);
+    sprintf(cmdline, "\"%s\" font font_resource %s \"%s\" %d", argv[0], cmd, ttf_name, count);
+    ret = CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess failed: %u\n", GetLastError());
+    winetest_wait_child_process(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+}
+
+/* fonts added with AddFontResource are visible to other processes until they are removed */
+static void test_AddFontResource_other_process(void)
+{
+    char ttf_name[MAX_PATH];
+    int count;
+
+    if (!pAddFontResourceExA || !pRemoveFontResourceExA)
+    {
+        win_skip("AddFontResourceExA is not available on this platform\n");
+        return;
+    }
+
+    if (!write_ttf_file("wine_test.ttf", ttf_name))
+    {
+        skip("Failed to create ttf file for testing\n");
+        return;
+    }
+
+    count = pAddFontResourceExA(ttf_name, FR_PRIVATE, 0);
+    ok(count, "AddFontResourceEx() error %d\n", GetLastError());
+    count = count_wine_test_faces();
+    ok(count > 0, "wine_test should be enumerated\n");
+    pRemoveFontResourceExA(ttf_name, FR_PRIVATE, 0);
+
+    /* adding the same file several times doesn't duplicate its faces */
+    run_font_resource_child("add", ttf_name, 3);
+    run_font_resource_child("check", ttf_name, count);
+    run_font_resource_child("add", ttf_name, 2);
+    run_font_resource_child("check", ttf_name, count);
+
+    run_font_resource_child("remove", ttf_name, 5);
+    run_font_resource_child("check", ttf_name, 0);
+
+    DeleteFileA(ttf_name);
+}
+
 static void check_vertical_font(const char *name, BOOL *installed, BOOL *selected, GLYPHMETRICS *gm, WORD *gi)
 {
     LOGFONTA lf;
@@ -6456,6 +6554,82 @@ static void test_fake_bold_font(void)
        "expected %d, got %d\n", data[0].gm.gmCellIncY, data[1].gm.gmCellIncY);
 }
 
+static void test_GetGlyphOutline_font_reuse(void)
+{
+    static const UINT formats[] = { GGO_METRICS, GGO_BITMAP, GGO_GRAY2_BITMAP, GGO_GRAY4_BITMAP,
+                                    GGO_GRAY8_BITMAP, GGO_NATIVE };
+    static const MAT2 scale = { {0,2}, {0,0}, {0,0}, {0,1} };
+    static const char *names[] = { "Arial", "ARIAL", "arial" };
+    const MAT2 *matrix;
+    GLYPHMETRICS gm[3];
+    DWORD size[3], ret;
+    BYTE *buf[3];
+    HFONT hfont, old_hfont;
+    LOGFONTA lf;
+    HDC hdc;
+    int i, j, m;
+
+    if (!is_truetype_font_installed("Arial"))
+    {
+        skip("Arial is not installed\n");
+        return;
+    }
+
+    hdc = CreateCompatibleDC(0);
+
+    /* fonts that only differ by the face name case or by the underline resolve to
+       the same face, and may share their glyphs; each one must see the same results */
+    for (m = 0; m < 2; m++)
+    {
+        matrix = m ? &scale : &mat;
+
+        for (i = 0; i < sizeof(formats)/sizeof(formats[0]); i++)
+        {
+            for (j = 0; j < 3; j++)
+            {
+                memset(&lf, 0, sizeof(lf));
+                lf.lfHeight = -23;
+                lf.lfUnderline = (j == 2);
+                strcpy(lf.lfFaceName, names[j]);
+                hfont = CreateFontIndirectA(&lf);
+                old_hfont = SelectObject(hdc, hfont);
+
+                memset(&gm[j], 0xcc, sizeof(gm[j]));
+                size[j] = GetGlyphOutlineA(hdc, 'g', formats[i], &gm[j], 0, NULL, matrix);
+                ok(size[j] != GDI_ERROR, "%d/%u: GetGlyphOutlineA failed\n", j, formats[i]);
+                buf[j] = NULL;
+
+                if (formats[i] != GGO_METRICS && size[j] && size[j] != GDI_ERROR)
+                {
+                    buf[j] = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size[j]);
+                    if (formats[i] != GGO_NATIVE)
+                    {
+                        ret = GetGlyphOutlineA(hdc, 'g', formats[i], &gm[j], size[j] - 1, buf[j], matrix);
+                        ok(ret == GDI_ERROR, "%d/%u: expected GDI_ERROR, got %u\n", j, formats[i], ret);
+                    }
+                    memset(&gm[j], 0xcc, sizeof(gm[j]));
+                    ret = GetGlyphOutlineA(hdc, 'g', formats[i], &gm[j], size[j], buf[j], matrix);
+                    ok(ret == size[j], "%d/%u: expected %u, got %u\n", j, formats[i], size[j], ret);
+                }
+
+                SelectObject(hdc, old_hfont);
+                DeleteObject(hfont);
+            }
+
+            for (j = 1; j < 3; j++)
+            {
+                ok(size[j] == size[0], "%d/%u: expected size %u, got %u\n", j, formats[i], size[0], size[j]);
+                ok(!memcmp(&gm[j], &gm[0], sizeof(gm[0])), "%d/%u: glyph metrics differ\n", j, formats[i]);
+                if (buf[0] && buf[j] && size[j] == size[0])
+                    ok(!memcmp(buf[j], buf[0], size[0]), "%d/%u: glyph data differs\n", j, formats[i]);
+            }
+            for (j = 0; j < 3; j++) HeapFree(GetProcessHeap(), 0, buf[j]);
+        }
+    }
+
+    DeleteDC(hdc);
+}
+
 static void test_bitmap_font_glyph_index(void)
 {
     const WCHAR text[] = {'#','!','/','b','i','n','/','s','h',0};
@@ -6591,8 +6765,18 @@ static void test_bitmap_font_glyph_index(void)
 
 START_TEST(font)
 {
+    char **argv;
+    int argc;
+
     init();
 
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 6 && !strcmp(argv[2], "font_resource"))
+    {
+        font_resource_child(argv[3], argv[4], atoi(argv[5]));
+        return;
+    }
+
     test_stock_fonts();
     test_logfont();
     test_bitmap_font();
@@ -6651,10 +6835,12 @@ START_TEST(font)
     test_GetCharWidth32();
     test_fake_bold_font();
     test_bitmap_font_glyph_index();
+    test_GetGlyphOutline_font_reuse();
 
     /* These tests should be last test until RemoveFontResource
      * is properly implemented.
      */
     test_vertical_font();
     test_CreateScalableFontResource();
+    test_AddFontResource_other_process();
 }
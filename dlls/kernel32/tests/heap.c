@@ -39,6 +39,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
@@ -867,6 +868,172 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+struct heap_thread_params
+{
+    HANDLE heap;
+    HANDLE start;
+    unsigned int id;
+    void *foreign[16];  /* blocks allocated by the main thread, freed by this one */
+};
+
+static DWORD WINAPI heap_thread_proc( void *arg )
+{
+    struct heap_thread_params *params = arg;
+    void *blocks[32];
+    SIZE_T sizes[32];
+    unsigned int i, j;
+    BYTE *ptr;
+
+    memset( blocks, 0, sizeof(blocks) );
+    WaitForSingleObject( params->start, INFINITE );
+
+    for (i = 0; i < 16; i++)
+        if (!HeapFree( params->heap, 0, params->foreign[i] )) return 1;
+
+    /* every block must only be handed out once, check that nobody else wrote to it */
+    for (i = 0; i < 5000; i++)
+    {
+        unsigned int idx = i % 32;
+
+        if ((ptr = blocks[idx]))
+        {
+            for (j = 0; j < sizes[idx]; j++) if (ptr[j] != (BYTE)(params->id + idx)) return 2;
+            if (!HeapFree( params->heap, 0, ptr )) return 1;
+        }
+        sizes[idx] = 8 + (i * 7) % 500;
+        if (!(ptr = blocks[idx] = HeapAlloc( params->heap, 0, sizes[idx] ))) return 3;
+        if (HeapSize( params->heap, 0, ptr ) != sizes[idx]) return 4;
+        memset( ptr, params->id + idx, sizes[idx] );
+    }
+    for (i = 0; i < 32; i++)
+        if (!HeapFree( params->heap, 0, blocks[i] )) return 1;
+    return 0;
+}
+
+static void test_heap_threads( HANDLE heap )
+{
+    struct heap_thread_params params[4];
+    HANDLE threads[4], start;
+    DWORD exit_code;
+    unsigned int i, j;
+
+    start = CreateEventA( NULL, TRUE, FALSE, NULL );
+    for (i = 0; i < 4; i++)
+    {
+        params[i].heap = heap;
+        params[i].start = start;
+        params[i].id = i * 64;
+        for (j = 0; j < 16; j++) params[i].foreign[j] = HeapAlloc( heap, 0, 16 + j * 8 );
+        threads[i] = CreateThread( NULL, 0, heap_thread_proc, &params[i], 0, NULL );
+    }
+    SetEvent( start );
+    WaitForMultipleObjects( 4, threads, TRUE, INFINITE );
+
+    for (i = 0; i < 4; i++)
+    {
+        GetExitCodeThread( threads[i], &exit_code );
+        ok( !exit_code, "thread %u failed with %u\n", i, exit_code );
+        CloseHandle( threads[i] );
+    }
+    CloseHandle( start );
+
+    /* the blocks cached by the threads that exited must be usable again */
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+    for (i = 0; i < 16; i++) params[0].foreign[i] = HeapAlloc( heap, 0, 16 + i * 8 );
+    for (i = 0; i < 16; i++)
+    {
+        ok( params[0].foreign[i] != NULL, "HeapAlloc failed\n" );
+        ok( HeapValidate( heap, 0, params[0].foreign[i] ), "block %p is invalid\n", params[0].foreign[i] );
+        ok( HeapFree( heap, 0, params[0].foreign[i] ), "HeapFree failed\n" );
+    }
+}
+
+static void test_low_fragmentation_heap(void)
+{
+    PROCESS_HEAP_ENTRY entry;
+    HANDLE heap, heap_lfh;
+    ULONG info;
+    BOOL ret;
+    void *ptr, *ptr2;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation should fail for a HEAP_NO_SERIALIZE heap\n" );
+    HeapDestroy( heap );
+
+    heap_lfh = HeapCreate( 0, 0, 0 );
+    info = 2;
+    ret = pHeapSetInformation( heap_lfh, HeapCompatibilityInformation, &info, sizeof(info) );
+    if (!ret && GetLastError() == ERROR_GEN_FAILURE)
+    {
+        skip("low-fragmentation heap not available (running under a debugger?)\n");
+        HeapDestroy( heap_lfh );
+        return;
+    }
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap_lfh, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    /* freed blocks must not be reported as busy */
+    ptr = HeapAlloc( heap_lfh, 0, 24 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ok( HeapSize( heap_lfh, 0, ptr ) == 24, "wrong size %lu\n", HeapSize( heap_lfh, 0, ptr ) );
+    ok( HeapFree( heap_lfh, 0, ptr ), "HeapFree failed\n" );
+    ok( HeapValidate( heap_lfh, 0, NULL ), "HeapValidate failed\n" );
+
+    memset( &entry, 0, sizeof(entry) );
+    while (HeapWalk( heap_lfh, &entry ))
+        ok( entry.lpData != ptr || !(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY), "freed block %p is busy\n", ptr );
+
+    ptr = HeapAlloc( heap_lfh, HEAP_ZERO_MEMORY, 24 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ok( !*(DWORD *)ptr, "block not zeroed\n" );
+    HeapFree( heap_lfh, 0, ptr );
+
+    /* blocks cached for a destroyed heap must not be handed out again */
+    heap = HeapCreate( 0, 0, 0 );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+    ptr = HeapAlloc( heap, 0, 24 );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+    HeapDestroy( heap );
+    heap = HeapCreate( 0, 0, 0 );
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+    ptr2 = HeapAlloc( heap, 0, 24 );
+    ok( ptr2 != NULL, "HeapAlloc failed\n" );
+    ok( HeapValidate( heap, 0, ptr2 ), "block %p of the new heap is invalid\n", ptr2 );
+    HeapFree( heap, 0, ptr2 );
+
+    /* invalid frees must be rejected instead of being cached; this corrupts the heap on Windows */
+    if (!strcmp( winetest_platform, "wine" ))
+    {
+        ptr = HeapAlloc( heap, 0, 24 );
+        ok( !HeapFree( heap_lfh, 0, ptr ), "HeapFree succeeded for a block of another heap\n" );
+        ptr2 = HeapAlloc( heap_lfh, 0, 24 );
+        ok( ptr2 != ptr, "block of another heap was handed out\n" );
+        ok( HeapFree( heap_lfh, 0, ptr2 ), "HeapFree failed\n" );
+        ok( !HeapFree( heap_lfh, 0, ptr2 ), "double HeapFree succeeded\n" );
+        ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+    }
+    HeapDestroy( heap );
+
+    test_heap_threads( heap_lfh );
+    HeapDestroy( heap_lfh );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1220,6 +1387,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
@@ -233,6 +233,51 @@ static void testGetProcAddress_Wrong(void)
         "Expected ERROR_MOD_NOT_FOUND or ERROR_INVALID_HANDLE(win9x), got %d\n", GetLastError());
 }
 
+static void testGetProcAddress_exports(void)
+{
+    static const char * const dlls[] = { "ntdll.dll", "kernel32.dll", "user32.dll", "gdi32.dll",
+                                         "advapi32.dll", "ole32.dll", "shell32.dll" };
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const IMAGE_NT_HEADERS *nt;
+    const DWORD *names;
+    const WORD *ordinals;
+    DWORD i, j, pass, start, elapsed, count = 0, lookups = 0;
+    const char *name;
+    HMODULE mod;
+    FARPROC proc;
+
+    start = GetTickCount();
+    for (pass = 0; pass < 10; pass++)
+    {
+        for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+        {
+            if (!(mod = LoadLibraryA( dlls[i] ))) continue;
+            nt = (const IMAGE_NT_HEADERS *)((const char *)mod + ((const IMAGE_DOS_HEADER *)mod)->e_lfanew);
+            exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)mod +
+                       nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+            names = (const DWORD *)((const char *)mod + exports->AddressOfNames);
+            ordinals = (const WORD *)((const char *)mod + exports->AddressOfNameOrdinals);
+
+            for (j = 0; j < exports->NumberOfNames; j++)
+            {
+                name = (const char *)mod + names[j];
+                proc = GetProcAddress( mod, name );
+                if (!pass)
+                    ok( proc == GetProcAddress( mod, (const char *)(ULONG_PTR)(ordinals[j] + exports->Base) ),
+                        "%s: %s doesn't match its ordinal\n", dlls[i], name );
+                count++;
+            }
+            ok( !GetProcAddress( mod, "non_ex_call" ), "%s: non_ex_call should not be found\n", dlls[i] );
+            ok( GetModuleHandleA( dlls[i] ) == mod, "%s: wrong module handle\n", dlls[i] );
+            lookups++;
+            FreeLibrary( mod );
+        }
+    }
+    elapsed = GetTickCount() - start;
+    trace( "resolved %u exports and %u modules in %u ms, %u exports/s\n", count, lookups, elapsed,
+           elapsed ? (DWORD)((ULONGLONG)count * 1000 / elapsed) : 0 );
+}
+
 static void testLoadLibraryEx(void)
 {
     CHAR path[MAX_PATH];
@@ -765,6 +810,7 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testGetProcAddress_exports();
     testLoadLibraryEx();
     testGetModuleHandleEx();
     testK32GetModuleInformation();
@@ -2895,6 +2895,66 @@ static void test_StartupNoConsole(void)
 #endif
 }
 
+/* compare the resolved import thunks with what GetProcAddress returns */
+static void check_import_table(HMODULE module, const char *module_name)
+{
+    IMAGE_NT_HEADERS *nt = (IMAGE_NT_HEADERS *)((char *)module + ((IMAGE_DOS_HEADER *)module)->e_lfanew);
+    IMAGE_DATA_DIRECTORY *dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    IMAGE_IMPORT_DESCRIPTOR *imp;
+    DWORD count = 0;
+
+    if (!dir->VirtualAddress || !dir->Size) return;
+    for (imp = (IMAGE_IMPORT_DESCRIPTOR *)((char *)module + dir->VirtualAddress); imp->Name; imp++)
+    {
+        const char *dll_name = (const char *)module + imp->Name;
+        HMODULE dll = GetModuleHandleA(dll_name);
+        IMAGE_THUNK_DATA *names, *thunks;
+
+        if (!dll || !imp->OriginalFirstThunk) continue;
+        names = (IMAGE_THUNK_DATA *)((char *)module + imp->OriginalFirstThunk);
+        thunks = (IMAGE_THUNK_DATA *)((char *)module + imp->FirstThunk);
+        for ( ; names->u1.Ordinal; names++, thunks++)
+        {
+            IMAGE_IMPORT_BY_NAME *name;
+            FARPROC proc;
+
+            if (IMAGE_SNAP_BY_ORDINAL(names->u1.Ordinal)) continue;
+            name = (IMAGE_IMPORT_BY_NAME *)((char *)module + names->u1.AddressOfData);
+            proc = GetProcAddress(dll, (const char *)name->Name);
+            ok((ULONG_PTR)proc == thunks->u1.Function, "%s: %s.%s resolved to %p, expected %p\n",
+               module_name, dll_name, name->Name, (void *)thunks->u1.Function, proc);
+            count++;
+        }
+    }
+    ok(count > 0, "%s: no imports checked\n", module_name);
+}
+
+static void run_import_child(void)
+{
+    char                buffer[MAX_PATH];
+    STARTUPINFOA        startup;
+    PROCESS_INFORMATION info;
+
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESHOWWINDOW;
+    startup.wShowWindow = SW_HIDE;
+
+    sprintf(buffer, "\"%s\" tests/process.c imports", selfname);
+    ok(CreateProcessA(NULL, buffer, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info),
+       "CreateProcess failed %u\n", GetLastError());
+    winetest_wait_child_process(info.hProcess);
+    CloseHandle(info.hProcess);
+    CloseHandle(info.hThread);
+}
+
+static void test_import_cache(void)
+{
+    /* the first run may fill the loader caches, the second one may resolve from them */
+    run_import_child();
+    run_import_child();
+}
+
 static void test_GetNumaProcessorNode(void)
 {
     SYSTEM_INFO si;
@@ -3284,6 +3344,13 @@ START_TEST(process)
             Sleep(100);
             return;
         }
+        else if (!strcmp(myARGV[2], "imports"))
+        {
+            check_import_table(GetModuleHandleA(NULL), "main module");
+            if (!strcmp(winetest_platform, "wine"))
+                check_import_table(hkernel32, "kernel32");
+            return;
+        }
         else if (!strcmp(myARGV[2], "nested") && myARGC >= 4)
         {
             char                buffer[MAX_PATH];
@@ -3328,6 +3395,7 @@ START_TEST(process)
     test_RegistryQuota();
     test_DuplicateHandle();
     test_StartupNoConsole();
+    test_import_cache();
     test_GetNumaProcessorNode();
     test_session_info();
     test_GetLogicalProcessorInformationEx();
@@ -76,6 +76,9 @@
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #ifdef HAVE_LINUX_IOCTL_H
 #include <linux/ioctl.h>
 #endif
@@ -115,6 +118,7 @@
 #include "wine/exception.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(file);
+WINE_DECLARE_DEBUG_CHANNEL(dircache);
 
 /* just in case... */
 #undef VFAT_IOCTL_READDIR_BOTH
@@ -221,6 +225,48 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* case-insensitive directory name cache */
+
+#define DIR_NAME_CACHE_MAX_DIRS 64
+
+struct dir_name_entry
+{
+    unsigned int hash;               /* hash of the case-folded Unicode name */
+    int          next;               /* next entry in the hash chain, -1 if none */
+    unsigned int len;                /* length of the Unicode name */
+    unsigned int name_pos;           /* position of the Unicode name in the names buffer */
+    unsigned int unix_pos;           /* position of the Unix name in the Unix names buffer */
+};
+
+struct dir_name_cache
+{
+    struct list            entry;    /* entry in the LRU list */
+    struct file_identity   id;       /* directory file identity */
+    time_t                 mtime;    /* directory modification time when it was read */
+    time_t                 ctime;    /* directory change time when it was read */
+    int                    wd;       /* inotify watch descriptor, -1 if none */
+    unsigned int           count;    /* number of entries */
+    unsigned int           mask;     /* hash buckets mask */
+    int                   *buckets;  /* first entry of each hash chain */
+    struct dir_name_entry *entries;  /* directory entries */
+    WCHAR                 *names;    /* Unicode names */
+    char                  *unix_names; /* null-terminated Unix names */
+};
+
+static struct list dir_name_caches = LIST_INIT( dir_name_caches );
+static unsigned int dir_name_cache_count;
+static int dir_name_inotify_fd = -2;  /* not initialized yet */
+static LONG dir_name_cache_hits, dir_name_cache_misses, dir_name_cache_reads, dir_name_cache_invalidations;
+
+static RTL_CRITICAL_SECTION dir_name_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_name_critsect_debug =
+{
+    0, 0, &dir_name_section,
+    { &dir_name_critsect_debug.ProcessLocksList, &dir_name_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_name_section") }
+};
+static RTL_CRITICAL_SECTION dir_name_section = { &dir_name_critsect_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -2094,6 +2140,344 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/***********************************************************************
+ *           hash_dir_name
+ *
+ * Case-insensitive hash of a directory entry name.
+ */
+static unsigned int hash_dir_name( const WCHAR *name, unsigned int len )
+{
+    unsigned int i, hash = 2166136261u;
+
+    for (i = 0; i < len; i++) hash = (hash ^ tolowerW( name[i] )) * 16777619;
+    return hash;
+}
+
+
+/***********************************************************************
+ *           dump_dir_name_cache_stats
+ */
+static void dump_dir_name_cache_stats(void)
+{
+    TRACE_(dircache)( "%u hits %u misses, %u directories read, %u invalidated, %u cached\n",
+                      dir_name_cache_hits, dir_name_cache_misses, dir_name_cache_reads,
+                      dir_name_cache_invalidations, dir_name_cache_count );
+}
+
+
+/***********************************************************************
+ *           free_dir_name_cache
+ *
+ * dir_name_section must be held by caller.
+ */
+static void free_dir_name_cache( struct dir_name_cache *cache )
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    if (cache->wd != -1) inotify_rm_watch( dir_name_inotify_fd, cache->wd );
+#endif
+    list_remove( &cache->entry );
+    dir_name_cache_count--;
+    RtlFreeHeap( GetProcessHeap(), 0, cache->buckets );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->entries );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->names );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->unix_names );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+
+/***********************************************************************
+ *           process_dir_name_events
+ *
+ * Drop the cached directories that have been modified since they were read.
+ * dir_name_section must be held by caller.
+ */
+static void process_dir_name_events(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct dir_name_cache *cache, *next;
+    struct inotify_event *event;
+    ssize_t size, pos;
+
+    if (dir_name_inotify_fd < 0) return;
+
+    while ((size = read( dir_name_inotify_fd, buffer, sizeof(buffer) )) > 0)
+    {
+        for (pos = 0; pos < size; pos += sizeof(*event) + event->len)
+        {
+            event = (struct inotify_event *)(buffer + pos);
+            LIST_FOR_EACH_ENTRY_SAFE( cache, next, &dir_name_caches, struct dir_name_cache, entry )
+            {
+                if (!(event->mask & IN_Q_OVERFLOW) && cache->wd != event->wd) continue;
+                if (event->mask & IN_IGNORED) cache->wd = -1;  /* watch is already gone */
+                free_dir_name_cache( cache );
+                dir_name_cache_invalidations++;
+            }
+        }
+    }
+#endif
+}
+
+
+/***********************************************************************
+ *           is_remote_dir
+ *
+ * Checks if a directory is on a network or FUSE file system. inotify only
+ * sees the changes made through the local kernel, so changes made by other
+ * clients or by the FUSE daemon itself would be missed.
+ */
+static BOOL is_remote_dir( const char *unix_name )
+{
+#ifdef __linux__
+    struct statfs stfs;
+
+    if (statfs( unix_name, &stfs ) == -1) return TRUE;
+    switch ((unsigned int)stfs.f_type)
+    {
+    case 0x6969:     /* NFS_SUPER_MAGIC */
+    case 0x517b:     /* SMB_SUPER_MAGIC */
+    case 0xfe534d42: /* SMB2_MAGIC_NUMBER */
+    case 0xff534d42: /* CIFS_MAGIC_NUMBER */
+    case 0x65735546: /* FUSE_SUPER_MAGIC */
+        return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           add_dir_name_watch
+ *
+ * Start watching a directory for entries being added, removed or renamed.
+ * dir_name_section must be held by caller.
+ */
+static int add_dir_name_watch( const char *unix_name )
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    if (is_remote_dir( unix_name ))
+    {
+        TRACE_(dircache)( "not caching %s, it may change behind inotify's back\n", debugstr_a(unix_name) );
+        return -1;
+    }
+    if (dir_name_inotify_fd == -2)
+    {
+        if ((dir_name_inotify_fd = inotify_init()) != -1)
+        {
+            fcntl( dir_name_inotify_fd, F_SETFD, FD_CLOEXEC );
+            fcntl( dir_name_inotify_fd, F_SETFL, O_NONBLOCK );
+        }
+        else WARN_(dircache)( "inotify not available, relying on directory times\n" );
+    }
+    if (dir_name_inotify_fd >= 0)
+        return inotify_add_watch( dir_name_inotify_fd, unix_name,
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                  IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+#endif
+    return -1;
+}
+
+
+/***********************************************************************
+ *           grow_dir_name_buffer
+ */
+static BOOL grow_dir_name_buffer( void **buffer, unsigned int *size, unsigned int needed, unsigned int elem )
+{
+    unsigned int new_size = max( *size * 2, 256 );
+    void *ptr;
+
+    if (needed <= *size) return TRUE;
+    while (new_size < needed) new_size *= 2;
+    if (*buffer) ptr = RtlReAllocateHeap( GetProcessHeap(), 0, *buffer, new_size * elem );
+    else ptr = RtlAllocateHeap( GetProcessHeap(), 0, new_size * elem );
+    if (!ptr) return FALSE;
+    *buffer = ptr;
+    *size = new_size;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           read_dir_name_cache
+ *
+ * Read the full contents of a directory into a new cache entry.
+ * dir_name_section must be held by caller.
+ */
+static struct dir_name_cache *read_dir_name_cache( const char *unix_name, const struct stat *st )
+{
+    struct dir_name_cache *cache;
+    unsigned int i, entries_size = 0, names_size = 0, unix_size = 0, names_pos = 0, unix_pos = 0;
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dirent *de;
+    DIR *dir;
+    int len;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) ))) return NULL;
+    cache->id.dev = st->st_dev;
+    cache->id.ino = st->st_ino;
+    cache->mtime  = st->st_mtime;
+    cache->ctime  = st->st_ctime;
+
+    /* set the watch first so that no change can be missed while reading; the directory
+     * times only have a one second resolution, so don't cache anything without a watch */
+    if ((cache->wd = add_dir_name_watch( unix_name )) == -1)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        return NULL;
+    }
+    list_add_head( &dir_name_caches, &cache->entry );
+    dir_name_cache_count++;
+
+    if (!(dir = opendir( unix_name ))) goto failed;
+    while ((de = readdir( dir )))
+    {
+        unsigned int unix_len = strlen( de->d_name ) + 1;
+
+        len = ntdll_umbstowcs( 0, de->d_name, unix_len - 1, buffer, MAX_DIR_ENTRY_LEN );
+        if (len <= 0) continue;
+        if (!grow_dir_name_buffer( (void **)&cache->entries, &entries_size, cache->count + 1,
+                                   sizeof(*cache->entries) ) ||
+            !grow_dir_name_buffer( (void **)&cache->names, &names_size, names_pos + len, sizeof(WCHAR) ) ||
+            !grow_dir_name_buffer( (void **)&cache->unix_names, &unix_size, unix_pos + unix_len, 1 ))
+        {
+            closedir( dir );
+            goto failed;
+        }
+        cache->entries[cache->count].hash = hash_dir_name( buffer, len );
+        cache->entries[cache->count].len = len;
+        cache->entries[cache->count].name_pos = names_pos;
+        cache->entries[cache->count].unix_pos = unix_pos;
+        memcpy( cache->names + names_pos, buffer, len * sizeof(WCHAR) );
+        memcpy( cache->unix_names + unix_pos, de->d_name, unix_len );
+        names_pos += len;
+        unix_pos += unix_len;
+        cache->count++;
+    }
+    closedir( dir );
+
+    for (cache->mask = 15; cache->mask < cache->count; cache->mask = cache->mask * 2 + 1) /* nothing */;
+    if (!(cache->buckets = RtlAllocateHeap( GetProcessHeap(), 0, (cache->mask + 1) * sizeof(int) )))
+        goto failed;
+    memset( cache->buckets, 0xff, (cache->mask + 1) * sizeof(int) );
+    /* insert in reverse order so that chains follow the readdir order */
+    for (i = cache->count; i > 0; i--)
+    {
+        struct dir_name_entry *entry = &cache->entries[i - 1];
+        entry->next = cache->buckets[entry->hash & cache->mask];
+        cache->buckets[entry->hash & cache->mask] = i - 1;
+    }
+
+    dir_name_cache_reads++;
+    TRACE_(dircache)( "read %u entries from %s\n", cache->count, debugstr_a(unix_name) );
+    if (dir_name_cache_count > DIR_NAME_CACHE_MAX_DIRS)
+        free_dir_name_cache( LIST_ENTRY( list_tail( &dir_name_caches ), struct dir_name_cache, entry ));
+    return cache;
+
+failed:
+    free_dir_name_cache( cache );
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           get_dir_name_cache
+ *
+ * Find the cache entry for a directory, reading it if needed.
+ * dir_name_section must be held by caller.
+ */
+static struct dir_name_cache *get_dir_name_cache( const char *unix_name, const struct stat *st )
+{
+    struct dir_name_cache *cache;
+
+    process_dir_name_events();
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_name_caches, struct dir_name_cache, entry )
+    {
+        if (!is_same_file( &cache->id, st )) continue;
+        if (cache->mtime != st->st_mtime || cache->ctime != st->st_ctime)
+        {
+            /* replaced or modified without us seeing the events yet */
+            free_dir_name_cache( cache );
+            dir_name_cache_invalidations++;
+            break;
+        }
+        list_remove( &cache->entry );
+        list_add_head( &dir_name_caches, &cache->entry );
+        dir_name_cache_hits++;
+        return cache;
+    }
+    dir_name_cache_misses++;
+    return read_dir_name_cache( unix_name, st );
+}
+
+
+/***********************************************************************
+ *           find_file_in_dir_cache
+ *
+ * Find a file in a directory through the case-insensitive name cache.
+ * The file found is appended to unix_name at pos.
+ * Returns STATUS_NOT_SUPPORTED if the directory could not be cached.
+ */
+static NTSTATUS find_file_in_dir_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                        BOOLEAN is_name_8_dot_3 )
+{
+    struct dir_name_cache *cache;
+    struct dir_name_entry *entry;
+    NTSTATUS status = STATUS_OBJECT_PATH_NOT_FOUND;
+    const char *found = NULL;
+    struct stat st;
+    int i;
+
+    if (stat( unix_name, &st ) == -1 || !S_ISDIR( st.st_mode )) return STATUS_NOT_SUPPORTED;
+
+    RtlEnterCriticalSection( &dir_name_section );
+    if (!(cache = get_dir_name_cache( unix_name, &st )))
+    {
+        RtlLeaveCriticalSection( &dir_name_section );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    for (i = cache->buckets[hash_dir_name( name, length ) & cache->mask]; i != -1; i = entry->next)
+    {
+        entry = &cache->entries[i];
+        if (entry->len == length && !memicmpW( cache->names + entry->name_pos, name, length ))
+        {
+            found = cache->unix_names + entry->unix_pos;
+            break;
+        }
+    }
+
+    if (!found && is_name_8_dot_3)
+    {
+        UNICODE_STRING str;
+        BOOLEAN spaces;
+        WCHAR short_nameW[12];
+
+        for (i = 0; i < cache->count && !found; i++)
+        {
+            entry = &cache->entries[i];
+            str.Buffer = cache->names + entry->name_pos;
+            str.Length = str.MaximumLength = entry->len * sizeof(WCHAR);
+            if (RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) && !spaces) continue;
+            if (hash_short_file_name( &str, short_nameW ) == length &&
+                !memicmpW( short_nameW, name, length ))
+                found = cache->unix_names + entry->unix_pos;
+        }
+    }
+
+    if (found)
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, found );
+        status = STATUS_SUCCESS;
+    }
+    if (!((dir_name_cache_hits + dir_name_cache_misses) % 4096) && TRACE_ON(dircache))
+        dump_dir_name_cache_stats();
+    RtlLeaveCriticalSection( &dir_name_section );
+    return status;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2204,6 +2588,13 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+    switch (find_file_in_dir_cache( unix_name, pos, name, length, is_name_8_dot_3 ))
+    {
+    case STATUS_SUCCESS: goto success;
+    case STATUS_NOT_SUPPORTED: break;  /* fall back to reading the directory */
+    default: goto not_found;
+    }
+
     if (!(dir = opendir( unix_name )))
     {
         if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
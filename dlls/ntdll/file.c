@@ -57,6 +57,15 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 #ifdef MAJOR_IN_MKDEV
 # include <sys/mkdev.h>
 #elif defined(MAJOR_IN_SYSMACROS)
@@ -1039,6 +1048,465 @@ static NTSTATUS register_async_file_read( HANDLE handle, HANDLE event,
     return status;
 }
 
+/* asynchronous regular file I/O */
+
+enum file_io_state
+{
+    FILE_IO_QUEUED,      /* waiting for a thread pool thread */
+    FILE_IO_RUNNING,     /* being performed */
+    FILE_IO_CANCELLING,  /* the cancel callback waits for the result */
+    FILE_IO_CANCELLED,   /* cancelled before it was started */
+    FILE_IO_DONE         /* finished */
+};
+
+struct async_file_io
+{
+    int              fd;         /* duplicated unix fd */
+    BOOL             write;      /* write or read operation */
+    struct iovec     iov;        /* remaining part of the user buffer */
+    off_t            offset;     /* file offset of the remaining part */
+    ULONG            done;       /* bytes transferred before the operation was queued */
+    int              state;      /* enum file_io_state */
+    int              refs;       /* held by the operation and by the server async */
+    NTSTATUS         status;     /* final status */
+    ULONG            total;      /* final number of bytes transferred */
+    HANDLE           handle;     /* file handle */
+    IO_STATUS_BLOCK *iosb;       /* status block to fill on completion */
+};
+
+static RTL_RUN_ONCE file_io_once = RTL_RUN_ONCE_INIT;
+
+static void release_async_file_io( struct async_file_io *io )
+{
+    if (interlocked_xchg_add( &io->refs, -1 ) == 1) RtlFreeHeap( GetProcessHeap(), 0, io );
+}
+
+/***********************************************************************
+ *           cancel_async_file_io
+ *
+ * Async callback, only called by the server when the async is terminated
+ * (cancelled or its handle closed) before the operation reported its result.
+ */
+static NTSTATUS cancel_async_file_io( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS status,
+                                      void **apc, void **arg )
+{
+    struct async_file_io *io = user;
+    int state = interlocked_cmpxchg( &io->state, FILE_IO_CANCELLED, FILE_IO_QUEUED );
+
+    if (state == FILE_IO_QUEUED)
+    {
+        /* not started, the work item will only release it */
+        io->total = io->done;
+        io->status = io->done ? STATUS_SUCCESS : status;
+    }
+    else if (state == FILE_IO_RUNNING &&
+             interlocked_cmpxchg( &io->state, FILE_IO_CANCELLING, FILE_IO_RUNNING ) == FILE_IO_RUNNING)
+    {
+        /* the buffer is in use until the operation finishes */
+        NtWaitForKeyedEvent( keyed_event, io, FALSE, NULL );
+    }
+
+    TRACE( "%p %s = %x\n", io->handle, io->write ? "write" : "read", io->status );
+
+    status = io->status;
+    iosb->Information = io->total;
+    iosb->u.Status = status;
+    release_async_file_io( io );
+    return status;
+}
+
+/***********************************************************************
+ *           complete_async_file_io
+ *
+ * Report the result of an asynchronous file operation, result is
+ * the number of bytes transferred or a negative errno value.
+ */
+static void complete_async_file_io( struct async_file_io *io, int result )
+{
+    IO_STATUS_BLOCK *iosb = io->iosb;
+    ULONG total = io->done;
+    NTSTATUS status;
+
+    close( io->fd );
+    if (result >= 0) total += result;
+
+    /* the data transferred before an error is still reported */
+    if (result >= 0 || total)
+        status = (total || io->write) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    else if (result == -EFAULT)
+        status = io->write ? STATUS_INVALID_USER_BUFFER : STATUS_ACCESS_VIOLATION;
+    else
+    {
+        errno = -result;
+        status = FILE_GetNtStatus();
+    }
+
+    TRACE( "%p %s %u bytes at %s = %x\n", io->handle, io->write ? "wrote" : "read",
+           total, wine_dbgstr_longlong( io->offset - io->done ), status );
+
+    io->status = status;
+    io->total = total;
+    if (interlocked_cmpxchg( &io->state, FILE_IO_DONE, FILE_IO_RUNNING ) == FILE_IO_CANCELLING)
+    {
+        NtReleaseKeyedEvent( keyed_event, io, FALSE, NULL );
+    }
+    else
+    {
+        iosb->Information = total;
+        interlocked_xchg( (int *)&iosb->u.Status, status );
+
+        /* the server signals the event and posts to the completion port */
+        SERVER_START_REQ( complete_async )
+        {
+            req->iosb   = wine_server_client_ptr( iosb );
+            req->arg    = wine_server_client_ptr( io );
+            req->status = status;
+            req->total  = total;
+            /* if it was terminated, the cancel callback releases it */
+            if (!wine_server_call( req )) release_async_file_io( io );
+        }
+        SERVER_END_REQ;
+    }
+    release_async_file_io( io );
+}
+
+
+/***********************************************************************
+ *           file_io_work_item
+ *
+ * Thread pool fallback used when io_uring is not available.
+ */
+static DWORD WINAPI file_io_work_item( void *arg )
+{
+    struct async_file_io *io = arg;
+    int result;
+
+    if (interlocked_cmpxchg( &io->state, FILE_IO_RUNNING, FILE_IO_QUEUED ) != FILE_IO_QUEUED)
+    {
+        close( io->fd );
+        release_async_file_io( io );
+        return 0;
+    }
+
+    do
+    {
+        if (io->write) result = pwrite( io->fd, io->iov.iov_base, io->iov.iov_len, io->offset );
+        else result = pread( io->fd, io->iov.iov_base, io->iov.iov_len, io->offset );
+    } while (result == -1 && errno == EINTR);
+
+    complete_async_file_io( io, result == -1 ? -errno : result );
+    return 0;
+}
+
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#define URING_ENTRIES 256
+
+static int uring_fd = -1;
+static unsigned int uring_sq_size, uring_cq_size;
+static LONG uring_inflight;
+static BOOL uring_thread_running;  /* protected by uring_section */
+static unsigned int *uring_sq_head, *uring_sq_tail, *uring_sq_mask, *uring_sq_array;
+static unsigned int *uring_cq_head, *uring_cq_tail, *uring_cq_mask;
+static struct io_uring_sqe *uring_sqes;
+static struct io_uring_cqe *uring_cqes;
+
+static RTL_CRITICAL_SECTION uring_section;
+static RTL_CRITICAL_SECTION_DEBUG uring_critsect_debug =
+{
+    0, 0, &uring_section,
+    { &uring_critsect_debug.ProcessLocksList, &uring_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": uring_section") }
+};
+static RTL_CRITICAL_SECTION uring_section = { &uring_critsect_debug, -1, 0, 0, 0, 0 };
+
+/***********************************************************************
+ *           uring_completion_thread
+ *
+ * Reap io_uring completions and report them to the application. The thread
+ * exits as soon as nothing is in flight, so that it doesn't keep the process
+ * alive; uring_submit starts a new one when needed.
+ */
+static void CALLBACK uring_completion_thread( void *arg )
+{
+    for (;;)
+    {
+        unsigned int head = *uring_cq_head;
+        unsigned int tail = __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE );
+
+        if (head == tail)
+        {
+            RtlEnterCriticalSection( &uring_section );
+            if (!uring_inflight)
+            {
+                uring_thread_running = FALSE;
+                RtlLeaveCriticalSection( &uring_section );
+                return;
+            }
+            RtlLeaveCriticalSection( &uring_section );
+
+            if (syscall( __NR_io_uring_enter, uring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 ) == -1 &&
+                errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                ERR( "io_uring_enter failed: %s\n", strerror(errno) );
+            continue;
+        }
+        for ( ; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &uring_cqes[head & *uring_cq_mask];
+            struct async_file_io *io = (struct async_file_io *)(ULONG_PTR)cqe->user_data;
+            int result = cqe->res;
+
+            __atomic_store_n( uring_cq_head, head + 1, __ATOMIC_RELEASE );
+            interlocked_xchg_add( &uring_inflight, -1 );
+            complete_async_file_io( io, result );
+        }
+    }
+}
+
+
+/***********************************************************************
+ *           init_uring
+ */
+static BOOL init_uring(void)
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ring, *cq_ring;
+    int fd;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1)
+    {
+        TRACE( "io_uring not available: %s\n", strerror(errno) );
+        return FALSE;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = max( sq_size, cq_size );
+#endif
+    sq_ring = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    if (sq_ring == MAP_FAILED) goto failed;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (params.features & IORING_FEAT_SINGLE_MMAP) cq_ring = sq_ring;
+    else
+#endif
+    cq_ring = mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    if (cq_ring == MAP_FAILED) goto failed;
+    uring_sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (uring_sqes == MAP_FAILED) goto failed;
+
+    uring_sq_head  = (unsigned int *)(sq_ring + params.sq_off.head);
+    uring_sq_tail  = (unsigned int *)(sq_ring + params.sq_off.tail);
+    uring_sq_mask  = (unsigned int *)(sq_ring + params.sq_off.ring_mask);
+    uring_sq_array = (unsigned int *)(sq_ring + params.sq_off.array);
+    uring_cq_head  = (unsigned int *)(cq_ring + params.cq_off.head);
+    uring_cq_tail  = (unsigned int *)(cq_ring + params.cq_off.tail);
+    uring_cq_mask  = (unsigned int *)(cq_ring + params.cq_off.ring_mask);
+    uring_cqes     = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+    uring_sq_size  = params.sq_entries;
+    uring_cq_size  = params.cq_entries;
+    uring_fd = fd;
+    TRACE( "using io_uring with %u entries\n", uring_sq_size );
+    return TRUE;
+
+failed:
+    /* this is only attempted once, so don't bother unmapping the rings */
+    WARN( "failed to set up io_uring: %s\n", strerror(errno) );
+    close( fd );
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           uring_submit
+ *
+ * Queue an operation to the io_uring. Returns FALSE if the ring is full.
+ */
+static BOOL uring_submit( struct async_file_io *io )
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail, idx;
+    HANDLE thread;
+    int ret;
+
+    RtlEnterCriticalSection( &uring_section );
+
+    /* make sure that the completion ring can never overflow */
+    tail = *uring_sq_tail;
+    if (uring_inflight >= uring_cq_size ||
+        tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE ) >= uring_sq_size)
+        goto failed;
+
+    if (!uring_thread_running)
+    {
+        if (RtlCreateUserThread( NtCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                 uring_completion_thread, NULL, &thread, NULL ))
+            goto failed;
+        NtClose( thread );
+        uring_thread_running = TRUE;
+    }
+
+    idx = tail & *uring_sq_mask;
+    sqe = &uring_sqes[idx];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = io->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd        = io->fd;
+    sqe->off       = io->offset;
+    sqe->addr      = (ULONG_PTR)&io->iov;
+    sqe->len       = 1;
+    sqe->user_data = (ULONG_PTR)io;
+    uring_sq_array[idx] = idx;
+    __atomic_store_n( uring_sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+    do ret = syscall( __NR_io_uring_enter, uring_fd, tail + 1 - *uring_sq_head, 0, 0, NULL, 0 );
+    while (ret == -1 && errno == EINTR);
+
+    if (ret == -1 && *uring_sq_head == tail)
+    {
+        /* not consumed by the kernel, take it back */
+        WARN( "io_uring_enter failed: %s\n", strerror(errno) );
+        __atomic_store_n( uring_sq_tail, tail, __ATOMIC_RELEASE );
+        goto failed;
+    }
+
+    /* the completion thread can't look at the count before we leave the section */
+    interlocked_xchg_add( &uring_inflight, 1 );
+    RtlLeaveCriticalSection( &uring_section );
+    return TRUE;
+
+failed:
+    RtlLeaveCriticalSection( &uring_section );
+    return FALSE;
+}
+
+#endif  /* HAVE_LINUX_IO_URING_H */
+
+
+/***********************************************************************
+ *           init_file_io
+ */
+static DWORD WINAPI init_file_io( RTL_RUN_ONCE *once, void *param, void **context )
+{
+#ifdef HAVE_LINUX_IO_URING_H
+    if (init_uring()) return TRUE;
+#endif
+    TRACE( "using the thread pool for asynchronous file I/O\n" );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           try_file_io_nowait
+ *
+ * Try to perform a file operation without blocking. Returns -1 with errno
+ * set to EAGAIN if the operation needs to wait for the disk.
+ */
+static int try_file_io_nowait( int fd, void *buffer, ULONG length, off_t offset, BOOL write )
+{
+#if defined(RWF_NOWAIT) && defined(HAVE_PREADV2) && defined(HAVE_PWRITEV2)
+    struct iovec iov;
+    int result;
+
+    iov.iov_base = buffer;
+    iov.iov_len  = length;
+    do
+    {
+        if (write) result = pwritev2( fd, &iov, 1, offset, RWF_NOWAIT );
+        else result = preadv2( fd, &iov, 1, offset, RWF_NOWAIT );
+    } while (result == -1 && errno == EINTR);
+
+    /* RWF_NOWAIT may not be supported by the kernel or the file system */
+    if (result == -1 && (errno == EOPNOTSUPP || errno == EINVAL)) errno = EAGAIN;
+    return result;
+#else
+    errno = EAGAIN;
+    return -1;
+#endif
+}
+
+
+/***********************************************************************
+ *           queue_async_file_io
+ *
+ * Perform a regular file operation in the background. The server only
+ * holds the async, for cancellation and to report the completion through
+ * the event and the completion port; done is the number of bytes already
+ * transferred, which are reported as part of the result.
+ */
+static NTSTATUS queue_async_file_io( HANDLE handle, int unix_fd, HANDLE event, ULONG_PTR cvalue,
+                                     IO_STATUS_BLOCK *iosb, void *buffer, ULONG length,
+                                     off_t offset, ULONG done, BOOL write )
+{
+    struct async_file_io *io;
+    NTSTATUS status;
+
+    RtlRunOnceExecuteOnce( &file_io_once, init_file_io, NULL, NULL );
+
+    if (!(io = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*io) ))) return STATUS_NO_MEMORY;
+#ifdef F_DUPFD_CLOEXEC
+    io->fd = fcntl( unix_fd, F_DUPFD_CLOEXEC, 0 );
+#else
+    if ((io->fd = dup( unix_fd )) != -1) fcntl( io->fd, F_SETFD, FD_CLOEXEC );
+#endif
+    if (io->fd == -1)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        return FILE_GetNtStatus();
+    }
+    io->write        = write;
+    io->iov.iov_base = buffer;
+    io->iov.iov_len  = length;
+    io->offset       = offset;
+    io->done         = done;
+    io->state        = FILE_IO_QUEUED;
+    io->refs         = 2;
+    io->status       = STATUS_PENDING;
+    io->total        = 0;
+    io->handle       = handle;
+    io->iosb         = iosb;
+
+    iosb->u.Status = STATUS_PENDING;
+    iosb->Information = 0;
+
+    SERVER_START_REQ( register_async )
+    {
+        req->type           = ASYNC_TYPE_WAIT;
+        req->count          = length;
+        req->async.handle   = wine_server_obj_handle( handle );
+        req->async.event    = wine_server_obj_handle( event );
+        req->async.callback = wine_server_client_ptr( cancel_async_file_io );
+        req->async.iosb     = wine_server_client_ptr( iosb );
+        req->async.arg      = wine_server_client_ptr( io );
+        req->async.cvalue   = cvalue;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    if (status != STATUS_PENDING)
+    {
+        close( io->fd );
+        RtlFreeHeap( GetProcessHeap(), 0, io );
+        return status;
+    }
+
+#ifdef HAVE_LINUX_IO_URING_H
+    if (uring_fd != -1)
+    {
+        io->state = FILE_IO_RUNNING;
+        if (uring_submit( io )) return STATUS_PENDING;
+        io->state = FILE_IO_QUEUED;
+    }
+#endif
+    /* the async is registered now, so it has to be completed even without a thread */
+    if (RtlQueueWorkItem( file_io_work_item, io, WT_EXECUTELONGFUNCTION )) file_io_work_item( io );
+    return STATUS_PENDING;
+}
+
+
 /******************************************************************************
  *  NtReadFile					[NTDLL.@]
  *  ZwReadFile					[NTDLL.@]
@@ -1070,7 +1538,7 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
     unsigned int options;
     struct io_timeouts timeouts;
     NTSTATUS status;
-    ULONG total = 0;
+    ULONG total = 0, done = 0;
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE, async_read, timeout_init_done = FALSE;
@@ -1105,14 +1573,41 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
-            /* async I/O doesn't make sense on regular files */
-            while ((result = pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
+            if (async_read && hEvent && !apc && length)
+            {
+                /* complete right away if the data is cached, otherwise don't block the caller */
+                result = try_file_io_nowait( unix_handle, buffer, length, offset->QuadPart, FALSE );
+                if (!result || result == length)
+                {
+                    total = result;
+                    status = total ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+                    goto done;
+                }
+                if (result > 0 || errno == EAGAIN)
+                {
+                    /* only the start of the range may be cached, queue the rest */
+                    if (result > 0) done = result;
+                    if ((status = queue_async_file_io( hFile, unix_handle, hEvent, cvalue, io_status,
+                                                       (char *)buffer + done, length - done,
+                                                       offset->QuadPart + done, done, FALSE )) == STATUS_PENDING)
+                        goto err;
+                }
+            }
+
+            while ((result = pread( unix_handle, (char *)buffer + done, length - done,
+                                    offset->QuadPart + done )) == -1)
             {
                 if (errno == EFAULT && virtual_check_buffer_for_write( buffer, length ))
                     continue;
 
                 if (errno != EINTR)
                 {
+                    /* report the data read so far */
+                    if (done)
+                    {
+                        result = 0;
+                        break;
+                    }
                     status = FILE_GetNtStatus();
                     goto done;
                 }
@@ -1121,7 +1616,7 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
                 /* update file pointer position */
                 lseek( unix_handle, offset->QuadPart + result, SEEK_SET );
 
-            total = result;
+            total = done + result;
             status = (total || !length) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
             goto done;
         }
@@ -1514,7 +2009,14 @@ NTSTATUS WINAPI NtWriteFile(HANDLE hFile, HANDLE hEvent,
                 goto done;
             }
 
-            /* async I/O doesn't make sense on regular files */
+            /* buffered writes don't wait for the disk, only write-through ones (opened with
+             * O_DSYNC) are worth queuing; appends need their offset at completion time */
+            if (async_write && hEvent && !apc && length && (options & FILE_WRITE_THROUGH) &&
+                offset->QuadPart != FILE_WRITE_TO_END_OF_FILE &&
+                (status = queue_async_file_io( hFile, unix_handle, hEvent, cvalue, io_status, (void *)buffer,
+                                               length, off, 0, TRUE )) == STATUS_PENDING)
+                goto err;
+
             while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
             {
                 if (errno != EINTR)
@@ -89,6 +89,7 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_CACHED_MAGIC     0xcac4ed  /* block held in a thread front-end cache */
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -164,6 +165,8 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    BOOL             lfh;           /* Low-fragmentation front-end enabled */
+    struct list      cache_list;    /* Thread front-end caches */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -178,6 +181,27 @@ typedef struct tagHEAP
 #define HEAP_VALIDATE_ALL     0x20000000
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
+/* Thread front-end cache used in low-fragmentation heap mode. Freed small
+ * blocks are kept as in-use arenas tagged with ARENA_CACHED_MAGIC in a
+ * per-thread, per-heap set of magazines, one per block size, so that most
+ * alloc/free pairs don't need the heap critical section. */
+#define HEAP_CACHE_CLASSES    64   /* number of size classes, in ALIGNMENT steps */
+#define HEAP_CACHE_DEPTH      16   /* max number of blocks cached per class */
+#define HEAP_CACHE_MAX_SIZE   ((HEAP_CACHE_CLASSES - 1) * ALIGNMENT + ARENA_OFFSET)
+
+struct heap_cache
+{
+    struct list         entry;     /* Entry in heap cache list */
+    struct heap_cache  *next;      /* Next cache of the owning thread */
+    struct tagHEAP     *heap;      /* Heap the blocks belong to, NULL if destroyed */
+    LONG                lock;      /* Held while the cache is in use */
+    unsigned int        count[HEAP_CACHE_CLASSES];
+    ARENA_INUSE        *blocks[HEAP_CACHE_CLASSES][HEAP_CACHE_DEPTH];
+};
+
+/* the cache itself must not be cacheable */
+C_ASSERT( sizeof(struct heap_cache) > HEAP_CACHE_MAX_SIZE );
+
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
@@ -296,7 +320,8 @@ static void subheap_notify_free_all(SUBHEAP const *subheap)
         {
             ARENA_INUSE const *pArena = (ARENA_INUSE const *)ptr;
             if (pArena->magic == ARENA_INUSE_MAGIC) notify_free(pArena + 1);
-            else if (pArena->magic != ARENA_PENDING_MAGIC) ERR("bad inuse_magic @%p\n", pArena);
+            else if (pArena->magic != ARENA_PENDING_MAGIC && pArena->magic != ARENA_CACHED_MAGIC)
+                ERR("bad inuse_magic @%p\n", pArena);
             ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
         }
     }
@@ -382,8 +407,9 @@ static void HEAP_Dump( HEAP *heap )
             else
             {
                 ARENA_INUSE *pArena = (ARENA_INUSE *)ptr;
-                DPRINTF( "%p %08x %s %08x\n",
-                         pArena, pArena->magic, pArena->magic == ARENA_INUSE_MAGIC ? "used" : "pend",
+                DPRINTF( "%p %08x %s %08x\n", pArena, pArena->magic,
+                         pArena->magic == ARENA_INUSE_MAGIC ? "used" :
+                         pArena->magic == ARENA_CACHED_MAGIC ? "cach" : "pend",
                          pArena->size & ARENA_SIZE_MASK );
                 ptr += sizeof(*pArena) + (pArena->size & ARENA_SIZE_MASK);
                 arenaSize += sizeof(ARENA_INUSE);
@@ -667,10 +693,12 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
     if (!(subheap->heap->flags & HEAP_GROWABLE) && (subheap != &subheap->heap->subheap))
         return;  /* virtual heap, never attempt to release or decommit memory */
 
-    /* Free the whole sub-heap if it's empty and not the original one */
+    /* Free the whole sub-heap if it's empty and not the original one. Sub-heaps of
+     * low-fragmentation heaps stay until the heap is destroyed, since the front-end
+     * cache looks them up without the lock. */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) && !subheap->heap->lfh)
     {
         void *addr = subheap->base;
 
@@ -914,7 +942,11 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->commitSize = commitSize;
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
-        list_add_head( &heap->subheap_list, &subheap->entry );
+        /* the list is walked without the lock by the front-end cache, publish the entry last */
+        subheap->entry.next = heap->subheap_list.next;
+        subheap->entry.prev = &heap->subheap_list;
+        heap->subheap_list.next->prev = &subheap->entry;
+        interlocked_xchg_ptr( (void **)&heap->subheap_list.next, &subheap->entry );
     }
     else
     {
@@ -926,6 +958,7 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
+        list_init( &heap->cache_list );
 
         subheap = &heap->subheap;
         subheap->base       = address;
@@ -1255,7 +1288,8 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
     }
 
     /* Check magic number */
-    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC)
+    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC &&
+        pArena->magic != ARENA_CACHED_MAGIC)
     {
         if (quiet == NOISY) {
             ERR("Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, pArena->magic, pArena );
@@ -1470,7 +1504,7 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_CACHED_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
     else if (arena->magic != ARENA_INUSE_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
@@ -1488,6 +1522,186 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           get_thread_cache
+ *
+ * Find or create the front-end cache of the current thread for a heap.
+ */
+static struct heap_cache *get_thread_cache( HEAP *heap )
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_cache *cache, *unused = NULL;
+
+    for (cache = thread_data->heap_cache; cache; cache = cache->next)
+    {
+        if (cache->heap == heap) return cache;
+        if (!cache->heap && !unused) unused = cache;
+    }
+
+    /* reuse the cache of a destroyed heap if possible */
+    if ((cache = unused)) memset( cache->count, 0, sizeof(cache->count) );
+    else
+    {
+        if (!(cache = RtlAllocateHeap( processHeap, HEAP_ZERO_MEMORY, sizeof(*cache) ))) return NULL;
+        cache->next = thread_data->heap_cache;
+        thread_data->heap_cache = cache;
+    }
+    cache->heap = heap;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    list_add_tail( &heap->cache_list, &cache->entry );
+    RtlLeaveCriticalSection( &heap->critSection );
+    return cache;
+}
+
+
+/***********************************************************************
+ *           release_cached_blocks
+ *
+ * Give cached blocks of a size class back to the heap.
+ * The heap critical section must be held by caller.
+ */
+static void release_cached_blocks( struct heap_cache *cache, unsigned int class, unsigned int count )
+{
+    while (count--)
+    {
+        ARENA_INUSE *arena = cache->blocks[class][--cache->count[class]];
+
+        arena->magic = ARENA_INUSE_MAGIC;
+        HEAP_MakeInUseBlockFree( HEAP_FindSubHeap( cache->heap, arena ), arena );
+    }
+}
+
+
+/***********************************************************************
+ *           flush_heap_caches
+ *
+ * Give the blocks of all thread caches back to the heap. Caches in use
+ * are skipped. The heap critical section must be held by caller.
+ */
+static void flush_heap_caches( HEAP *heap )
+{
+    struct heap_cache *cache;
+    unsigned int i;
+
+    LIST_FOR_EACH_ENTRY( cache, &heap->cache_list, struct heap_cache, entry )
+    {
+        if (interlocked_cmpxchg( &cache->lock, 1, 0 )) continue;
+        for (i = 0; i < HEAP_CACHE_CLASSES; i++) release_cached_blocks( cache, i, cache->count[i] );
+        interlocked_xchg( &cache->lock, 0 );
+    }
+}
+
+
+/***********************************************************************
+ *           cache_alloc
+ *
+ * Try to allocate a block from the thread front-end cache.
+ */
+static void *cache_alloc( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    unsigned int class = (rounded_size - ARENA_OFFSET) / ALIGNMENT;
+    struct heap_cache *cache;
+    ARENA_INUSE *arena = NULL;
+
+    if (!(cache = get_thread_cache( heap ))) return NULL;
+    if (interlocked_cmpxchg( &cache->lock, 1, 0 )) return NULL;
+    if (cache->count[class]) arena = cache->blocks[class][--cache->count[class]];
+    interlocked_xchg( &cache->lock, 0 );
+    if (!arena) return NULL;
+
+    arena->magic = ARENA_INUSE_MAGIC;
+    arena->unused_bytes = (arena->size & ARENA_SIZE_MASK) - size;
+
+    notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( arena + 1, size, arena->unused_bytes, flags );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           cache_free
+ *
+ * Try to put a block in the thread front-end cache without taking the heap
+ * lock. When a size class is full, half of it is given back to the heap at
+ * once. Blocks that don't look like small in-use blocks of this heap are
+ * left to the regular path, which reports the error.
+ */
+static BOOL cache_free( HEAP *heap, ARENA_INUSE *arena )
+{
+    ARENA_INUSE old_arena, new_arena;
+    struct heap_cache *cache;
+    const SUBHEAP *subheap;
+    unsigned int class;
+    SIZE_T size;
+
+    if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET) return FALSE;
+
+    /* sub-heaps of a low-fragmentation heap are never released, the list can be walked safely */
+    if (!(subheap = HEAP_FindSubHeap( heap, arena ))) return FALSE;
+    if ((const char *)arena < (const char *)subheap->base + subheap->headerSize) return FALSE;
+
+    old_arena = *arena;
+    if (old_arena.magic != ARENA_INUSE_MAGIC || (old_arena.size & ARENA_FLAG_FREE)) return FALSE;
+    size = old_arena.size & ARENA_SIZE_MASK;
+    if (size > HEAP_CACHE_MAX_SIZE) return FALSE;
+    if ((const char *)(arena + 1) + size > (const char *)subheap->base + subheap->size) return FALSE;
+
+    class = (size - ARENA_OFFSET) / ALIGNMENT;
+    if (!(cache = get_thread_cache( heap ))) return FALSE;
+    if (interlocked_cmpxchg( &cache->lock, 1, 0 )) return FALSE;
+
+    /* switch the magic atomically, so that concurrent double frees are caught */
+    new_arena = old_arena;
+    new_arena.magic = ARENA_CACHED_MAGIC;
+    if (interlocked_cmpxchg( (LONG *)arena + 1, ((LONG *)&new_arena)[1], ((LONG *)&old_arena)[1] ) !=
+        ((LONG *)&old_arena)[1])
+    {
+        interlocked_xchg( &cache->lock, 0 );
+        return FALSE;
+    }
+
+    if (cache->count[class] == HEAP_CACHE_DEPTH)
+    {
+        RtlEnterCriticalSection( &heap->critSection );
+        release_cached_blocks( cache, class, HEAP_CACHE_DEPTH / 2 );
+        RtlLeaveCriticalSection( &heap->critSection );
+    }
+    cache->blocks[class][cache->count[class]++] = arena;
+    interlocked_xchg( &cache->lock, 0 );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           heap_thread_detach
+ *
+ * Give the blocks of the current thread caches back to their heaps.
+ */
+void heap_thread_detach(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_cache *cache, *next;
+    unsigned int i;
+
+    for (cache = thread_data->heap_cache; cache; cache = next)
+    {
+        HEAP *heap = cache->heap;
+
+        next = cache->next;
+        if (heap)
+        {
+            RtlEnterCriticalSection( &heap->critSection );
+            for (i = 0; i < HEAP_CACHE_CLASSES; i++) release_cached_blocks( cache, i, cache->count[i] );
+            list_remove( &cache->entry );
+            RtlLeaveCriticalSection( &heap->critSection );
+        }
+        RtlFreeHeap( processHeap, 0, cache );
+    }
+    thread_data->heap_cache = NULL;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1640,6 +1854,7 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SUBHEAP *subheap, *next;
     ARENA_LARGE *arena, *arena_next;
+    struct heap_cache *cache, *cache_next;
     SIZE_T size;
     void *addr;
 
@@ -1653,6 +1868,19 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     list_remove( &heapPtr->entry );
     RtlLeaveCriticalSection( &processHeap->critSection );
 
+    /* empty and detach the thread caches, their owners reuse them for other heaps
+     * and free them when they exit */
+    RtlEnterCriticalSection( &heapPtr->critSection );
+    LIST_FOR_EACH_ENTRY_SAFE( cache, cache_next, &heapPtr->cache_list, struct heap_cache, entry )
+    {
+        while (interlocked_cmpxchg( &cache->lock, 1, 0 )) NtYieldExecution();
+        list_remove( &cache->entry );
+        memset( cache->count, 0, sizeof(cache->count) );
+        cache->heap = NULL;
+        interlocked_xchg( &cache->lock, 0 );
+    }
+    RtlLeaveCriticalSection( &heapPtr->critSection );
+
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
@@ -1724,6 +1952,16 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && rounded_size <= HEAP_CACHE_MAX_SIZE)
+    {
+        void *ret = cache_alloc( heapPtr, flags, size, rounded_size );
+        if (ret)
+        {
+            TRACE("(%p,%08x,%08lx): returning cached %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1807,6 +2045,13 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    if (heapPtr->lfh && cache_free( heapPtr, (ARENA_INUSE *)ptr - 1 ))
+    {
+        TRACE("(%p,%08x,%p): cached, returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
@@ -1999,6 +2244,15 @@ error:
 ULONG WINAPI RtlCompactHeap( HANDLE heap, ULONG flags )
 {
     static BOOL reported;
+    HEAP *heapPtr = HEAP_GetPtr( heap );
+
+    if (heapPtr && heapPtr->lfh)
+    {
+        RtlEnterCriticalSection( &heapPtr->critSection );
+        flush_heap_caches( heapPtr );
+        RtlLeaveCriticalSection( &heapPtr->critSection );
+    }
+
     if (!reported++) FIXME( "(%p, 0x%x) stub\n", heap, flags );
     return 0;
 }
@@ -2174,7 +2428,8 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         }
 
         if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_CACHED_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2222,7 +2477,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->lpData = pArena + 1;
         entry->cbData = pArena->size & ARENA_SIZE_MASK;
         entry->cbOverhead = sizeof(ARENA_INUSE);
-        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
+        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC || pArena->magic == ARENA_CACHED_MAGIC) ?
                         PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
         /* FIXME: can't handle PROCESS_HEAP_ENTRY_MOVEABLE
         and PROCESS_HEAP_ENTRY_DDESHARE yet */
@@ -2287,6 +2542,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2295,7 +2552,8 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        *(ULONG *)info = heapPtr->lfh ? 2 : 0; /* low-fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2309,6 +2567,33 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        /* the low-fragmentation heap can't be turned off once enabled */
+        if (*(ULONG *)info != 2) return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+
+        if ((heapPtr->flags & (HEAP_NO_SERIALIZE | HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED |
+                               HEAP_PAGE_ALLOCS | HEAP_VALIDATE | HEAP_VALIDATE_ALL | HEAP_VALIDATE_PARAMS)) ||
+            RUNNING_ON_VALGRIND)
+        {
+            WARN( "not enabling low-fragmentation heap for %p, flags %08x\n", heap, heapPtr->flags );
+            return STATUS_UNSUCCESSFUL;
+        }
+        TRACE( "enabling low-fragmentation heap for %p\n", heap );
+        /* wait for a sub-heap release in progress */
+        RtlEnterCriticalSection( &heapPtr->critSection );
+        heapPtr->lfh = TRUE;
+        RtlLeaveCriticalSection( &heapPtr->critSection );
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
@@ -23,10 +23,19 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdio.h>
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -38,6 +47,7 @@
 
 #include "wine/exception.h"
 #include "wine/library.h"
+#include "wine/rbtree.h"
 #include "wine/unicode.h"
 #include "wine/debug.h"
 #include "wine/server.h"
@@ -88,8 +98,19 @@ typedef struct _wine_modref
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct _wine_modref  *next_base_name;  /* next entry in the base name hash chain */
+    struct _wine_modref  *next_full_name;  /* next entry in the full name hash chain */
+    struct _wine_modref  *next_address;    /* next entry in the base address hash chain */
+    DWORD                *export_index;    /* hash table of export names, built on first use */
+    DWORD                 export_mask;     /* size of the export hash table minus one */
+    ULONGLONG             unix_mtime;      /* modification time of the builtin .so file, in ns */
+    ULONGLONG             unix_size;       /* size of the builtin .so file, 0 if not a builtin */
+    ULONGLONG             unix_ino;        /* inode of the builtin .so file */
 } WINE_MODREF;
 
+#define MODULE_HASH_SIZE 64  /* must be a power of two */
+#define MIN_EXPORT_INDEX 16  /* don't bother indexing modules with fewer named exports */
+
 /* info about the current builtin dll load */
 /* used to keep track of things across the register_dll constructor call */
 struct builtin_load_info
@@ -128,6 +149,11 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
+/* hash tables for module lookups, protected by the loader_section */
+static WINE_MODREF *base_name_hash[MODULE_HASH_SIZE];
+static WINE_MODREF *full_name_hash[MODULE_HASH_SIZE];
+static WINE_MODREF *address_hash[MODULE_HASH_SIZE];
+
 static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, LPCWSTR fakemodule,
                           DWORD flags, WINE_MODREF** pwm );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
@@ -348,6 +374,72 @@ static inline ULONG_PTR allocate_stub( const char *dll, const char *name ) { ret
 #endif  /* __i386__ */
 
 
+/*************************************************************************
+ *		hash_module_name
+ *
+ * Case-insensitive hash of a module name, matching strcmpiW.
+ */
+static unsigned int hash_module_name( const WCHAR *name )
+{
+    unsigned int hash = 2166136261u;
+
+    while (*name) hash = (hash ^ tolowerW( *name++ )) * 16777619;
+    return hash & (MODULE_HASH_SIZE - 1);
+}
+
+
+/*************************************************************************
+ *		hash_module_address
+ */
+static unsigned int hash_module_address( HMODULE hmod )
+{
+    /* modules are aligned on 64k boundaries */
+    return ((ULONG_PTR)hmod >> 16) & (MODULE_HASH_SIZE - 1);
+}
+
+
+/*************************************************************************
+ *		insert_module_hash
+ *
+ * Add a module to the lookup hash tables.
+ * The loader_section must be locked while calling this function.
+ */
+static void insert_module_hash( WINE_MODREF *wm )
+{
+    WINE_MODREF **head;
+
+    head = &base_name_hash[hash_module_name( wm->ldr.BaseDllName.Buffer )];
+    wm->next_base_name = *head;
+    *head = wm;
+    head = &full_name_hash[hash_module_name( wm->ldr.FullDllName.Buffer )];
+    wm->next_full_name = *head;
+    *head = wm;
+    head = &address_hash[hash_module_address( wm->ldr.BaseAddress )];
+    wm->next_address = *head;
+    *head = wm;
+}
+
+
+/*************************************************************************
+ *		remove_module_hash
+ *
+ * Remove a module from the lookup hash tables.
+ * The loader_section must be locked while calling this function.
+ */
+static void remove_module_hash( WINE_MODREF *wm )
+{
+    WINE_MODREF **ptr;
+
+    for (ptr = &base_name_hash[hash_module_name( wm->ldr.BaseDllName.Buffer )]; *ptr; ptr = &(*ptr)->next_base_name)
+        if (*ptr == wm) { *ptr = wm->next_base_name; break; }
+    for (ptr = &full_name_hash[hash_module_name( wm->ldr.FullDllName.Buffer )]; *ptr; ptr = &(*ptr)->next_full_name)
+        if (*ptr == wm) { *ptr = wm->next_full_name; break; }
+    for (ptr = &address_hash[hash_module_address( wm->ldr.BaseAddress )]; *ptr; ptr = &(*ptr)->next_address)
+        if (*ptr == wm) { *ptr = wm->next_address; break; }
+    if (cached_modref == wm) cached_modref = NULL;
+}
+
+
 /*************************************************************************
  *		get_modref
  *
@@ -356,18 +448,12 @@ static inline ULONG_PTR allocate_stub( const char *dll, const char *name ) { ret
  */
 static WINE_MODREF *get_modref( HMODULE hmod )
 {
-    PLIST_ENTRY mark, entry;
-    PLDR_MODULE mod;
+    WINE_MODREF *wm;
 
     if (cached_modref && cached_modref->ldr.BaseAddress == hmod) return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
-        if (mod->BaseAddress == hmod)
-            return cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-    }
+    for (wm = address_hash[hash_module_address( hmod )]; wm; wm = wm->next_address)
+        if (wm->ldr.BaseAddress == hmod) return cached_modref = wm;
     return NULL;
 }
 
@@ -380,21 +466,13 @@ static WINE_MODREF *get_modref( HMODULE hmod )
  */
 static WINE_MODREF *find_basename_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
 
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.BaseDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->BaseDllName.Buffer ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
-    }
+    for (wm = base_name_hash[hash_module_name( name )]; wm; wm = wm->next_base_name)
+        if (!strcmpiW( name, wm->ldr.BaseDllName.Buffer )) return cached_modref = wm;
     return NULL;
 }
 
@@ -407,21 +485,13 @@ static WINE_MODREF *find_basename_module( LPCWSTR name )
  */
 static WINE_MODREF *find_fullname_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
+    WINE_MODREF *wm;
 
     if (cached_modref && !strcmpiW( name, cached_modref->ldr.FullDllName.Buffer ))
         return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->FullDllName.Buffer ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
-    }
+    for (wm = full_name_hash[hash_module_name( name )]; wm; wm = wm->next_full_name)
+        if (!strcmpiW( name, wm->ldr.FullDllName.Buffer )) return cached_modref = wm;
     return NULL;
 }
 
@@ -546,6 +616,54 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static unsigned int hash_export_name( const char *name )
+{
+    unsigned int hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		get_export_index
+ *
+ * Return the export name hash table of a module, building it on first use.
+ * Entries are indices in the AddressOfNames array plus one, zero means empty.
+ * The loader_section must be locked while calling this function.
+ */
+static const DWORD *get_export_index( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports, DWORD *mask )
+{
+    const DWORD *names;
+    WINE_MODREF *wm;
+    DWORD i, pos, size;
+
+    if (exports->NumberOfNames < MIN_EXPORT_INDEX) return NULL;
+    if (!(wm = get_modref( module ))) return NULL;
+    *mask = wm->export_mask;
+    if (wm->export_index) return wm->export_index;
+
+    for (size = MIN_EXPORT_INDEX; size < 2 * exports->NumberOfNames; size *= 2) ;
+    if (!(wm->export_index = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                              size * sizeof(*wm->export_index) )))
+        return NULL;
+    *mask = wm->export_mask = size - 1;
+
+    names = get_rva( module, exports->AddressOfNames );
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( module, names[i] ) ) & wm->export_mask;
+        while (wm->export_index[pos]) pos = (pos + 1) & wm->export_mask;
+        wm->export_index[pos] = i + 1;
+    }
+    TRACE( "indexed %u exports of %s\n", exports->NumberOfNames, debugstr_w(wm->ldr.BaseDllName.Buffer) );
+    return wm->export_index;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -557,6 +675,8 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    const DWORD *index;
+    DWORD mask;
     int min = 0, max = exports->NumberOfNames - 1;
 
     /* first check the hint */
@@ -567,6 +687,20 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
+    /* then look it up in the export index */
+    if ((index = get_export_index( module, exports, &mask )))
+    {
+        DWORD pos;
+
+        for (pos = hash_export_name( name ) & mask; index[pos]; pos = (pos + 1) & mask)
+        {
+            DWORD i = index[pos] - 1;
+            if (!strcmp( get_rva( module, names[i] ), name ))
+                return find_ordinal_export( module, exports, exp_size, ordinals[i], load_path );
+        }
+        return NULL;
+    }
+
     /* then do a binary search */
     while (min <= max)
     {
@@ -582,6 +716,317 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 }
 
 
+/* prelink cache: import tables of builtin modules resolved by previous processes */
+
+#define PRELINK_MAGIC       0x4b4c5250  /* "PRLK" */
+#define PRELINK_VERSION     2
+#define PRELINK_UNRESOLVED  (~0u)       /* forwarded or missing, resolve it the normal way */
+
+struct prelink_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD count;    /* number of records */
+    DWORD pad;
+};
+
+/* on-disk record, followed by the key padded to a DWORD boundary and the thunk RVAs */
+struct prelink_record
+{
+    ULONGLONG importer_mtime;
+    ULONGLONG importer_size;
+    ULONGLONG importer_ino;
+    ULONGLONG import_mtime;
+    ULONGLONG import_size;
+    ULONGLONG import_ino;
+    DWORD     key_len;  /* key length including the null terminator */
+    DWORD     count;    /* number of thunks */
+};
+
+struct prelink_entry
+{
+    struct wine_rb_entry  entry;
+    struct prelink_record rec;
+    char                 *key;     /* "importer:import", lower case */
+    DWORD                 rvas[1]; /* thunk values relative to the imported module */
+};
+
+static int compare_prelink_entry( const void *key, const struct wine_rb_entry *entry )
+{
+    return strcmp( key, WINE_RB_ENTRY_VALUE( entry, const struct prelink_entry, entry )->key );
+}
+
+static struct wine_rb_tree prelink_tree = { compare_prelink_entry };
+static BOOL prelink_loaded;
+static BOOL prelink_dirty;
+
+/***********************************************************************
+ *           get_prelink_path
+ */
+static char *get_prelink_path( const char *suffix )
+{
+    const char *config_dir = wine_get_config_dir();
+    char *path;
+
+    if (!config_dir) return NULL;
+    if ((path = RtlAllocateHeap( GetProcessHeap(), 0, strlen(config_dir) + sizeof("/prelink.cache") + strlen(suffix) )))
+    {
+        strcpy( path, config_dir );
+        strcat( path, "/prelink.cache" );
+        strcat( path, suffix );
+    }
+    return path;
+}
+
+
+/***********************************************************************
+ *           prelink_enabled
+ *
+ * Relay and snoop return thunks instead of the real entry points, don't cache those.
+ */
+static BOOL prelink_enabled(void)
+{
+    return !TRACE_ON(relay) && !TRACE_ON(snoop);
+}
+
+
+/***********************************************************************
+ *           add_prelink_entry
+ *
+ * The loader_section must be locked while calling this function.
+ */
+static struct prelink_entry *add_prelink_entry( const char *key, const struct prelink_record *rec,
+                                                const DWORD *rvas )
+{
+    struct prelink_entry *entry;
+    struct wine_rb_entry *old;
+
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0,
+                                   offsetof( struct prelink_entry, rvas[rec->count] ) + rec->key_len )))
+        return NULL;
+    entry->rec = *rec;
+    entry->key = (char *)&entry->rvas[rec->count];
+    memcpy( entry->key, key, rec->key_len );
+    entry->key[rec->key_len - 1] = 0;
+    if (rvas) memcpy( entry->rvas, rvas, rec->count * sizeof(*rvas) );
+
+    if ((old = wine_rb_get( &prelink_tree, entry->key )))
+    {
+        wine_rb_remove( &prelink_tree, old );
+        RtlFreeHeap( GetProcessHeap(), 0, WINE_RB_ENTRY_VALUE( old, struct prelink_entry, entry ) );
+    }
+    wine_rb_put( &prelink_tree, entry->key, &entry->entry );
+    return entry;
+}
+
+
+/***********************************************************************
+ *           load_prelink_cache
+ *
+ * The loader_section must be locked while calling this function.
+ */
+static void load_prelink_cache(void)
+{
+    struct prelink_header header;
+    struct prelink_record rec;
+    struct stat st;
+    char *path, *data = NULL, *ptr, *end;
+    DWORD i, key_size;
+    int fd;
+
+    prelink_loaded = TRUE;
+    if (!(path = get_prelink_path( "" ))) return;
+    fd = open( path, O_RDONLY );
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+    if (fd == -1) return;
+
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(header) || st.st_size > 16 * 1024 * 1024) goto done;
+    if (!(data = RtlAllocateHeap( GetProcessHeap(), 0, st.st_size ))) goto done;
+    if (read( fd, data, st.st_size ) != st.st_size) goto done;
+
+    memcpy( &header, data, sizeof(header) );
+    if (header.magic != PRELINK_MAGIC || header.version != PRELINK_VERSION) goto done;
+
+    ptr = data + sizeof(header);
+    end = data + st.st_size;
+    for (i = 0; i < header.count; i++)
+    {
+        if (end - ptr < sizeof(rec)) break;
+        memcpy( &rec, ptr, sizeof(rec) );
+        ptr += sizeof(rec);
+        key_size = (rec.key_len + 3) & ~3;
+        if (!rec.key_len || rec.key_len > MAX_PATH || rec.count > 0x10000) break;
+        if ((end - ptr) / sizeof(DWORD) < (key_size / sizeof(DWORD)) + rec.count) break;
+        if (!add_prelink_entry( ptr, &rec, (const DWORD *)(ptr + key_size) )) break;
+        ptr += key_size + rec.count * sizeof(DWORD);
+    }
+    TRACE( "loaded %u prelink records\n", i );
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, data );
+    close( fd );
+}
+
+
+/***********************************************************************
+ *           save_prelink_cache
+ *
+ * Write the cache back if this process resolved new imports. The file is
+ * replaced atomically, concurrent processes simply overwrite each other.
+ * The loader_section must be locked while calling this function.
+ */
+static void save_prelink_cache(void)
+{
+    static const DWORD zero;
+    struct prelink_header header;
+    struct prelink_entry *entry;
+    char *path, *tmp, suffix[16];
+    BOOL ok = TRUE;
+    int fd;
+
+    if (!prelink_dirty) return;
+    prelink_dirty = FALSE;
+
+    sprintf( suffix, ".%x", GetCurrentProcessId() );
+    if (!(path = get_prelink_path( "" ))) return;
+    if (!(tmp = get_prelink_path( suffix )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, path );
+        return;
+    }
+    if ((fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) == -1) goto done;
+
+    header.magic   = PRELINK_MAGIC;
+    header.version = PRELINK_VERSION;
+    header.count   = 0;
+    header.pad     = 0;
+    WINE_RB_FOR_EACH_ENTRY( entry, &prelink_tree, struct prelink_entry, entry ) header.count++;
+    ok = write( fd, &header, sizeof(header) ) == sizeof(header);
+
+    WINE_RB_FOR_EACH_ENTRY( entry, &prelink_tree, struct prelink_entry, entry )
+    {
+        DWORD pad = ((entry->rec.key_len + 3) & ~3) - entry->rec.key_len;
+
+        if (!ok) break;
+        ok = write( fd, &entry->rec, sizeof(entry->rec) ) == sizeof(entry->rec) &&
+             write( fd, entry->key, entry->rec.key_len ) == entry->rec.key_len &&
+             write( fd, &zero, pad ) == pad &&
+             write( fd, entry->rvas, entry->rec.count * sizeof(DWORD) ) == entry->rec.count * sizeof(DWORD);
+    }
+    close( fd );
+
+    if (ok && !rename( tmp, path )) TRACE( "saved %u prelink records\n", header.count );
+    else
+    {
+        WARN( "failed to write %s: %s\n", debugstr_a(tmp), strerror(errno) );
+        unlink( tmp );
+    }
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, tmp );
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+}
+
+
+/***********************************************************************
+ *           get_prelink_key
+ *
+ * Build the cache key for an import descriptor, returns its length including the null.
+ */
+static DWORD get_prelink_key( const WINE_MODREF *wm, const char *name, DWORD len, char *key, DWORD size )
+{
+    const WCHAR *base = wm->ldr.BaseDllName.Buffer;
+    DWORD i, pos = 0, base_len = strlenW( base );
+
+    if (base_len + len + 2 > size) return 0;
+    for (i = 0; i < base_len; i++)
+    {
+        if (base[i] >= 0x80) return 0;
+        key[pos++] = tolower( base[i] );
+    }
+    key[pos++] = ':';
+    for (i = 0; i < len; i++) key[pos++] = tolower( name[i] );
+    key[pos++] = 0;
+    return pos;
+}
+
+
+/***********************************************************************
+ *           find_prelink_entry
+ *
+ * Find the resolved thunks of an import descriptor, if they are still valid.
+ * The loader_section must be locked while calling this function.
+ */
+static const struct prelink_entry *find_prelink_entry( const char *key, const WINE_MODREF *importer,
+                                                       const WINE_MODREF *import, DWORD count,
+                                                       const IMAGE_EXPORT_DIRECTORY *exports, DWORD exp_size )
+{
+    const struct prelink_entry *entry;
+    struct wine_rb_entry *ptr;
+    DWORD i, exp_rva = (const char *)exports - (const char *)import->ldr.BaseAddress;
+
+    if (!prelink_loaded) load_prelink_cache();
+    if (!(ptr = wine_rb_get( &prelink_tree, key ))) return NULL;
+
+    entry = WINE_RB_ENTRY_VALUE( ptr, const struct prelink_entry, entry );
+    if (entry->rec.count != count ||
+        entry->rec.importer_mtime != importer->unix_mtime || entry->rec.importer_size != importer->unix_size ||
+        entry->rec.importer_ino != importer->unix_ino ||
+        entry->rec.import_mtime != import->unix_mtime || entry->rec.import_size != import->unix_size ||
+        entry->rec.import_ino != import->unix_ino)
+        return NULL;
+
+    /* don't trust a damaged cache file, an export is inside the image but never
+     * in the export directory itself, which only holds the forwarder names */
+    for (i = 0; i < count; i++)
+    {
+        if (entry->rvas[i] == PRELINK_UNRESOLVED) continue;
+        if (entry->rvas[i] >= import->ldr.SizeOfImage ||
+            (entry->rvas[i] >= exp_rva && entry->rvas[i] < exp_rva + exp_size))
+        {
+            WARN( "invalid prelink record %s\n", debugstr_a(key) );
+            return NULL;
+        }
+    }
+    return entry;
+}
+
+
+/***********************************************************************
+ *           store_prelink_entry
+ *
+ * Remember the thunks that were just resolved for an import descriptor.
+ * The loader_section must be locked while calling this function.
+ */
+static void store_prelink_entry( const char *key, DWORD key_len, const WINE_MODREF *importer,
+                                 const WINE_MODREF *import, const IMAGE_THUNK_DATA *thunks, DWORD count )
+{
+    const char *base = import->ldr.BaseAddress;
+    struct prelink_record rec;
+    struct prelink_entry *entry;
+    DWORD i;
+
+    rec.importer_mtime = importer->unix_mtime;
+    rec.importer_size  = importer->unix_size;
+    rec.importer_ino   = importer->unix_ino;
+    rec.import_mtime   = import->unix_mtime;
+    rec.import_size    = import->unix_size;
+    rec.import_ino     = import->unix_ino;
+    rec.key_len        = key_len;
+    rec.count          = count;
+    if (!(entry = add_prelink_entry( key, &rec, NULL ))) return;
+
+    /* anything outside of the imported module is a forward or a stub, it can't be cached */
+    for (i = 0; i < count; i++)
+    {
+        const char *proc = (const char *)thunks[i].u1.Function;
+        if (proc >= base && proc < base + import->ldr.SizeOfImage) entry->rvas[i] = proc - base;
+        else entry->rvas[i] = PRELINK_UNRESOLVED;
+    }
+    prelink_dirty = TRUE;
+}
+
+
 /*************************************************************************
  *		import_dll
  *
@@ -603,6 +1048,9 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     PVOID protect_base;
     SIZE_T protect_size = 0;
     DWORD protect_old;
+    const struct prelink_entry *prelink = NULL;
+    char prelink_key[2 * MAX_PATH];
+    DWORD i, count, prelink_len = 0;
 
     thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
     if (descr->u.OriginalFirstThunk)
@@ -649,6 +1097,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     /* unprotect the import address table since it can be located in
      * readonly section */
     while (import_list[protect_size].u1.Ordinal) protect_size++;
+    count = protect_size;
     protect_base = thunk_list;
     protect_size *= sizeof(*thunk_list);
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base,
@@ -657,6 +1106,11 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     imp_mod = wmImp->ldr.BaseAddress;
     exports = RtlImageDirectoryEntryToData( imp_mod, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size );
 
+    /* builtin to builtin imports can be taken from the prelink cache */
+    if (exports && current_modref->unix_size && wmImp->unix_size && prelink_enabled() &&
+        (prelink_len = get_prelink_key( current_modref, name, len, prelink_key, sizeof(prelink_key) )))
+        prelink = find_prelink_entry( prelink_key, current_modref, wmImp, count, exports, exp_size );
+
     if (!exports)
     {
         /* set all imported function to deadbeef */
@@ -683,9 +1137,14 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         goto done;
     }
 
-    while (import_list->u1.Ordinal)
+    for (i = 0; import_list->u1.Ordinal; i++)
     {
-        if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
+        if (prelink && prelink->rvas[i] != PRELINK_UNRESOLVED)
+        {
+            thunk_list->u1.Function = (ULONG_PTR)imp_mod + prelink->rvas[i];
+            TRACE_(imports)("--- prelinked %s.%u = %p\n", name, i, (void *)thunk_list->u1.Function );
+        }
+        else if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
         {
             int ordinal = IMAGE_ORDINAL(import_list->u1.Ordinal);
 
@@ -721,6 +1180,9 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         thunk_list++;
     }
 
+    if (prelink_len && !prelink)
+        store_prelink_entry( prelink_key, prelink_len, current_modref, wmImp, thunk_list - count, count );
+
 done:
     /* restore old protection of the import address table */
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base, &protect_size, protect_old, &protect_old );
@@ -965,6 +1427,11 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename, LPCWSTR fak
 
     wm->nDeps    = 0;
     wm->deps     = NULL;
+    wm->export_index = NULL;
+    wm->export_mask  = 0;
+    wm->unix_mtime   = 0;
+    wm->unix_size    = 0;
+    wm->unix_ino     = 0;
 
     wm->ldr.BaseAddress   = hModule;
     wm->ldr.EntryPoint    = NULL;
@@ -994,6 +1461,7 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename, LPCWSTR fak
                    &wm->ldr.InLoadOrderModuleList);
     InsertTailList(&NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList,
                    &wm->ldr.InMemoryOrderModuleList);
+    insert_module_hash( wm );
 
     /* wait until init is called for inserting into this list */
     wm->ldr.InInitializationOrderModuleList.Flink = NULL;
@@ -1678,6 +2146,7 @@ static void load_builtin_callback( void *module, const char *filename )
     WINE_MODREF *wm;
     WCHAR *fullname;
     const WCHAR *load_path;
+    struct stat st;
 
     if (!module)
     {
@@ -1712,6 +2181,20 @@ static void load_builtin_callback( void *module, const char *filename )
     }
     wm->ldr.Flags |= LDR_WINE_INTERNAL;
 
+    /* the prelink cache is validated against the .so file; a file rebuilt
+     * in place within the same second needs the nanoseconds to be told apart */
+    if (filename && !stat( filename, &st ))
+    {
+        wm->unix_mtime = (ULONGLONG)st.st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+        wm->unix_mtime += st.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+        wm->unix_mtime += st.st_mtimespec.tv_nsec;
+#endif
+        wm->unix_size  = st.st_size;
+        wm->unix_ino   = st.st_ino;
+    }
+
     if ((nt->FileHeader.Characteristics & IMAGE_FILE_DLL) ||
         nt->OptionalHeader.Subsystem == IMAGE_SUBSYSTEM_NATIVE ||
         is_16bit_builtin( module ))
@@ -1726,6 +2209,7 @@ static void load_builtin_callback( void *module, const char *filename )
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_hash( wm );
             /* FIXME: free the modref */
             builtin_load_info->status = STATUS_DLL_NOT_FOUND;
             return;
@@ -1940,6 +2424,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, LPCWSTR fakemo
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_hash( wm );
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -2990,6 +3475,9 @@ void WINAPI LdrShutdownProcess(void)
     TRACE("()\n");
     process_detaching = TRUE;
     process_detach();
+    RtlEnterCriticalSection( &loader_section );
+    save_prelink_cache();
+    RtlLeaveCriticalSection( &loader_section );
 }
 
 
@@ -3061,6 +3549,7 @@ static void free_modref( WINE_MODREF *wm )
 {
     RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
     RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+    remove_module_hash( wm );
     if (wm->ldr.InInitializationOrderModuleList.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderModuleList);
 
@@ -3084,6 +3573,7 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_index );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -3367,6 +3857,7 @@ void WINAPI LdrInitializeThunk( void *kernel_start, ULONG_PTR unknown2,
     actctx_init();
     load_path = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
     if ((status = fixup_imports( wm, load_path )) != STATUS_SUCCESS) goto error;
+    save_prelink_cache();
     heap_set_debug_flags( GetProcessHeap() );
 
     status = wine_call_on_stack( attach_process_dlls, wm, NtCurrentTeb()->Tib.StackBase );
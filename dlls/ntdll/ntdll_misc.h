@@ -80,6 +80,7 @@ extern void fill_cpu_info(void) DECLSPEC_HIDDEN;
 /* heap routines */
 extern void *grow_virtual_heap( HANDLE handle, SIZE_T *size ) DECLSPEC_HIDDEN;
 extern void heap_set_debug_flags( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void heap_thread_detach(void) DECLSPEC_HIDDEN;
 
 /* server support */
 extern timeout_t server_start_time DECLSPEC_HIDDEN;
@@ -105,6 +106,8 @@ extern NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct o
                                          data_size_t *ret_len ) DECLSPEC_HIDDEN;
 extern NTSTATUS validate_open_object_attributes( const OBJECT_ATTRIBUTES *attr ) DECLSPEC_HIDDEN;
 extern void *server_get_shared_memory( HANDLE thread ) DECLSPEC_HIDDEN;
+extern sync_slot_t *server_get_sync_memory( unsigned int *close_slot ) DECLSPEC_HIDDEN;
+extern void invalidate_sync_cache( HANDLE handle ) DECLSPEC_HIDDEN;
 
 /* module handling */
 extern LIST_ENTRY tls_links DECLSPEC_HIDDEN;
@@ -246,6 +249,7 @@ struct ntdll_thread_data
     void              *exit_frame;    /* 204 exit frame pointer */
 #endif
     void              *pthread_stack; /* 208/318 pthread stack */
+    struct heap_cache *heap_cache;    /* 20c/350 heap front-end caches */
 };
 
 C_ASSERT( FIELD_OFFSET(TEB, SpareBytes1) + sizeof(struct ntdll_thread_data) <=
@@ -84,6 +84,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(server);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
+WINE_DECLARE_DEBUG_CHANNEL(fdcache);
 
 /* Some versions of glibc don't define this */
 #ifndef SCM_RIGHTS
@@ -841,12 +842,21 @@ union fd_cache_entry
 
 C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 
+/* Lookups and updates are lock-free. Blocks are allocated on demand and
+ * never freed, and there are enough of them to cover the whole server
+ * handle space (0x00ffffff entries). fd_cache_section only serializes the
+ * requests that receive a new fd from the server. */
+
 #define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(union fd_cache_entry))
-#define FD_CACHE_ENTRIES     128
+#define FD_CACHE_ENTRIES     ((0x01000000 + FD_CACHE_BLOCK_SIZE - 1) / FD_CACHE_BLOCK_SIZE)
 
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
 
+/* statistics, only maintained when the fdcache debug channel is enabled */
+static LONG fd_cache_hits;
+static LONG fd_cache_misses;
+
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
     unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
@@ -855,43 +865,60 @@ static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 }
 
 
+/***********************************************************************
+ *           get_fd_cache_block
+ *
+ * Return the block of entries for a handle, allocating it if needed.
+ */
+static union fd_cache_entry *get_fd_cache_block( unsigned int entry )
+{
+    union fd_cache_entry *block;
+    void *ptr;
+
+    if ((block = fd_cache[entry])) return block;
+    if (!entry)
+        ptr = fd_cache_initial_block;
+    else
+    {
+        ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry),
+                              PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return NULL;
+    }
+    /* another thread may have installed a block in the meantime */
+    if ((block = interlocked_cmpxchg_ptr( (void **)&fd_cache[entry], ptr, NULL )))
+    {
+        if (entry) munmap( ptr, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry) );
+        return block;
+    }
+    return ptr;
+}
+
+
 /***********************************************************************
  *           add_fd_to_cache
  *
- * Caller must hold fd_cache_section.
+ * Fails if the entry is already set, the caller then keeps ownership of the fd.
  */
 static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
                             unsigned int access, unsigned int options )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
-    union fd_cache_entry cache;
+    union fd_cache_entry cache, *block;
 
     if (entry >= FD_CACHE_ENTRIES)
     {
-        FIXME( "too many allocated handles, not caching %p\n", handle );
+        FIXME( "handle %p out of range, not caching\n", handle );
         return FALSE;
     }
 
-    if (!fd_cache[entry])  /* do we need to allocate a new block of entries? */
-    {
-        if (!entry) fd_cache[0] = fd_cache_initial_block;
-        else
-        {
-            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry),
-                                        PROT_READ | PROT_WRITE, 0 );
-            if (ptr == MAP_FAILED) return FALSE;
-            fd_cache[entry] = ptr;
-        }
-    }
+    if (!(block = get_fd_cache_block( entry ))) return FALSE;
 
     /* store fd+1 so that 0 can be used as the unset value */
     cache.s.fd = fd + 1;
     cache.s.type = type;
     cache.s.access = access;
     cache.s.options = options;
-    cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, cache.data );
-    assert( !cache.s.fd );
-    return TRUE;
+    return !interlocked_cmpxchg64( &block[idx].data, cache.data, 0 );
 }
 
 
@@ -981,12 +1008,19 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
     wanted_access &= FILE_READ_DATA | FILE_WRITE_DATA | FILE_APPEND_DATA;
 
     ret = get_cached_fd( handle, &fd, type, &access, options );
-    if (ret != STATUS_INVALID_HANDLE) goto done;
+    if (ret != STATUS_INVALID_HANDLE)
+    {
+        if (TRACE_ON(fdcache)) interlocked_xchg_add( &fd_cache_hits, 1 );
+        goto done;
+    }
 
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
     ret = get_cached_fd( handle, &fd, type, &access, options );
     if (ret == STATUS_INVALID_HANDLE)
     {
+        if (TRACE_ON(fdcache))
+            TRACE_(fdcache)( "miss for handle %p, %d hits %d misses\n", handle,
+                             fd_cache_hits, interlocked_xchg_add( &fd_cache_misses, 1 ) + 1 );
         SERVER_START_REQ( get_handle_fd )
         {
             req->handle = wine_server_obj_handle( handle );
@@ -1105,6 +1139,59 @@ void *server_get_shared_memory( HANDLE thread )
 }
 
 
+/***********************************************************************
+ *           server_get_sync_memory
+ *
+ * Get address of the synchronization object state shared with the server,
+ * and optionally the index of the slot counting handles closed by other
+ * processes.
+ */
+sync_slot_t *server_get_sync_memory( unsigned int *close_slot )
+{
+    static sync_slot_t *sync_slots = (void *)-1;
+    static unsigned int sync_close_slot;
+    obj_handle_t dummy;
+    sigset_t sigset;
+    void *mem = NULL;
+    int fd = -1;
+
+    if (!experimental_SHARED_MEMORY())
+        return NULL;
+
+    /* Only requested once, from the initialization of the first thread. */
+    if (sync_slots != (void *)-1)
+    {
+        if (close_slot) *close_slot = sync_close_slot;
+        return sync_slots;
+    }
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+
+    SERVER_START_REQ( get_sync_memory )
+    {
+        if (!wine_server_call( req ))
+        {
+            fd = receive_fd( &dummy );
+            sync_close_slot = reply->close_slot;
+        }
+    }
+    SERVER_END_REQ;
+
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd != -1)
+    {
+        SIZE_T size = SYNC_SLOT_COUNT * sizeof(sync_slot_t);
+        virtual_map_shared_memory( fd, &mem, 0, &size, PAGE_READWRITE );
+        close( fd );
+    }
+
+    sync_slots = mem;
+    if (close_slot) *close_slot = sync_close_slot;
+    return mem;
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
@@ -1637,6 +1724,7 @@ size_t server_init_thread( void *entry_point )
     /* initialize thread shared memory pointers */
     NtCurrentTeb()->Reserved5[1] = server_get_shared_memory( 0 );
     NtCurrentTeb()->Reserved5[2] = server_get_shared_memory( NtCurrentTeb()->ClientId.UniqueThread );
+    server_get_sync_memory( NULL );
 
     is_wow64 = !is_win64 && (server_cpus & ((1 << CPU_x86_64) | (1 << CPU_ARM64))) != 0;
     ntdll_get_thread_data()->wow64_redir = is_wow64;
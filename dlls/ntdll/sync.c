@@ -72,6 +72,106 @@ static inline int interlocked_dec_if_nonzero( int *dest )
     return val;
 }
 
+/* Events, semaphores and mutexes keep their state in memory shared with the
+ * server. As long as no thread is waiting for the object in the server, the
+ * operations that don't need to wake anybody up are done directly here. The
+ * slot of each handle is looked up once and cached. The cache is dropped
+ * when the server reports that another process closed one of our handles,
+ * since the handle value may then be reused for a different object. */
+
+#define SYNC_CACHE_SIZE     16384
+#define SYNC_CACHE_VALID    0x80000000
+#define SYNC_ACCESS_WAIT    0x40000000  /* SYNCHRONIZE */
+#define SYNC_ACCESS_MODIFY  0x20000000  /* EVENT_MODIFY_STATE, SEMAPHORE_MODIFY_STATE */
+#define SYNC_ACCESS_QUERY   0x10000000  /* EVENT_QUERY_STATE, SEMAPHORE_QUERY_STATE, MUTANT_QUERY_STATE */
+#define SYNC_CACHE_TYPE(entry) (((entry) >> 16) & 0xff)
+#define SYNC_CACHE_SLOT(entry) ((entry) & 0xffff)
+
+static LONG sync_cache[SYNC_CACHE_SIZE];
+static unsigned int sync_cache_closed;  /* close counter the cache is valid for */
+
+static inline unsigned int sync_cache_index( HANDLE handle )
+{
+    ULONG_PTR value = (ULONG_PTR)handle;
+    if (!value || (value & 3) || (value >> 2) >= SYNC_CACHE_SIZE) return 0;
+    return value >> 2;
+}
+
+/* return the shared state of a handle if it grants the requested access */
+static sync_slot_t *get_sync_slot( HANDLE handle, unsigned int access, unsigned int *type )
+{
+    unsigned int index = sync_cache_index( handle );
+    unsigned int close_slot, closed;
+    sync_slot_t *slots;
+    sync_slot_t *slot;
+    LONG entry;
+
+    if (!index || !(slots = server_get_sync_memory( &close_slot )) || !close_slot) return NULL;
+
+    closed = *(volatile unsigned int *)&slots[close_slot].state;
+    if (closed != sync_cache_closed)
+    {
+        memset( sync_cache, 0, sizeof(sync_cache) );
+        sync_cache_closed = closed;
+    }
+
+    if (!(entry = sync_cache[index]))
+    {
+        SERVER_START_REQ( get_sync_slot )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            if (!wine_server_call( req ))
+            {
+                entry = SYNC_CACHE_VALID | (reply->type << 16) | reply->slot;
+                if (reply->access & SYNCHRONIZE) entry |= SYNC_ACCESS_WAIT;
+                if (reply->access & EVENT_MODIFY_STATE) entry |= SYNC_ACCESS_MODIFY;
+                if (reply->access & EVENT_QUERY_STATE) entry |= SYNC_ACCESS_QUERY;
+            }
+        }
+        SERVER_END_REQ;
+        if (!entry) return NULL;
+        /* don't cache what may have been looked up before a remote close */
+        if (*(volatile unsigned int *)&slots[close_slot].state == closed && sync_cache_closed == closed)
+            sync_cache[index] = entry;
+    }
+
+    if (!SYNC_CACHE_SLOT(entry) || (entry & access) != access) return NULL;
+    slot = &slots[SYNC_CACHE_SLOT(entry)];
+    /* the server may have reused the slot if the handle was closed behind our back */
+    if (slot->type != SYNC_CACHE_TYPE(entry)) return NULL;
+    *type = slot->type;
+    return slot;
+}
+
+/* forget the cached slot of a closed handle */
+void invalidate_sync_cache( HANDLE handle )
+{
+    unsigned int index = sync_cache_index( handle );
+    if (index) sync_cache[index] = 0;
+}
+
+/* try to satisfy a wait without the server, returns FALSE if it has to be done there */
+static BOOL try_acquire_sync( sync_slot_t *slot, unsigned int type )
+{
+    unsigned int state = *(volatile unsigned int *)&slot->state;
+
+    switch (type)
+    {
+    case SYNC_TYPE_EVENT:
+        if (slot->max) return (state & ~SYNC_WAITERS) != 0;
+        return state == 1 && interlocked_cmpxchg( (int *)&slot->state, 0, 1 ) == 1;
+    case SYNC_TYPE_SEMAPHORE:
+        return state && !(state & SYNC_WAITERS) &&
+               interlocked_cmpxchg( (int *)&slot->state, state - 1, state ) == state;
+    case SYNC_TYPE_MUTEX:
+        /* only recursive grabs, the server tracks the owner and abandonment */
+        if (slot->owner != HandleToULong( NtCurrentTeb()->ClientId.UniqueThread )) return FALSE;
+        if (!(state & ~SYNC_WAITERS) || ((state + 1) & SYNC_WAITERS)) return FALSE;
+        return interlocked_cmpxchg( (int *)&slot->state, state + 1, state ) == state;
+    }
+    return FALSE;
+}
+
 /* creates a struct security_descriptor and contained information in one contiguous piece of memory */
 NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                   data_size_t *ret_len )
@@ -234,6 +334,8 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
 {
     NTSTATUS ret;
     SEMAPHORE_BASIC_INFORMATION *out = info;
+    unsigned int type;
+    sync_slot_t *slot;
 
     TRACE("(%p, %u, %p, %u, %p)\n", handle, class, info, len, ret_len);
 
@@ -245,6 +347,14 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
 
     if (len != sizeof(SEMAPHORE_BASIC_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
 
+    if ((slot = get_sync_slot( handle, SYNC_ACCESS_QUERY, &type )) && type == SYNC_TYPE_SEMAPHORE)
+    {
+        out->CurrentCount = *(volatile unsigned int *)&slot->state & ~SYNC_WAITERS;
+        out->MaximumCount = slot->max;
+        if (ret_len) *ret_len = sizeof(SEMAPHORE_BASIC_INFORMATION);
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( query_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -266,6 +376,24 @@ NTSTATUS WINAPI NtQuerySemaphore( HANDLE handle, SEMAPHORE_INFORMATION_CLASS cla
 NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous )
 {
     NTSTATUS ret;
+    unsigned int type, state;
+    sync_slot_t *slot;
+
+    /* nobody can be woken up as long as the server has no waiters */
+    if ((slot = get_sync_slot( handle, SYNC_ACCESS_MODIFY, &type )) && type == SYNC_TYPE_SEMAPHORE)
+    {
+        while (!((state = *(volatile unsigned int *)&slot->state) & SYNC_WAITERS))
+        {
+            if (state + count < state || state + count > slot->max)
+                return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+            if (interlocked_cmpxchg( (int *)&slot->state, state + count, state ) == state)
+            {
+                if (previous) *previous = state;
+                return STATUS_SUCCESS;
+            }
+        }
+    }
+
     SERVER_START_REQ( release_semaphore )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -343,9 +471,19 @@ NTSTATUS WINAPI NtOpenEvent( HANDLE *handle, ACCESS_MASK access, const OBJECT_AT
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
     NTSTATUS ret;
+    unsigned int type;
+    sync_slot_t *slot;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    /* nobody can be woken up as long as the server has no waiters */
+    if ((slot = get_sync_slot( handle, SYNC_ACCESS_MODIFY, &type )) && type == SYNC_TYPE_EVENT)
+    {
+        if (*(volatile unsigned int *)&slot->state == 1 ||
+            !interlocked_cmpxchg( (int *)&slot->state, 1, 0 ))
+            return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -362,10 +500,20 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
     NTSTATUS ret;
+    unsigned int type, state;
+    sync_slot_t *slot;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    /* ... so it never needs the server */
+    if ((slot = get_sync_slot( handle, SYNC_ACCESS_MODIFY, &type )) && type == SYNC_TYPE_EVENT)
+    {
+        do state = *(volatile unsigned int *)&slot->state;
+        while (interlocked_cmpxchg( (int *)&slot->state, state & SYNC_WAITERS, state ) != state);
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -418,6 +566,8 @@ NTSTATUS WINAPI NtQueryEvent( HANDLE handle, EVENT_INFORMATION_CLASS class,
 {
     NTSTATUS ret;
     EVENT_BASIC_INFORMATION *out = info;
+    unsigned int type;
+    sync_slot_t *slot;
 
     TRACE("(%p, %u, %p, %u, %p)\n", handle, class, info, len, ret_len);
 
@@ -430,6 +580,14 @@ NTSTATUS WINAPI NtQueryEvent( HANDLE handle, EVENT_INFORMATION_CLASS class,
 
     if (len != sizeof(EVENT_BASIC_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
 
+    if ((slot = get_sync_slot( handle, SYNC_ACCESS_QUERY, &type )) && type == SYNC_TYPE_EVENT)
+    {
+        out->EventType  = slot->max ? NotificationEvent : SynchronizationEvent;
+        out->EventState = (*(volatile unsigned int *)&slot->state & ~SYNC_WAITERS) != 0;
+        if (ret_len) *ret_len = sizeof(EVENT_BASIC_INFORMATION);
+        return STATUS_SUCCESS;
+    }
+
     SERVER_START_REQ( query_event )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -509,6 +667,21 @@ NTSTATUS WINAPI NtOpenMutant( HANDLE *handle, ACCESS_MASK access, const OBJECT_A
 NTSTATUS WINAPI NtReleaseMutant( IN HANDLE handle, OUT PLONG prev_count OPTIONAL)
 {
     NTSTATUS    status;
+    unsigned int type, count;
+    sync_slot_t *slot;
+
+    /* only recursive releases, the final one has to wake up the waiters */
+    if ((slot = get_sync_slot( handle, 0, &type )) && type == SYNC_TYPE_MUTEX &&
+        slot->owner == HandleToULong( NtCurrentTeb()->ClientId.UniqueThread ))
+    {
+        count = *(volatile unsigned int *)&slot->state;
+        if (count > 1 && !(count & SYNC_WAITERS) &&
+            interlocked_cmpxchg( (int *)&slot->state, count - 1, count ) == count)
+        {
+            if (prev_count) *prev_count = 1 - count;
+            return STATUS_SUCCESS;
+        }
+    }
 
     SERVER_START_REQ( release_mutex )
     {
@@ -998,9 +1171,23 @@ static NTSTATUS wait_objects( DWORD count, const HANDLE *handles,
 {
     select_op_t select_op;
     UINT i, flags = SELECT_INTERRUPTIBLE;
+    unsigned int type;
+    sync_slot_t *slot;
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    /* An alertable wait has to go through the server to run the APCs. Stop
+     * at the first handle without shared state, since a later one must not
+     * be reported if that one is signaled. */
+    if (!alertable && (wait_any || count == 1))
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!(slot = get_sync_slot( handles[i], SYNC_ACCESS_WAIT, &type ))) break;
+            if (try_acquire_sync( slot, type )) return STATUS_WAIT_0 + i;
+        }
+    }
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_any ? SELECT_WAIT : SELECT_WAIT_ALL;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
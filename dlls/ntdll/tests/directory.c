@@ -821,6 +821,82 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+static void mix_case(char *name, unsigned int seed)
+{
+    for ( ; *name; name++, seed >>= 1)
+    {
+        if (!seed) seed = 0x2d;
+        if (seed & 1) *name = (*name >= 'a' && *name <= 'z') ? *name - 'a' + 'A' : *name;
+        else *name = (*name >= 'A' && *name <= 'Z') ? *name - 'A' + 'a' : *name;
+    }
+}
+
+static void test_mixed_case_lookup(void)
+{
+    const unsigned int count = 1000, opens = 50000;
+    char testdir[MAX_PATH], buf[MAX_PATH], name[32];
+    unsigned int i, failed = 0;
+    DWORD start, create_time, open_time;
+    HANDLE h;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, testdir);
+    strcat(testdir, "mixcase.tmp");
+    ret = CreateDirectoryA(testdir, NULL);
+    ok(ret, "couldn't create dir '%s', error %d\n", testdir, GetLastError());
+    if (!ret) return;
+
+    start = GetTickCount();
+    for (i = 0; i < count; i++)
+    {
+        sprintf(buf, "%s\\Asset%04u.Dat", testdir, i);
+        h = CreateFileA(buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+        ok(h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError());
+        CloseHandle(h);
+    }
+    create_time = GetTickCount() - start;
+
+    start = GetTickCount();
+    for (i = 0; i < opens; i++)
+    {
+        sprintf(name, "asset%04u.dat", (i * 7919) % count);
+        mix_case(name, i);
+        sprintf(buf, "%s\\%s", testdir, name);
+        h = CreateFileA(buf, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0);
+        if (h == INVALID_HANDLE_VALUE)
+        {
+            if (!failed++) ok(0, "failed to open '%s', error %d\n", buf, GetLastError());
+            continue;
+        }
+        CloseHandle(h);
+    }
+    open_time = GetTickCount() - start;
+    ok(!failed, "%u opens failed\n", failed);
+    trace("%u files: create %u ms, %u mixed-case opens %u ms\n", count, create_time, opens, open_time);
+
+    /* entries added or removed after the first lookups must be seen immediately */
+    sprintf(buf, "%s\\Late.Dat", testdir);
+    h = CreateFileA(buf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ok(h != INVALID_HANDLE_VALUE, "failed to create '%s', error %d\n", buf, GetLastError());
+    CloseHandle(h);
+    sprintf(buf, "%s\\lATE.dAT", testdir);
+    h = CreateFileA(buf, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0);
+    ok(h != INVALID_HANDLE_VALUE, "failed to open '%s', error %d\n", buf, GetLastError());
+    CloseHandle(h);
+    ret = DeleteFileA(buf);
+    ok(ret, "failed to delete '%s', error %d\n", buf, GetLastError());
+    h = CreateFileA(buf, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0);
+    ok(h == INVALID_HANDLE_VALUE && GetLastError() == ERROR_FILE_NOT_FOUND,
+       "opened deleted file '%s', error %d\n", buf, GetLastError());
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf(buf, "%s\\Asset%04u.Dat", testdir, i);
+        DeleteFileA(buf);
+    }
+    RemoveDirectoryA(testdir);
+}
+
 static void test_redirection(void)
 {
     ULONG old, cur;
@@ -899,5 +975,6 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_mixed_case_lookup();
     test_redirection();
 }
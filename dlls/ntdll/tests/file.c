@@ -4427,6 +4427,260 @@ static void test_read_write(void)
     CloseHandle(hfile);
 }
 
+static NTSTATUS queue_random_read( HANDLE hfile, HANDLE event, IO_STATUS_BLOCK *iosb, void *buffer,
+                                   LARGE_INTEGER *offset, ULONG block_size, ULONG block_count, ULONG *seed )
+{
+    *seed = *seed * 1103515245 + 12345;
+    offset->QuadPart = (LONGLONG)((*seed >> 8) % block_count) * block_size;
+    U(*iosb).Status = 0xdeadbeef;
+    iosb->Information = 0xdeadbeef;
+    return pNtReadFile( hfile, event, NULL, NULL, iosb, buffer, block_size, offset, NULL );
+}
+
+static void test_overlapped_random_read(void)
+{
+    enum { block_size = 4096, block_count = 1024, depth = 32, total = 4096 };
+    const ULONG words = block_size / sizeof(ULONG);
+    HANDLE hfile, events[depth];
+    IO_STATUS_BLOCK iosb[depth];
+    LARGE_INTEGER offset[depth];
+    ULONG *buffers[depth], seed = 0x1234;
+    DWORD i, j, k, ret, submitted = 0, completed = 0;
+    NTSTATUS status;
+
+    /* write-through writes wait for the disk, so they are completed in the background */
+    hfile = create_temp_file( FILE_FLAG_OVERLAPPED | FILE_FLAG_WRITE_THROUGH );
+    if (!hfile) return;
+
+    for (i = 0; i < depth; i++)
+    {
+        events[i] = CreateEventA( NULL, TRUE, FALSE, NULL );
+        buffers[i] = HeapAlloc( GetProcessHeap(), 0, block_size );
+    }
+
+    /* every word holds its own index so that misplaced writes and reads are detected */
+    for (i = 0; i < block_count + depth; i++)
+    {
+        j = i % depth;
+        if (i >= depth)
+        {
+            ret = WaitForSingleObject( events[j], 5000 );
+            ok( !ret, "wait failed %u\n", ret );
+            ok( U(iosb[j]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[j]).Status );
+            ok( iosb[j].Information == block_size, "got %lu bytes\n", iosb[j].Information );
+        }
+        if (i >= block_count) continue;
+
+        for (k = 0; k < words; k++) buffers[j][k] = i * words + k;
+        offset[j].QuadPart = (LONGLONG)i * block_size;
+        U(iosb[j]).Status = 0xdeadbeef;
+        iosb[j].Information = 0xdeadbeef;
+        status = pNtWriteFile( hfile, events[j], NULL, NULL, &iosb[j], buffers[j], block_size, &offset[j], NULL );
+        ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtWriteFile returned %#x\n", status );
+        if (status == STATUS_SUCCESS)
+        {
+            ok( U(iosb[j]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[j]).Status );
+            ok( iosb[j].Information == block_size, "got %lu bytes\n", iosb[j].Information );
+        }
+    }
+
+    /* appends take their offset from the file size, so they must not overlap */
+    for (i = 0; i < 2; i++)
+    {
+        offset[i].QuadPart = (LONGLONG)-1 /* FILE_WRITE_TO_END_OF_FILE */;
+        status = pNtWriteFile( hfile, events[i], NULL, NULL, &iosb[i], buffers[i], block_size, &offset[i], NULL );
+        ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtWriteFile returned %#x\n", status );
+    }
+    ok( !WaitForMultipleObjects( 2, events, TRUE, 5000 ), "wait failed\n" );
+    ret = GetFileSize( hfile, NULL );
+    ok( ret == (block_count + 2) * block_size, "got size %u\n", ret );
+
+    /* the data is cached now, so most reads complete right away */
+    for (i = 0; i < depth; i++)
+    {
+        status = queue_random_read( hfile, events[i], &iosb[i], buffers[i], &offset[i],
+                                    block_size, block_count, &seed );
+        ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtReadFile returned %#x\n", status );
+        submitted++;
+    }
+
+    while (completed < submitted)
+    {
+        ret = WaitForMultipleObjects( depth, events, FALSE, 5000 );
+        ok( ret < WAIT_OBJECT_0 + depth, "wait failed %u\n", ret );
+        if (ret >= WAIT_OBJECT_0 + depth) break;
+        i = ret - WAIT_OBJECT_0;
+
+        ok( U(iosb[i]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[i]).Status );
+        ok( iosb[i].Information == block_size, "got %lu bytes\n", iosb[i].Information );
+        j = offset[i].QuadPart / sizeof(ULONG);
+        ok( buffers[i][0] == j && buffers[i][words - 1] == j + words - 1,
+            "wrong data at %#x: %u\n", offset[i].u.LowPart, buffers[i][0] );
+        completed++;
+
+        if (submitted < total)
+        {
+            status = queue_random_read( hfile, events[i], &iosb[i], buffers[i], &offset[i],
+                                        block_size, block_count, &seed );
+            ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtReadFile returned %#x\n", status );
+            submitted++;
+        }
+        else ResetEvent( events[i] );
+    }
+
+    for (i = 0; i < depth; i++)
+    {
+        CloseHandle( events[i] );
+        HeapFree( GetProcessHeap(), 0, buffers[i] );
+    }
+    CloseHandle( hfile );
+}
+
+static void test_overlapped_file_io_cancel(void)
+{
+    enum { block_size = 65536, depth = 16 };
+    const ULONG words = block_size / sizeof(ULONG);
+    HANDLE hfile, port, events[depth];
+    IO_STATUS_BLOCK iosb[depth];
+    LARGE_INTEGER offset[depth];
+    ULONG *buffers[depth], seen;
+    DWORD i, k, ret, pass;
+    NTSTATUS status;
+
+    hfile = create_temp_file( FILE_FLAG_OVERLAPPED | FILE_FLAG_WRITE_THROUGH );
+    if (!hfile) return;
+
+    /* write the contents first, so that cancelled writes don't leave holes */
+    for (i = 0; i < depth; i++)
+    {
+        events[i] = CreateEventA( NULL, TRUE, FALSE, NULL );
+        buffers[i] = HeapAlloc( GetProcessHeap(), 0, block_size );
+        for (k = 0; k < words; k++) buffers[i][k] = i * words + k;
+        offset[i].QuadPart = (LONGLONG)i * block_size;
+        status = pNtWriteFile( hfile, events[i], NULL, NULL, &iosb[i], buffers[i], block_size, &offset[i], NULL );
+        ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtWriteFile returned %#x\n", status );
+        ret = WaitForSingleObject( events[i], 5000 );
+        ok( !ret, "wait failed %u\n", ret );
+        ok( U(iosb[i]).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb[i]).Status );
+        ResetEvent( events[i] );
+    }
+
+    port = CreateIoCompletionPort( hfile, NULL, 0xdeadbeef, 0 );
+    ok( port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError() );
+
+    /* every operation either completes or is cancelled, and is reported exactly once */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < depth; i++)
+        {
+            for (k = 0; k < words; k++) buffers[i][k] = pass ? 0 : i * words + k;
+            offset[i].QuadPart = (LONGLONG)i * block_size;
+            U(iosb[i]).Status = 0xdeadbeef;
+            iosb[i].Information = 0xdeadbeef;
+            if (pass)
+                status = pNtReadFile( hfile, events[i], NULL, (void *)(ULONG_PTR)(i + 1), &iosb[i],
+                                      buffers[i], block_size, &offset[i], NULL );
+            else
+                status = pNtWriteFile( hfile, events[i], NULL, (void *)(ULONG_PTR)(i + 1), &iosb[i],
+                                       buffers[i], block_size, &offset[i], NULL );
+            ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "%u: got %#x\n", pass, status );
+        }
+        CancelIo( hfile );
+
+        ret = WaitForMultipleObjects( depth, events, TRUE, 5000 );
+        ok( !ret, "%u: wait failed %u\n", pass, ret );
+        for (i = 0; i < depth; i++)
+        {
+            if (U(iosb[i]).Status == STATUS_SUCCESS)
+            {
+                ok( iosb[i].Information == block_size, "%u: got %lu bytes\n", pass, iosb[i].Information );
+                ok( buffers[i][0] == i * words && buffers[i][words - 1] == (i + 1) * words - 1,
+                    "%u: wrong data at %#x: %u\n", pass, offset[i].u.LowPart, buffers[i][0] );
+            }
+            else ok( U(iosb[i]).Status == STATUS_CANCELLED, "%u: got status %#x\n", pass, U(iosb[i]).Status );
+        }
+
+        for (i = 0, seen = 0; i < depth; i++)
+        {
+            if (!get_msg( port )) break;
+            ok( completionKey == 0xdeadbeef, "%u: got key %#lx\n", pass, completionKey );
+            k = completionValue - 1;
+            ok( k < depth && !(seen & (1 << k)), "%u: got value %#lx\n", pass, completionValue );
+            if (k >= depth) continue;
+            seen |= 1 << k;
+            ok( U(ioSb).Status == U(iosb[k]).Status, "%u: got status %#x\n", pass, U(ioSb).Status );
+            ok( ioSb.Information == iosb[k].Information, "%u: got %lu bytes\n", pass, ioSb.Information );
+        }
+        ok( !get_pending_msgs( port ), "%u: unexpected completions\n", pass );
+        for (i = 0; i < depth; i++) ResetEvent( events[i] );
+    }
+
+    for (i = 0; i < depth; i++)
+    {
+        CloseHandle( events[i] );
+        HeapFree( GetProcessHeap(), 0, buffers[i] );
+    }
+    CloseHandle( hfile );
+    CloseHandle( port );
+}
+
+static void test_write_through(void)
+{
+    static const char data[] = "write-through data";
+    char path[MAX_PATH], name[MAX_PATH], buffer[64];
+    HANDLE hfile, reader, event;
+    IO_STATUS_BLOCK iosb;
+    LARGE_INTEGER offset;
+    NTSTATUS status;
+    DWORD size, ret;
+
+    GetTempPathA( MAX_PATH, path );
+    GetTempFileNameA( path, "foo", 0, name );
+
+    /* the data is visible through other handles as soon as the write completes */
+    hfile = CreateFileA( name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         CREATE_ALWAYS, FILE_FLAG_WRITE_THROUGH, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "failed to create file, error %u\n", GetLastError() );
+    reader = CreateFileA( name, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, 0 );
+    ok( reader != INVALID_HANDLE_VALUE, "failed to open file, error %u\n", GetLastError() );
+
+    ret = WriteFile( hfile, data, sizeof(data), &size, NULL );
+    ok( ret, "WriteFile failed, error %u\n", GetLastError() );
+    ok( size == sizeof(data), "got size %u\n", size );
+    ok( SetFilePointer( hfile, 0, NULL, FILE_CURRENT ) == sizeof(data), "wrong file pointer\n" );
+
+    memset( buffer, 0, sizeof(buffer) );
+    ret = ReadFile( reader, buffer, sizeof(buffer), &size, NULL );
+    ok( ret, "ReadFile failed, error %u\n", GetLastError() );
+    ok( size == sizeof(data) && !memcmp( buffer, data, sizeof(data) ), "got %u bytes %s\n", size, buffer );
+    CloseHandle( hfile );
+
+    /* overlapped write-through writes */
+    hfile = CreateFileA( name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_WRITE_THROUGH, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "failed to open file, error %u\n", GetLastError() );
+    event = CreateEventA( NULL, TRUE, FALSE, NULL );
+
+    offset.QuadPart = sizeof(data);
+    status = pNtWriteFile( hfile, event, NULL, NULL, &iosb, data, sizeof(data), &offset, NULL );
+    ok( status == STATUS_SUCCESS || status == STATUS_PENDING, "NtWriteFile returned %#x\n", status );
+    ret = WaitForSingleObject( event, 5000 );
+    ok( !ret, "wait failed %u\n", ret );
+    ok( U(iosb).Status == STATUS_SUCCESS, "got status %#x\n", U(iosb).Status );
+    ok( iosb.Information == sizeof(data), "got %lu bytes\n", iosb.Information );
+
+    ok( GetFileSize( reader, NULL ) == 2 * sizeof(data), "got size %u\n", GetFileSize( reader, NULL ) );
+    memset( buffer, 0, sizeof(buffer) );
+    ret = ReadFile( reader, buffer, sizeof(buffer), &size, NULL );
+    ok( ret, "ReadFile failed, error %u\n", GetLastError() );
+    ok( size == sizeof(data) && !memcmp( buffer, data, sizeof(data) ), "got %u bytes %s\n", size, buffer );
+
+    CloseHandle( event );
+    CloseHandle( hfile );
+    CloseHandle( reader );
+    DeleteFileA( name );
+}
+
 static void test_query_ea(void)
 {
     #define EA_BUFFER_SIZE 4097
@@ -4717,6 +4971,9 @@ START_TEST(file)
     pNtQueryEaFile          = (void *)GetProcAddress(hntdll, "NtQueryEaFile");
 
     test_read_write();
+    test_overlapped_random_read();
+    test_overlapped_file_io_cancel();
+    test_write_through();
     test_NtCreateFile();
     test_readonly();
     create_file_test();
@@ -47,6 +47,7 @@ static NTSTATUS (WINAPI *pNtQueryMutant) ( HANDLE, MUTANT_INFORMATION_CLASS, PVO
 static NTSTATUS (WINAPI *pNtReleaseMutant)( HANDLE, PLONG );
 static NTSTATUS (WINAPI *pNtCreateSemaphore)( PHANDLE, ACCESS_MASK,const POBJECT_ATTRIBUTES,LONG,LONG );
 static NTSTATUS (WINAPI *pNtOpenSemaphore)( PHANDLE, ACCESS_MASK, const POBJECT_ATTRIBUTES );
+static NTSTATUS (WINAPI *pNtQuerySemaphore)( HANDLE, SEMAPHORE_INFORMATION_CLASS, PVOID, ULONG, PULONG );
 static NTSTATUS (WINAPI *pNtCreateTimer) ( PHANDLE, ACCESS_MASK, const POBJECT_ATTRIBUTES, TIMER_TYPE );
 static NTSTATUS (WINAPI *pNtOpenTimer)( PHANDLE, ACCESS_MASK, const POBJECT_ATTRIBUTES );
 static NTSTATUS (WINAPI *pNtCreateSection)( PHANDLE, ACCESS_MASK, const POBJECT_ATTRIBUTES, const PLARGE_INTEGER,
@@ -1976,10 +1977,141 @@ static void test_mutant(void)
     NtClose( mutant );
 }
 
+static void test_uncontended_sync(void)
+{
+    SEMAPHORE_BASIC_INFORMATION sem_info;
+    MUTANT_BASIC_INFORMATION mutant_info;
+    EVENT_BASIC_INFORMATION event_info;
+    HANDLE event, semaphore, mutant, dup;
+    NTSTATUS status;
+    ULONG prev;
+    LONG prev_count;
+    DWORD ret;
+
+    status = pNtCreateEvent( &event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, 0 );
+    ok( !status, "NtCreateEvent failed %08x\n", status );
+    SetEvent( event );
+    SetEvent( event );
+    ret = WaitForSingleObject( event, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    ret = WaitForSingleObject( event, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %u\n", ret );
+    SetEvent( event );
+    ResetEvent( event );
+    status = pNtQueryEvent( event, EventBasicInformation, &event_info, sizeof(event_info), NULL );
+    ok( !status, "NtQueryEvent failed %08x\n", status );
+    ok( event_info.EventType == SynchronizationEvent && event_info.EventState == 0,
+        "got type %d state %d\n", event_info.EventType, event_info.EventState );
+
+    /* a handle without modify access must still be rejected */
+    ret = DuplicateHandle( GetCurrentProcess(), event, GetCurrentProcess(), &dup, SYNCHRONIZE, FALSE, 0 );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    ret = SetEvent( dup );
+    ok( !ret && GetLastError() == ERROR_ACCESS_DENIED, "SetEvent returned %u, error %u\n", ret, GetLastError() );
+    pNtClose( dup );
+    pNtClose( event );
+
+    status = pNtCreateSemaphore( &semaphore, SEMAPHORE_ALL_ACCESS, NULL, 1, 2 );
+    ok( !status, "NtCreateSemaphore failed %08x\n", status );
+    status = pNtReleaseSemaphore( semaphore, 1, &prev );
+    ok( !status && prev == 1, "NtReleaseSemaphore returned %08x, prev %u\n", status, prev );
+    status = pNtReleaseSemaphore( semaphore, 1, &prev );
+    ok( status == STATUS_SEMAPHORE_LIMIT_EXCEEDED, "NtReleaseSemaphore returned %08x\n", status );
+    ret = WaitForSingleObject( semaphore, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    status = pNtQuerySemaphore( semaphore, SemaphoreBasicInformation, &sem_info, sizeof(sem_info), NULL );
+    ok( !status, "NtQuerySemaphore failed %08x\n", status );
+    ok( sem_info.CurrentCount == 1 && sem_info.MaximumCount == 2,
+        "got count %d max %d\n", sem_info.CurrentCount, sem_info.MaximumCount );
+    ret = WaitForSingleObject( semaphore, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    ret = WaitForSingleObject( semaphore, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %u\n", ret );
+    pNtClose( semaphore );
+
+    status = pNtCreateMutant( &mutant, MUTANT_ALL_ACCESS, NULL, TRUE );
+    ok( !status, "NtCreateMutant failed %08x\n", status );
+    ret = WaitForSingleObject( mutant, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    ret = WaitForSingleObject( mutant, 0 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+    status = pNtQueryMutant( mutant, MutantBasicInformation, &mutant_info, sizeof(mutant_info), NULL );
+    ok( !status, "NtQueryMutant failed %08x\n", status );
+    ok( mutant_info.CurrentCount == -2 && mutant_info.OwnedByCaller,
+        "got count %d owned %d\n", mutant_info.CurrentCount, mutant_info.OwnedByCaller );
+    status = pNtReleaseMutant( mutant, &prev_count );
+    ok( !status && prev_count == -2, "NtReleaseMutant returned %08x, prev %d\n", status, prev_count );
+    status = pNtReleaseMutant( mutant, &prev_count );
+    ok( !status && prev_count == -1, "NtReleaseMutant returned %08x, prev %d\n", status, prev_count );
+    status = pNtReleaseMutant( mutant, &prev_count );
+    ok( !status && prev_count == 0, "NtReleaseMutant returned %08x, prev %d\n", status, prev_count );
+    status = pNtReleaseMutant( mutant, NULL );
+    ok( status == STATUS_MUTANT_NOT_OWNED, "NtReleaseMutant returned %08x\n", status );
+    pNtClose( mutant );
+}
+
+static void test_remote_close_sync(void)
+{
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    HANDLE event, event2, dup;
+    char cmdline[MAX_PATH + 64];
+    char **argv;
+    DWORD ret;
+
+    winetest_get_mainargs( &argv );
+
+    event = CreateEventA( NULL, TRUE, FALSE, NULL );
+    ok( event != NULL, "CreateEvent failed %u\n", GetLastError() );
+    ret = DuplicateHandle( GetCurrentProcess(), event, GetCurrentProcess(), &dup, 0, FALSE, DUPLICATE_SAME_ACCESS );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    ResetEvent( event );
+
+    /* another process closes the handle behind our back */
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    sprintf( cmdline, "\"%s\" om remote_close %x %lx", argv[0], GetCurrentProcessId(), (ULONG_PTR)event );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    ok( ret, "CreateProcess failed %u\n", GetLastError() );
+    winetest_wait_child_process( info.hProcess );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+
+    event2 = CreateEventA( NULL, TRUE, FALSE, NULL );
+    ok( event2 != NULL, "CreateEvent failed %u\n", GetLastError() );
+    if (event2 != event)
+        skip( "handle %p wasn't reused\n", event );
+    else
+    {
+        /* the reused handle must refer to the new event */
+        ret = SetEvent( event2 );
+        ok( ret, "SetEvent failed %u\n", GetLastError() );
+        ret = WaitForSingleObject( event2, 0 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", ret );
+        ret = WaitForSingleObject( dup, 0 );
+        ok( ret == WAIT_TIMEOUT, "the closed event was signaled, returned %u\n", ret );
+    }
+    CloseHandle( event2 );
+    CloseHandle( dup );
+}
+
+static void remote_close( DWORD pid, HANDLE handle )
+{
+    HANDLE process = OpenProcess( PROCESS_DUP_HANDLE, FALSE, pid );
+    BOOL ret;
+
+    ok( process != NULL, "OpenProcess failed %u\n", GetLastError() );
+    ret = DuplicateHandle( process, handle, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE );
+    ok( ret, "DuplicateHandle failed %u\n", GetLastError() );
+    CloseHandle( process );
+}
+
 START_TEST(om)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
     HMODULE hkernel32 = GetModuleHandleA("kernel32.dll");
+    char **argv;
+    int argc;
 
     if (!hntdll)
     {
@@ -1987,6 +2119,13 @@ START_TEST(om)
         return;
     }
 
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 5 && !strcmp( argv[2], "remote_close" ))
+    {
+        remote_close( strtoul( argv[3], NULL, 16 ), (HANDLE)(ULONG_PTR)strtoul( argv[4], NULL, 16 ) );
+        return;
+    }
+
     pCreateWaitableTimerA = (void *)GetProcAddress(hkernel32, "CreateWaitableTimerA");
 
     pRtlCreateUnicodeStringFromAsciiz = (void *)GetProcAddress(hntdll, "RtlCreateUnicodeStringFromAsciiz");
@@ -2016,6 +2155,7 @@ START_TEST(om)
     pNtQuerySymbolicLinkObject  = (void *)GetProcAddress(hntdll, "NtQuerySymbolicLinkObject");
     pNtCreateSemaphore      =  (void *)GetProcAddress(hntdll, "NtCreateSemaphore");
     pNtOpenSemaphore        =  (void *)GetProcAddress(hntdll, "NtOpenSemaphore");
+    pNtQuerySemaphore       =  (void *)GetProcAddress(hntdll, "NtQuerySemaphore");
     pNtCreateTimer          =  (void *)GetProcAddress(hntdll, "NtCreateTimer");
     pNtOpenTimer            =  (void *)GetProcAddress(hntdll, "NtOpenTimer");
     pNtCreateSection        =  (void *)GetProcAddress(hntdll, "NtCreateSection");
@@ -2041,4 +2181,6 @@ START_TEST(om)
     test_mutant();
     test_keyed_events();
     test_null_device();
+    test_uncontended_sync();
+    test_remote_close_sync();
 }
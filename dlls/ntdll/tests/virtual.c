@@ -0,0 +1,181 @@
+/*
+ * Unit test suite for ntdll virtual memory functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "ntdll_test.h"
+
+static NTSTATUS (WINAPI *pNtAllocateVirtualMemory)(HANDLE, PVOID *, ULONG, SIZE_T *, ULONG, ULONG);
+static NTSTATUS (WINAPI *pNtFreeVirtualMemory)(HANDLE, PVOID *, SIZE_T *, ULONG);
+static NTSTATUS (WINAPI *pNtProtectVirtualMemory)(HANDLE, PVOID *, SIZE_T *, ULONG, ULONG *);
+static NTSTATUS (WINAPI *pNtQueryVirtualMemory)(HANDLE, LPCVOID, MEMORY_INFORMATION_CLASS, PVOID, SIZE_T, SIZE_T *);
+
+static void check_region( void *addr, void *base, SIZE_T size, DWORD state, DWORD protect )
+{
+    MEMORY_BASIC_INFORMATION info;
+    NTSTATUS status;
+
+    status = pNtQueryVirtualMemory( NtCurrentProcess(), addr, MemoryBasicInformation, &info, sizeof(info), NULL );
+    ok( !status, "%p: NtQueryVirtualMemory failed %08x\n", addr, status );
+    ok( info.AllocationBase == base, "%p: got allocation base %p, expected %p\n", addr, info.AllocationBase, base );
+    ok( info.RegionSize == size, "%p: got size %#lx, expected %#lx\n", addr, info.RegionSize, size );
+    ok( info.State == state, "%p: got state %#x, expected %#x\n", addr, info.State, state );
+    if (protect) ok( info.Protect == protect, "%p: got protect %#x, expected %#x\n", addr, info.Protect, protect );
+}
+
+static void test_reserve_regions(void)
+{
+    void *regions[64];
+    unsigned int i;
+    NTSTATUS status;
+    SIZE_T size;
+    ULONG old_prot;
+
+    for (i = 0; i < sizeof(regions)/sizeof(regions[0]); i++)
+    {
+        regions[i] = NULL;
+        size = 0x10000 * (1 + i % 3);
+        status = pNtAllocateVirtualMemory( NtCurrentProcess(), &regions[i], 0, &size, MEM_RESERVE, PAGE_READWRITE );
+        ok( !status, "region %u: NtAllocateVirtualMemory failed %08x\n", i, status );
+        ok( !((UINT_PTR)regions[i] & 0xffff), "region %u: %p is not aligned\n", i, regions[i] );
+        ok( size == 0x10000 * (1 + i % 3), "region %u: got size %#lx\n", i, size );
+    }
+
+    for (i = 0; i < sizeof(regions)/sizeof(regions[0]); i++)
+        check_region( regions[i], regions[i], 0x10000 * (1 + i % 3), MEM_RESERVE, 0 );
+
+    /* release every other region, the remaining ones must not be affected */
+    for (i = 0; i < sizeof(regions)/sizeof(regions[0]); i += 2)
+    {
+        size = 0;
+        status = pNtFreeVirtualMemory( NtCurrentProcess(), &regions[i], &size, MEM_RELEASE );
+        ok( !status, "region %u: NtFreeVirtualMemory failed %08x\n", i, status );
+    }
+
+    for (i = 1; i < sizeof(regions)/sizeof(regions[0]); i += 2)
+    {
+        void *addr = regions[i];
+
+        size = 0x1000;
+        status = pNtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_COMMIT, PAGE_READWRITE );
+        ok( !status, "region %u: failed to commit %08x\n", i, status );
+        size = 0x1000;
+        status = pNtProtectVirtualMemory( NtCurrentProcess(), &addr, &size, PAGE_READONLY, &old_prot );
+        ok( !status, "region %u: failed to protect %08x\n", i, status );
+        ok( old_prot == PAGE_READWRITE, "region %u: got old protection %#x\n", i, old_prot );
+
+        check_region( regions[i], regions[i], 0x1000, MEM_COMMIT, PAGE_READONLY );
+        check_region( (char *)regions[i] + 0x1000, regions[i], 0x10000 * (1 + i % 3) - 0x1000, MEM_RESERVE, 0 );
+    }
+
+    for (i = 1; i < sizeof(regions)/sizeof(regions[0]); i += 2)
+    {
+        size = 0;
+        status = pNtFreeVirtualMemory( NtCurrentProcess(), &regions[i], &size, MEM_RELEASE );
+        ok( !status, "region %u: NtFreeVirtualMemory failed %08x\n", i, status );
+    }
+}
+
+static void test_fragmented_placement(void)
+{
+    void *base, *addr, *extra[16];
+    unsigned int i, j;
+    NTSTATUS status;
+    SIZE_T size;
+
+    /* find a free 1MB range, then reserve every other 64k chunk of it */
+    base = NULL;
+    size = 0x100000;
+    status = pNtAllocateVirtualMemory( NtCurrentProcess(), &base, 0, &size, MEM_RESERVE, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %08x\n", status );
+    size = 0;
+    status = pNtFreeVirtualMemory( NtCurrentProcess(), &base, &size, MEM_RELEASE );
+    ok( !status, "NtFreeVirtualMemory failed %08x\n", status );
+
+    for (i = 1; i < 16; i += 2)
+    {
+        addr = (char *)base + i * 0x10000;
+        size = 0x10000;
+        status = pNtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE, PAGE_READWRITE );
+        ok( !status, "chunk %u: NtAllocateVirtualMemory failed %08x\n", i, status );
+        ok( addr == (char *)base + i * 0x10000, "chunk %u: got %p\n", i, addr );
+    }
+
+    /* the 64k holes are too small, the new regions have to be placed around them */
+    for (i = 0; i < sizeof(extra)/sizeof(extra[0]); i++)
+    {
+        extra[i] = NULL;
+        size = 0x20000;
+        status = pNtAllocateVirtualMemory( NtCurrentProcess(), &extra[i], 0, &size,
+                                           MEM_RESERVE | (i % 2 ? MEM_TOP_DOWN : 0), PAGE_READWRITE );
+        ok( !status, "region %u: NtAllocateVirtualMemory failed %08x\n", i, status );
+        ok( !((UINT_PTR)extra[i] & 0xffff), "region %u: %p is not aligned\n", i, extra[i] );
+        check_region( extra[i], extra[i], 0x20000, MEM_RESERVE, 0 );
+        for (j = 0; j < i; j++)
+            ok( (char *)extra[i] + 0x20000 <= (char *)extra[j] || (char *)extra[j] + 0x20000 <= (char *)extra[i],
+                "region %u at %p overlaps region %u at %p\n", i, extra[i], j, extra[j] );
+    }
+    for (i = 1; i < 16; i += 2)
+        check_region( (char *)base + i * 0x10000, (char *)base + i * 0x10000, 0x10000, MEM_RESERVE, 0 );
+
+    for (i = 0; i < sizeof(extra)/sizeof(extra[0]); i++)
+    {
+        size = 0;
+        status = pNtFreeVirtualMemory( NtCurrentProcess(), &extra[i], &size, MEM_RELEASE );
+        ok( !status, "region %u: NtFreeVirtualMemory failed %08x\n", i, status );
+    }
+
+    /* the holes are still free */
+    for (i = 2; i < 16; i += 2)
+    {
+        addr = (char *)base + i * 0x10000;
+        size = 0x10000;
+        status = pNtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE, PAGE_READWRITE );
+        ok( !status, "hole %u: NtAllocateVirtualMemory failed %08x\n", i, status );
+        ok( addr == (char *)base + i * 0x10000, "hole %u: got %p\n", i, addr );
+    }
+
+    /* once everything is released, the whole range can be reserved again */
+    for (i = 1; i < 16; i++)
+    {
+        addr = (char *)base + i * 0x10000;
+        size = 0;
+        status = pNtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+        ok( !status, "chunk %u: NtFreeVirtualMemory failed %08x\n", i, status );
+    }
+    addr = base;
+    size = 0x100000;
+    status = pNtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE, PAGE_READWRITE );
+    ok( !status, "NtAllocateVirtualMemory failed %08x\n", status );
+    ok( addr == base, "got %p, expected %p\n", addr, base );
+    check_region( base, base, 0x100000, MEM_RESERVE, 0 );
+    size = 0;
+    status = pNtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    ok( !status, "NtFreeVirtualMemory failed %08x\n", status );
+}
+
+START_TEST(virtual)
+{
+    HMODULE mod = GetModuleHandleA( "ntdll.dll" );
+
+    pNtAllocateVirtualMemory = (void *)GetProcAddress( mod, "NtAllocateVirtualMemory" );
+    pNtFreeVirtualMemory = (void *)GetProcAddress( mod, "NtFreeVirtualMemory" );
+    pNtProtectVirtualMemory = (void *)GetProcAddress( mod, "NtProtectVirtualMemory" );
+    pNtQueryVirtualMemory = (void *)GetProcAddress( mod, "NtQueryVirtualMemory" );
+
+    test_reserve_regions();
+    test_fragmented_placement();
+}
@@ -412,6 +412,7 @@ void exit_thread( int status )
 
     LdrShutdownThread();
     RtlFreeThreadActivationContextStack();
+    heap_thread_detach();
 
     shmlocal = interlocked_xchg_ptr( &NtCurrentTeb()->Reserved5[2], NULL );
     if (shmlocal) NtUnmapViewOfSection( NtCurrentProcess(), shmlocal );
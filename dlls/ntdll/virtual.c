@@ -53,7 +53,7 @@
 #include "wine/library.h"
 #include "wine/server.h"
 #include "wine/exception.h"
-#include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -67,12 +67,14 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 /* File view */
 struct file_view
 {
-    struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry entry; /* Entry in global view tree */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
     HANDLE        mapping;     /* Handle to the file mapping */
     unsigned int  map_protect; /* Mapping protection */
     unsigned int  protect;     /* Protection for all pages at allocation time */
+    size_t        gap;         /* Size of the gap between the previous view and this one */
+    size_t        max_gap;     /* Largest gap in the subtree rooted at this view */
     BYTE          prot[1];     /* Protection byte for each page */
 };
 
@@ -98,7 +100,8 @@ static const BYTE VIRTUAL_Win32Flags[16] =
     PAGE_EXECUTE_WRITECOPY      /* READ | WRITE | EXEC | WRITECOPY */
 };
 
-static struct list views_list = LIST_INIT(views_list);
+static int compare_view( const void *addr, const struct wine_rb_entry *entry );
+static struct wine_rb_tree views_tree = { compare_view };
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -269,7 +272,7 @@ static void VIRTUAL_Dump(void)
 
     TRACE( "Dump of all virtual memory views:\n" );
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
     {
         VIRTUAL_DumpView( view );
     }
@@ -278,6 +281,64 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+/***********************************************************************
+ *           compare_view
+ *
+ * Comparison function for the views tree, ordered by base address.
+ */
+static int compare_view( const void *addr, const struct wine_rb_entry *entry )
+{
+    struct file_view *view = WINE_RB_ENTRY_VALUE( entry, struct file_view, entry );
+
+    if (addr < view->base) return -1;
+    if (addr > view->base) return 1;
+    return 0;
+}
+
+
+/***********************************************************************
+ *           find_view_before
+ *
+ * Find the last view starting at or before a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct wine_rb_entry *find_view_before( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root, *ret = NULL;
+
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
+        if ((const char *)view->base > (const char *)addr) ptr = ptr->left;
+        else
+        {
+            ret = ptr;
+            ptr = ptr->right;
+        }
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           find_view_after
+ *
+ * Find the first view ending after a given address.
+ * The csVirtual section must be held by caller.
+ */
+static struct wine_rb_entry *find_view_after( const void *addr )
+{
+    struct wine_rb_entry *ptr = find_view_before( addr );
+    struct file_view *view;
+
+    if (!ptr) return wine_rb_head( views_tree.root );
+    view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+    if ((const char *)view->base + view->size > (const char *)addr) return ptr;
+    return wine_rb_next( ptr );
+}
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -292,15 +353,18 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct wine_rb_entry *ptr = views_tree.root;
+
+    if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    while (ptr)
     {
-        if (view->base > addr) break;  /* no matching view */
-        if ((const char *)view->base + view->size <= (const char *)addr) continue;
-        if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        if ((const char *)addr + size < (const char *)addr) break; /* overflow */
-        return view;
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
+        if (view->base > addr) ptr = ptr->left;
+        else if ((const char *)view->base + view->size <= (const char *)addr) ptr = ptr->right;
+        else if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
+        else return view;
     }
     return NULL;
 }
@@ -325,61 +389,217 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
 {
+    struct wine_rb_entry *ptr = find_view_after( addr );
     struct file_view *view;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    if (!ptr) return NULL;
+    view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+    if ((const char *)view->base >= (const char *)addr + size) return NULL;
+    return view;
+}
+
+
+/***********************************************************************
+ *           get_max_gap
+ */
+static inline size_t get_max_gap( const struct wine_rb_entry *ptr )
+{
+    return ptr ? WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry )->max_gap : 0;
+}
+
+
+/***********************************************************************
+ *           refresh_max_gap
+ */
+static inline void refresh_max_gap( struct wine_rb_entry *ptr )
+{
+    struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+    size_t left = get_max_gap( ptr->left ), right = get_max_gap( ptr->right );
+
+    view->max_gap = max( view->gap, max( left, right ));
+}
+
+
+/***********************************************************************
+ *           update_max_gaps
+ *
+ * Recompute the largest gap of the subtrees on the path from a modified
+ * view up to the root. Rebalancing the tree only rotates nodes that end
+ * up on that path or directly below it, so refreshing those is enough.
+ * The csVirtual section must be held by caller.
+ */
+static void update_max_gaps( struct wine_rb_entry *ptr )
+{
+    for ( ; ptr; ptr = ptr->parent)
     {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
+        if (ptr->left) refresh_max_gap( ptr->left );
+        if (ptr->right) refresh_max_gap( ptr->right );
+        refresh_max_gap( ptr );
     }
-    return NULL;
 }
 
 
 /***********************************************************************
- *           find_free_area
+ *           update_view_gap
  *
- * Find a free area between views inside the specified range.
+ * Recompute the gap between a view and its predecessor.
  * The csVirtual section must be held by caller.
  */
-static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
+static void update_view_gap( struct wine_rb_entry *ptr )
 {
-    struct list *ptr;
-    void *start;
+    struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+    struct wine_rb_entry *prev = wine_rb_prev( ptr );
+    char *start = NULL;
+
+    if (prev)
+    {
+        struct file_view *prev_view = WINE_RB_ENTRY_VALUE( prev, struct file_view, entry );
+        start = (char *)prev_view->base + prev_view->size;
+    }
+    view->gap = (char *)view->base - start;
+    update_max_gaps( ptr );
+}
+
+
+/***********************************************************************
+ *           insert_view
+ *
+ * Insert a view in the tree and update the gap index.
+ * The csVirtual section must be held by caller.
+ */
+static void insert_view( struct file_view *view )
+{
+    struct wine_rb_entry *next;
+
+    wine_rb_put( &views_tree, view->base, &view->entry );
+
+    /* rebalancing starts at the new node, so its path covers every rotated node */
+    update_view_gap( &view->entry );
+    if ((next = wine_rb_next( &view->entry ))) update_view_gap( next );
+}
+
+
+/***********************************************************************
+ *           remove_view
+ *
+ * Remove a view from the tree and update the gap index.
+ * The csVirtual section must be held by caller.
+ */
+static void remove_view( struct file_view *view )
+{
+    struct wine_rb_entry *ptr = &view->entry, *next = wine_rb_next( ptr ), *start;
+
+    /* find the node where the tree gets modified, the successor takes
+     * the place of the removed view if it has two children */
+    if (ptr->left && ptr->right) start = (next->parent == ptr) ? next : next->parent;
+    else start = ptr->parent;
+
+    wine_rb_remove( &views_tree, ptr );
+
+    /* the successor moved to the place of the removed view, so it is on the path from start */
+    update_max_gaps( start );
+    if (next) update_view_gap( next );
+}
+
+
+/***********************************************************************
+ *           fit_in_gap
+ *
+ * Find a position for an area of the specified size inside a gap,
+ * restricted to the base-end range.
+ */
+static void *fit_in_gap( char *start, char *end, void *base, void *limit,
+                         size_t size, size_t mask, int top_down )
+{
+    char *ptr;
+
+    if (start < (char *)base) start = base;
+    if (end > (char *)limit) end = limit;
+    if (start >= end || end - start < size) return NULL;
 
     if (top_down)
     {
-        start = ROUND_ADDR( (char *)end - size, mask );
-        if (start >= end || start < base) return NULL;
+        ptr = ROUND_ADDR( end - size, mask );
+        if (ptr < start) return NULL;
+    }
+    else
+    {
+        ptr = ROUND_ADDR( start + mask, mask );
+        if (ptr < start || ptr > end - size) return NULL;
+    }
+    return ptr;
+}
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
-            if ((char *)view->base + view->size <= (char *)start) break;
-            if ((char *)view->base >= (char *)start + size) continue;
-            start = ROUND_ADDR( (char *)view->base - size, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || start < base) return NULL;
-        }
+/***********************************************************************
+ *           find_gap_in_subtree
+ *
+ * Find the first (or last if top_down) gap in a subtree that can hold the area.
+ * Subtrees whose largest gap is too small, or that lie outside the base-end
+ * range, are skipped.
+ * The csVirtual section must be held by caller.
+ */
+static void *find_gap_in_subtree( struct wine_rb_entry *ptr, void *base, void *end,
+                                  size_t size, size_t mask, int top_down )
+{
+    struct file_view *view;
+    char *gap_start;
+    void *ret;
+
+    if (!ptr) return NULL;
+    view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+    if (view->max_gap < size) return NULL;
+    gap_start = (char *)view->base - view->gap;
+
+    if (top_down)
+    {
+        if ((char *)view->base + view->size < (char *)end &&
+            (ret = find_gap_in_subtree( ptr->right, base, end, size, mask, top_down )))
+            return ret;
+        if ((ret = fit_in_gap( gap_start, view->base, base, end, size, mask, top_down ))) return ret;
+        if (gap_start > (char *)base)
+            return find_gap_in_subtree( ptr->left, base, end, size, mask, top_down );
     }
     else
     {
-        start = ROUND_ADDR( (char *)base + mask, mask );
-        if (start >= end || (char *)end - (char *)start < size) return NULL;
+        if (gap_start > (char *)base &&
+            (ret = find_gap_in_subtree( ptr->left, base, end, size, mask, top_down )))
+            return ret;
+        if ((ret = fit_in_gap( gap_start, view->base, base, end, size, mask, top_down ))) return ret;
+        if ((char *)view->base + view->size < (char *)end)
+            return find_gap_in_subtree( ptr->right, base, end, size, mask, top_down );
+    }
+    return NULL;
+}
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
-            if ((char *)view->base >= (char *)start + size) break;
-            if ((char *)view->base + view->size <= (char *)start) continue;
-            start = ROUND_ADDR( (char *)view->base + view->size + mask, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || (char *)end - (char *)start < size) return NULL;
-        }
+/***********************************************************************
+ *           find_free_area
+ *
+ * Find a free area between views inside the specified range.
+ * The csVirtual section must be held by caller.
+ *
+ * Every view records the size of the gap before it and the largest gap
+ * in its subtree, so that subtrees that cannot hold the area are skipped
+ * and the search only descends into candidate gaps.
+ */
+static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
+{
+    struct wine_rb_entry *last = wine_rb_tail( views_tree.root );
+    char *tail = NULL;
+    void *ret;
+
+    if (last)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( last, struct file_view, entry );
+        tail = (char *)view->base + view->size;
     }
-    return start;
+
+    /* the space after the last view is not covered by the gap index */
+    if (top_down && (ret = fit_in_gap( tail, end, base, end, size, mask, top_down ))) return ret;
+    if ((ret = find_gap_in_subtree( views_tree.root, base, end, size, mask, top_down ))) return ret;
+    if (!top_down) return fit_in_gap( tail, end, base, end, size, mask, top_down );
+    return NULL;
 }
 
 
@@ -415,14 +635,16 @@ static void add_reserved_area( void *addr, size_t size )
  */
 static void remove_reserved_area( void *addr, size_t size )
 {
-    struct file_view *view;
+    struct wine_rb_entry *ptr;
 
     TRACE( "removing %p-%p\n", addr, (char *)addr + size );
     wine_mmap_remove_reserved_area( addr, size, 0 );
 
     /* unmap areas not covered by an existing view */
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    for (ptr = find_view_after( addr ); ptr; ptr = wine_rb_next( ptr ))
     {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
         if ((char *)view->base >= (char *)addr + size)
         {
             munmap( addr, size );
@@ -473,7 +695,7 @@ static inline void unmap_area( void *addr, size_t size )
 static void delete_view( struct file_view *view ) /* [in] View */
 {
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
-    list_remove( &view->entry );
+    remove_view( view );
     if (view->mapping) close_handle( view->mapping );
     RtlFreeHeap( virtual_heap, 0, view );
 }
@@ -487,7 +709,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, unsigned int vprot )
 {
     struct file_view *view;
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
     SIZE_T view_size = sizeof(*view) + (size >> page_shift) - 1;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
@@ -528,24 +750,17 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->mapping = 0;
     view->map_protect = 0;
     view->protect = vprot;
+    view->gap     = 0;
+    view->max_gap = 0;
     memset( view->prot, vprot, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
     /* Check for overlapping views. This can happen if the previous view
      * was a system view that got unmapped behind our back. In that case
      * we recover by simply deleting it. */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
+    if ((ptr = find_view_before( base )) != NULL)
     {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
+        struct file_view *prev = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
         if ((char *)prev->base + prev->size > (char *)base)
         {
             TRACE( "overlapping prev view %p-%p for %p-%p\n",
@@ -555,9 +770,10 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
             delete_view( prev );
         }
     }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
+
+    if ((ptr = find_view_after( base )) != NULL)
     {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
+        struct file_view *next = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
         if ((char *)base + view->size > (char *)next->base)
         {
             TRACE( "overlapping next view %p-%p for %p-%p\n",
@@ -568,6 +784,10 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
         }
     }
 
+    /* Insert it in the tree */
+
+    insert_view( view );
+
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
 
@@ -1041,13 +1261,13 @@ static NTSTATUS allocate_dos_memory( struct file_view **view, unsigned int vprot
     void * const low_64k = (void *)0x10000;
     const size_t dosmem_size = 0x110000;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
 
     /* check for existing view */
 
-    if ((ptr = list_head( &views_list )))
+    if ((ptr = wine_rb_head( views_tree.root )))
     {
-        struct file_view *first_view = LIST_ENTRY( ptr, struct file_view, entry );
+        struct file_view *first_view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
         if (first_view->base < (void *)dosmem_size) return STATUS_CONFLICTING_ADDRESSES;
     }
 
@@ -1840,7 +2060,7 @@ void VIRTUAL_SetForceExec( BOOL enable )
     {
         force_exec_prot = enable;
 
-        LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+        WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
         {
             UINT i, count;
             char *addr = view->base;
@@ -2352,7 +2572,7 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
 {
     struct file_view *view;
     char *base, *alloc_base = 0;
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
     SIZE_T size = 0;
     MEMORY_BASIC_INFORMATION *info = buffer;
     sigset_t sigset;
@@ -2408,30 +2628,29 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = list_head( &views_list );
-    for (;;)
+    if ((ptr = find_view_before( base )))
     {
-        if (!ptr)
-        {
-            size = (char *)working_set_limit - alloc_base;
-            view = NULL;
-            break;
-        }
-        view = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            size = (char *)view->base - alloc_base;
-            view = NULL;
-            break;
-        }
-        if ((char *)view->base + view->size > base)
-        {
-            alloc_base = view->base;
-            size = view->size;
-            break;
-        }
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
         alloc_base = (char *)view->base + view->size;
-        ptr = list_next( &views_list, ptr );
+        ptr = wine_rb_next( ptr );
+    }
+    else ptr = wine_rb_head( views_tree.root );
+
+    if (alloc_base > base)
+    {
+        alloc_base = view->base;
+        size = view->size;
+    }
+    else if (ptr)
+    {
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        size = (char *)view->base - alloc_base;
+        view = NULL;
+    }
+    else
+    {
+        size = (char *)working_set_limit - alloc_base;
+        view = NULL;
     }
 
     /* Fill the info structure */
@@ -43,7 +43,9 @@ static DWORD   vcomp_context_tls = TLS_OUT_OF_INDEXES;
 static HMODULE vcomp_module;
 static int     vcomp_max_threads;
 static int     vcomp_num_threads;
+static int     vcomp_num_procs;
 static BOOL    vcomp_nested_fork = FALSE;
+static BOOL    vcomp_proc_bind = FALSE;
 
 static RTL_CRITICAL_SECTION vcomp_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -59,6 +61,9 @@ static RTL_CRITICAL_SECTION vcomp_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 #define VCOMP_DYNAMIC_FLAGS_GUIDED      0x03
 #define VCOMP_DYNAMIC_FLAGS_INCREMENT   0x40
 
+/* number of polls before a waiting thread goes to sleep */
+#define VCOMP_SPIN_COUNT                4000
+
 struct vcomp_thread_data
 {
     struct vcomp_team_data  *team;
@@ -70,6 +75,7 @@ struct vcomp_thread_data
     /* only used for concurrent tasks */
     struct list             entry;
     CONDITION_VARIABLE      cond;
+    int                     bound_cpu;
 
     /* single */
     unsigned int            single;
@@ -98,6 +104,7 @@ struct vcomp_team_data
     /* barrier */
     unsigned int            barrier;
     int                     barrier_count;
+    int                     barrier_sleepers;
 };
 
 struct vcomp_task_data
@@ -108,10 +115,11 @@ struct vcomp_task_data
     /* section */
     unsigned int            section;
     int                     num_sections;
-    int                     section_index;
+    LONG64                  section_state;  /* generation << 32 | remaining sections */
 
     /* dynamic */
     unsigned int            dynamic;
+    LONG64                  dynamic_state;  /* generation << 32 | remaining iterations */
     unsigned int            dynamic_first;
     unsigned int            dynamic_last;
     unsigned int            dynamic_iterations;
@@ -285,21 +293,29 @@ static inline char interlocked_xchg_add8(char *dest, char incr)
     return __sync_fetch_and_add(dest, incr);
 }
 #else
+/* emulated with a compare-and-swap of the containing 32-bit word */
 static char interlocked_cmpxchg8(char *dest, char xchg, char compare)
 {
-    EnterCriticalSection(&vcomp_section);
-    if (*dest == compare) *dest = xchg; else compare = *dest;
-    LeaveCriticalSection(&vcomp_section);
+    int *word = (int *)((ULONG_PTR)dest & ~3);
+    unsigned int shift = ((ULONG_PTR)dest & 3) * 8;
+    unsigned int old, new;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if ((char)(old >> shift) != compare) return (char)(old >> shift);
+        new = (old & ~(0xffu << shift)) | ((unsigned int)(unsigned char)xchg << shift);
+    }
+    while ((unsigned int)interlocked_cmpxchg(word, new, old) != old);
     return compare;
 }
 
 static char interlocked_xchg_add8(char *dest, char incr)
 {
-    char ret;
-    EnterCriticalSection(&vcomp_section);
-    ret = *dest; *dest += incr;
-    LeaveCriticalSection(&vcomp_section);
-    return ret;
+    char old;
+    do old = *(volatile char *)dest;
+    while (interlocked_cmpxchg8(dest, old + incr, old) != old);
+    return old;
 }
 #endif
 
@@ -314,26 +330,103 @@ static inline short interlocked_xchg_add16(short *dest, short incr)
     return __sync_fetch_and_add(dest, incr);
 }
 #else
+/* emulated with a compare-and-swap of the containing 32-bit word */
 static short interlocked_cmpxchg16(short *dest, short xchg, short compare)
 {
-    EnterCriticalSection(&vcomp_section);
-    if (*dest == compare) *dest = xchg; else compare = *dest;
-    LeaveCriticalSection(&vcomp_section);
+    int *word = (int *)((ULONG_PTR)dest & ~3);
+    unsigned int shift = ((ULONG_PTR)dest & 2) * 8;
+    unsigned int old, new;
+
+    do
+    {
+        old = *(volatile int *)word;
+        if ((short)(old >> shift) != compare) return (short)(old >> shift);
+        new = (old & ~(0xffffu << shift)) | ((unsigned int)(unsigned short)xchg << shift);
+    }
+    while ((unsigned int)interlocked_cmpxchg(word, new, old) != old);
     return compare;
 }
 
 static short interlocked_xchg_add16(short *dest, short incr)
 {
-    short ret;
-    EnterCriticalSection(&vcomp_section);
-    ret = *dest; *dest += incr;
-    LeaveCriticalSection(&vcomp_section);
-    return ret;
+    short old;
+    do old = *(volatile short *)dest;
+    while (interlocked_cmpxchg16(dest, old + incr, old) != old);
+    return old;
 }
 #endif
 
 #endif  /* __GNUC__ */
 
+static inline void vcomp_pause(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ __volatile__( "rep; nop" : : : "memory" );
+#endif
+}
+
+/* The loop and section counters of a task are kept together with the
+ * generation of the construct they belong to in a single 64-bit word, so
+ * that a thread can take its share with one compare-and-swap. A thread
+ * still working on an older construct then simply finds nothing to do. */
+static inline LONG64 vcomp_read_state(LONG64 *state)
+{
+#ifdef _WIN64
+    return *(volatile LONG64 *)state;
+#else
+    return interlocked_cmpxchg64(state, 0, 0);
+#endif
+}
+
+static inline unsigned int vcomp_state_generation(LONG64 state)
+{
+    return (ULONG64)state >> 32;
+}
+
+static void vcomp_write_state(LONG64 *state, unsigned int generation, unsigned int count)
+{
+    LONG64 old, new = ((ULONG64)generation << 32) | count;
+    do old = vcomp_read_state(state);
+    while (interlocked_cmpxchg64(state, new, old) != old);
+}
+
+/* Returns TRUE if the calling thread is the first one to reach "generation". */
+static BOOL vcomp_claim_generation(unsigned int *current, unsigned int generation)
+{
+    unsigned int old;
+
+    do
+    {
+        old = *(volatile unsigned int *)current;
+        if ((int)(generation - old) <= 0) return FALSE;
+    }
+    while ((unsigned int)interlocked_cmpxchg((int *)current, generation, old) != old);
+    return TRUE;
+}
+
+/* Waits until the thread which claimed "generation" has published its state. */
+static void vcomp_wait_state(unsigned int *current, LONG64 *state, unsigned int generation)
+{
+    unsigned int i = 0;
+
+    while (*(volatile unsigned int *)current == generation &&
+           vcomp_state_generation(vcomp_read_state(state)) != generation)
+    {
+        if (++i < VCOMP_SPIN_COUNT) vcomp_pause();
+        else Sleep(0);
+    }
+}
+
+static void vcomp_bind_thread(struct vcomp_thread_data *thread_data)
+{
+    int cpu = thread_data->thread_num % vcomp_num_procs;
+
+    if (thread_data->bound_cpu == cpu || cpu >= sizeof(DWORD_PTR) * 8)
+        return;
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+        thread_data->bound_cpu = cpu;
+}
+
 static inline struct vcomp_thread_data *vcomp_get_thread_data(void)
 {
     return (struct vcomp_thread_data *)TlsGetValue(vcomp_context_tls);
@@ -362,7 +455,9 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
 
     data->task.single           = 0;
     data->task.section          = 0;
+    data->task.section_state    = 0;
     data->task.dynamic          = 0;
+    data->task.dynamic_state    = 0;
 
     thread_data = &data->thread;
     thread_data->team           = NULL;
@@ -374,6 +469,7 @@ static struct vcomp_thread_data *vcomp_init_thread_data(void)
     thread_data->section        = 1;
     thread_data->dynamic        = 1;
     thread_data->dynamic_type   = 0;
+    thread_data->bound_cpu      = -1;
 
     vcomp_set_thread_data(thread_data);
     return thread_data;
@@ -1009,25 +1105,41 @@ void CDECL _vcomp_flush(void)
 void CDECL _vcomp_barrier(void)
 {
     struct vcomp_team_data *team_data = vcomp_init_thread_data()->team;
+    unsigned int barrier, i, spin_count;
 
     TRACE("()\n");
 
     if (!team_data)
         return;
 
-    EnterCriticalSection(&vcomp_section);
-    if (++team_data->barrier_count >= team_data->num_threads)
+    /* the generation can't change before this thread has arrived */
+    barrier = *(volatile unsigned int *)&team_data->barrier;
+    if (interlocked_xchg_add(&team_data->barrier_count, 1) + 1 >= team_data->num_threads)
     {
-        team_data->barrier++;
         team_data->barrier_count = 0;
-        WakeAllConditionVariable(&team_data->cond);
+        interlocked_xchg_add((int *)&team_data->barrier, 1);
+        if (*(volatile int *)&team_data->barrier_sleepers)
+        {
+            EnterCriticalSection(&vcomp_section);
+            WakeAllConditionVariable(&team_data->cond);
+            LeaveCriticalSection(&vcomp_section);
+        }
+        return;
     }
-    else
+
+    /* spinning only helps when every thread of the team has a processor */
+    spin_count = team_data->num_threads <= vcomp_num_procs ? VCOMP_SPIN_COUNT : 0;
+    for (i = 0; i < spin_count; i++)
     {
-        unsigned int barrier = team_data->barrier;
-        while (team_data->barrier == barrier)
-            SleepConditionVariableCS(&team_data->cond, &vcomp_section, INFINITE);
+        if (*(volatile unsigned int *)&team_data->barrier != barrier) return;
+        vcomp_pause();
     }
+
+    EnterCriticalSection(&vcomp_section);
+    interlocked_xchg_add(&team_data->barrier_sleepers, 1);
+    while (*(volatile unsigned int *)&team_data->barrier == barrier)
+        SleepConditionVariableCS(&team_data->cond, &vcomp_section, INFINITE);
+    interlocked_xchg_add(&team_data->barrier_sleepers, -1);
     LeaveCriticalSection(&vcomp_section);
 }
 
@@ -1054,20 +1166,11 @@ int CDECL _vcomp_single_begin(int flags)
 {
     struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
     struct vcomp_task_data *task_data = thread_data->task;
-    int ret = FALSE;
 
     TRACE("(%x): semi-stub\n", flags);
 
-    EnterCriticalSection(&vcomp_section);
     thread_data->single++;
-    if ((int)(thread_data->single - task_data->single) > 0)
-    {
-        task_data->single = thread_data->single;
-        ret = TRUE;
-    }
-    LeaveCriticalSection(&vcomp_section);
-
-    return ret;
+    return vcomp_claim_generation(&task_data->single, thread_data->single);
 }
 
 void CDECL _vcomp_single_end(void)
@@ -1083,33 +1186,38 @@ void CDECL _vcomp_sections_init(int n)
 
     TRACE("(%d)\n", n);
 
-    EnterCriticalSection(&vcomp_section);
     thread_data->section++;
-    if ((int)(thread_data->section - task_data->section) > 0)
+    if (vcomp_claim_generation(&task_data->section, thread_data->section))
     {
-        task_data->section       = thread_data->section;
-        task_data->num_sections  = n;
-        task_data->section_index = 0;
+        /* invalidate the previous state before the parameters change */
+        vcomp_write_state(&task_data->section_state, thread_data->section, 0);
+        task_data->num_sections = max(n, 0);
+        vcomp_write_state(&task_data->section_state, thread_data->section, task_data->num_sections);
     }
-    LeaveCriticalSection(&vcomp_section);
+    else
+        vcomp_wait_state(&task_data->section, &task_data->section_state, thread_data->section);
 }
 
 int CDECL _vcomp_sections_next(void)
 {
     struct vcomp_thread_data *thread_data = vcomp_init_thread_data();
     struct vcomp_task_data *task_data = thread_data->task;
-    int i = -1;
+    unsigned int remaining;
+    LONG64 state;
+    int i;
 
     TRACE("()\n");
 
-    EnterCriticalSection(&vcomp_section);
-    if (thread_data->section == task_data->section &&
-        task_data->section_index != task_data->num_sections)
+    for (;;)
     {
-        i = task_data->section_index++;
+        state = vcomp_read_state(&task_data->section_state);
+        if (vcomp_state_generation(state) != thread_data->section || !(remaining = (unsigned int)state))
+            return -1;
+
+        i = task_data->num_sections - remaining;
+        if (interlocked_cmpxchg64(&task_data->section_state, state - 1, state) == state)
+            return i;
     }
-    LeaveCriticalSection(&vcomp_section);
-    return i;
 }
 
 void CDECL _vcomp_for_static_simple_init(unsigned int first, unsigned int last, int step,
@@ -1287,19 +1395,21 @@ void CDECL _vcomp_for_dynamic_init(unsigned int flags, unsigned int first, unsig
             type = VCOMP_DYNAMIC_FLAGS_GUIDED;
         }
 
-        EnterCriticalSection(&vcomp_section);
         thread_data->dynamic++;
         thread_data->dynamic_type = type;
-        if ((int)(thread_data->dynamic - task_data->dynamic) > 0)
+        if (vcomp_claim_generation(&task_data->dynamic, thread_data->dynamic))
         {
-            task_data->dynamic              = thread_data->dynamic;
+            /* invalidate the previous state before the parameters change */
+            vcomp_write_state(&task_data->dynamic_state, thread_data->dynamic, 0);
             task_data->dynamic_first        = first;
             task_data->dynamic_last         = last;
             task_data->dynamic_iterations   = iterations;
             task_data->dynamic_step         = step;
             task_data->dynamic_chunksize    = chunksize;
+            vcomp_write_state(&task_data->dynamic_state, thread_data->dynamic, iterations);
         }
-        LeaveCriticalSection(&vcomp_section);
+        else
+            vcomp_wait_state(&task_data->dynamic, &task_data->dynamic_state, thread_data->dynamic);
     }
 }
 
@@ -1322,26 +1432,36 @@ int CDECL _vcomp_for_dynamic_next(unsigned int *begin, unsigned int *end)
     else if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_CHUNKED ||
              thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED)
     {
-        unsigned int iterations = 0;
-        EnterCriticalSection(&vcomp_section);
-        if (thread_data->dynamic == task_data->dynamic &&
-            task_data->dynamic_iterations != 0)
+        unsigned int iterations, remaining, first, last;
+        LONG64 state;
+
+        for (;;)
         {
-            iterations = min(task_data->dynamic_iterations, task_data->dynamic_chunksize);
+            state = vcomp_read_state(&task_data->dynamic_state);
+            if (vcomp_state_generation(state) != thread_data->dynamic || !(remaining = (unsigned int)state))
+                return 0;
+
+            iterations = min(remaining, task_data->dynamic_chunksize);
             if (thread_data->dynamic_type == VCOMP_DYNAMIC_FLAGS_GUIDED &&
-                task_data->dynamic_iterations > num_threads * task_data->dynamic_chunksize)
+                remaining > num_threads * task_data->dynamic_chunksize)
+            {
+                iterations = (remaining + num_threads - 1) / num_threads;
+            }
+            if (!iterations)
+                return 0;
+
+            first = task_data->dynamic_first + (task_data->dynamic_iterations - remaining) * task_data->dynamic_step;
+            last  = first + (iterations - 1) * task_data->dynamic_step;
+            if (iterations == remaining)
+                last = task_data->dynamic_last;
+
+            if (interlocked_cmpxchg64(&task_data->dynamic_state, state - iterations, state) == state)
             {
-                iterations = (task_data->dynamic_iterations + num_threads - 1) / num_threads;
+                *begin = first;
+                *end   = last;
+                return 1;
             }
-            *begin = task_data->dynamic_first;
-            *end   = task_data->dynamic_first + (iterations - 1) * task_data->dynamic_step;
-            task_data->dynamic_iterations -= iterations;
-            task_data->dynamic_first      += iterations * task_data->dynamic_step;
-            if (!task_data->dynamic_iterations)
-                *end = task_data->dynamic_last;
         }
-        LeaveCriticalSection(&vcomp_section);
-        return iterations != 0;
     }
 
     return 0;
@@ -1367,6 +1487,7 @@ static DWORD WINAPI _vcomp_fork_worker(void *param)
         if (team != NULL)
         {
             LeaveCriticalSection(&vcomp_section);
+            if (vcomp_proc_bind) vcomp_bind_thread(thread_data);
             _vcomp_fork_call_wrapper(team->wrapper, team->nargs, team->valist);
             EnterCriticalSection(&vcomp_section);
 
@@ -1422,10 +1543,13 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     __ms_va_start(team_data.valist, wrapper);
     team_data.barrier           = 0;
     team_data.barrier_count     = 0;
+    team_data.barrier_sleepers  = 0;
 
     task_data.single            = 0;
     task_data.section           = 0;
+    task_data.section_state     = 0;
     task_data.dynamic           = 0;
+    task_data.dynamic_state     = 0;
 
     thread_data.team            = &team_data;
     thread_data.task            = &task_data;
@@ -1436,6 +1560,7 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
     thread_data.section         = 1;
     thread_data.dynamic         = 1;
     thread_data.dynamic_type    = 0;
+    thread_data.bound_cpu       = -1;
     list_init(&thread_data.entry);
     InitializeConditionVariable(&thread_data.cond);
 
@@ -1481,6 +1606,7 @@ void WINAPIV _vcomp_fork(BOOL ifval, int nargs, void *wrapper, ...)
             data->section       = 1;
             data->dynamic       = 1;
             data->dynamic_type  = 0;
+            data->bound_cpu     = -1;
             InitializeConditionVariable(&data->cond);
 
             thread = CreateThread(NULL, 0, _vcomp_fork_worker, data, 0, NULL);
@@ -1630,6 +1756,7 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
         case DLL_PROCESS_ATTACH:
         {
             SYSTEM_INFO sysinfo;
+            char buffer[16];
 
             if ((vcomp_context_tls = TlsAlloc()) == TLS_OUT_OF_INDEXES)
             {
@@ -1641,6 +1768,14 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
             vcomp_module      = instance;
             vcomp_max_threads = sysinfo.dwNumberOfProcessors;
             vcomp_num_threads = sysinfo.dwNumberOfProcessors;
+            vcomp_num_procs   = sysinfo.dwNumberOfProcessors;
+
+            if (GetEnvironmentVariableA("OMP_PROC_BIND", buffer, sizeof(buffer)) &&
+                lstrcmpiA(buffer, "false"))
+            {
+                TRACE("binding worker threads to processors\n");
+                vcomp_proc_bind = TRUE;
+            }
             break;
         }
 
@@ -2172,6 +2172,103 @@ static void test_reduction_float_double(void)
     }
 }
 
+#define PERF_ITERATIONS 1000000
+#define PERF_BARRIERS   10000
+#define PERF_ATOMICS    100000
+
+static void CDECL perf_static_cb(LONG64 *sum)
+{
+    unsigned int begin, end;
+    LONG64 local = 0;
+    int i;
+
+    p_vcomp_for_static_simple_init(0, PERF_ITERATIONS - 1, 1, TRUE, &begin, &end);
+    for (i = begin; i <= (int)end; i++)
+        local += i;
+    p_vcomp_reduction_i8(VCOMP_REDUCTION_FLAGS_ADD, sum, local);
+}
+
+static void CDECL perf_dynamic_cb(unsigned int flags, LONG64 *sum)
+{
+    unsigned int begin, end, i;
+    LONG64 local = 0;
+
+    p_vcomp_for_dynamic_init(flags | VCOMP_DYNAMIC_FLAGS_INCREMENT, 0, PERF_ITERATIONS - 1, 1, 64);
+    while (p_vcomp_for_dynamic_next(&begin, &end))
+    {
+        for (i = begin; i <= end; i++)
+            local += i;
+    }
+    p_vcomp_reduction_i8(VCOMP_REDUCTION_FLAGS_ADD, sum, local);
+}
+
+static void CDECL perf_reduction_cb(int *sum)
+{
+    int i;
+
+    for (i = 0; i < PERF_ATOMICS; i++)
+        p_vcomp_reduction_i4(VCOMP_REDUCTION_FLAGS_ADD, sum, 1);
+}
+
+static void CDECL perf_barrier_cb(LONG *count)
+{
+    int i;
+
+    for (i = 0; i < PERF_BARRIERS; i++)
+        p_vcomp_barrier();
+    InterlockedIncrement(count);
+}
+
+static void test_performance(void)
+{
+    static const LONG64 expected = (LONG64)PERF_ITERATIONS * (PERF_ITERATIONS - 1) / 2;
+    DWORD start, static_time, chunked_time, guided_time, reduction_time, barrier_time;
+    int max_threads = pomp_get_max_threads();
+    LONG64 sum;
+    LONG count;
+    int i, value;
+
+    for (i = 1; i <= max_threads; i++)
+    {
+        pomp_set_num_threads(i);
+
+        sum = 0;
+        start = GetTickCount();
+        p_vcomp_fork(TRUE, 1, perf_static_cb, &sum);
+        static_time = GetTickCount() - start;
+        ok(sum == expected, "%d threads: static sum %s\n", i, debugstr_longlong(sum));
+
+        sum = 0;
+        start = GetTickCount();
+        p_vcomp_fork(TRUE, 2, perf_dynamic_cb, VCOMP_DYNAMIC_FLAGS_CHUNKED, &sum);
+        chunked_time = GetTickCount() - start;
+        ok(sum == expected, "%d threads: chunked sum %s\n", i, debugstr_longlong(sum));
+
+        sum = 0;
+        start = GetTickCount();
+        p_vcomp_fork(TRUE, 2, perf_dynamic_cb, VCOMP_DYNAMIC_FLAGS_GUIDED, &sum);
+        guided_time = GetTickCount() - start;
+        ok(sum == expected, "%d threads: guided sum %s\n", i, debugstr_longlong(sum));
+
+        value = 0;
+        start = GetTickCount();
+        p_vcomp_fork(TRUE, 1, perf_reduction_cb, &value);
+        reduction_time = GetTickCount() - start;
+        ok(value == i * PERF_ATOMICS, "%d threads: reduction %d\n", i, value);
+
+        count = 0;
+        start = GetTickCount();
+        p_vcomp_fork(TRUE, 1, perf_barrier_cb, &count);
+        barrier_time = GetTickCount() - start;
+        ok(count == i, "%d threads: %d threads left the barriers\n", i, count);
+
+        trace("%d threads: static %u ms, chunked %u ms, guided %u ms, %u reductions %u ms, %u barriers %u ms\n",
+              i, static_time, chunked_time, guided_time, PERF_ATOMICS, reduction_time, PERF_BARRIERS, barrier_time);
+    }
+
+    pomp_set_num_threads(max_threads);
+}
+
 START_TEST(vcomp)
 {
     if (!init_vcomp())
@@ -2201,6 +2298,7 @@ START_TEST(vcomp)
     test_reduction_integer32();
     test_reduction_integer64();
     test_reduction_float_double();
+    test_performance();
 
     release_vcomp();
 }
@@ -5849,6 +5849,11 @@ static void shader_arb_handle_instruction(const struct wined3d_shader_instructio
     shader_arb_add_instruction_modifiers(ins);
 }
 
+static void shader_arb_precompile(void *shader_priv, struct wined3d_context *context,
+        const struct wined3d_state *state, struct wined3d_shader *shader) {}
+
+static void shader_arb_end_frame(void *shader_priv) {}
+
 static BOOL shader_arb_has_ffp_proj_control(void *shader_priv)
 {
     struct shader_arb_priv *priv = shader_priv;
@@ -5867,6 +5872,8 @@ const struct wined3d_shader_backend_ops arb_program_shader_backend =
     shader_arb_update_float_pixel_constants,
     shader_arb_load_constants,
     shader_arb_destroy,
+    shader_arb_precompile,
+    shader_arb_end_frame,
     shader_arb_alloc,
     shader_arb_free,
     shader_arb_allocate_context_data,
@@ -1065,6 +1065,115 @@ static void buffer_direct_upload(struct wined3d_buffer *This, struct wined3d_con
         ERR("Failed to map OpenGL buffer.\n");
         return;
 #else  /* STAGING_CSMT */
+static BOOL wined3d_upload_ring_init(struct wined3d_upload_ring *ring, const struct wined3d_gl_info *gl_info)
+{
+    static const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    static const GLsizeiptr size = WINED3D_UPLOAD_RING_SEGMENTS * WINED3D_UPLOAD_RING_SEGMENT_SIZE;
+
+    GL_EXTCALL(glGenBuffers(1, &ring->buffer_object));
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+    GL_EXTCALL(glBufferStorage(GL_COPY_READ_BUFFER, size, NULL, flags));
+    ring->map_ptr = GL_EXTCALL(glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags));
+    checkGLcall("create upload ring");
+
+    if (!ring->map_ptr)
+    {
+        ERR("Failed to map upload ring, falling back to glBufferSubData.\n");
+        GL_EXTCALL(glDeleteBuffers(1, &ring->buffer_object));
+        ring->buffer_object = 0;
+        return FALSE;
+    }
+
+    TRACE("Created upload ring %u, %u bytes mapped at %p.\n", ring->buffer_object, (unsigned int)size, ring->map_ptr);
+    ring->segment = 0;
+    ring->head = 0;
+    memset(ring->fences, 0, sizeof(ring->fences));
+    return TRUE;
+}
+
+void wined3d_upload_ring_destroy(struct wined3d_device *device, const struct wined3d_gl_info *gl_info)
+{
+    struct wined3d_upload_ring *ring = &device->upload_ring;
+    unsigned int i;
+
+    if (!ring->buffer_object)
+        return;
+
+    for (i = 0; i < WINED3D_UPLOAD_RING_SEGMENTS; ++i)
+    {
+        if (ring->fences[i])
+            GL_EXTCALL(glDeleteSync(ring->fences[i]));
+    }
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+    GL_EXTCALL(glUnmapBuffer(GL_COPY_READ_BUFFER));
+    GL_EXTCALL(glDeleteBuffers(1, &ring->buffer_object));
+    checkGLcall("destroy upload ring");
+
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* Returns the ring offset of "size" bytes of staging memory. Moving into a
+ * new segment fences the one being left and waits until the GPU is done
+ * with the copies previously sourced from the one being entered. */
+static unsigned int wined3d_upload_ring_alloc(struct wined3d_upload_ring *ring,
+        const struct wined3d_gl_info *gl_info, unsigned int size)
+{
+    unsigned int offset, next;
+    GLenum ret;
+
+    if (ring->head + size > WINED3D_UPLOAD_RING_SEGMENT_SIZE)
+    {
+        next = (ring->segment + 1) % WINED3D_UPLOAD_RING_SEGMENTS;
+
+        ring->fences[ring->segment] = GL_EXTCALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        checkGLcall("glFenceSync");
+
+        if (ring->fences[next])
+        {
+            ret = GL_EXTCALL(glClientWaitSync(ring->fences[next], GL_SYNC_FLUSH_COMMANDS_BIT, ~(GLuint64)0));
+            if (ret == GL_WAIT_FAILED)
+                ERR("Failed to wait for upload ring segment %u.\n", next);
+            GL_EXTCALL(glDeleteSync(ring->fences[next]));
+            checkGLcall("glClientWaitSync");
+            ring->fences[next] = NULL;
+        }
+
+        ring->segment = next;
+        ring->head = 0;
+    }
+
+    offset = ring->segment * WINED3D_UPLOAD_RING_SEGMENT_SIZE + ring->head;
+    ring->head = (ring->head + size + RESOURCE_ALIGNMENT - 1) & ~(RESOURCE_ALIGNMENT - 1);
+
+    return offset;
+}
+
+/* Copies a dirty range through the upload ring instead of handing it to
+ * glBufferSubData, which drivers may implement with an implicit sync. The
+ * destination buffer has to be bound to its type hint. */
+static BOOL buffer_ring_upload(struct wined3d_buffer *buffer, const struct wined3d_gl_info *gl_info,
+        unsigned int start, unsigned int len)
+{
+    struct wined3d_upload_ring *ring = &buffer->resource.device->upload_ring;
+    unsigned int offset;
+
+    if (!gl_info->supported[ARB_BUFFER_STORAGE] || !gl_info->supported[ARB_COPY_BUFFER]
+            || !gl_info->supported[ARB_SYNC] || len > WINED3D_UPLOAD_RING_SEGMENT_SIZE)
+        return FALSE;
+
+    if (!ring->buffer_object && !wined3d_upload_ring_init(ring, gl_info))
+        return FALSE;
+
+    offset = wined3d_upload_ring_alloc(ring, gl_info, len);
+    memcpy(ring->map_ptr + offset, (BYTE *)buffer->resource.heap_memory + start, len);
+
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->buffer_object));
+    GL_EXTCALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, buffer->buffer_type_hint, offset, start, len));
+    checkGLcall("glCopyBufferSubData");
+
+    return TRUE;
+}
+
 static void buffer_direct_upload(struct wined3d_buffer *This, const struct wined3d_gl_info *gl_info, DWORD flags)
 {
     UINT start = 0, len = 0;
@@ -1181,6 +1290,9 @@ void buffer_mark_used(struct wined3d_buffer *buffer)
 {
     buffer->flags &= ~(WINED3D_BUFFER_MAP | WINED3D_BUFFER_SYNC | WINED3D_BUFFER_DISCARD);
 #else  /* STAGING_CSMT */
+        if (buffer_ring_upload(This, gl_info, start, len))
+            continue;
+
         GL_EXTCALL(glBufferSubData(This->buffer_type_hint, start, len, (BYTE *)This->resource.heap_memory + start));
         checkGLcall("glBufferSubData");
     }
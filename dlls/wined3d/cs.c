@@ -18,6 +18,15 @@
 
 #include "config.h"
 #include "wine/port.h"
+
+#include <errno.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
 #include "wined3d_private.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d);
@@ -99,6 +108,7 @@ enum wined3d_cs_op
     WINED3D_CS_OP_CREATE_SWAPCHAIN_CONTEXT,
     WINED3D_CS_OP_DELETE_GL_CONTEXTS,
     WINED3D_CS_OP_UPDATE_SWAP_INTERVAL,
+    WINED3D_CS_OP_PRECOMPILE_SHADER,
     WINED3D_CS_OP_STOP,
 };
 
@@ -561,6 +571,81 @@ struct wined3d_cs_update_swap_interval
     struct wined3d_swapchain *swapchain;
 };
 
+struct wined3d_cs_precompile_shader
+{
+    enum wined3d_cs_op opcode;
+    struct wined3d_shader *shader;
+};
+
+#ifdef __linux__
+static int futex_wait_op = 128; /* FUTEX_WAIT | FUTEX_PRIVATE_FLAG */
+static int futex_wake_op = 129; /* FUTEX_WAKE | FUTEX_PRIVATE_FLAG */
+
+static inline int futex_wait(int *addr, int val, const struct timespec *timeout)
+{
+    return syscall(__NR_futex, addr, futex_wait_op, val, timeout, 0, 0);
+}
+
+static inline int futex_wake(int *addr, int val)
+{
+    return syscall(__NR_futex, addr, futex_wake_op, val, NULL, 0, 0);
+}
+
+static BOOL use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        futex_wait(&supported, 10, NULL);
+        if (errno == ENOSYS)
+        {
+            futex_wait_op = 0; /* FUTEX_WAIT */
+            futex_wake_op = 1; /* FUTEX_WAKE */
+            futex_wait(&supported, 10, NULL);
+        }
+        supported = (errno != ENOSYS);
+    }
+    return supported;
+}
+#else
+static BOOL use_futexes(void)
+{
+    return FALSE;
+}
+#endif
+
+static inline void wined3d_cs_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("rep;nop" : : : "memory");
+#else
+    __asm__ __volatile__("" : : : "memory");
+#endif
+}
+
+/* Called by the submitting thread after publishing a new queue head. The
+ * InterlockedExchange() on the head is a full barrier, so a plain read of
+ * waiting_for_event is enough to skip the wake-up while the CS thread is
+ * busy or spinning. */
+static void wined3d_cs_wake(struct wined3d_cs *cs)
+{
+    if (!*(volatile BOOL *)&cs->waiting_for_event)
+        return;
+    if (!InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
+        return;
+
+    InterlockedIncrement(&cs->wake_count);
+#ifdef __linux__
+    if (cs->use_futex)
+    {
+        futex_wake(&cs->waiting_for_event, 1);
+        return;
+    }
+#endif
+    SetEvent(cs->event);
+}
+
 static void wined3d_cs_mt_submit(struct wined3d_cs *cs, size_t size)
 {
     LONG new_val = (cs->queue.head + size) & (WINED3D_CS_QUEUE_SIZE - 1);
@@ -568,8 +653,7 @@ static void wined3d_cs_mt_submit(struct wined3d_cs *cs, size_t size)
      * is used for the memory barrier. */
     InterlockedExchange(&cs->queue.head, new_val);
 
-    if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
-        SetEvent(cs->event);
+    wined3d_cs_wake(cs);
 }
 
 static void wined3d_cs_mt_submit_prio(struct wined3d_cs *cs, size_t size)
@@ -579,8 +663,7 @@ static void wined3d_cs_mt_submit_prio(struct wined3d_cs *cs, size_t size)
      * is used for the memory barrier. */
     InterlockedExchange(&cs->prio_queue.head, new_val);
 
-    if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
-        SetEvent(cs->event);
+    wined3d_cs_wake(cs);
 }
 
 static UINT wined3d_cs_exec_nop(struct wined3d_cs *cs, const void *data)
@@ -645,6 +728,7 @@ static UINT wined3d_cs_exec_present(struct wined3d_cs *cs, const void *data)
             cs->state.fb.depth_stencil);
 
     InterlockedDecrement(&cs->pending_presents);
+    cs->device->shader_backend->shader_end_frame(cs->device->shader_priv);
 #endif /* STAGING_CSMT */
 
     wined3d_resource_release(&swapchain->front_buffer->resource);
@@ -3185,6 +3269,33 @@ void wined3d_cs_emit_update_swap_interval(struct wined3d_cs *cs, struct wined3d_
     cs->ops->finish(cs);
 }
 
+static UINT wined3d_cs_exec_precompile_shader(struct wined3d_cs *cs, const void *data)
+{
+    const struct wined3d_cs_precompile_shader *op = data;
+    struct wined3d_device *device = cs->device;
+    struct wined3d_context *context;
+
+    if (!device->context_count)
+        return sizeof(*op);
+
+    context = context_acquire(device, NULL);
+    device->shader_backend->shader_precompile(device->shader_priv, context, &cs->state, op->shader);
+    context_release(context);
+
+    return sizeof(*op);
+}
+
+void wined3d_cs_emit_precompile_shader(struct wined3d_cs *cs, struct wined3d_shader *shader)
+{
+    struct wined3d_cs_precompile_shader *op;
+
+    op = cs->ops->require_space(cs, sizeof(*op));
+    op->opcode = WINED3D_CS_OP_PRECOMPILE_SHADER;
+    op->shader = shader;
+
+    cs->ops->submit(cs, sizeof(*op));
+}
+
 static UINT (* const wined3d_cs_op_handlers[])(struct wined3d_cs *cs, const void *data) =
 {
     /* WINED3D_CS_OP_NOP                        */ wined3d_cs_exec_nop,
@@ -3323,6 +3434,7 @@ static void wined3d_cs_st_push_constants(struct wined3d_cs *cs, enum wined3d_pus
     /* WINED3D_CS_OP_CREATE_SWAPCHAIN_CONTEXT   */ wined3d_cs_exec_create_swapchain_context,
     /* WINED3D_CS_OP_DELETE_GL_CONTEXTS         */ wined3d_cs_exec_delete_gl_contexts,
     /* WINED3D_CS_OP_UPDATE_SWAP_INTERVAL       */ wined3d_cs_exec_update_swap_interval,
+    /* WINED3D_CS_OP_PRECOMPILE_SHADER          */ wined3d_cs_exec_precompile_shader,
 };
 
 static inline void *_wined3d_cs_mt_require_space(struct wined3d_cs *cs, size_t size, BOOL prio)
@@ -3527,8 +3639,28 @@ static inline BOOL queue_is_empty(const struct wined3d_cs_queue *queue)
 
 static void wined3d_cs_wait_event(struct wined3d_cs *cs)
 {
+    ++cs->sleep_count;
     InterlockedExchange(&cs->waiting_for_event, TRUE);
 
+#ifdef __linux__
+    if (cs->use_futex)
+    {
+        /* The submitting thread clears waiting_for_event before waking us,
+         * so the futex wait returns immediately if a command was queued
+         * after the check below. */
+        if (queue_is_empty(&cs->prio_queue) && queue_is_empty(&cs->queue))
+        {
+            while (*(volatile BOOL *)&cs->waiting_for_event)
+            {
+                if (futex_wait(&cs->waiting_for_event, TRUE, NULL) == -1 && errno != EINTR)
+                    break;
+            }
+        }
+        InterlockedExchange(&cs->waiting_for_event, FALSE);
+        return;
+    }
+#endif
+
     /* The main thread might enqueue a finish command and block on it
      * after the worker thread decided to enter wined3d_cs_wait_event
      * and before waiting_for_event was set to TRUE. Check again if
@@ -3557,7 +3689,7 @@ static DWORD WINAPI wined3d_cs_run(void *thread_param)
     struct wined3d_cs_queue *queue;
     unsigned int spin_count = 0;
 
-    TRACE("Started.\n");
+    TRACE("Started, spin count %u, using %s.\n", cs->spin_limit, cs->use_futex ? "futexes" : "events");
 
     list_init(&cs->query_poll_list);
     cs->thread_id = GetCurrentThreadId();
@@ -3583,14 +3715,35 @@ static DWORD WINAPI wined3d_cs_run(void *thread_param)
         }
         else
         {
-            spin_count++;
-            if (spin_count >= WINED3D_CS_SPIN_COUNT && list_empty(&cs->query_poll_list))
-                wined3d_cs_wait_event(cs);
+            if (spin_count++ < cs->spin_limit)
+            {
+                wined3d_cs_pause();
+                continue;
+            }
 
+            /* Pending queries need to be polled, don't go to sleep. */
+            if (!list_empty(&cs->query_poll_list))
+            {
+                SwitchToThread();
+                spin_count = 0;
+                continue;
+            }
+
+            /* Work didn't arrive within the spin budget, spin less next
+             * time. */
+            cs->spin_limit = max(cs->spin_limit / 2, min(WINED3D_CS_SPIN_COUNT_MIN, wined3d_settings.cs_spin_count));
+            wined3d_cs_wait_event(cs);
+            spin_count = 0;
             continue;
         }
 
-        spin_count = 0;
+        if (spin_count)
+        {
+            /* Work arrived while spinning, allow a longer spin next time. */
+            ++cs->spin_count;
+            cs->spin_limit = min(cs->spin_limit * 2, wined3d_settings.cs_spin_count);
+            spin_count = 0;
+        }
 
         tail = queue->tail;
         opcode = *(const enum wined3d_cs_op *)&queue->data[tail];
@@ -3659,6 +3812,8 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device)
         cs->ops = &wined3d_cs_mt_ops;
 
         cs->event = CreateEventW(NULL, FALSE, FALSE, NULL);
+        cs->use_futex = use_futexes();
+        cs->spin_limit = wined3d_settings.cs_spin_count;
 
         if (!(cs->thread = CreateThread(NULL, 0, wined3d_cs_run, cs, 0, NULL)))
         {
@@ -3700,6 +3855,9 @@ void wined3d_cs_destroy(struct wined3d_cs *cs)
             ERR("Wait failed (%#x).\n", ret);
         if (!CloseHandle(cs->event))
             ERR("Closing event failed.\n");
+
+        TRACE("CS thread statistics: %d spins, %d sleeps, %d wakes.\n",
+                cs->spin_count, cs->sleep_count, cs->wake_count);
     }
 
 #endif /* STAGING_CSMT */
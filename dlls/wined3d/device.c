@@ -5163,6 +5163,9 @@ void device_delete_opengl_contexts_cs(struct wined3d_device *device, struct wine
     device->shader_backend->shader_free_private(device);
     destroy_dummy_textures(device, context);
     destroy_default_samplers(device, context);
+#if defined(STAGING_CSMT)
+    wined3d_upload_ring_destroy(device, gl_info);
+#endif /* STAGING_CSMT */
 
     context_release(context);
 
@@ -42,6 +42,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
 WINE_DECLARE_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
 
 #define WINED3D_GLSL_SAMPLE_PROJECTED   0x01
@@ -113,6 +114,45 @@ struct constant_heap
     unsigned int size;
 };
 
+#define WINED3D_GLSL_MAX_COMPILE_THREADS 8
+
+struct glsl_compile_job
+{
+    struct list entry;
+    GLuint shader_id;
+    BOOL running;
+    char source[1];
+};
+
+struct glsl_compile_thread
+{
+    struct glsl_compiler *compiler;
+    HANDLE thread;
+    HWND window;
+    HDC dc;
+    HGLRC gl_ctx;
+};
+
+/* Compiles GLSL shader objects on worker threads with GL contexts that
+ * share objects with the device contexts. */
+struct glsl_compiler
+{
+    const struct wined3d_gl_info *gl_info;
+    CRITICAL_SECTION cs;
+    CONDITION_VARIABLE work_cv;
+    CONDITION_VARIABLE done_cv;
+    struct list jobs;
+    unsigned int job_count;
+    BOOL shutdown;
+    struct glsl_compile_thread threads[WINED3D_GLSL_MAX_COMPILE_THREADS];
+    unsigned int thread_count;
+
+    /* Per-frame statistics. */
+    unsigned int frame;
+    unsigned int queued, max_depth, stalls;
+    LONGLONG stall_time;
+};
+
 /* GLSL shader private data */
 struct shader_glsl_priv {
     struct wined3d_string_buffer shader_buffer;
@@ -131,6 +171,13 @@ struct shader_glsl_priv {
     struct wine_rb_tree ffp_fragment_shaders;
     BOOL ffp_proj_control;
     BOOL legacy_lighting;
+
+    struct wined3d_shader_cache *shader_cache;
+    unsigned int cache_hits, cache_misses, cache_rejects;
+    LONGLONG cache_load_time, cache_link_time;
+
+    struct glsl_compiler *compiler;
+    BOOL compiler_failed;
 };
 
 struct glsl_vs_program
@@ -268,6 +315,7 @@ struct glsl_shader_private
         struct glsl_ps_compiled_shader *ps;
     } gl_shaders;
     UINT num_gl_shaders, shader_array_size;
+    UINT64 byte_code_hash;
 };
 
 struct glsl_ffp_vertex_shader
@@ -481,6 +529,270 @@ static void shader_glsl_compile(const struct wined3d_gl_info *gl_info, GLuint sh
     print_glsl_info_log(gl_info, shader, FALSE);
 }
 
+static void glsl_compiler_compile(const struct wined3d_gl_info *gl_info, const struct glsl_compile_job *job)
+{
+    const char *src = job->source;
+
+    GL_EXTCALL(glShaderSource(job->shader_id, 1, &src, NULL));
+    GL_EXTCALL(glCompileShader(job->shader_id));
+    checkGLcall("glCompileShader");
+    print_glsl_info_log(gl_info, job->shader_id, FALSE);
+}
+
+static DWORD WINAPI glsl_compiler_thread_proc(void *arg)
+{
+    struct glsl_compile_thread *thread = arg;
+    struct glsl_compiler *compiler;
+    const struct wined3d_gl_info *gl_info;
+    struct glsl_compile_job *job;
+
+    compiler = thread->compiler;
+    gl_info = compiler->gl_info;
+
+    if (!wglMakeCurrent(thread->dc, thread->gl_ctx))
+    {
+        ERR("Failed to make the shader compiler context current, last error %#x.\n", GetLastError());
+        return 1;
+    }
+
+    EnterCriticalSection(&compiler->cs);
+    for (;;)
+    {
+        job = NULL;
+        while (!compiler->shutdown)
+        {
+            LIST_FOR_EACH_ENTRY(job, &compiler->jobs, struct glsl_compile_job, entry)
+            {
+                if (!job->running)
+                    break;
+            }
+            if (&job->entry != &compiler->jobs)
+                break;
+            job = NULL;
+            SleepConditionVariableCS(&compiler->work_cv, &compiler->cs, INFINITE);
+        }
+        if (!job)
+            break;
+
+        job->running = TRUE;
+        LeaveCriticalSection(&compiler->cs);
+
+        glsl_compiler_compile(gl_info, job);
+        /* Make the compiled object visible to the device contexts before
+         * anybody waiting for it gets to attach it. */
+        gl_info->gl_ops.gl.p_glFinish();
+
+        EnterCriticalSection(&compiler->cs);
+        list_remove(&job->entry);
+        --compiler->job_count;
+        HeapFree(GetProcessHeap(), 0, job);
+        WakeAllConditionVariable(&compiler->done_cv);
+    }
+    LeaveCriticalSection(&compiler->cs);
+
+    wglMakeCurrent(NULL, NULL);
+    return 0;
+}
+
+static void glsl_compiler_destroy_thread_context(struct glsl_compile_thread *thread)
+{
+    if (thread->gl_ctx)
+        wglDeleteContext(thread->gl_ctx);
+    if (thread->dc)
+        ReleaseDC(thread->window, thread->dc);
+    if (thread->window)
+        DestroyWindow(thread->window);
+}
+
+/* Context activation is done by the caller. */
+static struct glsl_compiler *glsl_compiler_create(const struct wined3d_context *context)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    unsigned int count = min(wined3d_settings.shader_compile_threads, WINED3D_GLSL_MAX_COMPILE_THREADS);
+    struct glsl_compile_thread *thread;
+    struct glsl_compiler *compiler;
+    PIXELFORMATDESCRIPTOR pfd;
+
+    if (!count || !gl_info->p_wglCreateContextAttribsARB)
+        return NULL;
+
+    if (!(compiler = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*compiler))))
+        return NULL;
+    compiler->gl_info = gl_info;
+    InitializeCriticalSection(&compiler->cs);
+    compiler->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": glsl_compiler.cs");
+    InitializeConditionVariable(&compiler->work_cv);
+    InitializeConditionVariable(&compiler->done_cv);
+    list_init(&compiler->jobs);
+
+    DescribePixelFormat(context->hdc, context->pixel_format, sizeof(pfd), &pfd);
+    while (compiler->thread_count < count)
+    {
+        thread = &compiler->threads[compiler->thread_count];
+        thread->compiler = compiler;
+
+        if (!(thread->window = CreateWindowA(WINED3D_OPENGL_WINDOW_CLASS_NAME, "WineD3D shader compiler",
+                WS_OVERLAPPEDWINDOW, 10, 10, 10, 10, NULL, NULL, NULL, NULL))
+                || !(thread->dc = GetDC(thread->window))
+                || !SetPixelFormat(thread->dc, context->pixel_format, &pfd)
+                || !(thread->gl_ctx = context_create_wgl_attribs(gl_info, thread->dc, context->glCtx))
+                || !(thread->thread = CreateThread(NULL, 0, glsl_compiler_thread_proc, thread, 0, NULL)))
+        {
+            WARN("Failed to create shader compiler thread %u.\n", compiler->thread_count);
+            glsl_compiler_destroy_thread_context(thread);
+            memset(thread, 0, sizeof(*thread));
+            break;
+        }
+        ++compiler->thread_count;
+    }
+
+    if (!compiler->thread_count)
+    {
+        compiler->cs.DebugInfo->Spare[0] = 0;
+        DeleteCriticalSection(&compiler->cs);
+        HeapFree(GetProcessHeap(), 0, compiler);
+        return NULL;
+    }
+
+    TRACE("Created %u shader compiler threads.\n", compiler->thread_count);
+    return compiler;
+}
+
+static void glsl_compiler_destroy(struct glsl_compiler *compiler)
+{
+    struct glsl_compile_job *job, *next;
+    unsigned int i;
+
+    EnterCriticalSection(&compiler->cs);
+    compiler->shutdown = TRUE;
+    WakeAllConditionVariable(&compiler->work_cv);
+    LeaveCriticalSection(&compiler->cs);
+
+    for (i = 0; i < compiler->thread_count; ++i)
+    {
+        WaitForSingleObject(compiler->threads[i].thread, INFINITE);
+        CloseHandle(compiler->threads[i].thread);
+        glsl_compiler_destroy_thread_context(&compiler->threads[i]);
+    }
+
+    LIST_FOR_EACH_ENTRY_SAFE(job, next, &compiler->jobs, struct glsl_compile_job, entry)
+    {
+        HeapFree(GetProcessHeap(), 0, job);
+    }
+
+    compiler->cs.DebugInfo->Spare[0] = 0;
+    DeleteCriticalSection(&compiler->cs);
+    HeapFree(GetProcessHeap(), 0, compiler);
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_compile_async(struct shader_glsl_priv *priv, const struct wined3d_context *context,
+        GLuint shader_id, const char *src)
+{
+    const struct wined3d_gl_info *gl_info = context->gl_info;
+    struct glsl_compiler *compiler;
+    struct glsl_compile_job *job;
+    SIZE_T len;
+
+    if (!priv->compiler && !priv->compiler_failed && !(priv->compiler = glsl_compiler_create(context)))
+        priv->compiler_failed = TRUE;
+
+    len = strlen(src);
+    if (!(compiler = priv->compiler) || !(job = HeapAlloc(GetProcessHeap(), 0,
+            FIELD_OFFSET(struct glsl_compile_job, source[len + 1]))))
+    {
+        shader_glsl_compile(gl_info, shader_id, src);
+        return;
+    }
+
+    if (TRACE_ON(d3d_shader))
+    {
+        const char *ptr = src, *line;
+
+        TRACE("Queueing shader object %u for compilation.\n", shader_id);
+        while ((line = get_info_log_line(&ptr))) TRACE_(d3d_shader)("    %.*s", (int)(ptr - line), line);
+    }
+
+    job->shader_id = shader_id;
+    job->running = FALSE;
+    memcpy(job->source, src, len + 1);
+
+    EnterCriticalSection(&compiler->cs);
+    list_add_tail(&compiler->jobs, &job->entry);
+    ++compiler->queued;
+    compiler->max_depth = max(compiler->max_depth, ++compiler->job_count);
+    WakeConditionVariable(&compiler->work_cv);
+    LeaveCriticalSection(&compiler->cs);
+}
+
+/* Makes sure "shader_id" is compiled. A job nobody picked up yet is compiled
+ * right away on the calling thread instead of waiting for the queue, or
+ * dropped when "discard" is set. Context activation is done by the caller. */
+static void shader_glsl_compile_wait(struct shader_glsl_priv *priv, const struct wined3d_gl_info *gl_info,
+        GLuint shader_id, BOOL discard)
+{
+    struct glsl_compiler *compiler = priv->compiler;
+    struct glsl_compile_job *job;
+    LARGE_INTEGER start, end;
+    BOOL found;
+
+    if (!compiler || !shader_id)
+        return;
+
+    EnterCriticalSection(&compiler->cs);
+    LIST_FOR_EACH_ENTRY(job, &compiler->jobs, struct glsl_compile_job, entry)
+    {
+        if (job->shader_id == shader_id)
+            break;
+    }
+    if (&job->entry == &compiler->jobs)
+    {
+        LeaveCriticalSection(&compiler->cs);
+        return;
+    }
+
+    QueryPerformanceCounter(&start);
+    if (!job->running)
+    {
+        list_remove(&job->entry);
+        --compiler->job_count;
+        LeaveCriticalSection(&compiler->cs);
+
+        if (!discard)
+        {
+            TRACE("Compiling queued shader object %u on the calling thread.\n", shader_id);
+            glsl_compiler_compile(gl_info, job);
+        }
+        HeapFree(GetProcessHeap(), 0, job);
+
+        EnterCriticalSection(&compiler->cs);
+    }
+    else
+    {
+        TRACE("Waiting for shader object %u.\n", shader_id);
+        do
+        {
+            SleepConditionVariableCS(&compiler->done_cv, &compiler->cs, INFINITE);
+            found = FALSE;
+            LIST_FOR_EACH_ENTRY(job, &compiler->jobs, struct glsl_compile_job, entry)
+            {
+                if (job->shader_id == shader_id)
+                {
+                    found = TRUE;
+                    break;
+                }
+            }
+        } while (found);
+    }
+    QueryPerformanceCounter(&end);
+    if (!discard)
+    {
+        ++compiler->stalls;
+        compiler->stall_time += end.QuadPart - start.QuadPart;
+    }
+    LeaveCriticalSection(&compiler->cs);
+}
+
 /* Context activation is done by the caller. */
 static void shader_glsl_dump_program_source(const struct wined3d_gl_info *gl_info, GLuint program)
 {
@@ -6134,6 +6446,7 @@ static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context
         const struct ps_compile_args *args, struct ps_np2fixup_info *np2fixup_info)
 {
     const struct wined3d_shader_reg_maps *reg_maps = &shader->reg_maps;
+    struct shader_glsl_priv *priv = context->device->shader_priv;
     const struct wined3d_gl_info *gl_info = context->gl_info;
     const DWORD *function = shader->function;
     struct shader_glsl_ctx_priv priv_ctx;
@@ -6239,8 +6552,7 @@ static GLuint shader_glsl_generate_pshader(const struct wined3d_context *context
 
     shader_addline(buffer, "}\n");
 
-    TRACE("Compiling shader object %u.\n", shader_id);
-    shader_glsl_compile(gl_info, shader_id, buffer->buffer);
+    shader_glsl_compile_async(priv, context, shader_id, buffer->buffer);
 
     return shader_id;
 }
@@ -6339,8 +6651,7 @@ static GLuint shader_glsl_generate_vshader(const struct wined3d_context *context
 
     shader_addline(buffer, "}\n");
 
-    TRACE("Compiling shader object %u.\n", shader_id);
-    shader_glsl_compile(gl_info, shader_id, buffer->buffer);
+    shader_glsl_compile_async(priv, context, shader_id, buffer->buffer);
 
     return shader_id;
 }
@@ -6375,8 +6686,7 @@ static GLuint shader_glsl_generate_geometry_shader(const struct wined3d_context
     shader_generate_main(shader, buffer, reg_maps, function, &priv_ctx);
     shader_addline(buffer, "}\n");
 
-    TRACE("Compiling shader object %u.\n", shader_id);
-    shader_glsl_compile(gl_info, shader_id, buffer->buffer);
+    shader_glsl_compile_async(priv, context, shader_id, buffer->buffer);
 
     return shader_id;
 }
@@ -7946,6 +8256,150 @@ static void shader_glsl_init_uniform_block_bindings(const struct wined3d_gl_info
     string_buffer_release(&priv->string_buffers, name);
 }
 
+/* Link-time state that isn't part of any of the shader compile args. */
+#define WINED3D_GLSL_LINK_POINT_SIZE    0x1
+#define WINED3D_GLSL_LINK_FLATSHADING   0x2
+
+/* Mixes the bytecode of "shader" and the compile args its GLSL object "id"
+ * was generated with into "key". Returns 0 if "id" isn't one of its
+ * variants. */
+static UINT64 shader_glsl_cache_key_add_shader(UINT64 key, const struct wined3d_shader *shader, GLuint id)
+{
+    struct glsl_shader_private *shader_data = shader->backend_data;
+    unsigned int i;
+
+    if (!shader_data)
+        return 0;
+
+    if (!shader_data->byte_code_hash)
+        shader_data->byte_code_hash = wined3d_hash_data(WINED3D_HASH_INIT,
+                shader->function, shader->functionLength);
+    key = wined3d_hash_data(key, &shader_data->byte_code_hash, sizeof(shader_data->byte_code_hash));
+
+    for (i = 0; i < shader_data->num_gl_shaders; ++i)
+    {
+        switch (shader->reg_maps.shader_version.type)
+        {
+            case WINED3D_SHADER_TYPE_VERTEX:
+            {
+                const struct vs_compile_args *args = &shader_data->gl_shaders.vs[i].args;
+                DWORD flags;
+
+                if (shader_data->gl_shaders.vs[i].id != id)
+                    continue;
+                /* Hash the fields individually, the padding bit isn't
+                 * initialised. */
+                flags = args->fog_src | args->clip_enabled << 8 | args->point_size << 9
+                        | args->per_vertex_point_size << 10 | args->flatshading << 11
+                        | args->next_shader_type << 12 | args->swizzle_map << 16;
+                key = wined3d_hash_data(key, &flags, sizeof(flags));
+                return wined3d_hash_data(key, &args->next_shader_input_count,
+                        sizeof(args->next_shader_input_count));
+            }
+
+            case WINED3D_SHADER_TYPE_GEOMETRY:
+                if (shader_data->gl_shaders.gs[i].id != id)
+                    continue;
+                return wined3d_hash_data(key, &shader_data->gl_shaders.gs[i].args,
+                        sizeof(shader_data->gl_shaders.gs[i].args));
+
+            case WINED3D_SHADER_TYPE_PIXEL:
+                if (shader_data->gl_shaders.ps[i].id != id)
+                    continue;
+                /* find_ps_compile_args() clears the structure first. */
+                return wined3d_hash_data(key, &shader_data->gl_shaders.ps[i].args,
+                        sizeof(shader_data->gl_shaders.ps[i].args));
+
+            default:
+                return 0;
+        }
+    }
+
+    return 0;
+}
+
+/* Programs using the fixed function pipeline aren't cached. */
+static UINT64 shader_glsl_program_cache_key(const struct wined3d_gl_info *gl_info,
+        const struct wined3d_shader *vshader, GLuint vs_id, const struct wined3d_shader *gshader, GLuint gs_id,
+        const struct wined3d_shader *pshader, GLuint ps_id, DWORD link_flags)
+{
+    UINT64 key = WINED3D_HASH_INIT;
+
+    if (!vshader || !pshader)
+        return 0;
+
+    link_flags |= gl_info->supported[WINED3D_GL_LEGACY_CONTEXT] << 8
+            | wined3d_settings.check_float_constants << 9;
+    key = wined3d_hash_data(key, &link_flags, sizeof(link_flags));
+    key = wined3d_hash_data(key, &gl_info->glsl_version, sizeof(gl_info->glsl_version));
+
+    if (!(key = shader_glsl_cache_key_add_shader(key, vshader, vs_id)))
+        return 0;
+    if (gshader && !(key = shader_glsl_cache_key_add_shader(key, gshader, gs_id)))
+        return 0;
+    return shader_glsl_cache_key_add_shader(key, pshader, ps_id);
+}
+
+static BOOL shader_glsl_load_program_binary(struct shader_glsl_priv *priv,
+        const struct wined3d_gl_info *gl_info, GLuint program_id, UINT64 key)
+{
+    LARGE_INTEGER start, end;
+    unsigned int size;
+    GLint status;
+    GLenum format;
+    void *data;
+
+    if (!key)
+        return FALSE;
+
+    QueryPerformanceCounter(&start);
+    if (!(data = wined3d_shader_cache_get(priv->shader_cache, key, &format, &size)))
+    {
+        ++priv->cache_misses;
+        return FALSE;
+    }
+
+    GL_EXTCALL(glProgramBinary(program_id, format, data, size));
+    HeapFree(GetProcessHeap(), 0, data);
+    GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+    checkGLcall("glProgramBinary");
+
+    if (!status)
+    {
+        TRACE("Driver rejected cached binary %s for program %u.\n", wine_dbgstr_longlong(key), program_id);
+        wined3d_shader_cache_remove(priv->shader_cache, key);
+        ++priv->cache_misses;
+        ++priv->cache_rejects;
+        return FALSE;
+    }
+
+    QueryPerformanceCounter(&end);
+    priv->cache_load_time += end.QuadPart - start.QuadPart;
+    ++priv->cache_hits;
+    TRACE("Loaded program %u from cached binary %s.\n", program_id, wine_dbgstr_longlong(key));
+
+    return TRUE;
+}
+
+static void shader_glsl_store_program_binary(struct shader_glsl_priv *priv,
+        const struct wined3d_gl_info *gl_info, GLuint program_id, UINT64 key)
+{
+    GLint size, status;
+    GLenum format;
+    void *data;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+    GL_EXTCALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &size));
+    checkGLcall("glGetProgramiv");
+    if (!status || size <= 0 || !(data = HeapAlloc(GetProcessHeap(), 0, size)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program_id, size, &size, &format, data));
+    checkGLcall("glGetProgramBinary");
+    wined3d_shader_cache_put(priv->shader_cache, key, format, data, size);
+    HeapFree(GetProcessHeap(), 0, data);
+}
+
 /* Context activation is done by the caller. */
 static void set_glsl_shader_program(const struct wined3d_context *context, const struct wined3d_state *state,
         struct shader_glsl_priv *priv, struct glsl_context_data *ctx_data)
@@ -7964,6 +8418,9 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     GLuint gs_id = 0;
     GLuint ps_id = 0;
     struct list *ps_list = NULL, *vs_list = NULL;
+    LARGE_INTEGER link_start, link_end;
+    DWORD link_flags = 0;
+    UINT64 cache_key = 0;
     WORD attribs_map;
     struct wined3d_string_buffer *tmp_name;
 
@@ -8078,108 +8535,136 @@ static void set_glsl_shader_program(const struct wined3d_context *context, const
     /* Set the current program */
     ctx_data->glsl_program = entry;
 
-    /* Attach GLSL vshader */
     if (vs_id)
-    {
-        TRACE("Attaching GLSL shader object %u to program %u.\n", vs_id, program_id);
-        GL_EXTCALL(glAttachShader(program_id, vs_id));
-        checkGLcall("glAttachShader");
-
         list_add_head(vs_list, &entry->vs.shader_entry);
+    if (gshader)
+        list_add_head(&gshader->linked_programs, &entry->gs.shader_entry);
+    if (ps_id)
+        list_add_head(ps_list, &entry->ps.shader_entry);
+
+    if (vshader && vshader->reg_maps.shader_version.major < 4)
+    {
+        if (state->gl_primitive_type == GL_POINTS && vshader->reg_maps.point_size)
+            link_flags |= WINED3D_GLSL_LINK_POINT_SIZE;
+        if (d3d_info->emulated_flatshading && state->render_states[WINED3D_RS_SHADEMODE] == WINED3D_SHADE_FLAT)
+            link_flags |= WINED3D_GLSL_LINK_FLATSHADING;
     }
 
-    if (vshader)
+    if (priv->shader_cache)
+        cache_key = shader_glsl_program_cache_key(gl_info, vshader, vs_id, gshader, gs_id, pshader, ps_id, link_flags);
+
+    if (!shader_glsl_load_program_binary(priv, gl_info, program_id, cache_key))
     {
-        attribs_map = vshader->reg_maps.input_registers;
-        if (vshader->reg_maps.shader_version.major < 4)
+        /* Only block on the objects this program needs. */
+        shader_glsl_compile_wait(priv, gl_info, vs_id, FALSE);
+        shader_glsl_compile_wait(priv, gl_info, gs_id, FALSE);
+        shader_glsl_compile_wait(priv, gl_info, ps_id, FALSE);
+
+        /* Attach GLSL vshader */
+        if (vs_id)
         {
-            reorder_shader_id = shader_glsl_generate_vs3_rasterizer_input_setup(priv, vshader, pshader,
-                    state->gl_primitive_type == GL_POINTS && vshader->reg_maps.point_size,
-                    d3d_info->emulated_flatshading
-                    && state->render_states[WINED3D_RS_SHADEMODE] == WINED3D_SHADE_FLAT, gl_info);
-            TRACE("Attaching GLSL shader object %u to program %u.\n", reorder_shader_id, program_id);
-            GL_EXTCALL(glAttachShader(program_id, reorder_shader_id));
+            TRACE("Attaching GLSL shader object %u to program %u.\n", vs_id, program_id);
+            GL_EXTCALL(glAttachShader(program_id, vs_id));
             checkGLcall("glAttachShader");
-            /* Flag the reorder function for deletion, it will be freed
-             * automatically when the program is destroyed. */
-            GL_EXTCALL(glDeleteShader(reorder_shader_id));
         }
-    }
-    else
-    {
-        attribs_map = (1u << WINED3D_FFP_ATTRIBS_COUNT) - 1;
-    }
 
-    if (!shader_glsl_use_explicit_attrib_location(gl_info))
-    {
-        /* Bind vertex attributes to a corresponding index number to match
-         * the same index numbers as ARB_vertex_programs (makes loading
-         * vertex attributes simpler).  With this method, we can use the
-         * exact same code to load the attributes later for both ARB and
-         * GLSL shaders.
-         *
-         * We have to do this here because we need to know the Program ID
-         * in order to make the bindings work, and it has to be done prior
-         * to linking the GLSL program. */
-        tmp_name = string_buffer_get(&priv->string_buffers);
-        for (i = 0; attribs_map; attribs_map >>= 1, ++i)
+        if (vshader)
         {
-            if (!(attribs_map & 1))
-                continue;
+            attribs_map = vshader->reg_maps.input_registers;
+            if (vshader->reg_maps.shader_version.major < 4)
+            {
+                reorder_shader_id = shader_glsl_generate_vs3_rasterizer_input_setup(priv, vshader, pshader,
+                        !!(link_flags & WINED3D_GLSL_LINK_POINT_SIZE),
+                        !!(link_flags & WINED3D_GLSL_LINK_FLATSHADING), gl_info);
+                TRACE("Attaching GLSL shader object %u to program %u.\n", reorder_shader_id, program_id);
+                GL_EXTCALL(glAttachShader(program_id, reorder_shader_id));
+                checkGLcall("glAttachShader");
+                /* Flag the reorder function for deletion, it will be freed
+                 * automatically when the program is destroyed. */
+                GL_EXTCALL(glDeleteShader(reorder_shader_id));
+            }
+        }
+        else
+        {
+            attribs_map = (1u << WINED3D_FFP_ATTRIBS_COUNT) - 1;
+        }
 
-            string_buffer_sprintf(tmp_name, "vs_in%u", i);
-            GL_EXTCALL(glBindAttribLocation(program_id, i, tmp_name->buffer));
-            if (vshader && vshader->reg_maps.shader_version.major >= 4)
+        if (!shader_glsl_use_explicit_attrib_location(gl_info))
+        {
+            /* Bind vertex attributes to a corresponding index number to match
+             * the same index numbers as ARB_vertex_programs (makes loading
+             * vertex attributes simpler).  With this method, we can use the
+             * exact same code to load the attributes later for both ARB and
+             * GLSL shaders.
+             *
+             * We have to do this here because we need to know the Program ID
+             * in order to make the bindings work, and it has to be done prior
+             * to linking the GLSL program. */
+            tmp_name = string_buffer_get(&priv->string_buffers);
+            for (i = 0; attribs_map; attribs_map >>= 1, ++i)
             {
-                string_buffer_sprintf(tmp_name, "vs_in_uint%u", i);
-                GL_EXTCALL(glBindAttribLocation(program_id, i, tmp_name->buffer));
-                string_buffer_sprintf(tmp_name, "vs_in_int%u", i);
+                if (!(attribs_map & 1))
+                    continue;
+
+                string_buffer_sprintf(tmp_name, "vs_in%u", i);
                 GL_EXTCALL(glBindAttribLocation(program_id, i, tmp_name->buffer));
+                if (vshader && vshader->reg_maps.shader_version.major >= 4)
+                {
+                    string_buffer_sprintf(tmp_name, "vs_in_uint%u", i);
+                    GL_EXTCALL(glBindAttribLocation(program_id, i, tmp_name->buffer));
+                    string_buffer_sprintf(tmp_name, "vs_in_int%u", i);
+                    GL_EXTCALL(glBindAttribLocation(program_id, i, tmp_name->buffer));
+                }
             }
+            checkGLcall("glBindAttribLocation");
+            string_buffer_release(&priv->string_buffers, tmp_name);
         }
-        checkGLcall("glBindAttribLocation");
-        string_buffer_release(&priv->string_buffers, tmp_name);
-    }
 
-    if (gshader)
-    {
-        TRACE("Attaching GLSL geometry shader object %u to program %u.\n", gs_id, program_id);
-        GL_EXTCALL(glAttachShader(program_id, gs_id));
-        checkGLcall("glAttachShader");
-
-        if (gl_info->supported[WINED3D_GL_LEGACY_CONTEXT])
+        if (gshader)
         {
-            TRACE("input type %s, output type %s, vertices out %u.\n",
-                    debug_d3dprimitivetype(gshader->u.gs.input_type),
-                    debug_d3dprimitivetype(gshader->u.gs.output_type),
-                    gshader->u.gs.vertices_out);
-            GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_INPUT_TYPE_ARB,
-                    gl_primitive_type_from_d3d(gshader->u.gs.input_type)));
-            GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_OUTPUT_TYPE_ARB,
-                    gl_primitive_type_from_d3d(gshader->u.gs.output_type)));
-            GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_VERTICES_OUT_ARB,
-                    gshader->u.gs.vertices_out));
-            checkGLcall("glProgramParameteriARB");
-        }
+            TRACE("Attaching GLSL geometry shader object %u to program %u.\n", gs_id, program_id);
+            GL_EXTCALL(glAttachShader(program_id, gs_id));
+            checkGLcall("glAttachShader");
 
-        list_add_head(&gshader->linked_programs, &entry->gs.shader_entry);
-    }
+            if (gl_info->supported[WINED3D_GL_LEGACY_CONTEXT])
+            {
+                TRACE("input type %s, output type %s, vertices out %u.\n",
+                        debug_d3dprimitivetype(gshader->u.gs.input_type),
+                        debug_d3dprimitivetype(gshader->u.gs.output_type),
+                        gshader->u.gs.vertices_out);
+                GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_INPUT_TYPE_ARB,
+                        gl_primitive_type_from_d3d(gshader->u.gs.input_type)));
+                GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_OUTPUT_TYPE_ARB,
+                        gl_primitive_type_from_d3d(gshader->u.gs.output_type)));
+                GL_EXTCALL(glProgramParameteriARB(program_id, GL_GEOMETRY_VERTICES_OUT_ARB,
+                        gshader->u.gs.vertices_out));
+                checkGLcall("glProgramParameteriARB");
+            }
+        }
 
-    /* Attach GLSL pshader */
-    if (ps_id)
-    {
-        TRACE("Attaching GLSL shader object %u to program %u.\n", ps_id, program_id);
-        GL_EXTCALL(glAttachShader(program_id, ps_id));
-        checkGLcall("glAttachShader");
+        /* Attach GLSL pshader */
+        if (ps_id)
+        {
+            TRACE("Attaching GLSL shader object %u to program %u.\n", ps_id, program_id);
+            GL_EXTCALL(glAttachShader(program_id, ps_id));
+            checkGLcall("glAttachShader");
+        }
 
-        list_add_head(ps_list, &entry->ps.shader_entry);
+        /* Link the program */
+        TRACE("Linking GLSL shader program %u.\n", program_id);
+        if (cache_key)
+            GL_EXTCALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        QueryPerformanceCounter(&link_start);
+        GL_EXTCALL(glLinkProgram(program_id));
+        shader_glsl_validate_link(gl_info, program_id);
+        if (cache_key)
+        {
+            QueryPerformanceCounter(&link_end);
+            priv->cache_link_time += link_end.QuadPart - link_start.QuadPart;
+            shader_glsl_store_program_binary(priv, gl_info, program_id, cache_key);
+        }
     }
 
-    /* Link the program */
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
-
     shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
             vshader ? vshader->limits->constant_float : 0);
     shader_glsl_init_gs_uniform_locations(gl_info, priv, program_id, &entry->gs);
@@ -8623,6 +9108,7 @@ static void shader_glsl_destroy(struct wined3d_shader *shader)
                 for (i = 0; i < shader_data->num_gl_shaders; ++i)
                 {
                     TRACE("Deleting pixel shader %u.\n", gl_shaders[i].id);
+                    shader_glsl_compile_wait(priv, gl_info, gl_shaders[i].id, TRUE);
                     GL_EXTCALL(glDeleteShader(gl_shaders[i].id));
                     checkGLcall("glDeleteShader");
                 }
@@ -8645,6 +9131,7 @@ static void shader_glsl_destroy(struct wined3d_shader *shader)
                 for (i = 0; i < shader_data->num_gl_shaders; ++i)
                 {
                     TRACE("Deleting vertex shader %u.\n", gl_shaders[i].id);
+                    shader_glsl_compile_wait(priv, gl_info, gl_shaders[i].id, TRUE);
                     GL_EXTCALL(glDeleteShader(gl_shaders[i].id));
                     checkGLcall("glDeleteShader");
                 }
@@ -8667,6 +9154,7 @@ static void shader_glsl_destroy(struct wined3d_shader *shader)
                 for (i = 0; i < shader_data->num_gl_shaders; ++i)
                 {
                     TRACE("Deleting geometry shader %u.\n", gl_shaders[i].id);
+                    shader_glsl_compile_wait(priv, gl_info, gl_shaders[i].id, TRUE);
                     GL_EXTCALL(glDeleteShader(gl_shaders[i].id));
                     checkGLcall("glDeleteShader");
                 }
@@ -8798,6 +9286,7 @@ static HRESULT shader_glsl_alloc(struct wined3d_device *device, const struct win
     fragment_pipe->get_caps(gl_info, &fragment_caps);
     priv->ffp_proj_control = fragment_caps.wined3d_caps & WINED3D_FRAGMENT_CAP_PROJ_CONTROL;
     priv->legacy_lighting = device->wined3d->flags & WINED3D_LEGACY_FFP_LIGHTING;
+    priv->shader_cache = wined3d_shader_cache_open(device->adapter);
 
     device->vertex_priv = vertex_priv;
     device->fragment_priv = fragment_priv;
@@ -8823,6 +9312,9 @@ static void shader_glsl_free(struct wined3d_device *device)
     struct shader_glsl_priv *priv = device->shader_priv;
     int i;
 
+    if (priv->compiler)
+        glsl_compiler_destroy(priv->compiler);
+
     for (i = 0; i < WINED3D_GL_RES_TYPE_COUNT; ++i)
     {
         if (priv->depth_blt_program_full[i])
@@ -8835,6 +9327,18 @@ static void shader_glsl_free(struct wined3d_device *device)
         }
     }
 
+    if (priv->shader_cache)
+    {
+        LARGE_INTEGER freq;
+
+        QueryPerformanceFrequency(&freq);
+        TRACE("Shader cache: %u hits, %u misses (%u rejected by the driver), "
+                "%.3f ms loading binaries, %.3f ms linking missed programs.\n",
+                priv->cache_hits, priv->cache_misses, priv->cache_rejects,
+                priv->cache_load_time * 1000.0 / freq.QuadPart, priv->cache_link_time * 1000.0 / freq.QuadPart);
+        wined3d_shader_cache_close(priv->shader_cache);
+    }
+
     wine_rb_destroy(&priv->program_lookup, NULL, NULL);
     constant_heap_free(&priv->pconst_heap);
     constant_heap_free(&priv->vconst_heap);
@@ -9192,6 +9696,78 @@ static BOOL shader_glsl_has_ffp_proj_control(void *shader_priv)
     return priv->ffp_proj_control;
 }
 
+/* Queue the variant of a newly created shader that the current state would
+ * select, so that it's usually compiled by the time the shader is first
+ * drawn with. The program itself is still linked on first use.
+ * Context activation is done by the caller. */
+static void shader_glsl_precompile(void *shader_priv, struct wined3d_context *context,
+        const struct wined3d_state *state, struct wined3d_shader *shader)
+{
+    const struct ps_np2fixup_info *np2fixup_info;
+    struct shader_glsl_priv *priv = shader_priv;
+
+    if (!priv->compiler && priv->compiler_failed)
+        return;
+
+    switch (shader->reg_maps.shader_version.type)
+    {
+        case WINED3D_SHADER_TYPE_VERTEX:
+        {
+            struct vs_compile_args args;
+
+            find_vs_compile_args(state, shader, context->stream_info.swizzle_map, &args, context->d3d_info);
+            find_glsl_vshader(context, priv, shader, &args);
+            break;
+        }
+
+        case WINED3D_SHADER_TYPE_GEOMETRY:
+        {
+            struct gs_compile_args args;
+
+            find_gs_compile_args(state, shader, &args);
+            find_glsl_geometry_shader(context, priv, shader, &args);
+            break;
+        }
+
+        case WINED3D_SHADER_TYPE_PIXEL:
+        {
+            struct ps_compile_args args;
+
+            find_ps_compile_args(state, shader, context->stream_info.position_transformed, &args, context);
+            find_glsl_pshader(context, &priv->shader_buffer, &priv->string_buffers, shader, &args, &np2fixup_info);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void shader_glsl_end_frame(void *shader_priv)
+{
+    struct shader_glsl_priv *priv = shader_priv;
+    struct glsl_compiler *compiler;
+    LARGE_INTEGER freq;
+
+    if (!(compiler = priv->compiler))
+        return;
+
+    EnterCriticalSection(&compiler->cs);
+    if (compiler->queued || compiler->stalls)
+    {
+        QueryPerformanceFrequency(&freq);
+        TRACE_(d3d_perf)("Frame %u: %u shaders queued, queue depth %u, %u stalls, %.3f ms stalled.\n",
+                compiler->frame, compiler->queued, compiler->max_depth, compiler->stalls,
+                compiler->stall_time * 1000.0 / freq.QuadPart);
+    }
+    ++compiler->frame;
+    compiler->queued = 0;
+    compiler->max_depth = compiler->job_count;
+    compiler->stalls = 0;
+    compiler->stall_time = 0;
+    LeaveCriticalSection(&compiler->cs);
+}
+
 const struct wined3d_shader_backend_ops glsl_shader_backend =
 {
     shader_glsl_handle_instruction,
@@ -9203,6 +9779,8 @@ const struct wined3d_shader_backend_ops glsl_shader_backend =
     shader_glsl_update_float_pixel_constants,
     shader_glsl_load_constants,
     shader_glsl_destroy,
+    shader_glsl_precompile,
+    shader_glsl_end_frame,
     shader_glsl_alloc,
     shader_glsl_free,
     shader_glsl_allocate_context_data,
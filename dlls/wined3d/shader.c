@@ -2661,6 +2661,9 @@ static void shader_none_update_float_pixel_constants(struct wined3d_device *devi
 static void shader_none_load_constants(void *shader_priv, struct wined3d_context *context,
         const struct wined3d_state *state) {}
 static void shader_none_destroy(struct wined3d_shader *shader) {}
+static void shader_none_precompile(void *shader_priv, struct wined3d_context *context,
+        const struct wined3d_state *state, struct wined3d_shader *shader) {}
+static void shader_none_end_frame(void *shader_priv) {}
 static void shader_none_free_context_data(struct wined3d_context *context) {}
 static void shader_none_init_context_state(struct wined3d_context *context) {}
 
@@ -2784,6 +2787,8 @@ const struct wined3d_shader_backend_ops none_shader_backend =
     shader_none_update_float_pixel_constants,
     shader_none_load_constants,
     shader_none_destroy,
+    shader_none_precompile,
+    shader_none_end_frame,
     shader_none_alloc,
     shader_none_free,
     shader_none_allocate_context_data,
@@ -3594,6 +3599,11 @@ HRESULT CDECL wined3d_shader_create_gs(struct wined3d_device *device, const stru
 
     TRACE("Created geometry shader %p.\n", object);
     *shader = object;
+#if defined(STAGING_CSMT)
+
+    if (wined3d_settings.shader_compile_threads)
+        wined3d_cs_emit_precompile_shader(device->cs, object);
+#endif /* STAGING_CSMT */
 
     return WINED3D_OK;
 }
@@ -3645,6 +3655,11 @@ HRESULT CDECL wined3d_shader_create_ps(struct wined3d_device *device, const stru
 
     TRACE("Created pixel shader %p.\n", object);
     *shader = object;
+#if defined(STAGING_CSMT)
+
+    if (wined3d_settings.shader_compile_threads)
+        wined3d_cs_emit_precompile_shader(device->cs, object);
+#endif /* STAGING_CSMT */
 
     return WINED3D_OK;
 }
@@ -3671,6 +3686,11 @@ HRESULT CDECL wined3d_shader_create_vs(struct wined3d_device *device, const stru
 
     TRACE("Created vertex shader %p.\n", object);
     *shader = object;
+#if defined(STAGING_CSMT)
+
+    if (wined3d_settings.shader_compile_threads)
+        wined3d_cs_emit_precompile_shader(device->cs, object);
+#endif /* STAGING_CSMT */
 
     return WINED3D_OK;
 }
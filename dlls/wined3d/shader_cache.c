@@ -0,0 +1,387 @@
+/*
+ * Persistent cache of linked GL program binaries.
+ *
+ * Copyright 2017 Wine Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* The cache is a single file in the Wine configuration directory. It starts
+ * with a header identifying the GL driver and the Wine version that produced
+ * it, followed by records that are only ever appended. When the header
+ * doesn't match the current driver the file is truncated. A record that
+ * was only partially written terminates the scan when the file is loaded,
+ * and is truncated away.
+ *
+ * Several processes may use the file at the same time. Resets and appends
+ * are serialised with a byte range lock past the maximum file size, which
+ * no read or write ever touches. */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include "wined3d_private.h"
+#include "wine/library.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
+
+#define WINED3D_SHADER_CACHE_MAGIC      0x63337377 /* "ws3c" */
+#define WINED3D_SHADER_CACHE_VERSION    1
+#define WINED3D_SHADER_CACHE_MAX_SIZE   (256 * 1024 * 1024)
+
+struct wined3d_shader_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    UINT64 identity;
+};
+
+struct wined3d_shader_cache_record
+{
+    UINT64 key;
+    UINT64 checksum;
+    DWORD format;
+    DWORD size;
+};
+
+struct wined3d_shader_cache_entry
+{
+    struct wine_rb_entry entry;
+    UINT64 key;
+    UINT64 checksum;
+    DWORD format;
+    DWORD size;
+    UINT64 offset;
+};
+
+struct wined3d_shader_cache
+{
+    HANDLE file;
+    UINT64 end;
+    struct wine_rb_tree entries;
+};
+
+static int wined3d_shader_cache_compare(const void *key, const struct wine_rb_entry *entry)
+{
+    UINT64 k = *(const UINT64 *)key;
+    const struct wined3d_shader_cache_entry *e = WINE_RB_ENTRY_VALUE(entry,
+            const struct wined3d_shader_cache_entry, entry);
+
+    return k > e->key ? 1 : k < e->key ? -1 : 0;
+}
+
+static void wined3d_shader_cache_free_entry(struct wine_rb_entry *entry, void *context)
+{
+    HeapFree(GetProcessHeap(), 0, WINE_RB_ENTRY_VALUE(entry, struct wined3d_shader_cache_entry, entry));
+}
+
+static BOOL wined3d_shader_cache_add_entry(struct wined3d_shader_cache *cache,
+        const struct wined3d_shader_cache_record *record, UINT64 offset)
+{
+    struct wined3d_shader_cache_entry *entry;
+
+    if (wine_rb_get(&cache->entries, &record->key))
+        return TRUE;
+
+    if (!(entry = HeapAlloc(GetProcessHeap(), 0, sizeof(*entry))))
+        return FALSE;
+    entry->key = record->key;
+    entry->checksum = record->checksum;
+    entry->format = record->format;
+    entry->size = record->size;
+    entry->offset = offset;
+    wine_rb_put(&cache->entries, &entry->key, &entry->entry);
+
+    return TRUE;
+}
+
+static BOOL wined3d_shader_cache_read(const struct wined3d_shader_cache *cache,
+        void *data, DWORD size, UINT64 offset)
+{
+    OVERLAPPED overlapped;
+    DWORD count;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.u.s.Offset = offset;
+    overlapped.u.s.OffsetHigh = offset >> 32;
+    return ReadFile(cache->file, data, size, &count, &overlapped) && count == size;
+}
+
+static BOOL wined3d_shader_cache_write(const struct wined3d_shader_cache *cache,
+        const void *data, DWORD size, UINT64 offset)
+{
+    OVERLAPPED overlapped;
+    DWORD count;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.u.s.Offset = offset;
+    overlapped.u.s.OffsetHigh = offset >> 32;
+    return WriteFile(cache->file, data, size, &count, &overlapped) && count == size;
+}
+
+static BOOL wined3d_shader_cache_lock(const struct wined3d_shader_cache *cache)
+{
+    OVERLAPPED overlapped;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.u.s.Offset = WINED3D_SHADER_CACHE_MAX_SIZE;
+    return LockFileEx(cache->file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+}
+
+static void wined3d_shader_cache_unlock(const struct wined3d_shader_cache *cache)
+{
+    UnlockFile(cache->file, WINED3D_SHADER_CACHE_MAX_SIZE, 0, 1, 0);
+}
+
+/* The cache must be locked. */
+static BOOL wined3d_shader_cache_reset(struct wined3d_shader_cache *cache,
+        const struct wined3d_shader_cache_header *header)
+{
+    if (SetFilePointer(cache->file, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER
+            || !SetEndOfFile(cache->file)
+            || !wined3d_shader_cache_write(cache, header, sizeof(*header), 0))
+    {
+        WARN("Failed to reset shader cache, error %u.\n", GetLastError());
+        return FALSE;
+    }
+    cache->end = sizeof(*header);
+
+    return TRUE;
+}
+
+static WCHAR *wined3d_shader_cache_get_path(void)
+{
+    static const char cache_name[] = "/wined3d-shader-cache";
+    const char *config_dir;
+    WCHAR *dos_path;
+    char *path;
+
+    if (!(config_dir = wine_get_config_dir()))
+        return NULL;
+
+    if (!(path = HeapAlloc(GetProcessHeap(), 0, strlen(config_dir) + sizeof(cache_name))))
+        return NULL;
+    strcpy(path, config_dir);
+    strcat(path, cache_name);
+    dos_path = wine_get_dos_file_name(path);
+    HeapFree(GetProcessHeap(), 0, path);
+
+    return dos_path;
+}
+
+struct wined3d_shader_cache *wined3d_shader_cache_open(const struct wined3d_adapter *adapter)
+{
+    struct wined3d_shader_cache_header header, file_header;
+    struct wined3d_shader_cache_record record;
+    struct wined3d_shader_cache *cache;
+    unsigned int count = 0;
+    LARGE_INTEGER size;
+    UINT64 offset;
+    WCHAR *path;
+    BOOL ret;
+
+    if (!wined3d_settings.shader_cache || !adapter->gl_info.supported[ARB_GET_PROGRAM_BINARY])
+        return NULL;
+
+    if (!(path = wined3d_shader_cache_get_path()))
+        return NULL;
+
+    if (!(cache = HeapAlloc(GetProcessHeap(), 0, sizeof(*cache))))
+    {
+        HeapFree(GetProcessHeap(), 0, path);
+        return NULL;
+    }
+
+    cache->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (cache->file == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to open shader cache %s, error %u.\n", debugstr_w(path), GetLastError());
+        HeapFree(GetProcessHeap(), 0, path);
+        HeapFree(GetProcessHeap(), 0, cache);
+        return NULL;
+    }
+    wine_rb_init(&cache->entries, wined3d_shader_cache_compare);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WINED3D_SHADER_CACHE_MAGIC;
+    header.version = WINED3D_SHADER_CACHE_VERSION;
+    header.identity = wined3d_hash_string(adapter->driver_info.gl_identity, PACKAGE_VERSION);
+
+    if (!wined3d_shader_cache_lock(cache))
+    {
+        WARN("Failed to lock shader cache %s, error %u.\n", debugstr_w(path), GetLastError());
+        wined3d_shader_cache_close(cache);
+        HeapFree(GetProcessHeap(), 0, path);
+        return NULL;
+    }
+
+    if (!wined3d_shader_cache_read(cache, &file_header, sizeof(file_header), 0)
+            || memcmp(&file_header, &header, sizeof(header)))
+    {
+        TRACE("Shader cache %s is empty or was created by a different driver, resetting.\n", debugstr_w(path));
+        ret = wined3d_shader_cache_reset(cache, &header);
+    }
+    else
+    {
+        if (!GetFileSizeEx(cache->file, &size))
+            size.QuadPart = 0;
+        offset = sizeof(header);
+        while (offset + sizeof(record) <= (UINT64)size.QuadPart)
+        {
+            if (!wined3d_shader_cache_read(cache, &record, sizeof(record), offset)
+                    || offset + sizeof(record) + record.size > (UINT64)size.QuadPart)
+                break;
+            if (!wined3d_shader_cache_add_entry(cache, &record, offset + sizeof(record)))
+                break;
+            offset += sizeof(record) + record.size;
+            ++count;
+        }
+        cache->end = offset;
+        ret = TRUE;
+
+        /* Drop a partially written record, appends go to the end of the
+         * file and would never be found behind it. */
+        if (offset < (UINT64)size.QuadPart)
+        {
+            LARGE_INTEGER end;
+
+            TRACE("Truncating shader cache %s from %s to %s bytes.\n", debugstr_w(path),
+                    wine_dbgstr_longlong(size.QuadPart), wine_dbgstr_longlong(offset));
+            end.QuadPart = offset;
+            if (!SetFilePointerEx(cache->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(cache->file))
+                ret = wined3d_shader_cache_reset(cache, &header);
+        }
+    }
+
+    wined3d_shader_cache_unlock(cache);
+    if (!ret)
+    {
+        wined3d_shader_cache_close(cache);
+        HeapFree(GetProcessHeap(), 0, path);
+        return NULL;
+    }
+
+    TRACE("Opened shader cache %s, %u programs, %s bytes.\n",
+            debugstr_w(path), count, wine_dbgstr_longlong(cache->end));
+    HeapFree(GetProcessHeap(), 0, path);
+
+    return cache;
+}
+
+void wined3d_shader_cache_close(struct wined3d_shader_cache *cache)
+{
+    wine_rb_destroy(&cache->entries, wined3d_shader_cache_free_entry, NULL);
+    CloseHandle(cache->file);
+    HeapFree(GetProcessHeap(), 0, cache);
+}
+
+/* Returns a binary previously stored for "key", to be freed with HeapFree(). */
+void *wined3d_shader_cache_get(struct wined3d_shader_cache *cache, UINT64 key, GLenum *format, unsigned int *size)
+{
+    struct wined3d_shader_cache_entry *entry;
+    struct wine_rb_entry *rb_entry;
+    void *data;
+
+    if (!(rb_entry = wine_rb_get(&cache->entries, &key)))
+        return NULL;
+    entry = WINE_RB_ENTRY_VALUE(rb_entry, struct wined3d_shader_cache_entry, entry);
+
+    if (!(data = HeapAlloc(GetProcessHeap(), 0, entry->size)))
+        return NULL;
+
+    if (!wined3d_shader_cache_read(cache, data, entry->size, entry->offset)
+            || wined3d_hash_data(WINED3D_HASH_INIT, data, entry->size) != entry->checksum)
+    {
+        WARN("Failed to read program %s from the shader cache.\n", wine_dbgstr_longlong(key));
+        HeapFree(GetProcessHeap(), 0, data);
+        wined3d_shader_cache_remove(cache, key);
+        return NULL;
+    }
+
+    *format = entry->format;
+    *size = entry->size;
+    return data;
+}
+
+/* Drops an entry the driver refused to load. It stays in the file until the
+ * next reset, but this process won't try it again. */
+void wined3d_shader_cache_remove(struct wined3d_shader_cache *cache, UINT64 key)
+{
+    struct wine_rb_entry *entry;
+
+    if ((entry = wine_rb_get(&cache->entries, &key)))
+    {
+        wine_rb_remove(&cache->entries, entry);
+        wined3d_shader_cache_free_entry(entry, NULL);
+    }
+}
+
+void wined3d_shader_cache_put(struct wined3d_shader_cache *cache, UINT64 key,
+        GLenum format, const void *data, unsigned int size)
+{
+    struct wined3d_shader_cache_record *record;
+    unsigned int record_size = sizeof(*record) + size;
+    LARGE_INTEGER end;
+
+    if (wine_rb_get(&cache->entries, &key))
+        return;
+
+    if (cache->end + record_size > WINED3D_SHADER_CACHE_MAX_SIZE)
+    {
+        TRACE("Shader cache is full, not storing program %s.\n", wine_dbgstr_longlong(key));
+        return;
+    }
+
+    if (!(record = HeapAlloc(GetProcessHeap(), 0, record_size)))
+        return;
+    record->key = key;
+    record->checksum = wined3d_hash_data(WINED3D_HASH_INIT, data, size);
+    record->format = format;
+    record->size = size;
+    memcpy(record + 1, data, size);
+
+    /* Other processes may append to the same file, take the lock so that
+     * the end of the file doesn't move under us. */
+    if (!wined3d_shader_cache_lock(cache))
+    {
+        WARN("Failed to lock the shader cache, error %u.\n", GetLastError());
+        HeapFree(GetProcessHeap(), 0, record);
+        return;
+    }
+
+    if (!GetFileSizeEx(cache->file, &end))
+    {
+        WARN("Failed to get the shader cache size, error %u.\n", GetLastError());
+    }
+    else if (end.QuadPart + record_size > WINED3D_SHADER_CACHE_MAX_SIZE)
+    {
+        TRACE("Shader cache is full, not storing program %s.\n", wine_dbgstr_longlong(key));
+        cache->end = end.QuadPart;
+    }
+    else if (!wined3d_shader_cache_write(cache, record, record_size, end.QuadPart))
+    {
+        WARN("Failed to write program %s to the shader cache, error %u.\n",
+                wine_dbgstr_longlong(key), GetLastError());
+    }
+    else
+    {
+        cache->end = end.QuadPart + record_size;
+        wined3d_shader_cache_add_entry(cache, record, end.QuadPart + sizeof(*record));
+    }
+    wined3d_shader_cache_unlock(cache);
+
+    HeapFree(GetProcessHeap(), 0, record);
+}
@@ -91,8 +91,11 @@ struct wined3d_settings wined3d_settings =
     ~0U,            /* No PS shader model limit by default. */
     ~0u,            /* No CS shader model limit by default. */
     FALSE,          /* 3D support enabled by default. */
+    TRUE,           /* Persistent GLSL program cache enabled by default. */
+    2,              /* Two background GLSL compiler threads by default. */
 #if defined(STAGING_CSMT)
     TRUE,           /* Multithreaded CS by default. */
+    WINED3D_CS_SPIN_COUNT_DEFAULT, /* Maximum number of CS idle polls before sleeping. */
 #endif /* STAGING_CSMT */
 };
 
@@ -337,6 +340,14 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
             TRACE("Disabling 3D support.\n");
             wined3d_settings.no_3d = TRUE;
         }
+        if (!get_config_key(hkey, appkey, "ShaderCache", buffer, size)
+                && !strcmp(buffer,"disabled"))
+        {
+            TRACE("Disabling the persistent shader cache.\n");
+            wined3d_settings.shader_cache = FALSE;
+        }
+        if (!get_config_key_dword(hkey, appkey, "ShaderCompileThreads", &wined3d_settings.shader_compile_threads))
+            TRACE("Using %u shader compiler threads.\n", wined3d_settings.shader_compile_threads);
 #if !defined(STAGING_CSMT)
     }
 #else  /* STAGING_CSMT */
@@ -346,6 +357,8 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
             TRACE("Disabling multithreaded command stream.\n");
             wined3d_settings.cs_multithreaded = FALSE;
         }
+        if (!get_config_key_dword(hkey, appkey, "CSMTSpinCount", &wined3d_settings.cs_spin_count))
+            TRACE("Limiting CS spin count to %u.\n", wined3d_settings.cs_spin_count);
     }
 
     FIXME_(winediag)("Experimental wined3d CSMT feature is currently %s.\n",
@@ -280,6 +280,26 @@ static inline unsigned int wined3d_popcount(unsigned int x)
 #endif
 }
 
+/* 64-bit FNV-1a, used for keys that have to be stable across processes. */
+#define WINED3D_HASH_INIT (((UINT64)0xcbf29ce4 << 32) | 0x84222325)
+
+static inline UINT64 wined3d_hash_data(UINT64 hash, const void *data, SIZE_T size)
+{
+    const BYTE *p = data;
+
+    while (size--)
+    {
+        hash ^= *p++;
+        hash *= ((UINT64)1 << 40) | 0x1b3;
+    }
+    return hash;
+}
+
+static inline UINT64 wined3d_hash_string(UINT64 hash, const char *str)
+{
+    return wined3d_hash_data(hash, str, strlen(str) + 1);
+}
+
 #define ORM_BACKBUFFER  0
 #define ORM_FBO         1
 
@@ -310,8 +330,11 @@ struct wined3d_settings
     unsigned int max_sm_ps;
     unsigned int max_sm_cs;
     BOOL no_3d;
+    BOOL shader_cache;
+    unsigned int shader_compile_threads;
 #if defined(STAGING_CSMT)
     BOOL cs_multithreaded;
+    unsigned int cs_spin_count;
 #endif /* STAGING_CSMT */
 };
 
@@ -1217,6 +1240,9 @@ struct wined3d_shader_backend_ops
     void (*shader_load_constants)(void *shader_priv, struct wined3d_context *context,
             const struct wined3d_state *state);
     void (*shader_destroy)(struct wined3d_shader *shader);
+    void (*shader_precompile)(void *shader_priv, struct wined3d_context *context,
+            const struct wined3d_state *state, struct wined3d_shader *shader);
+    void (*shader_end_frame)(void *shader_priv);
     HRESULT (*shader_alloc_private)(struct wined3d_device *device, const struct wined3d_vertex_pipe_ops *vertex_pipe,
             const struct fragment_pipeline *fragment_pipe);
     void (*shader_free_private)(struct wined3d_device *device);
@@ -2265,6 +2291,7 @@ struct wined3d_driver_info
     UINT64 vram_bytes;
     DWORD version_high;
     DWORD version_low;
+    UINT64 gl_identity; /* Hash of the GL vendor, renderer and version strings. */
 };
 
 struct wined3d_d3d_limits
@@ -2350,6 +2377,14 @@ UINT64 adapter_adjust_memory(struct wined3d_adapter *adapter, INT64 amount) DECL
 BOOL initPixelFormatsNoGL(struct wined3d_gl_info *gl_info) DECLSPEC_HIDDEN;
 void install_gl_compat_wrapper(struct wined3d_gl_info *gl_info, enum wined3d_gl_extension ext) DECLSPEC_HIDDEN;
 
+struct wined3d_shader_cache *wined3d_shader_cache_open(const struct wined3d_adapter *adapter) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_close(struct wined3d_shader_cache *cache) DECLSPEC_HIDDEN;
+void *wined3d_shader_cache_get(struct wined3d_shader_cache *cache, UINT64 key,
+        GLenum *format, unsigned int *size) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_put(struct wined3d_shader_cache *cache, UINT64 key,
+        GLenum format, const void *data, unsigned int size) DECLSPEC_HIDDEN;
+void wined3d_shader_cache_remove(struct wined3d_shader_cache *cache, UINT64 key) DECLSPEC_HIDDEN;
+
 enum projection_types
 {
     proj_none    = 0,
@@ -2583,6 +2618,22 @@ struct wined3d_gl_bo
  * wined3d_device_create() ignores it. */
 #define WINED3DCREATE_MULTITHREADED 0x00000004
 
+#if defined(STAGING_CSMT)
+#define WINED3D_UPLOAD_RING_SEGMENTS        4
+#define WINED3D_UPLOAD_RING_SEGMENT_SIZE    (1024 * 1024)
+
+/* Persistently mapped staging buffer used by the CS thread to upload dirty
+ * buffer ranges. Each segment is fenced once the ring moves past it. */
+struct wined3d_upload_ring
+{
+    GLuint buffer_object;
+    BYTE *map_ptr;
+    unsigned int segment;
+    unsigned int head;
+    GLsync fences[WINED3D_UPLOAD_RING_SEGMENTS];
+};
+
+#endif /* STAGING_CSMT */
 struct wined3d_device
 {
     LONG ref;
@@ -2677,6 +2728,9 @@ struct wined3d_device
 
     /* Command stream */
     struct wined3d_cs *cs;
+#if defined(STAGING_CSMT)
+    struct wined3d_upload_ring upload_ring;
+#endif /* STAGING_CSMT */
 
     /* Context management */
     struct wined3d_context **contexts;
@@ -3287,7 +3341,8 @@ struct wined3d_cs_list
 };
 
 #define WINED3D_CS_QUEUE_SIZE 0x100000
-#define WINED3D_CS_SPIN_COUNT 10000000
+#define WINED3D_CS_SPIN_COUNT_DEFAULT 4000
+#define WINED3D_CS_SPIN_COUNT_MIN 64
 
 struct wined3d_cs_queue
 {
@@ -3335,6 +3390,11 @@ struct wined3d_cs
 
     HANDLE event;
     BOOL waiting_for_event;
+    BOOL use_futex;
+    unsigned int spin_limit;
+
+    /* Statistics, reported on destruction. */
+    LONG spin_count, sleep_count, wake_count;
 #endif /* STAGING_CSMT */
 };
 
@@ -3478,6 +3538,7 @@ void wined3d_cs_emit_update_sub_resource(struct wined3d_cs *cs, struct wined3d_r
         unsigned int sub_resource_idx, const struct wined3d_box *box, const void *data, unsigned int row_pitch,
         unsigned int depth_pitch) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_update_swap_interval(struct wined3d_cs *cs, struct wined3d_swapchain *swapchain) DECLSPEC_HIDDEN;
+void wined3d_cs_emit_precompile_shader(struct wined3d_cs *cs, struct wined3d_shader *shader) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_update_texture(struct wined3d_cs *cs, struct wined3d_texture *src,
         struct wined3d_texture *dst) DECLSPEC_HIDDEN;
 #endif /* STAGING_CSMT */
@@ -3554,6 +3615,8 @@ HRESULT wined3d_buffer_upload_data(struct wined3d_buffer *buffer,
 #if defined(STAGING_CSMT)
 void buffer_invalidate_bo_range(struct wined3d_buffer *buffer, unsigned int offset, unsigned int size) DECLSPEC_HIDDEN;
 void buffer_swap_mem(struct wined3d_buffer *buffer, BYTE *mem) DECLSPEC_HIDDEN;
+void wined3d_upload_ring_destroy(struct wined3d_device *device,
+        const struct wined3d_gl_info *gl_info) DECLSPEC_HIDDEN;
 void buffer_create_buffer_object(struct wined3d_buffer *This,
         struct wined3d_context *context) DECLSPEC_HIDDEN;
 #endif /* STAGING_CSMT */
@@ -26,6 +26,7 @@
  * clients and servers (www.winsite.com got a lot of those).
  */
 
+#define _GNU_SOURCE  /* for recvmmsg, sendmmsg */
 #include "config.h"
 #include "wine/port.h"
 
@@ -502,6 +503,7 @@ struct ws2_async
     WSABUF                             *control;
     unsigned int                        n_iovecs;
     unsigned int                        first_iovec;
+    BOOL                                batch;  /* datagram I/O that can be part of a batch */
     struct iovec                        iovec[1];
 };
 
@@ -2332,6 +2334,69 @@ static void WINAPI ws2_async_apc( void *arg, IO_STATUS_BLOCK *iosb, ULONG reserv
     release_async_io( &wsa->io );
 }
 
+/* number of pending overlapped datagram operations in the process; claiming
+ * a batch is only worth a server call when there are others than the woken one */
+static LONG batch_pending;
+
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+
+#define WS2_BATCH_SIZE 32
+
+/* claim the overlapped operations queued behind a woken one */
+static unsigned int claim_async_batch( struct ws2_async *wsa, IO_STATUS_BLOCK *iosb,
+                                       async_result_t *results )
+{
+    unsigned int count = 0;
+
+    if (batch_pending < 2) return 0;
+
+    SERVER_START_REQ( claim_async_batch )
+    {
+        req->iosb = wine_server_client_ptr( iosb );
+        req->arg  = wine_server_client_ptr( wsa );
+        wine_server_set_reply( req, results, (WS2_BATCH_SIZE - 1) * sizeof(*results) );
+        if (!wine_server_call( req )) count = wine_server_reply_size( reply ) / sizeof(*results);
+    }
+    SERVER_END_REQ;
+    return count;
+}
+
+/* mark a claimed operation as done; its iosb is updated right away */
+static void complete_async_batch_entry( async_result_t *result, struct ws2_async *wsa, int len )
+{
+    IO_STATUS_BLOCK *iosb = wine_server_get_ptr( result->iosb );
+
+    iosb->u.Status = STATUS_SUCCESS;
+    iosb->Information += len;
+    result->status = STATUS_SUCCESS;
+    result->total  = iosb->Information;
+    if (wsa->completion_func) result->apc = wine_server_client_ptr( ws2_async_apc );
+}
+
+/* report the results of a batch in a single call, the server takes care of the
+ * events and completion ports; the entries left pending are restarted */
+static void finish_async_batch( const async_result_t *results, struct ws2_async **batch, unsigned int count )
+{
+    unsigned int i, done = 0;
+
+    SERVER_START_REQ( set_async_results )
+    {
+        wine_server_add_data( req, results, count * sizeof(*results) );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    for (i = 0; i < count; i++)
+    {
+        if (results[i].status == STATUS_PENDING) continue;
+        if (!batch[i]->completion_func) release_async_io( &batch[i]->io );
+        done++;
+    }
+    if (done) InterlockedExchangeAdd( &batch_pending, -done );
+}
+
+#endif
+
 /***********************************************************************
  *              WS2_recv                (INTERNAL)
  *
@@ -2415,6 +2480,63 @@ static int WS2_recv( int fd, struct ws2_async *wsa, int flags )
     return n;
 }
 
+/***********************************************************************
+ *              WS2_recv_batch          (INTERNAL)
+ *
+ * Receive for a woken overlapped datagram recv, along with the ones queued
+ * behind it in the same system call. Returns the result of the woken one.
+ */
+static int WS2_recv_batch( int fd, struct ws2_async *wsa, IO_STATUS_BLOCK *iosb, int flags )
+{
+#ifdef HAVE_RECVMMSG
+    async_result_t results[WS2_BATCH_SIZE - 1];
+    struct ws2_async *batch[WS2_BATCH_SIZE];
+    union generic_unix_sockaddr addrs[WS2_BATCH_SIZE];
+    struct mmsghdr msgs[WS2_BATCH_SIZE];
+    unsigned int i, count, claimed;
+    int n;
+
+    if (!(claimed = claim_async_batch( wsa, iosb, results ))) return WS2_recv( fd, wsa, flags );
+
+    /* all the datagrams have to be received with the same flags */
+    batch[0] = wsa;
+    for (count = 1; count <= claimed; count++)
+    {
+        batch[count] = wine_server_get_ptr( results[count - 1].arg );
+        if (!batch[count]->batch || batch[count]->flags != wsa->flags) break;
+    }
+
+    memset( msgs, 0, count * sizeof(*msgs) );
+    for (i = 0; i < count; i++)
+    {
+        if (batch[i]->addr)
+        {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+        msgs[i].msg_hdr.msg_iov = batch[i]->iovec + batch[i]->first_iovec;
+        msgs[i].msg_hdr.msg_iovlen = batch[i]->n_iovecs - batch[i]->first_iovec;
+    }
+
+    while ((n = recvmmsg( fd, msgs, count, flags, NULL )) == -1 && errno == EINTR);
+    if (n == -1) n = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        if (batch[i]->addr && msgs[i].msg_hdr.msg_namelen)
+            ws_sockaddr_u2ws( &addrs[i].addr, batch[i]->addr, batch[i]->addrlen.ptr );
+        if (i) complete_async_batch_entry( &results[i - 1], batch[i], msgs[i].msg_len );
+    }
+    finish_async_batch( results, batch + 1, claimed );
+
+    /* let WS2_recv deal with the errors */
+    if (!n) return WS2_recv( fd, wsa, flags );
+    return msgs[0].msg_len;
+#else
+    return WS2_recv( fd, wsa, flags );
+#endif
+}
+
 /***********************************************************************
  *              WS2_async_recv          (INTERNAL)
  *
@@ -2432,7 +2554,8 @@ static NTSTATUS WS2_async_recv( void *user, IO_STATUS_BLOCK *iosb,
         if ((status = wine_server_handle_to_fd( wsa->hSocket, FILE_READ_DATA, &fd, NULL ) ))
             break;
 
-        result = WS2_recv( fd, wsa, convert_flags(wsa->flags) );
+        if (wsa->batch) result = WS2_recv_batch( fd, wsa, iosb, convert_flags(wsa->flags) );
+        else result = WS2_recv( fd, wsa, convert_flags(wsa->flags) );
         wine_server_release_fd( wsa->hSocket, fd );
         if (result >= 0)
         {
@@ -2456,6 +2579,7 @@ static NTSTATUS WS2_async_recv( void *user, IO_STATUS_BLOCK *iosb,
     }
     if (status != STATUS_PENDING)
     {
+        if (wsa->batch) InterlockedDecrement( &batch_pending );
         iosb->u.Status = status;
         iosb->Information = result;
         if (wsa->completion_func)
@@ -2645,6 +2769,65 @@ static int WS2_send( int fd, struct ws2_async *wsa, int flags )
     return ret;
 }
 
+/***********************************************************************
+ *              WS2_send_batch          (INTERNAL)
+ *
+ * Send for a woken overlapped datagram send, along with the ones queued
+ * behind it in the same system call. Returns the result of the woken one.
+ */
+static int WS2_send_batch( int fd, struct ws2_async *wsa, IO_STATUS_BLOCK *iosb, int flags )
+{
+#ifdef HAVE_SENDMMSG
+    async_result_t results[WS2_BATCH_SIZE - 1];
+    struct ws2_async *batch[WS2_BATCH_SIZE];
+    union generic_unix_sockaddr addrs[WS2_BATCH_SIZE];
+    struct mmsghdr msgs[WS2_BATCH_SIZE];
+    unsigned int i, count, claimed;
+    int n;
+
+    if (!(claimed = claim_async_batch( wsa, iosb, results ))) return WS2_send( fd, wsa, flags );
+
+    batch[0] = wsa;
+    for (count = 1; count <= claimed; count++)
+    {
+        batch[count] = wine_server_get_ptr( results[count - 1].arg );
+        if (!batch[count]->batch || batch[count]->flags != wsa->flags) break;
+    }
+
+    /* the datagrams are sent in queue order, up to the first one with an invalid address */
+    memset( msgs, 0, count * sizeof(*msgs) );
+    for (i = 0; i < count; i++)
+    {
+        if (batch[i]->addr)
+        {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = ws_sockaddr_ws2u( batch[i]->addr, batch[i]->addrlen.val, &addrs[i] );
+            if (!msgs[i].msg_hdr.msg_namelen) break;
+        }
+        msgs[i].msg_hdr.msg_iov = batch[i]->iovec + batch[i]->first_iovec;
+        msgs[i].msg_hdr.msg_iovlen = batch[i]->n_iovecs - batch[i]->first_iovec;
+    }
+    count = i;
+
+    n = 0;
+    if (count) while ((n = sendmmsg( fd, msgs, count, flags )) == -1 && errno == EINTR);
+    if (n == -1) n = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        batch[i]->first_iovec = batch[i]->n_iovecs;
+        if (i) complete_async_batch_entry( &results[i - 1], batch[i], msgs[i].msg_len );
+    }
+    finish_async_batch( results, batch + 1, claimed );
+
+    /* let WS2_send deal with the errors */
+    if (!n) return WS2_send( fd, wsa, flags );
+    return msgs[0].msg_len;
+#else
+    return WS2_send( fd, wsa, flags );
+#endif
+}
+
 /***********************************************************************
  *              WS2_async_send          (INTERNAL)
  *
@@ -2669,7 +2852,8 @@ static NTSTATUS WS2_async_send( void *user, IO_STATUS_BLOCK *iosb,
             break;
 
         /* check to see if the data is ready (non-blocking) */
-        result = WS2_send( fd, wsa, convert_flags(wsa->flags) );
+        if (wsa->batch) result = WS2_send_batch( fd, wsa, iosb, convert_flags(wsa->flags) );
+        else result = WS2_send( fd, wsa, convert_flags(wsa->flags) );
         wine_server_release_fd( wsa->hSocket, fd );
 
         if (result >= 0)
@@ -2693,6 +2877,7 @@ static NTSTATUS WS2_async_send( void *user, IO_STATUS_BLOCK *iosb,
     }
     if (status != STATUS_PENDING)
     {
+        if (wsa->batch) InterlockedDecrement( &batch_pending );
         iosb->u.Status = status;
         if (wsa->completion_func)
         {
@@ -2906,6 +3091,7 @@ static BOOL WINAPI WS2_AcceptEx(SOCKET listener, SOCKET acceptor, PVOID dest, DW
 
         wsa->read->hSocket     = wsa->accept_socket;
         wsa->read->flags       = 0;
+        wsa->read->batch       = FALSE;
         wsa->read->lpFlags     = &wsa->read->flags;
         wsa->read->addr        = NULL;
         wsa->read->addrlen.ptr = NULL;
@@ -3675,6 +3861,7 @@ static BOOL WINAPI WS2_ConnectEx(SOCKET s, const struct WS_sockaddr* name, int n
             wsa->n_iovecs    = sendBuf ? 1 : 0;
             wsa->first_iovec = 0;
             wsa->completion_func = NULL;
+            wsa->batch       = FALSE;
             wsa->iovec[0].iov_base = sendBuf;
             wsa->iovec[0].iov_len  = sendBufLen;
 
@@ -5706,12 +5893,18 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
         wsa->user_overlapped = lpOverlapped;
         wsa->completion_func = lpCompletionRoutine;
+        wsa->batch = FALSE;
+#ifdef HAVE_SENDMMSG
+        if (n == -1 && (!wsa->addr || wsa->addr->sa_family != WS_AF_IPX))
+            wsa->batch = _get_fd_type( fd ) == SOCK_DGRAM;
+#endif
         release_sock_fd( s, fd );
 
         if (n == -1 || n < totalLength)
         {
             iosb->u.Status = STATUS_PENDING;
             iosb->Information = n == -1 ? 0 : n;
+            if (wsa->batch) InterlockedIncrement( &batch_pending );
 
             SERVER_START_REQ( register_async )
             {
@@ -5730,7 +5923,11 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                the async is done. */
             _enable_event(SOCKET2HANDLE(s), FD_WRITE, 0, 0);
 
-            if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+            if (err != STATUS_PENDING)
+            {
+                if (wsa->batch) InterlockedDecrement( &batch_pending );
+                HeapFree( GetProcessHeap(), 0, wsa );
+            }
             SetLastError(NtStatusToWSAError( err ));
             return SOCKET_ERROR;
         }
@@ -7889,12 +8086,18 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
             wsa->user_overlapped = lpOverlapped;
             wsa->completion_func = lpCompletionRoutine;
+            wsa->batch = FALSE;
+#ifdef HAVE_RECVMMSG
+            if (n == -1 && !wsa->control && !(flags & (MSG_OOB | MSG_PEEK)))
+                wsa->batch = _get_fd_type( fd ) == SOCK_DGRAM;
+#endif
             release_sock_fd( s, fd );
 
             if (n == -1)
             {
                 iosb->u.Status = STATUS_PENDING;
                 iosb->Information = 0;
+                if (wsa->batch) InterlockedIncrement( &batch_pending );
 
                 SERVER_START_REQ( register_async )
                 {
@@ -7909,7 +8112,11 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                 }
                 SERVER_END_REQ;
 
-                if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
+                if (err != STATUS_PENDING)
+                {
+                    if (wsa->batch) InterlockedDecrement( &batch_pending );
+                    HeapFree( GetProcessHeap(), 0, wsa );
+                }
                 SetLastError(NtStatusToWSAError( err ));
                 return SOCKET_ERROR;
             }
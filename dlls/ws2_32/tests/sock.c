@@ -10099,6 +10099,227 @@ todo_wine
     HeapFree(GetProcessHeap(), 0, name);
 }
 
+static void run_packet_loop(const char *name, SOCKET src, SOCKET dst, int count, BOOL nonblocking)
+{
+    char buffer[64];
+    DWORD ticks;
+    int i, ret;
+
+    memset(buffer, 0xcc, sizeof(buffer));
+    ticks = GetTickCount();
+    for (i = 0; i < count; i++)
+    {
+        ret = send(src, buffer, sizeof(buffer), 0);
+        if (ret != sizeof(buffer)) break;
+        do ret = recv(dst, buffer, sizeof(buffer), 0);
+        while (nonblocking && ret == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK);
+        if (ret != sizeof(buffer)) break;
+    }
+    ticks = GetTickCount() - ticks;
+    ok(i == count, "%s: failed after %d packets, ret %d, error %d\n", name, i, ret, WSAGetLastError());
+    trace("%s: %d packets in %u ms (%u packets/s)\n", name, i, ticks,
+          ticks ? (DWORD)((ULONGLONG)i * 1000 / ticks) : 0);
+}
+
+static void test_performance(void)
+{
+    static const int count = 20000;
+    struct sockaddr_in addr;
+    int len = sizeof(addr);
+    SOCKET src, dst;
+    WSAEVENT event;
+    u_long arg;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    src = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    dst = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(src != INVALID_SOCKET && dst != INVALID_SOCKET, "failed to create sockets\n");
+    ok(!bind(dst, (struct sockaddr *)&addr, sizeof(addr)), "bind failed, error %d\n", WSAGetLastError());
+    ok(!getsockname(dst, (struct sockaddr *)&addr, &len), "getsockname failed, error %d\n", WSAGetLastError());
+    ok(!connect(src, (struct sockaddr *)&addr, sizeof(addr)), "connect failed, error %d\n", WSAGetLastError());
+
+    run_packet_loop("UDP blocking", src, dst, count, FALSE);
+
+    arg = 1;
+    ok(!ioctlsocket(src, FIONBIO, &arg), "ioctlsocket failed, error %d\n", WSAGetLastError());
+    ok(!ioctlsocket(dst, FIONBIO, &arg), "ioctlsocket failed, error %d\n", WSAGetLastError());
+    run_packet_loop("UDP nonblocking", src, dst, count, TRUE);
+
+    event = WSACreateEvent();
+    ok(!WSAEventSelect(dst, event, FD_READ), "WSAEventSelect failed, error %d\n", WSAGetLastError());
+    run_packet_loop("UDP event select", src, dst, count, TRUE);
+    WSAEventSelect(dst, NULL, 0);
+    WSACloseEvent(event);
+
+    closesocket(src);
+    closesocket(dst);
+
+    if (tcp_socketpair(&src, &dst))
+    {
+        skip("failed to create TCP socket pair\n");
+        return;
+    }
+    run_packet_loop("TCP blocking", src, dst, count, FALSE);
+
+    arg = 1;
+    ok(!ioctlsocket(dst, FIONBIO, &arg), "ioctlsocket failed, error %d\n", WSAGetLastError());
+    run_packet_loop("TCP nonblocking", src, dst, count, TRUE);
+
+    closesocket(src);
+    closesocket(dst);
+}
+
+static void test_event_select_duplicate(void)
+{
+    struct sockaddr_in addr;
+    int len = sizeof(addr);
+    SOCKET src, dst, dup;
+    char buffer[64];
+    WSAEVENT event;
+    HANDLE handle;
+    DWORD timeout;
+    u_long arg;
+    DWORD ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    src = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    dst = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(src != INVALID_SOCKET && dst != INVALID_SOCKET, "failed to create sockets\n");
+    ok(!bind(dst, (struct sockaddr *)&addr, sizeof(addr)), "bind failed, error %d\n", WSAGetLastError());
+    ok(!getsockname(dst, (struct sockaddr *)&addr, &len), "getsockname failed, error %d\n", WSAGetLastError());
+    ok(!connect(src, (struct sockaddr *)&addr, sizeof(addr)), "connect failed, error %d\n", WSAGetLastError());
+
+    /* a blocking receive on the original handle times out */
+    timeout = 100;
+    ok(!setsockopt(dst, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout)),
+       "setsockopt failed, error %d\n", WSAGetLastError());
+    ret = recv(dst, buffer, sizeof(buffer), 0);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAETIMEDOUT, "got %d, error %d\n", ret, WSAGetLastError());
+
+    if (!DuplicateHandle(GetCurrentProcess(), (HANDLE)dst, GetCurrentProcess(), &handle, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS))
+    {
+        skip("failed to duplicate socket handle, error %u\n", GetLastError());
+        closesocket(src);
+        closesocket(dst);
+        return;
+    }
+    dup = (SOCKET)handle;
+
+    /* the mode set through the duplicate applies to the original handle */
+    arg = 1;
+    ok(!ioctlsocket(dup, FIONBIO, &arg), "ioctlsocket failed, error %d\n", WSAGetLastError());
+    ret = recv(dst, buffer, sizeof(buffer), 0);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK, "got %d, error %d\n", ret, WSAGetLastError());
+    arg = 0;
+    ok(!ioctlsocket(dup, FIONBIO, &arg), "ioctlsocket failed, error %d\n", WSAGetLastError());
+    ret = recv(dst, buffer, sizeof(buffer), 0);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAETIMEDOUT, "got %d, error %d\n", ret, WSAGetLastError());
+
+    event = WSACreateEvent();
+    ok(!WSAEventSelect(dup, event, FD_READ), "WSAEventSelect failed, error %d\n", WSAGetLastError());
+
+    ret = send(src, buffer, sizeof(buffer), 0);
+    ok(ret == sizeof(buffer), "send returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "event not signaled, ret %u\n", ret);
+    ResetEvent(event);
+
+    /* receiving through the other handle must re-enable FD_READ */
+    ret = recv(dst, buffer, sizeof(buffer), 0);
+    ok(ret == sizeof(buffer), "recv returned %d, error %d\n", ret, WSAGetLastError());
+    ret = send(src, buffer, sizeof(buffer), 0);
+    ok(ret == sizeof(buffer), "send returned %d, error %d\n", ret, WSAGetLastError());
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "event not signaled after recv, ret %u\n", ret);
+
+    WSAEventSelect(dup, NULL, 0);
+    WSACloseEvent(event);
+    CloseHandle(handle);
+    closesocket(src);
+    closesocket(dst);
+}
+
+static void test_overlapped_datagrams(void)
+{
+    struct recv_entry
+    {
+        OVERLAPPED ovl;
+        WSABUF wsabuf;
+        char buffer[64];
+    } recvs[16];
+    char buffer[64];
+    struct sockaddr_in addr;
+    int i, ret, len = sizeof(addr);
+    DWORD flags, bytes;
+    ULONG_PTR key;
+    OVERLAPPED *ovl;
+    SOCKET src, dst;
+    HANDLE port;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    src = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    dst = WSASocketA(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    ok(src != INVALID_SOCKET && dst != INVALID_SOCKET, "failed to create sockets\n");
+    ok(!bind(dst, (struct sockaddr *)&addr, sizeof(addr)), "bind failed, error %d\n", WSAGetLastError());
+    ok(!getsockname(dst, (struct sockaddr *)&addr, &len), "getsockname failed, error %d\n", WSAGetLastError());
+    ok(!connect(src, (struct sockaddr *)&addr, sizeof(addr)), "connect failed, error %d\n", WSAGetLastError());
+
+    port = CreateIoCompletionPort((HANDLE)dst, NULL, 0x1234, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+
+    for (i = 0; i < sizeof(recvs) / sizeof(recvs[0]); i++)
+    {
+        memset(&recvs[i].ovl, 0, sizeof(recvs[i].ovl));
+        memset(recvs[i].buffer, 0, sizeof(recvs[i].buffer));
+        recvs[i].wsabuf.buf = recvs[i].buffer;
+        recvs[i].wsabuf.len = sizeof(recvs[i].buffer);
+        flags = 0;
+        ret = WSARecv(dst, &recvs[i].wsabuf, 1, NULL, &flags, &recvs[i].ovl, NULL);
+        ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING,
+           "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+    }
+
+    /* the pending receives get the datagrams in the order they were queued */
+    for (i = 0; i < sizeof(recvs) / sizeof(recvs[0]); i++)
+    {
+        memset(buffer, 'a' + i, sizeof(buffer));
+        ret = send(src, buffer, i + 1, 0);
+        ok(ret == i + 1, "send returned %d, error %d\n", ret, WSAGetLastError());
+    }
+
+    for (i = 0; i < sizeof(recvs) / sizeof(recvs[0]); i++)
+    {
+        ret = GetQueuedCompletionStatus(port, &bytes, &key, &ovl, 1000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        if (!ret) break;
+        ok(key == 0x1234, "got key %#lx\n", key);
+        /* the completions may be reported in any order */
+        ok(bytes >= 1 && bytes <= sizeof(recvs) / sizeof(recvs[0]), "got %u bytes\n", bytes);
+        if (bytes < 1 || bytes > sizeof(recvs) / sizeof(recvs[0])) continue;
+        ok(ovl == &recvs[bytes - 1].ovl, "got %u bytes for receive %d\n", bytes,
+           (int)((struct recv_entry *)ovl - recvs));
+        ok(recvs[bytes - 1].buffer[0] == 'a' + bytes - 1 && !recvs[bytes - 1].buffer[bytes],
+           "got wrong data for receive %u\n", bytes - 1);
+    }
+
+    ret = GetQueuedCompletionStatus(port, &bytes, &key, &ovl, 0);
+    ok(!ret && GetLastError() == WAIT_TIMEOUT, "got unexpected completion, error %u\n", GetLastError());
+
+    closesocket(src);
+    closesocket(dst);
+    CloseHandle(port);
+}
+
 /**************** Main program  ***************/
 
 START_TEST( sock )
@@ -10185,6 +10406,9 @@ START_TEST( sock )
     /* this is an io heavy test, do it at the end so the kernel doesn't start dropping packets */
     test_send();
     test_synchronous_WSAIoctl();
+    test_event_select_duplicate();
+    test_performance();
+    test_overlapped_datagrams();
 
     Exit();
 }
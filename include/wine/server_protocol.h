@@ -70,6 +70,23 @@ typedef struct
 } shmlocal_t;
 
 
+typedef struct
+{
+    unsigned int    state;
+    unsigned int    type;
+    unsigned int    max;
+    thread_id_t     owner;
+} sync_slot_t;
+
+#define SYNC_TYPE_NONE      0
+#define SYNC_TYPE_EVENT     1
+#define SYNC_TYPE_SEMAPHORE 2
+#define SYNC_TYPE_MUTEX     3
+
+#define SYNC_WAITERS        0x80000000
+#define SYNC_SLOT_COUNT     16384
+
+
 typedef union
 {
     int code;
@@ -274,6 +291,17 @@ typedef struct
 } async_data_t;
 
 
+typedef struct
+{
+    client_ptr_t    iosb;
+    client_ptr_t    arg;
+    client_ptr_t    apc;
+    apc_param_t     total;
+    unsigned int    status;
+    int             __pad;
+} async_result_t;
+
+
 
 struct hardware_msg_data
 {
@@ -1550,6 +1578,36 @@ struct get_shared_memory_reply
 
 
 
+struct get_sync_memory_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_sync_memory_reply
+{
+    struct reply_header __header;
+    unsigned int close_slot;
+    char __pad_12[4];
+};
+
+
+
+struct get_sync_slot_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct get_sync_slot_reply
+{
+    struct reply_header __header;
+    unsigned int slot;
+    unsigned int type;
+    unsigned int access;
+    char __pad_20[4];
+};
+
+
+
 struct flush_request
 {
     struct request_header __header;
@@ -3279,6 +3337,51 @@ struct cancel_async_reply
 
 
 
+struct complete_async_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+    client_ptr_t   iosb;
+    client_ptr_t   arg;
+    unsigned int   status;
+    char __pad_36[4];
+    apc_param_t    total;
+};
+struct complete_async_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct claim_async_batch_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+    client_ptr_t iosb;
+    client_ptr_t arg;
+};
+struct claim_async_batch_reply
+{
+    struct reply_header __header;
+    /* VARARG(asyncs,async_results); */
+};
+
+
+
+struct set_async_results_request
+{
+    struct request_header __header;
+    /* VARARG(results,async_results); */
+    char __pad_12[4];
+};
+struct set_async_results_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct get_async_result_request
 {
     struct request_header __header;
@@ -5683,6 +5786,8 @@ enum request
     REQ_get_handle_fd,
     REQ_get_directory_cache_entry,
     REQ_get_shared_memory,
+    REQ_get_sync_memory,
+    REQ_get_sync_slot,
     REQ_flush,
     REQ_lock_file,
     REQ_unlock_file,
@@ -5782,6 +5887,9 @@ enum request
     REQ_set_serial_info,
     REQ_register_async,
     REQ_cancel_async,
+    REQ_complete_async,
+    REQ_claim_async_batch,
+    REQ_set_async_results,
     REQ_get_async_result,
     REQ_read,
     REQ_write,
@@ -5978,6 +6086,8 @@ union generic_request
     struct get_handle_fd_request get_handle_fd_request;
     struct get_directory_cache_entry_request get_directory_cache_entry_request;
     struct get_shared_memory_request get_shared_memory_request;
+    struct get_sync_memory_request get_sync_memory_request;
+    struct get_sync_slot_request get_sync_slot_request;
     struct flush_request flush_request;
     struct lock_file_request lock_file_request;
     struct unlock_file_request unlock_file_request;
@@ -6077,6 +6187,9 @@ union generic_request
     struct set_serial_info_request set_serial_info_request;
     struct register_async_request register_async_request;
     struct cancel_async_request cancel_async_request;
+    struct complete_async_request complete_async_request;
+    struct claim_async_batch_request claim_async_batch_request;
+    struct set_async_results_request set_async_results_request;
     struct get_async_result_request get_async_result_request;
     struct read_request read_request;
     struct write_request write_request;
@@ -6271,6 +6384,8 @@ union generic_reply
     struct get_handle_fd_reply get_handle_fd_reply;
     struct get_directory_cache_entry_reply get_directory_cache_entry_reply;
     struct get_shared_memory_reply get_shared_memory_reply;
+    struct get_sync_memory_reply get_sync_memory_reply;
+    struct get_sync_slot_reply get_sync_slot_reply;
     struct flush_reply flush_reply;
     struct lock_file_reply lock_file_reply;
     struct unlock_file_reply unlock_file_reply;
@@ -6370,6 +6485,9 @@ union generic_reply
     struct set_serial_info_reply set_serial_info_reply;
     struct register_async_reply register_async_reply;
     struct cancel_async_reply cancel_async_reply;
+    struct complete_async_reply complete_async_reply;
+    struct claim_async_batch_reply claim_async_batch_reply;
+    struct set_async_results_reply set_async_results_reply;
     struct get_async_result_reply get_async_result_reply;
     struct read_reply read_reply;
     struct write_reply write_reply;
@@ -6513,6 +6631,6 @@ union generic_reply
     struct terminate_job_reply terminate_job_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 525
+#define SERVER_PROTOCOL_VERSION 530
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
@@ -43,18 +43,19 @@
 #endif
 
 #include "wine/library.h"
-#include "wine/list.h"
+#include "wine/rbtree.h"
 
 #ifdef HAVE_MMAP
 
 struct reserved_area
 {
-    struct list entry;
-    void       *base;
-    size_t      size;
+    struct wine_rb_entry entry;
+    void                *base;
+    size_t               size;
 };
 
-static struct list reserved_areas = LIST_INIT(reserved_areas);
+static int compare_reserved_area( const void *addr, const struct wine_rb_entry *entry );
+static struct wine_rb_tree reserved_areas = { compare_reserved_area };
 static const unsigned int granularity_mask = 0xffff;  /* reserved areas have 64k granularity */
 
 #ifndef MAP_NORESERVE
@@ -67,6 +68,45 @@ static const unsigned int granularity_mask = 0xffff;  /* reserved areas have 64k
 #define MAP_ANON 0
 #endif
 
+/***********************************************************************
+ *           compare_reserved_area
+ *
+ * Comparison function for the reserved areas tree, ordered by base address.
+ */
+static int compare_reserved_area( const void *addr, const struct wine_rb_entry *entry )
+{
+    struct reserved_area *area = WINE_RB_ENTRY_VALUE( entry, struct reserved_area, entry );
+
+    if (addr < area->base) return -1;
+    if (addr > area->base) return 1;
+    return 0;
+}
+
+
+/***********************************************************************
+ *           find_area_before
+ *
+ * Find the last reserved area starting at or before a given address.
+ */
+static struct wine_rb_entry *find_area_before( const void *addr )
+{
+    struct wine_rb_entry *ptr = reserved_areas.root, *ret = NULL;
+
+    while (ptr)
+    {
+        struct reserved_area *area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
+
+        if ((const char *)area->base > (const char *)addr) ptr = ptr->left;
+        else
+        {
+            ret = ptr;
+            ptr = ptr->right;
+        }
+    }
+    return ret;
+}
+
+
 static inline int get_fdzero(void)
 {
     static int fd = -1;
@@ -347,14 +387,14 @@ void mmap_init(void)
 {
 #ifdef __i386__
     struct reserved_area *area;
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
     char stack;
     char * const stack_ptr = &stack;
     char *user_space_limit = (char *)0x7ffe0000;
 
     reserve_malloc_space( 8 * 1024 * 1024 );
 
-    if (!list_head( &reserved_areas ))
+    if (!reserved_areas.root)
     {
         /* if we don't have a preloader, try to reserve some space below 2Gb */
         reserve_area( (void *)0x00110000, (void *)0x40000000 );
@@ -362,9 +402,9 @@ void mmap_init(void)
 
     /* check for a reserved area starting at the user space limit */
     /* to avoid wasting time trying to allocate it again */
-    LIST_FOR_EACH( ptr, &reserved_areas )
+    WINE_RB_FOR_EACH( ptr, &reserved_areas )
     {
-        area = LIST_ENTRY( ptr, struct reserved_area, entry );
+        area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
         if ((char *)area->base > user_space_limit) break;
         if ((char *)area->base + area->size > user_space_limit)
         {
@@ -390,17 +430,17 @@ void mmap_init(void)
 
     /* reserve the DOS area if not already done */
 
-    ptr = list_head( &reserved_areas );
+    ptr = wine_rb_head( reserved_areas.root );
     if (ptr)
     {
-        area = LIST_ENTRY( ptr, struct reserved_area, entry );
+        area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
         if (!area->base) return;  /* already reserved */
     }
     reserve_dos_area();
 
 #elif defined(__x86_64__)
 
-    if (!list_head( &reserved_areas ))
+    if (!reserved_areas.root)
     {
         /* if we don't have a preloader, try to reserve the space now */
         reserve_area( (void *)0x000000010000, (void *)0x000068000000 );
@@ -423,50 +463,47 @@ void mmap_init(void)
  */
 void wine_mmap_add_reserved_area( void *addr, size_t size )
 {
-    struct reserved_area *area;
-    struct list *ptr;
+    struct reserved_area *area, *prev = NULL, *next = NULL;
+    struct wine_rb_entry *ptr;
 
     if (!((char *)addr + size)) size--;  /* avoid wrap-around */
 
-    LIST_FOR_EACH( ptr, &reserved_areas )
+    if ((ptr = find_area_before( addr )))
+    {
+        prev = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
+        ptr = wine_rb_next( ptr );
+    }
+    else ptr = wine_rb_head( reserved_areas.root );
+    if (ptr) next = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
+
+    if (prev && (char *)prev->base + prev->size == (char *)addr)
     {
-        area = LIST_ENTRY( ptr, struct reserved_area, entry );
-        if (area->base > addr)
+        /* merge with the previous one */
+        prev->size += size;
+
+        /* try to merge with the next one too */
+        if (next && (char *)addr + size == (char *)next->base)
         {
-            /* try to merge with the next one */
-            if ((char *)addr + size == (char *)area->base)
-            {
-                area->base = addr;
-                area->size += size;
-                return;
-            }
-            break;
+            prev->size += next->size;
+            wine_rb_remove( &reserved_areas, &next->entry );
+            free( next );
         }
-        else if ((char *)area->base + area->size == (char *)addr)
-        {
-            /* merge with the previous one */
-            area->size += size;
+        return;
+    }
 
-            /* try to merge with the next one too */
-            if ((ptr = list_next( &reserved_areas, ptr )))
-            {
-                struct reserved_area *next = LIST_ENTRY( ptr, struct reserved_area, entry );
-                if ((char *)addr + size == (char *)next->base)
-                {
-                    area->size += next->size;
-                    list_remove( &next->entry );
-                    free( next );
-                }
-            }
-            return;
-        }
+    /* try to merge with the next one */
+    if (next && (char *)addr + size == (char *)next->base)
+    {
+        next->base = addr;
+        next->size += size;
+        return;
     }
 
     if ((area = malloc( sizeof(*area) )))
     {
         area->base = addr;
         area->size = size;
-        list_add_before( ptr, &area->entry );
+        wine_rb_put( &reserved_areas, addr, &area->entry );
     }
 }
 
@@ -483,15 +520,15 @@ void wine_mmap_add_reserved_area( void *addr, size_t size )
 void wine_mmap_remove_reserved_area( void *addr, size_t size, int unmap )
 {
     struct reserved_area *area;
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
 
     if (!((char *)addr + size)) size--;  /* avoid wrap-around */
 
-    ptr = list_head( &reserved_areas );
     /* find the first area covering address */
+    if (!(ptr = find_area_before( addr ))) ptr = wine_rb_head( reserved_areas.root );
     while (ptr)
     {
-        area = LIST_ENTRY( ptr, struct reserved_area, entry );
+        area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
         if ((char *)area->base >= (char *)addr + size) break;  /* outside the range */
         if ((char *)area->base + area->size > (char *)addr)  /* overlaps range */
         {
@@ -508,9 +545,9 @@ void wine_mmap_remove_reserved_area( void *addr, size_t size, int unmap )
                 else
                 {
                     /* range contains the whole area -> remove area completely */
-                    ptr = list_next( &reserved_areas, ptr );
+                    ptr = wine_rb_next( ptr );
                     if (unmap) munmap( area->base, area->size );
-                    list_remove( &area->entry );
+                    wine_rb_remove( &reserved_areas, &area->entry );
                     free( area );
                     continue;
                 }
@@ -525,7 +562,7 @@ void wine_mmap_remove_reserved_area( void *addr, size_t size, int unmap )
                     {
                         new_area->base = (char *)addr + size;
                         new_area->size = (char *)area->base + area->size - (char *)new_area->base;
-                        list_add_after( ptr, &new_area->entry );
+                        wine_rb_put( &reserved_areas, new_area->base, &new_area->entry );
                     }
                     else size = (char *)area->base + area->size - (char *)addr;
                     area->size = (char *)addr - (char *)area->base;
@@ -540,7 +577,7 @@ void wine_mmap_remove_reserved_area( void *addr, size_t size, int unmap )
                 }
             }
         }
-        ptr = list_next( &reserved_areas, ptr );
+        ptr = wine_rb_next( ptr );
     }
 }
 
@@ -558,18 +595,14 @@ void wine_mmap_remove_reserved_area( void *addr, size_t size, int unmap )
 int wine_mmap_is_in_reserved_area( void *addr, size_t size )
 {
     struct reserved_area *area;
-    struct list *ptr;
-
-    LIST_FOR_EACH( ptr, &reserved_areas )
-    {
-        area = LIST_ENTRY( ptr, struct reserved_area, entry );
-        if (area->base > addr) break;
-        if ((char *)area->base + area->size <= (char *)addr) continue;
-        /* area must contain block completely */
-        if ((char *)area->base + area->size < (char *)addr + size) return -1;
-        return 1;
-    }
-    return 0;
+    struct wine_rb_entry *ptr;
+
+    if (!(ptr = find_area_before( addr ))) return 0;
+    area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
+    if ((char *)area->base + area->size <= (char *)addr) return 0;
+    /* area must contain block completely */
+    if ((char *)area->base + area->size < (char *)addr + size) return -1;
+    return 1;
 }
 
 
@@ -586,21 +619,21 @@ int wine_mmap_enum_reserved_areas( int (*enum_func)(void *base, size_t size, voi
                                    int top_down )
 {
     int ret = 0;
-    struct list *ptr;
+    struct wine_rb_entry *ptr;
 
     if (top_down)
     {
-        for (ptr = reserved_areas.prev; ptr != &reserved_areas; ptr = ptr->prev)
+        for (ptr = wine_rb_tail( reserved_areas.root ); ptr; ptr = wine_rb_prev( ptr ))
         {
-            struct reserved_area *area = LIST_ENTRY( ptr, struct reserved_area, entry );
+            struct reserved_area *area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
             if ((ret = enum_func( area->base, area->size, arg ))) break;
         }
     }
     else
     {
-        for (ptr = reserved_areas.next; ptr != &reserved_areas; ptr = ptr->next)
+        WINE_RB_FOR_EACH( ptr, &reserved_areas )
         {
-            struct reserved_area *area = LIST_ENTRY( ptr, struct reserved_area, entry );
+            struct reserved_area *area = WINE_RB_ENTRY_VALUE( ptr, struct reserved_area, entry );
             if ((ret = enum_func( area->base, area->size, arg ))) break;
         }
     }
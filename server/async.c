@@ -40,6 +40,8 @@ struct async
     struct thread       *thread;          /* owning thread */
     struct list          queue_entry;     /* entry in async queue list */
     struct list          process_entry;   /* entry in process list */
+    struct list          hash_entry;      /* entry in the hash table of asyncs */
+    struct list          claim_entry;     /* entry in the list of asyncs claimed by a thread */
     struct async_queue  *queue;           /* queue containing this async */
     unsigned int         status;          /* current status */
     struct timeout_user *timeout;
@@ -114,6 +116,36 @@ static const struct object_ops async_queue_ops =
 };
 
 
+/* hash table of the asyncs by I/O status block, for the requests that
+ * identify them the same way as the client callbacks */
+#define ASYNC_HASH_SIZE 509
+
+static struct list async_hash[ASYNC_HASH_SIZE];
+
+static struct list *get_async_bucket( client_ptr_t iosb )
+{
+    static int initialized;
+    unsigned int i;
+
+    if (!initialized)
+    {
+        for (i = 0; i < ASYNC_HASH_SIZE; i++) list_init( &async_hash[i] );
+        initialized = 1;
+    }
+    return &async_hash[(iosb >> 3) % ASYNC_HASH_SIZE];
+}
+
+/* find an async of a process from its I/O status block and user data */
+static struct async *find_async( struct process *process, client_ptr_t iosb, client_ptr_t arg )
+{
+    struct async *async;
+
+    LIST_FOR_EACH_ENTRY( async, get_async_bucket( iosb ), struct async, hash_entry )
+        if (async->thread->process == process && async->data.iosb == iosb && async->data.arg == arg)
+            return async;
+    return NULL;
+}
+
 static inline void async_reselect( struct async *async )
 {
     if (async->queue->fd) fd_reselect_async( async->queue->fd, async->queue );
@@ -139,6 +171,7 @@ static void async_destroy( struct object *obj )
     assert( obj->ops == &async_ops );
 
     list_remove( &async->process_entry );
+    list_remove( &async->hash_entry );
     list_remove( &async->queue_entry );
     async_reselect( async );
 
@@ -252,12 +285,14 @@ struct async *create_async( struct thread *thread, struct async_queue *queue, co
     async->timeout = NULL;
     async->queue   = (struct async_queue *)grab_object( queue );
     async->signaled = 0;
+    list_init( &async->claim_entry );
 
     if (iosb) async->iosb = (struct iosb *)grab_object( iosb );
     else async->iosb = NULL;
 
     list_add_tail( &queue->queue, &async->queue_entry );
     list_add_tail( &thread->process->asyncs, &async->process_entry );
+    list_add_tail( get_async_bucket( data->iosb ), &async->hash_entry );
     grab_object( async );
 
     if (queue->fd) set_fd_signaled( queue->fd, 0 );
@@ -475,6 +510,113 @@ DECL_HANDLER(cancel_async)
     }
 }
 
+/* complete an async performed by the client, it is only woken up when terminated */
+DECL_HANDLER(complete_async)
+{
+    struct async *async = find_async( current->process, req->iosb, req->arg );
+
+    if (!async || req->status == STATUS_PENDING)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (async->status != STATUS_PENDING)
+    {
+        /* it was terminated in the meantime, the client callback reports the result */
+        set_error( STATUS_CANCELLED );
+        return;
+    }
+
+    async->status = req->status;
+    async_set_result( &async->obj, req->status, req->total, 0, 0 );
+    release_object( async );  /* the queue reference, as in async_terminate */
+}
+
+/* restart the asyncs claimed by a thread that died before storing their results */
+void release_claimed_asyncs( struct thread *thread )
+{
+    struct list *ptr;
+
+    while ((ptr = list_head( &thread->claimed_asyncs )))
+    {
+        struct async *async = LIST_ENTRY( ptr, struct async, claim_entry );
+
+        list_remove( &async->claim_entry );
+        list_init( &async->claim_entry );
+        async_set_result( &async->obj, STATUS_PENDING, 0, 0, 0 );
+        release_object( async );
+    }
+}
+
+/* claim pending asyncs queued behind a woken one */
+DECL_HANDLER(claim_async_batch)
+{
+    struct async *woken, *async;
+    async_result_t *results;
+    data_size_t count = 0, max = get_reply_max_size() / sizeof(*results);
+    struct list *ptr;
+
+    woken = find_async( current->process, req->iosb, req->arg );
+    if (!woken || woken->status == STATUS_PENDING)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+
+    /* stop at the first pending async that can't be part of the batch, to preserve the order */
+    for (ptr = list_next( &woken->queue->queue, &woken->queue_entry ); ptr && count < max;
+         ptr = list_next( &woken->queue->queue, ptr ))
+    {
+        async = LIST_ENTRY( ptr, struct async, queue_entry );
+        if (async->status != STATUS_PENDING) continue;
+        if (async->thread->process != current->process || async->data.callback != woken->data.callback) break;
+        count++;
+    }
+
+    if (!count || !(results = set_reply_data_size( count * sizeof(*results) ))) return;
+    memset( results, 0, count * sizeof(*results) );
+
+    for (ptr = list_next( &woken->queue->queue, &woken->queue_entry ); count;
+         ptr = list_next( &woken->queue->queue, ptr ))
+    {
+        async = LIST_ENTRY( ptr, struct async, queue_entry );
+        if (async->status != STATUS_PENDING) continue;
+
+        /* the queue reference is kept until the result is set, like for a queued APC */
+        async->status  = STATUS_ALERTED;
+        list_add_tail( &current->claimed_asyncs, &async->claim_entry );
+        results->iosb   = async->data.iosb;
+        results->arg    = async->data.arg;
+        results->status = STATUS_PENDING;
+        results++;
+        count--;
+    }
+}
+
+/* store the results of claimed asyncs */
+DECL_HANDLER(set_async_results)
+{
+    const async_result_t *results = get_req_data();
+    data_size_t i, count = get_req_data_size() / sizeof(*results);
+    struct async *async;
+
+    /* the results come in the order of the claims, so the search stops at the first entry */
+    for (i = 0; i < count; i++)
+    {
+        LIST_FOR_EACH_ENTRY( async, &current->claimed_asyncs, struct async, claim_entry )
+        {
+            if (async->data.iosb != results[i].iosb || async->data.arg != results[i].arg) continue;
+
+            list_remove( &async->claim_entry );
+            list_init( &async->claim_entry );
+            async_set_result( &async->obj, results[i].status, results[i].total,
+                              results[i].apc, results[i].arg );
+            release_object( async );
+            break;
+        }
+    }
+}
+
 /* get async result from associated iosb */
 DECL_HANDLER(get_async_result)
 {
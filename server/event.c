@@ -40,23 +40,27 @@ struct event
 {
     struct object  obj;             /* object header */
     int            manual_reset;    /* is it a manual reset event? */
-    int            signaled;        /* event has been signaled */
+    sync_slot_t   *sync;            /* signaled state, shared with the clients */
+    sync_slot_t    private_sync;    /* state storage if no shared slot is available */
 };
 
 static void event_dump( struct object *obj, int verbose );
 static struct object_type *event_get_type( struct object *obj );
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
     sizeof(struct event),      /* size */
     event_dump,                /* dump */
     event_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    event_add_queue,           /* add_queue */
+    event_remove_queue,        /* remove_queue */
     event_signaled,            /* signaled */
     event_satisfied,           /* satisfied */
     event_signal,              /* signal */
@@ -70,7 +74,7 @@ static const struct object_ops event_ops =
     no_open_file,              /* open_file */
     no_alloc_handle,           /* alloc_handle */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -120,7 +124,9 @@ struct event *create_event( struct object *root, const struct unicode_str *name,
         {
             /* initialize it if it didn't already exist */
             event->manual_reset = manual_reset;
-            event->signaled     = initial_state;
+            event->sync         = alloc_sync_slot( &event->private_sync, SYNC_TYPE_EVENT );
+            event->sync->max    = manual_reset;
+            set_sync_state( event->sync, initial_state != 0 );
         }
     }
     return event;
@@ -133,22 +139,28 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
 
 void pulse_event( struct event *event )
 {
-    event->signaled = 1;
+    set_sync_state( event->sync, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
-    event->signaled = 0;
+    set_sync_state( event->sync, 0 );
 }
 
 void set_event( struct event *event )
 {
-    event->signaled = 1;
+    set_sync_state( event->sync, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
 }
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    set_sync_state( event->sync, 0 );
+}
+
+sync_slot_t *get_event_sync( struct object *obj )
+{
+    if (obj->ops != &event_ops) return NULL;
+    return ((struct event *)obj)->sync;
 }
 
 static void event_dump( struct object *obj, int verbose )
@@ -156,7 +168,7 @@ static void event_dump( struct object *obj, int verbose )
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     fprintf( stderr, "Event manual=%d signaled=%d\n",
-             event->manual_reset, event->signaled );
+             event->manual_reset, get_sync_state( event->sync ) );
 }
 
 static struct object_type *event_get_type( struct object *obj )
@@ -166,11 +178,29 @@ static struct object_type *event_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    /* must be visible to the clients before the signaled state is checked */
+    set_sync_waiters( event->sync, 1 );
+    return add_queue( obj, entry );
+}
+
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    if (list_head( &obj->wait_queue ) == &entry->entry && list_tail( &obj->wait_queue ) == &entry->entry)
+        set_sync_waiters( event->sync, 0 );
+    remove_queue( obj, entry );
+}
+
 static int event_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    return event->signaled;
+    return get_sync_state( event->sync ) != 0;
 }
 
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -178,7 +208,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset) set_sync_state( event->sync, 0 );
 }
 
 static unsigned int event_map_access( struct object *obj, unsigned int access )
@@ -204,6 +234,13 @@ static int event_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+    free_sync_slot( event->sync );
+}
+
 struct keyed_event *create_keyed_event( struct object *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -339,7 +376,7 @@ DECL_HANDLER(query_event)
     if (!(event = get_event_obj( current->process, req->handle, EVENT_QUERY_STATE ))) return;
 
     reply->manual_reset = event->manual_reset;
-    reply->state = event->signaled;
+    reply->state = get_sync_state( event->sync ) != 0;
 
     release_object( event );
 }
@@ -1826,6 +1826,11 @@ struct fd *open_fd( struct fd *root, const char *name, int flags, mode_t *mode,
     }
     else rw_mode = O_RDONLY;
 
+#ifdef O_DSYNC
+    /* write-through writes must reach the disk before they complete */
+    if (options & FILE_WRITE_THROUGH) rw_mode |= O_DSYNC;
+#endif
+
     fd->unix_name = dup_fd_name( root, name );
 
     if ((fd->unix_fd = open( name, rw_mode | (flags & ~O_TRUNC), *mode )) == -1)
@@ -2630,6 +2635,10 @@ DECL_HANDLER(register_async)
     case ASYNC_TYPE_WRITE:
         access = FILE_WRITE_DATA;
         break;
+    case ASYNC_TYPE_WAIT:
+        /* regular file I/O performed by the client, completed with complete_async */
+        access = 0;
+        break;
     default:
         set_error( STATUS_INVALID_PARAMETER );
         return;
@@ -2637,7 +2646,8 @@ DECL_HANDLER(register_async)
 
     if ((fd = get_handle_fd_obj( current->process, req->async.handle, access )))
     {
-        if (get_unix_fd( fd ) != -1) fd->fd_ops->queue_async( fd, &req->async, req->type, req->count );
+        if (req->type == ASYNC_TYPE_WAIT && !fd->inode) set_error( STATUS_INVALID_PARAMETER );
+        else if (get_unix_fd( fd ) != -1) fd->fd_ops->queue_async( fd, &req->async, req->type, req->count );
         release_object( fd );
     }
 }
@@ -402,6 +402,7 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (entry->access & RESERVED_CLOSE_PROTECT) return STATUS_HANDLE_NOT_CLOSABLE;
     obj = entry->ptr;
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
+    notify_sync_handle_closed( process, obj );
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
     if (entry < table->entries + table->free) table->free = entry - table->entries;
@@ -148,6 +148,7 @@ int main( int argc, char *argv[] )
     init_directories();
     init_registry();
     init_shared_memory();
+    init_sync_memory();
     main_loop();
     return 0;
 }
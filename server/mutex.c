@@ -40,7 +40,8 @@ struct mutex
 {
     struct object  obj;             /* object header */
     struct thread *owner;           /* mutex owner */
-    unsigned int   count;           /* recursion count */
+    sync_slot_t   *sync;            /* recursion count and owner id, shared with the clients */
+    sync_slot_t    private_sync;    /* count storage if no shared slot is available */
     int            abandoned;       /* has it been abandoned? */
     struct list    entry;           /* entry in owner thread mutex list */
 };
@@ -77,29 +78,46 @@ static const struct object_ops mutex_ops =
 };
 
 
+/* The owner thread may change the recursion count in the client as long as
+ * it stays above 0, so ownership is tracked by the owner pointer here and the
+ * first grab and the final release always go through the server. */
+
 /* grab a mutex for a given thread */
 static void do_grab( struct mutex *mutex, struct thread *thread )
 {
-    assert( !mutex->count || (mutex->owner == thread) );
+    assert( !mutex->owner || (mutex->owner == thread) );
 
-    if (!mutex->count++)  /* FIXME: avoid wrap-around */
+    if (!mutex->owner)
     {
-        assert( !mutex->owner );
         mutex->owner = thread;
+        mutex->sync->owner = thread->id;
+        set_sync_state( mutex->sync, 1 );
         list_add_head( &thread->mutex_list, &mutex->entry );
     }
+    else add_sync_state( mutex->sync, 1 );  /* FIXME: avoid wrap-around */
 }
 
 /* release a mutex once the recursion count is 0 */
 static void do_release( struct mutex *mutex )
 {
-    assert( !mutex->count );
+    set_sync_state( mutex->sync, 0 );
+    mutex->sync->owner = 0;
     /* remove the mutex from the thread list of owned mutexes */
     list_remove( &mutex->entry );
     mutex->owner = NULL;
     wake_up( &mutex->obj, 0 );
 }
 
+/* release a mutex once for the current thread, returns the previous count */
+static unsigned int release_mutex( struct mutex *mutex )
+{
+    unsigned int count = get_sync_state( mutex->sync );
+
+    if (count > 1) add_sync_state( mutex->sync, -1 );
+    else do_release( mutex );
+    return count ? count : 1;
+}
+
 static struct mutex *create_mutex( struct object *root, const struct unicode_str *name,
                                    unsigned int attr, int owned, const struct security_descriptor *sd )
 {
@@ -110,7 +128,7 @@ static struct mutex *create_mutex( struct object *root, const struct unicode_str
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            mutex->count = 0;
+            mutex->sync = alloc_sync_slot( &mutex->private_sync, SYNC_TYPE_MUTEX );
             mutex->owner = NULL;
             mutex->abandoned = 0;
             if (owned) do_grab( mutex, current );
@@ -127,7 +145,6 @@ void abandon_mutexes( struct thread *thread )
     {
         struct mutex *mutex = LIST_ENTRY( ptr, struct mutex, entry );
         assert( mutex->owner == thread );
-        mutex->count = 0;
         mutex->abandoned = 1;
         do_release( mutex );
     }
@@ -137,7 +154,7 @@ static void mutex_dump( struct object *obj, int verbose )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    fprintf( stderr, "Mutex count=%u owner=%p\n", mutex->count, mutex->owner );
+    fprintf( stderr, "Mutex count=%u owner=%p\n", get_sync_state( mutex->sync ), mutex->owner );
 }
 
 static struct object_type *mutex_get_type( struct object *obj )
@@ -151,7 +168,7 @@ static int mutex_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
-    return (!mutex->count || (mutex->owner == get_wait_queue_thread( entry )));
+    return (!mutex->owner || (mutex->owner == get_wait_queue_thread( entry )));
 }
 
 static void mutex_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -183,23 +200,28 @@ static int mutex_signal( struct object *obj, unsigned int access )
         set_error( STATUS_ACCESS_DENIED );
         return 0;
     }
-    if (!mutex->count || (mutex->owner != current))
+    if (mutex->owner != current)
     {
         set_error( STATUS_MUTANT_NOT_OWNED );
         return 0;
     }
-    if (!--mutex->count) do_release( mutex );
+    release_mutex( mutex );
     return 1;
 }
 
+sync_slot_t *get_mutex_sync( struct object *obj )
+{
+    if (obj->ops != &mutex_ops) return NULL;
+    return ((struct mutex *)obj)->sync;
+}
+
 static void mutex_destroy( struct object *obj )
 {
     struct mutex *mutex = (struct mutex *)obj;
     assert( obj->ops == &mutex_ops );
 
-    if (!mutex->count) return;
-    mutex->count = 0;
-    do_release( mutex );
+    if (mutex->owner) do_release( mutex );
+    free_sync_slot( mutex->sync );
 }
 
 /* create a mutex */
@@ -243,12 +265,8 @@ DECL_HANDLER(release_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  0, &mutex_ops )))
     {
-        if (!mutex->count || (mutex->owner != current)) set_error( STATUS_MUTANT_NOT_OWNED );
-        else
-        {
-            reply->prev_count = mutex->count;
-            if (!--mutex->count) do_release( mutex );
-        }
+        if (mutex->owner != current) set_error( STATUS_MUTANT_NOT_OWNED );
+        else reply->prev_count = release_mutex( mutex );
         release_object( mutex );
     }
 }
@@ -261,7 +279,7 @@ DECL_HANDLER(query_mutex)
     if ((mutex = (struct mutex *)get_handle_obj( current->process, req->handle,
                                                  MUTANT_QUERY_STATE, &mutex_ops )))
     {
-        reply->count = mutex->count;
+        reply->count = mutex->owner ? get_sync_state( mutex->sync ) : 0;
         reply->owned = (mutex->owner == current);
         reply->abandoned = mutex->abandoned;
 
@@ -194,6 +194,20 @@ extern void pulse_event( struct event *event );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
 
+/* shared synchronization state functions */
+
+extern void init_sync_memory(void);
+extern sync_slot_t *alloc_sync_slot( sync_slot_t *fallback, unsigned int type );
+extern void free_sync_slot( sync_slot_t *slot );
+extern void notify_sync_handle_closed( struct process *process, struct object *obj );
+extern unsigned int get_sync_state( const sync_slot_t *slot );
+extern unsigned int set_sync_state( sync_slot_t *slot, unsigned int state );
+extern unsigned int add_sync_state( sync_slot_t *slot, int delta );
+extern void set_sync_waiters( sync_slot_t *slot, int waiters );
+extern sync_slot_t *get_event_sync( struct object *obj );
+extern sync_slot_t *get_semaphore_sync( struct object *obj );
+extern sync_slot_t *get_mutex_sync( struct object *obj );
+
 /* mutex functions */
 
 extern void abandon_mutexes( struct thread *thread );
@@ -531,6 +531,7 @@ struct thread *create_process( int fd, struct thread *parent_thread, int inherit
     process->peb             = 0;
     process->ldt_copy        = 0;
     process->dir_cache       = NULL;
+    process->close_sync      = NULL;
     process->winstation      = 0;
     process->desktop         = 0;
     process->token           = NULL;
@@ -644,6 +645,7 @@ static void process_destroy( struct object *obj )
     if (process->idle_event) release_object( process->idle_event );
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
+    if (process->close_sync) free_sync_slot( process->close_sync );
     free( process->dir_cache );
 }
 
@@ -82,6 +82,8 @@ struct key
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
+    struct name_index *subkey_index; /* hash index of the subkeys, NULL if there are few of them */
+    struct name_index *value_index;  /* hash index of the values, NULL if there are few of them */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
@@ -90,10 +92,13 @@ struct key
 /* key flags */
 #define KEY_VOLATILE 0x0001  /* key is volatile (not saved to disk) */
 #define KEY_DELETED  0x0002  /* key has been deleted */
-#define KEY_DIRTY    0x0004  /* key has been modified */
+#define KEY_DIRTY    0x0004  /* key or one of its subkeys has been modified */
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOW64    0x0010  /* key contains a Wow6432Node subkey */
 #define KEY_WOWSHARE 0x0020  /* key is a Wow64 shared key (used for Software\Classes) */
+#define KEY_CHANGED  0x0040  /* key values or class have been modified since the last save */
+#define KEY_SUBKEYS_UNSORTED 0x0080  /* subkeys array must be sorted before enumerating */
+#define KEY_VALUES_UNSORTED  0x0100  /* values array must be sorted before enumerating */
 
 /* a key value */
 struct key_value
@@ -107,6 +112,27 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_INDEXED  32  /* min. number of subkeys or values to maintain a hash index */
+
+/* Subkeys and values are kept sorted by name in their arrays, since that's
+ * the enumeration order, and looked up by binary search. Once a key has many
+ * of them, a hash index is used for lookups instead; new entries are then
+ * appended and the array is only sorted again when it gets enumerated.
+ * The index is updated in place when entries are removed, so that deleting
+ * a whole tree doesn't need to build it again for every key. */
+
+struct name_index_entry
+{
+    unsigned int      hash;    /* hash of the name */
+    int               pos;     /* position in the array plus 1, 0 if unused */
+};
+
+struct name_index
+{
+    unsigned int      mask;    /* number of entries minus 1 */
+    unsigned int      count;   /* number of used entries */
+    struct name_index_entry entries[1];
+};
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -123,15 +149,26 @@ static const WCHAR root_name[] = { '\\','R','e','g','i','s','t','r','y','\\' };
 static const WCHAR wow6432node[] = {'W','o','w','6','4','3','2','N','o','d','e'};
 static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n','k','V','a','l','u','e'};
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
+static unsigned int deleted_keys;  /* number of saved keys deleted so far */
 
 static void set_periodic_save_timer(void);
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index );
+static void sort_subkeys( struct key *key );
+static void sort_values( struct key *key );
+static void clear_values( struct key *key );
 
 /* information about where to save a registry branch */
 struct save_branch_info
 {
     struct key  *key;
     const char  *path;
+    char        *journal;       /* path of the journal of the changes since the last full save */
+    dev_t        dev;           /* device of the file written by the last full save */
+    ino_t        ino;           /* inode of the file written by the last full save */
+    off_t        file_size;     /* size of the file after the last full save, 0 if unknown */
+    unsigned long long mtime;   /* modification time in ns of the file after the last full save */
+    off_t        journal_size;  /* size of the journal, 0 if there is none */
+    unsigned int deleted_keys;  /* value of deleted_keys at the last full save */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
@@ -263,8 +300,31 @@ static void dump_value( const struct key_value *value, FILE *f )
     fputc( '\n', f );
 }
 
+/* save a single key and its values to a text file */
+/* with replace, the values replace the existing ones when the file is loaded */
+static void save_key( struct key *key, const struct key *base, FILE *f, int replace )
+{
+    int i;
+
+    sort_values( key );
+    fprintf( f, "\n[" );
+    if (key != base) dump_path( key, base, f );
+    fprintf( f, "] %u %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC),
+                             (unsigned int)((key->modif - ticks_1601_to_1970) % TICKS_PER_SEC) );
+    if (replace) fputs( "#replace\n", f );
+    fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+    for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+}
+
 /* save a registry and all its subkeys to a text file */
-static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
+static void save_subkeys( struct key *key, const struct key *base, FILE *f )
 {
     int i;
 
@@ -272,24 +332,21 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
     if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
-    {
-        fprintf( f, "\n[" );
-        if (key != base) dump_path( key, base, f );
-        fprintf( f, "] %u %u\n", (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC),
-                                 (unsigned int)((key->modif - ticks_1601_to_1970) % TICKS_PER_SEC) );
-        fprintf( f, "#time=%x%08x\n", (unsigned int)(key->modif >> 32), (unsigned int)key->modif );
-        if (key->class)
-        {
-            fprintf( f, "#class=\"" );
-            dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
-            fprintf( f, "\"\n" );
-        }
-        if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
-    }
+        save_key( key, base, f, 0 );
+    sort_subkeys( key );
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
 
+/* save the keys of a branch that changed since the last save to a text file */
+static void save_changed_keys( struct key *key, const struct key *base, FILE *f )
+{
+    int i;
+
+    if (!(key->flags & KEY_DIRTY) || (key->flags & KEY_VOLATILE)) return;
+    if (key->flags & KEY_CHANGED) save_key( key, base, f, 1 );
+    for (i = 0; i <= key->last_subkey; i++) save_changed_keys( key->subkeys[i], base, f );
+}
+
 static void dump_operation( const struct key *key, const struct key_value *value, const char *op )
 {
     fprintf( stderr, "%s key ", op );
@@ -438,12 +495,14 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    free( key->value_index );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_index );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -510,6 +569,8 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
+        key->subkey_index = NULL;
+        key->value_index = NULL;
         key->modif       = modif;
         key->parent      = NULL;
         list_init( &key->notify_list );
@@ -540,7 +601,7 @@ static void make_clean( struct key *key )
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    key->flags &= ~KEY_DIRTY;
+    key->flags &= ~(KEY_DIRTY | KEY_CHANGED);
     for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
 }
 
@@ -563,6 +624,7 @@ static void touch_key( struct key *key, unsigned int change )
     struct key *k;
 
     key->modif = current_time;
+    key->flags |= KEY_CHANGED;
     make_dirty( key );
 
     /* do notifications */
@@ -571,6 +633,203 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change & ~REG_NOTIFY_CHANGE_LAST_SET, 0 );
 }
 
+/* compute a case-insensitive hash of a name */
+static unsigned int hash_name( const WCHAR *name, data_size_t len )
+{
+    unsigned int i, hash = 0x811c9dc5;
+
+    for (i = 0; i < len / sizeof(WCHAR); i++) hash = (hash ^ tolowerW( name[i] )) * 0x01000193;
+    return hash;
+}
+
+/* compare two names in the order used for the subkeys and values arrays */
+static int compare_names( const WCHAR *name1, data_size_t len1, const WCHAR *name2, data_size_t len2 )
+{
+    int res = memicmpW( name1, name2, min( len1, len2 ) / sizeof(WCHAR) );
+    if (!res) res = len1 - len2;
+    return res;
+}
+
+typedef const WCHAR *(*get_name_func)( const struct key *key, int pos, data_size_t *len );
+
+static const WCHAR *get_subkey_name( const struct key *key, int pos, data_size_t *len )
+{
+    *len = key->subkeys[pos]->namelen;
+    return key->subkeys[pos]->name;
+}
+
+static const WCHAR *get_value_name( const struct key *key, int pos, data_size_t *len )
+{
+    *len = key->values[pos].namelen;
+    return key->values[pos].name;
+}
+
+/* allocate an empty name index large enough for count entries */
+/* failures are not reported, the arrays can always be searched without an index */
+static struct name_index *alloc_name_index( unsigned int count )
+{
+    struct name_index *index;
+    unsigned int size = 64;
+
+    while (size < 2 * count) size *= 2;
+    if (!(index = malloc( sizeof(*index) + (size - 1) * sizeof(index->entries[0]) ))) return NULL;
+    memset( index->entries, 0, size * sizeof(index->entries[0]) );
+    index->mask  = size - 1;
+    index->count = 0;
+    return index;
+}
+
+static void name_index_insert( struct name_index *index, unsigned int hash, int pos )
+{
+    unsigned int i;
+
+    for (i = hash & index->mask; index->entries[i].pos; i = (i + 1) & index->mask) ;
+    index->entries[i].hash = hash;
+    index->entries[i].pos  = pos + 1;
+    index->count++;
+}
+
+/* add an entry to a name index, growing it if needed; return 1 if OK, 0 on error */
+static int name_index_add( struct name_index **index, unsigned int hash, int pos )
+{
+    struct name_index *new_index, *old_index = *index;
+    unsigned int i;
+
+    if ((old_index->count + 1) * 2 > old_index->mask + 1)
+    {
+        if (!(new_index = alloc_name_index( old_index->count + 1 ))) return 0;
+        for (i = 0; i <= old_index->mask; i++)
+            if (old_index->entries[i].pos)
+                name_index_insert( new_index, old_index->entries[i].hash, old_index->entries[i].pos - 1 );
+        free( old_index );
+        *index = new_index;
+    }
+    name_index_insert( *index, hash, pos );
+    return 1;
+}
+
+/* build the name index of an array */
+static struct name_index *build_name_index( const struct key *key, int count, get_name_func get_name )
+{
+    struct name_index *index;
+    const WCHAR *name;
+    data_size_t len;
+    int i;
+
+    if (!(index = alloc_name_index( count ))) return NULL;
+    for (i = 0; i < count; i++)
+    {
+        name = get_name( key, i, &len );
+        name_index_insert( index, hash_name( name, len ), i );
+    }
+    return index;
+}
+
+/* find a name in the index and return its position in the array, -1 if not found */
+static int name_index_find( const struct name_index *index, const struct key *key, get_name_func get_name,
+                            const struct unicode_str *name )
+{
+    unsigned int i, hash = hash_name( name->str, name->len );
+    const WCHAR *str;
+    data_size_t len;
+
+    for (i = hash & index->mask; index->entries[i].pos; i = (i + 1) & index->mask)
+    {
+        if (index->entries[i].hash != hash) continue;
+        str = get_name( key, index->entries[i].pos - 1, &len );
+        if (!compare_names( str, len, name->str, name->len )) return index->entries[i].pos - 1;
+    }
+    return -1;
+}
+
+/* return the index entry of a given array position */
+static struct name_index_entry *name_index_lookup( struct name_index *index, unsigned int hash, int pos )
+{
+    unsigned int i;
+
+    for (i = hash & index->mask; index->entries[i].pos != pos + 1; i = (i + 1) & index->mask)
+        assert( index->entries[i].pos );
+    return &index->entries[i];
+}
+
+/* remove an entry, moving back the following ones so that no lookup chain is broken */
+static void name_index_remove( struct name_index *index, unsigned int hash, int pos )
+{
+    unsigned int i, j, home;
+
+    i = name_index_lookup( index, hash, pos ) - index->entries;
+    for (j = (i + 1) & index->mask; index->entries[j].pos; j = (j + 1) & index->mask)
+    {
+        home = index->entries[j].hash & index->mask;
+        if (((j - home) & index->mask) < ((j - i) & index->mask)) continue;
+        index->entries[i] = index->entries[j];
+        i = j;
+    }
+    index->entries[i].pos = 0;
+    index->count--;
+}
+
+/* update the index after the entries following pos have been moved back by one */
+static void name_index_shift( struct name_index *index, int pos )
+{
+    unsigned int i;
+
+    for (i = 0; i <= index->mask; i++)
+        if (index->entries[i].pos > pos + 1) index->entries[i].pos--;
+}
+
+static int compare_subkeys( const void *p1, const void *p2 )
+{
+    const struct key *key1 = *(const struct key * const *)p1;
+    const struct key *key2 = *(const struct key * const *)p2;
+    return compare_names( key1->name, key1->namelen, key2->name, key2->namelen );
+}
+
+static int compare_values( const void *p1, const void *p2 )
+{
+    const struct key_value *value1 = p1;
+    const struct key_value *value2 = p2;
+    return compare_names( value1->name, value1->namelen, value2->name, value2->namelen );
+}
+
+/* restore the order of the subkeys array after subkeys have been appended */
+static void sort_subkeys( struct key *key )
+{
+    if (!(key->flags & KEY_SUBKEYS_UNSORTED)) return;
+    qsort( key->subkeys, key->last_subkey + 1, sizeof(*key->subkeys), compare_subkeys );
+    key->flags &= ~KEY_SUBKEYS_UNSORTED;
+    if (!key->subkey_index) return;
+    free( key->subkey_index );
+    key->subkey_index = build_name_index( key, key->last_subkey + 1, get_subkey_name );
+}
+
+/* restore the order of the values array after values have been appended */
+static void sort_values( struct key *key )
+{
+    if (!(key->flags & KEY_VALUES_UNSORTED)) return;
+    qsort( key->values, key->last_value + 1, sizeof(*key->values), compare_values );
+    key->flags &= ~KEY_VALUES_UNSORTED;
+    if (!key->value_index) return;
+    free( key->value_index );
+    key->value_index = build_name_index( key, key->last_value + 1, get_value_name );
+}
+
+/* go back to binary searching the subkeys */
+static void drop_subkey_index( struct key *key )
+{
+    free( key->subkey_index );
+    key->subkey_index = NULL;
+    sort_subkeys( key );
+}
+
+/* go back to binary searching the values */
+static void drop_value_index( struct key *key )
+{
+    free( key->value_index );
+    key->value_index = NULL;
+    sort_values( key );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -619,6 +878,16 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (parent->subkey_index)
+        {
+            /* with an index, new subkeys are always appended */
+            if (index && compare_subkeys( &parent->subkeys[index - 1], &key ) > 0)
+                parent->flags |= KEY_SUBKEYS_UNSORTED;
+            if (!name_index_add( &parent->subkey_index, hash_name( key->name, key->namelen ), index ))
+                drop_subkey_index( parent );
+        }
+        else if (parent->last_subkey + 1 >= MIN_INDEXED)
+            parent->subkey_index = build_name_index( parent, parent->last_subkey + 1, get_subkey_name );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -635,8 +904,28 @@ static void free_subkey( struct key *parent, int index )
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
-    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+    if (parent->flags & KEY_SUBKEYS_UNSORTED)
+    {
+        /* the order doesn't matter, move the last subkey into the hole */
+        struct key *last = parent->subkeys[parent->last_subkey];
+        name_index_remove( parent->subkey_index, hash_name( key->name, key->namelen ), index );
+        if (index < parent->last_subkey)
+            name_index_lookup( parent->subkey_index, hash_name( last->name, last->namelen ),
+                               parent->last_subkey )->pos = index + 1;
+        parent->subkeys[index] = last;
+    }
+    else
+    {
+        for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+        if (parent->subkey_index)
+        {
+            name_index_remove( parent->subkey_index, hash_name( key->name, key->namelen ), index );
+            if (index < parent->last_subkey) name_index_shift( parent->subkey_index, index );
+        }
+    }
     parent->last_subkey--;
+    if (parent->subkey_index && parent->last_subkey + 1 < MIN_INDEXED / 2) drop_subkey_index( parent );
+    if (!(key->flags & KEY_VOLATILE)) deleted_keys++;
     key->flags |= KEY_DELETED;
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
@@ -659,16 +948,24 @@ static void free_subkey( struct key *parent, int index )
 static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
+
+    if (key->subkey_index)
+    {
+        if ((i = name_index_find( key->subkey_index, key, get_subkey_name, name )) >= 0)
+        {
+            *index = i;
+            return key->subkeys[i];
+        }
+        *index = key->last_subkey + 1;  /* new subkeys are appended */
+        return NULL;
+    }
 
     min = 0;
     max = key->last_subkey;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->subkeys[i]->namelen, name->len );
-        res = memicmpW( key->subkeys[i]->name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->subkeys[i]->namelen - name->len;
+        res = compare_names( key->subkeys[i]->name, key->subkeys[i]->namelen, name->str, name->len );
         if (!res)
         {
             *index = i;
@@ -836,7 +1133,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
 
     if (options & REG_OPTION_CREATE_LINK) key->flags |= KEY_SYMLINK;
     if (options & REG_OPTION_VOLATILE) key->flags |= KEY_VOLATILE;
-    else key->flags |= KEY_DIRTY;
+    else key->flags |= KEY_DIRTY | KEY_CHANGED;
 
     if (sd) default_set_sd( &key->obj, sd, OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION |
                             DACL_SECURITY_INFORMATION | SACL_SECURITY_INFORMATION );
@@ -897,7 +1194,7 @@ static struct key *create_key_recursive( struct key *key, const struct unicode_s
 }
 
 /* query information about a key or a subkey */
-static void enum_key( const struct key *key, int index, int info_class,
+static void enum_key( struct key *key, int index, int info_class,
                       struct enum_key_reply *reply )
 {
     static const WCHAR backslash[] = { '\\' };
@@ -915,6 +1212,7 @@ static void enum_key( const struct key *key, int index, int info_class,
             set_error( STATUS_NO_MORE_ENTRIES );
             return;
         }
+        sort_subkeys( key );
         key = key->subkeys[index];
     }
 
@@ -1007,6 +1305,7 @@ static int delete_key( struct key *key, int recurse )
 {
     int index;
     struct key *parent = key->parent;
+    struct unicode_str name;
 
     /* must find parent and index */
     if (key == root_key)
@@ -1020,9 +1319,10 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    name.str = key->name;
+    name.len = key->namelen;
+    find_subkey( parent, &name, &index );
+    assert( index <= parent->last_subkey && parent->subkeys[index] == key );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -1066,16 +1366,24 @@ static int grow_values( struct key *key )
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
+
+    if (key->value_index)
+    {
+        if ((i = name_index_find( key->value_index, key, get_value_name, name )) >= 0)
+        {
+            *index = i;
+            return &key->values[i];
+        }
+        *index = key->last_value + 1;  /* new values are appended */
+        return NULL;
+    }
 
     min = 0;
     max = key->last_value;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->values[i].namelen, name->len );
-        res = memicmpW( key->values[i].name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->values[i].namelen - name->len;
+        res = compare_names( key->values[i].name, key->values[i].namelen, name->str, name->len );
         if (!res)
         {
             *index = i;
@@ -1111,6 +1419,20 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     value->namelen = name->len;
     value->len     = 0;
     value->data    = NULL;
+    if (key->value_index)
+    {
+        /* with an index, new values are always appended */
+        if (index && compare_values( &key->values[index - 1], value ) > 0)
+            key->flags |= KEY_VALUES_UNSORTED;
+        if (!name_index_add( &key->value_index, hash_name( name->str, name->len ), index ))
+        {
+            drop_value_index( key );
+            find_value( key, name, &index );
+            value = &key->values[index];
+        }
+    }
+    else if (key->last_value + 1 >= MIN_INDEXED)
+        key->value_index = build_name_index( key, key->last_value + 1, get_value_name );
     return value;
 }
 
@@ -1193,6 +1515,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         void *data;
         data_size_t namelen, maxlen;
 
+        sort_values( key );
         value = &key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
@@ -1247,8 +1570,27 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     if (debug_level > 1) dump_operation( key, value, "Delete" );
     free( value->name );
     free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
+    if (key->flags & KEY_VALUES_UNSORTED)
+    {
+        /* the order doesn't matter, move the last value into the hole */
+        struct key_value *last = &key->values[key->last_value];
+        name_index_remove( key->value_index, hash_name( name->str, name->len ), index );
+        if (index < key->last_value)
+            name_index_lookup( key->value_index, hash_name( last->name, last->namelen ),
+                               key->last_value )->pos = index + 1;
+        key->values[index] = *last;
+    }
+    else
+    {
+        for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
+        if (key->value_index)
+        {
+            name_index_remove( key->value_index, hash_name( name->str, name->len ), index );
+            if (index < key->last_value) name_index_shift( key->value_index, index );
+        }
+    }
     key->last_value--;
+    if (key->value_index && key->last_value + 1 < MIN_INDEXED / 2) drop_value_index( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
     /* try to shrink the array */
@@ -1264,6 +1606,22 @@ static void delete_value( struct key *key, const struct unicode_str *name )
     }
 }
 
+/* delete all the values of a key */
+static void clear_values( struct key *key )
+{
+    int i;
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        free( key->values[i].name );
+        free( key->values[i].data );
+    }
+    key->last_value = -1;
+    key->flags &= ~KEY_VALUES_UNSORTED;
+    free( key->value_index );
+    key->value_index = NULL;
+}
+
 /* get the registry key corresponding to an hkey handle */
 static struct key *get_hkey_obj( obj_handle_t hkey, unsigned int access )
 {
@@ -1462,6 +1820,12 @@ static int load_key_option( struct key *key, const char *buffer, struct file_loa
     const char *p;
     data_size_t len;
 
+    if (!strncmp( buffer, "#replace", 8 ))
+    {
+        /* the key was saved again after a change, the values that follow replace the current ones */
+        clear_values( key );
+        key->modif = 0;
+    }
     if (!strncmp( buffer, "#time=", 6 ))
     {
         timeout_t modif = 0;
@@ -1735,9 +2099,126 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* The periodic saves append the keys changed since the last full save of a
+ * branch to a separate journal file, as records protected by a checksum. The
+ * journal starts with the identity of the file it applies to, so that it is
+ * ignored once that file has been replaced by a newer full save. Each record
+ * replaces the whole contents of its keys, so a torn record at the end can be
+ * dropped and records can be replayed more than once. */
+
+/* compute the checksum of a journal record (CRC-32) */
+static unsigned int journal_checksum( const char *data, size_t len )
+{
+    unsigned int crc = ~0u;
+    size_t i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (unsigned char)data[i];
+        for (bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/* return the modification time of a file in nanoseconds */
+static unsigned long long get_file_mtime( const struct stat *st )
+{
+    unsigned long long mtime = (unsigned long long)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime += st->st_mtimespec.tv_nsec;
+#endif
+    return mtime;
+}
+
+/* remember the identity of the file that the journal applies to */
+static void set_journal_base( struct save_branch_info *info, const struct stat *st )
+{
+    info->dev       = st->st_dev;
+    info->ino       = st->st_ino;
+    info->file_size = st->st_size;
+    info->mtime     = get_file_mtime( st );
+}
+
+/* check whether the file is still the one written by the last full save */
+static int is_journal_base( const struct save_branch_info *info, const struct stat *st )
+{
+    return (info->file_size && st->st_dev == info->dev && st->st_ino == info->ino &&
+            st->st_size == info->file_size && get_file_mtime( st ) == info->mtime);
+}
+
+/* format the first line of the journal file */
+static int format_journal_header( const struct save_branch_info *info, char *buffer )
+{
+    return sprintf( buffer, "WINE REGISTRY Journal %llx %llx %llx %llx\n",
+                    (unsigned long long)info->dev, (unsigned long long)info->ino,
+                    (unsigned long long)info->file_size, info->mtime );
+}
+
+/* replay the journal of a registry branch */
+static void load_journal( struct save_branch_info *info )
+{
+    char header[128], *data = NULL, *p, *end;
+    unsigned int len, sum;
+    struct stat st;
+    int fd, pos;
+    FILE *f;
+
+    info->journal_size = 0;
+    if ((fd = open( info->journal, O_RDWR )) == -1) return;
+
+    if (fstat( fd, &st ) || !(data = malloc( st.st_size + 1 )) ||
+        read( fd, data, st.st_size ) != st.st_size || !(f = tmpfile()))
+    {
+        fprintf( stderr, "%s: could not read journal\n", info->journal );
+        info->file_size = 0;  /* only do full saves from now on */
+        goto done;
+    }
+
+    /* a journal that doesn't match the file was written before its last full save */
+    len = format_journal_header( info, header );
+    if (!info->file_size || st.st_size < len || memcmp( data, header, len ))
+    {
+        unlink( info->journal );
+        fclose( f );
+        goto done;
+    }
+    data[st.st_size] = 0;
+    end = data + st.st_size;
+
+    fputs( "WINE REGISTRY Version 2\n", f );
+    for (p = data + len; p < end; p += pos + len)
+    {
+        pos = 0;
+        if (sscanf( p, "#record %x %x\n%n", &len, &sum, &pos ) != 2 || !pos) break;
+        if (len > end - p - pos || journal_checksum( p + pos, len ) != sum) break;
+        fwrite( p + pos, 1, len, f );
+    }
+    if (p < end)
+    {
+        /* the last save was interrupted, the record is dropped */
+        fprintf( stderr, "%s: ignoring incomplete record at offset %lu\n",
+                 info->journal, (unsigned long)(p - data) );
+        ftruncate( fd, p - data );  /* if this fails, the next save is a full one */
+    }
+    info->journal_size = p - data;
+
+    rewind( f );
+    load_keys( info->key, info->journal, f, 0 );
+    fclose( f );
+
+done:
+    free( data );
+    close( fd );
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
+    struct save_branch_info *info;
+    struct stat st;
     FILE *f;
 
     if ((f = fopen( filename, "r" )))
@@ -1753,8 +2234,17 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
+    info->file_size = 0;
+    if (f && !stat( filename, &st ) && S_ISREG(st.st_mode)) set_journal_base( info, &st );
+    if ((info->journal = malloc( strlen( filename ) + sizeof(".journal") )))
+    {
+        sprintf( info->journal, "%s.journal", filename );
+        load_journal( info );
+    }
+    info->deleted_keys = deleted_keys;
     make_object_static( &key->obj );
     return (f != NULL);
 }
@@ -1937,9 +2427,69 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* append the keys changed since the last save of a branch to its journal; return 1 if OK */
+static int save_branch_journal( struct save_branch_info *info )
+{
+    char header[128], *data = NULL;
+    off_t journal_size = info->journal_size;
+    struct stat st;
+    long size;
+    int fd = -1, len, ret = 0;
+    FILE *f;
+
+    /* deleted keys can't be expressed in the journal, and it must not grow too large */
+    if (deleted_keys != info->deleted_keys || !info->journal || info->journal_size > info->file_size / 2)
+        return 0;
+    /* the file may have been modified by someone else */
+    if (stat( info->path, &st ) || !is_journal_base( info, &st )) return 0;
+
+    if (!(f = tmpfile())) return 0;
+    save_changed_keys( info->key, info->key, f );
+    if (fflush( f ) || (size = ftell( f )) < 0) goto done;
+    if (!size)
+    {
+        ret = 1;
+        goto done;
+    }
+    if (!(data = malloc( size ))) goto done;
+    rewind( f );
+    if (fread( data, 1, size, f ) != size) goto done;
+
+    if (journal_size) fd = open( info->journal, O_WRONLY | O_APPEND );
+    else fd = open( info->journal, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if (fd == -1 || fstat( fd, &st ) || st.st_size != journal_size) goto done;
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", info->journal );
+        dump_operation( info->key, NULL, "appending" );
+    }
+
+    if (!journal_size)
+    {
+        len = format_journal_header( info, header );
+        if (write( fd, header, len ) != len) goto done;
+        journal_size = len;
+    }
+    len = sprintf( header, "#record %x %08x\n", (unsigned int)size, journal_checksum( data, size ) );
+    if (write( fd, header, len ) != len || write( fd, data, size ) != size) goto done;
+    if (fsync( fd )) goto done;
+    info->journal_size = journal_size + len + size;
+    ret = 1;
+
+done:
+    /* after a failure, the size doesn't match anymore and the next save is a full one */
+    if (fd != -1) close( fd );
+    free( data );
+    fclose( f );
+    return ret;
+}
+
 /* save a registry branch to a file */
-static int save_branch( struct key *key, const char *path )
+static int save_branch( struct save_branch_info *info )
 {
+    struct key *key = info->key;
+    const char *path = info->path;
     struct stat st;
     char *p, *tmp = NULL;
     int fd, count = 0, ret = 0;
@@ -1951,6 +2501,12 @@ static int save_branch( struct key *key, const char *path )
         return 1;
     }
 
+    if (save_branch_journal( info ))
+    {
+        ret = 1;
+        goto done;
+    }
+
     /* test the file type */
 
     if ((fd = open( path, O_WRONLY )) != -1)
@@ -1959,6 +2515,9 @@ static int save_branch( struct key *key, const char *path )
          * via symbolic links, write directly into it; otherwise use a temp file */
         if (!lstat( path, &st ) && (!S_ISREG(st.st_mode) || st.st_nlink > 1))
         {
+            /* the journal applied to the previous contents */
+            if (info->journal) unlink( info->journal );
+            info->file_size = 0;
             ftruncate( fd, 0 );
             goto save;
         }
@@ -1996,7 +2555,9 @@ static int save_branch( struct key *key, const char *path )
     }
 
     save_all_subkeys( key, f );
-    ret = !fclose(f);
+    /* the journal is written on top of this file, it has to be on disk first */
+    ret = !fflush( f ) && (!tmp || !fsync( fileno( f )));
+    if (fclose( f )) ret = 0;
 
     if (tmp)
     {
@@ -2005,6 +2566,16 @@ static int save_branch( struct key *key, const char *path )
         if (!ret) unlink( tmp );
     }
 
+    if (ret)
+    {
+        /* a leftover journal is ignored when loading since the file changed */
+        if (info->journal) unlink( info->journal );
+        info->file_size = 0;
+        if (tmp && !stat( path, &st )) set_journal_base( info, &st );
+        info->journal_size = 0;
+        info->deleted_keys = deleted_keys;
+    }
+
 done:
     free( tmp );
     if (ret) make_clean( key );
@@ -2018,8 +2589,7 @@ static void periodic_save( void *arg )
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    for (i = 0; i < save_branch_count; i++) save_branch( &save_branch_info[i] );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2039,7 +2609,7 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        if (!save_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].path );
@@ -160,6 +160,8 @@ DECL_HANDLER(get_handle_unix_name);
 DECL_HANDLER(get_handle_fd);
 DECL_HANDLER(get_directory_cache_entry);
 DECL_HANDLER(get_shared_memory);
+DECL_HANDLER(get_sync_memory);
+DECL_HANDLER(get_sync_slot);
 DECL_HANDLER(flush);
 DECL_HANDLER(lock_file);
 DECL_HANDLER(unlock_file);
@@ -259,6 +261,9 @@ DECL_HANDLER(get_serial_info);
 DECL_HANDLER(set_serial_info);
 DECL_HANDLER(register_async);
 DECL_HANDLER(cancel_async);
+DECL_HANDLER(complete_async);
+DECL_HANDLER(claim_async_batch);
+DECL_HANDLER(set_async_results);
 DECL_HANDLER(get_async_result);
 DECL_HANDLER(read);
 DECL_HANDLER(write);
@@ -454,6 +459,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_handle_fd,
     (req_handler)req_get_directory_cache_entry,
     (req_handler)req_get_shared_memory,
+    (req_handler)req_get_sync_memory,
+    (req_handler)req_get_sync_slot,
     (req_handler)req_flush,
     (req_handler)req_lock_file,
     (req_handler)req_unlock_file,
@@ -553,6 +560,9 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_set_serial_info,
     (req_handler)req_register_async,
     (req_handler)req_cancel_async,
+    (req_handler)req_complete_async,
+    (req_handler)req_claim_async_batch,
+    (req_handler)req_set_async_results,
     (req_handler)req_get_async_result,
     (req_handler)req_read,
     (req_handler)req_write,
@@ -1026,6 +1036,15 @@ C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_reply, entry) == 8 );
 C_ASSERT( sizeof(struct get_directory_cache_entry_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_shared_memory_request, tid) == 12 );
 C_ASSERT( sizeof(struct get_shared_memory_request) == 16 );
+C_ASSERT( sizeof(struct get_sync_memory_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_memory_reply, close_slot) == 8 );
+C_ASSERT( sizeof(struct get_sync_memory_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_slot_request, handle) == 12 );
+C_ASSERT( sizeof(struct get_sync_slot_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_slot_reply, slot) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_slot_reply, type) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_sync_slot_reply, access) == 16 );
+C_ASSERT( sizeof(struct get_sync_slot_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct flush_request, blocking) == 12 );
 C_ASSERT( FIELD_OFFSET(struct flush_request, async) == 16 );
 C_ASSERT( sizeof(struct flush_request) == 56 );
@@ -1600,6 +1619,16 @@ C_ASSERT( FIELD_OFFSET(struct cancel_async_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, iosb) == 16 );
 C_ASSERT( FIELD_OFFSET(struct cancel_async_request, only_thread) == 24 );
 C_ASSERT( sizeof(struct cancel_async_request) == 32 );
+C_ASSERT( FIELD_OFFSET(struct complete_async_request, iosb) == 16 );
+C_ASSERT( FIELD_OFFSET(struct complete_async_request, arg) == 24 );
+C_ASSERT( FIELD_OFFSET(struct complete_async_request, status) == 32 );
+C_ASSERT( FIELD_OFFSET(struct complete_async_request, total) == 40 );
+C_ASSERT( sizeof(struct complete_async_request) == 48 );
+C_ASSERT( FIELD_OFFSET(struct claim_async_batch_request, iosb) == 16 );
+C_ASSERT( FIELD_OFFSET(struct claim_async_batch_request, arg) == 24 );
+C_ASSERT( sizeof(struct claim_async_batch_request) == 32 );
+C_ASSERT( sizeof(struct claim_async_batch_reply) == 8 );
+C_ASSERT( sizeof(struct set_async_results_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_request, user_arg) == 16 );
 C_ASSERT( sizeof(struct get_async_result_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_reply, size) == 8 );
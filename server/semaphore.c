@@ -38,25 +38,29 @@
 
 struct semaphore
 {
-    struct object  obj;    /* object header */
-    unsigned int   count;  /* current count */
-    unsigned int   max;    /* maximum possible count */
+    struct object  obj;           /* object header */
+    unsigned int   max;           /* maximum possible count */
+    sync_slot_t   *sync;          /* current count, shared with the clients */
+    sync_slot_t    private_sync;  /* count storage if no shared slot is available */
 };
 
 static void semaphore_dump( struct object *obj, int verbose );
 static struct object_type *semaphore_get_type( struct object *obj );
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry );
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access );
 static int semaphore_signal( struct object *obj, unsigned int access );
+static void semaphore_destroy( struct object *obj );
 
 static const struct object_ops semaphore_ops =
 {
     sizeof(struct semaphore),      /* size */
     semaphore_dump,                /* dump */
     semaphore_get_type,            /* get_type */
-    add_queue,                     /* add_queue */
-    remove_queue,                  /* remove_queue */
+    semaphore_add_queue,           /* add_queue */
+    semaphore_remove_queue,        /* remove_queue */
     semaphore_signaled,            /* signaled */
     semaphore_satisfied,           /* satisfied */
     semaphore_signal,              /* signal */
@@ -70,7 +74,7 @@ static const struct object_ops semaphore_ops =
     no_open_file,                  /* open_file */
     no_alloc_handle,               /* alloc_handle */
     no_close_handle,               /* close_handle */
-    no_destroy                     /* destroy */
+    semaphore_destroy              /* destroy */
 };
 
 
@@ -90,8 +94,10 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
         if (get_error() != STATUS_OBJECT_NAME_EXISTS)
         {
             /* initialize it if it didn't already exist */
-            sem->count = initial;
-            sem->max   = max;
+            sem->max  = max;
+            sem->sync = alloc_sync_slot( &sem->private_sync, SYNC_TYPE_SEMAPHORE );
+            sem->sync->max = max;
+            set_sync_state( sem->sync, initial );
         }
     }
     return sem;
@@ -100,30 +106,37 @@ static struct semaphore *create_semaphore( struct object *root, const struct uni
 static int release_semaphore( struct semaphore *sem, unsigned int count,
                               unsigned int *prev )
 {
-    if (prev) *prev = sem->count;
-    if (sem->count + count < sem->count || sem->count + count > sem->max)
-    {
-        set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
-        return 0;
-    }
-    else if (sem->count)
-    {
-        /* there cannot be any thread to wake up if the count is != 0 */
-        sem->count += count;
-    }
-    else
+    unsigned int old, cur;
+
+    /* the clients may change the count behind our back while nobody is waiting */
+    do
     {
-        sem->count = count;
-        wake_up( &sem->obj, count );
-    }
+        old = *(volatile unsigned int *)&sem->sync->state;
+        cur = old & ~SYNC_WAITERS;
+        if (prev) *prev = cur;
+        if (cur + count < cur || cur + count > sem->max)
+        {
+            set_error( STATUS_SEMAPHORE_LIMIT_EXCEEDED );
+            return 0;
+        }
+    } while (interlocked_cmpxchg( (int *)&sem->sync->state, old + count, old ) != old);
+
+    /* there cannot be any thread to wake up if the count was != 0 */
+    if (!cur) wake_up( &sem->obj, count );
     return 1;
 }
 
+sync_slot_t *get_semaphore_sync( struct object *obj )
+{
+    if (obj->ops != &semaphore_ops) return NULL;
+    return ((struct semaphore *)obj)->sync;
+}
+
 static void semaphore_dump( struct object *obj, int verbose )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    fprintf( stderr, "Semaphore count=%d max=%d\n", sem->count, sem->max );
+    fprintf( stderr, "Semaphore count=%d max=%d\n", get_sync_state( sem->sync ), sem->max );
 }
 
 static struct object_type *semaphore_get_type( struct object *obj )
@@ -133,19 +146,37 @@ static struct object_type *semaphore_get_type( struct object *obj )
     return get_object_type( &str );
 }
 
+static int semaphore_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    /* must be visible to the clients before the count is checked */
+    set_sync_waiters( sem->sync, 1 );
+    return add_queue( obj, entry );
+}
+
+static void semaphore_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    if (list_head( &obj->wait_queue ) == &entry->entry && list_tail( &obj->wait_queue ) == &entry->entry)
+        set_sync_waiters( sem->sync, 0 );
+    remove_queue( obj, entry );
+}
+
 static int semaphore_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    return (sem->count > 0);
+    return (get_sync_state( sem->sync ) > 0);
 }
 
 static void semaphore_satisfied( struct object *obj, struct wait_queue_entry *entry )
 {
     struct semaphore *sem = (struct semaphore *)obj;
     assert( obj->ops == &semaphore_ops );
-    assert( sem->count );
-    sem->count--;
+    /* the clients don't touch the count while we have waiters, but don't trust them */
+    if (get_sync_state( sem->sync )) add_sync_state( sem->sync, -1 );
 }
 
 static unsigned int semaphore_map_access( struct object *obj, unsigned int access )
@@ -170,6 +201,13 @@ static int semaphore_signal( struct object *obj, unsigned int access )
     return release_semaphore( sem, 1, NULL );
 }
 
+static void semaphore_destroy( struct object *obj )
+{
+    struct semaphore *sem = (struct semaphore *)obj;
+    assert( obj->ops == &semaphore_ops );
+    free_sync_slot( sem->sync );
+}
+
 /* create a semaphore */
 DECL_HANDLER(create_semaphore)
 {
@@ -224,7 +262,7 @@ DECL_HANDLER(query_semaphore)
     if ((sem = (struct semaphore *)get_handle_obj( current->process, req->handle,
                                                    SEMAPHORE_QUERY_STATE, &semaphore_ops )))
     {
-        reply->current = sem->count;
+        reply->current = get_sync_state( sem->sync );
         reply->max = sem->max;
         release_object( sem );
     }
@@ -0,0 +1,208 @@
+/*
+ * Synchronization object state shared with the clients
+ *
+ * Copyright (C) 2017 Wine Project
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Events, semaphores and mutexes keep their state in a slot of a memory
+ * block that every client maps read-write, so that the uncontended
+ * operations can be done in the client without a server round trip.
+ *
+ * The server stays the authority for anything involving a wait queue: as
+ * soon as a thread waits on an event or a semaphore in the server, the
+ * SYNC_WAITERS bit is set in the slot state and the clients send every
+ * state change to the server until the wait queue is empty again. All
+ * changes are made with compare-and-swap so that the bit is never lost.
+ *
+ * Objects created when no slot is available use a private slot embedded in
+ * the object, which the clients never see.
+ *
+ * The clients cache the slot of each handle. They forget it when they close
+ * the handle themselves, but a handle can also be closed by another process
+ * with DUPLICATE_CLOSE_SOURCE and then reused for a different object. Every
+ * process has a counter slot that is incremented when that happens, and the
+ * clients drop their whole cache when it changes.
+ *
+ * The clients can write anything to the shared block, so the server never
+ * trusts it for its own bookkeeping: the free list and the slot types are
+ * kept in server memory. */
+
+#include "config.h"
+#include "wine/port.h"
+
+#include <assert.h>
+#include <stdarg.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+
+#include "file.h"
+#include "handle.h"
+#include "process.h"
+#include "thread.h"
+#include "request.h"
+
+static sync_slot_t *sync_slots;      /* shared slots, NULL if not supported */
+static int sync_slots_fd = -1;       /* file descriptor for the shared slots */
+static unsigned int sync_free_slot;  /* head of the free list, 0 if empty */
+static unsigned int sync_next_free[SYNC_SLOT_COUNT];  /* free list links, private to the server */
+
+/* initialize the shared slots and their free list */
+void init_sync_memory(void)
+{
+    unsigned int i;
+
+    if (!allocate_shared_memory( &sync_slots_fd, (void **)&sync_slots,
+                                 SYNC_SLOT_COUNT * sizeof(*sync_slots) ))
+        return;
+
+    /* slot 0 is never used so that the clients can use it as "no slot" */
+    for (i = 1; i < SYNC_SLOT_COUNT - 1; i++) sync_next_free[i] = i + 1;
+    sync_next_free[SYNC_SLOT_COUNT - 1] = 0;
+    sync_free_slot = 1;
+}
+
+/* return the index of a slot in the shared block, 0 for private slots */
+static unsigned int get_sync_slot_index( const sync_slot_t *slot )
+{
+    if (!sync_slots || slot <= sync_slots || slot >= sync_slots + SYNC_SLOT_COUNT) return 0;
+    return slot - sync_slots;
+}
+
+/* allocate a shared slot, or return the object's private one if there are none left */
+sync_slot_t *alloc_sync_slot( sync_slot_t *fallback, unsigned int type )
+{
+    sync_slot_t *slot = fallback;
+
+    if (sync_free_slot)
+    {
+        assert( sync_free_slot < SYNC_SLOT_COUNT );
+        slot = &sync_slots[sync_free_slot];
+        sync_free_slot = sync_next_free[sync_free_slot];
+    }
+    slot->state = 0;
+    slot->max   = 0;
+    slot->owner = 0;
+    slot->type  = type;
+    return slot;
+}
+
+/* return a slot to the free list */
+void free_sync_slot( sync_slot_t *slot )
+{
+    unsigned int index = get_sync_slot_index( slot );
+
+    slot->type  = SYNC_TYPE_NONE;
+    slot->state = 0;
+    if (!index) return;
+    slot->owner = 0;
+    sync_next_free[index] = sync_free_slot;
+    sync_free_slot = index;
+}
+
+/* return the state without the waiters bit */
+unsigned int get_sync_state( const sync_slot_t *slot )
+{
+    return *(volatile const unsigned int *)&slot->state & ~SYNC_WAITERS;
+}
+
+/* set the state, preserving the waiters bit; returns the previous state */
+unsigned int set_sync_state( sync_slot_t *slot, unsigned int state )
+{
+    unsigned int old;
+
+    do old = *(volatile unsigned int *)&slot->state;
+    while (interlocked_cmpxchg( (int *)&slot->state, (old & SYNC_WAITERS) | state, old ) != old);
+    return old & ~SYNC_WAITERS;
+}
+
+/* add to the state, preserving the waiters bit; returns the previous state */
+unsigned int add_sync_state( sync_slot_t *slot, int delta )
+{
+    unsigned int old;
+
+    do old = *(volatile unsigned int *)&slot->state;
+    while (interlocked_cmpxchg( (int *)&slot->state,
+                                (old & SYNC_WAITERS) | ((old + delta) & ~SYNC_WAITERS), old ) != old);
+    return old & ~SYNC_WAITERS;
+}
+
+/* tell the clients whether state changes have to go through the server */
+void set_sync_waiters( sync_slot_t *slot, int waiters )
+{
+    unsigned int old;
+
+    do old = *(volatile unsigned int *)&slot->state;
+    while (interlocked_cmpxchg( (int *)&slot->state,
+                                waiters ? old | SYNC_WAITERS : old & ~SYNC_WAITERS, old ) != old);
+}
+
+/* tell the owner of a handle to a synchronization object that another process closed it */
+void notify_sync_handle_closed( struct process *process, struct object *obj )
+{
+    if (!process->close_sync) return;
+    /* the client forgets the handles it closes itself */
+    if (current && current->process == process) return;
+    if (get_event_sync( obj ) || get_semaphore_sync( obj ) || get_mutex_sync( obj ))
+        add_sync_state( process->close_sync, 1 );
+}
+
+/* get file descriptor for the shared synchronization state */
+DECL_HANDLER(get_sync_memory)
+{
+    struct process *process = current->process;
+
+    if (sync_slots_fd == -1)
+    {
+        set_error( STATUS_NOT_SUPPORTED );
+        return;
+    }
+    if (!process->close_sync)
+        process->close_sync = alloc_sync_slot( &process->close_sync_private, SYNC_TYPE_NONE );
+    reply->close_slot = get_sync_slot_index( process->close_sync );
+    send_client_fd( process, sync_slots_fd, 0 );
+}
+
+/* get the shared state of a synchronization object */
+DECL_HANDLER(get_sync_slot)
+{
+    struct object *obj;
+    sync_slot_t *slot;
+    unsigned int type = SYNC_TYPE_NONE;
+
+    if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
+
+    /* don't trust the type stored in the shared slot */
+    if ((slot = get_event_sync( obj ))) type = SYNC_TYPE_EVENT;
+    else if ((slot = get_semaphore_sync( obj ))) type = SYNC_TYPE_SEMAPHORE;
+    else if ((slot = get_mutex_sync( obj ))) type = SYNC_TYPE_MUTEX;
+
+    if (slot)
+    {
+        reply->slot = get_sync_slot_index( slot );
+        reply->type = type;
+    }
+    else
+    {
+        reply->slot = 0;
+        reply->type = SYNC_TYPE_NONE;
+    }
+    reply->access = get_handle_access( current->process, req->handle );
+    release_object( obj );
+}
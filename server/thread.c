@@ -210,6 +210,7 @@ static inline void init_thread_structure( struct thread *thread )
     list_init( &thread->mutex_list );
     list_init( &thread->system_apc );
     list_init( &thread->user_apc );
+    list_init( &thread->claimed_asyncs );
 
     for (i = 0; i < MAX_INFLIGHT_FDS; i++)
         thread->inflight[i].server = thread->inflight[i].client = -1;
@@ -286,6 +287,7 @@ static void cleanup_thread( struct thread *thread )
 
     clear_apc_queue( &thread->system_apc );
     clear_apc_queue( &thread->user_apc );
+    release_claimed_asyncs( thread );
     free( thread->req_data );
     free( thread->reply_data );
     if (thread->request_fd) release_object( thread->request_fd );
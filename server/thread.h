@@ -61,6 +61,7 @@ struct thread
     struct thread_wait    *wait;          /* current wait condition if sleeping */
     struct list            system_apc;    /* queue of system async procedure calls */
     struct list            user_apc;      /* queue of user async procedure calls */
+    struct list            claimed_asyncs; /* asyncs claimed to be performed in a batch */
     struct inflight_fd     inflight[MAX_INFLIGHT_FDS];  /* fds currently in flight */
     unsigned int           error;         /* current error code */
     union generic_request  req;           /* current request */
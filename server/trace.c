@@ -1203,6 +1203,26 @@ static void dump_varargs_handle_infos( const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_async_results( const char *prefix, data_size_t size )
+{
+    const async_result_t *result;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*result))
+    {
+        result = cur_data;
+        dump_uint64( "{iosb=", &result->iosb );
+        dump_uint64( ",arg=", &result->arg );
+        dump_uint64( ",apc=", &result->apc );
+        dump_uint64( ",total=", &result->total );
+        fprintf( stderr, ",status=%s}", get_status_name( result->status ) );
+        size -= sizeof(*result);
+        remove_data( sizeof(*result) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1792,6 +1812,27 @@ static void dump_get_shared_memory_request( const struct get_shared_memory_reque
     fprintf( stderr, " tid=%04x", req->tid );
 }
 
+static void dump_get_sync_memory_request( const struct get_sync_memory_request *req )
+{
+}
+
+static void dump_get_sync_memory_reply( const struct get_sync_memory_reply *req )
+{
+    fprintf( stderr, " close_slot=%08x", req->close_slot );
+}
+
+static void dump_get_sync_slot_request( const struct get_sync_slot_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_get_sync_slot_reply( const struct get_sync_slot_reply *req )
+{
+    fprintf( stderr, " slot=%08x", req->slot );
+    fprintf( stderr, ", type=%08x", req->type );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
 static void dump_flush_request( const struct flush_request *req )
 {
     fprintf( stderr, " blocking=%d", req->blocking );
@@ -2891,6 +2932,30 @@ static void dump_cancel_async_request( const struct cancel_async_request *req )
     fprintf( stderr, ", only_thread=%d", req->only_thread );
 }
 
+static void dump_complete_async_request( const struct complete_async_request *req )
+{
+    dump_uint64( " iosb=", &req->iosb );
+    dump_uint64( ", arg=", &req->arg );
+    fprintf( stderr, ", status=%08x", req->status );
+    dump_uint64( ", total=", &req->total );
+}
+
+static void dump_claim_async_batch_request( const struct claim_async_batch_request *req )
+{
+    dump_uint64( " iosb=", &req->iosb );
+    dump_uint64( ", arg=", &req->arg );
+}
+
+static void dump_claim_async_batch_reply( const struct claim_async_batch_reply *req )
+{
+    dump_varargs_async_results( " asyncs=", cur_size );
+}
+
+static void dump_set_async_results_request( const struct set_async_results_request *req )
+{
+    dump_varargs_async_results( " results=", cur_size );
+}
+
 static void dump_get_async_result_request( const struct get_async_result_request *req )
 {
     dump_uint64( " user_arg=", &req->user_arg );
@@ -4542,6 +4607,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_fd_request,
     (dump_func)dump_get_directory_cache_entry_request,
     (dump_func)dump_get_shared_memory_request,
+    (dump_func)dump_get_sync_memory_request,
+    (dump_func)dump_get_sync_slot_request,
     (dump_func)dump_flush_request,
     (dump_func)dump_lock_file_request,
     (dump_func)dump_unlock_file_request,
@@ -4641,6 +4708,9 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_set_serial_info_request,
     (dump_func)dump_register_async_request,
     (dump_func)dump_cancel_async_request,
+    (dump_func)dump_complete_async_request,
+    (dump_func)dump_claim_async_batch_request,
+    (dump_func)dump_set_async_results_request,
     (dump_func)dump_get_async_result_request,
     (dump_func)dump_read_request,
     (dump_func)dump_write_request,
@@ -4833,6 +4903,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_fd_reply,
     (dump_func)dump_get_directory_cache_entry_reply,
     NULL,
+    (dump_func)dump_get_sync_memory_reply,
+    (dump_func)dump_get_sync_slot_reply,
     (dump_func)dump_flush_reply,
     (dump_func)dump_lock_file_reply,
     NULL,
@@ -4932,6 +5004,9 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     NULL,
+    NULL,
+    (dump_func)dump_claim_async_batch_reply,
+    NULL,
     (dump_func)dump_get_async_result_reply,
     (dump_func)dump_read_reply,
     (dump_func)dump_write_reply,
@@ -5124,6 +5199,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_handle_fd",
     "get_directory_cache_entry",
     "get_shared_memory",
+    "get_sync_memory",
+    "get_sync_slot",
     "flush",
     "lock_file",
     "unlock_file",
@@ -5223,6 +5300,9 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "set_serial_info",
     "register_async",
     "cancel_async",
+    "complete_async",
+    "claim_async_batch",
+    "set_async_results",
     "get_async_result",
     "read",
     "write",